@@ -271,9 +271,12 @@ HEADERS += src/typedefs.h \
            src/dxfdata.h \
            src/dxfdim.h \
            src/export.h \
+           src/BufferedWriter.h \
            src/expression.h \
+           src/bytecode.h \
            src/stackcheck.h \
            src/function.h \
+           src/FunctionCache.h \
            src/exceptions.h \
            src/grid.h \
            src/highlighter.h \
@@ -288,18 +291,23 @@ HEADERS += src/typedefs.h \
            src/projectionnode.h \
            src/cgaladvnode.h \
            src/importnode.h \
+           src/import-stl.h \
            src/transformnode.h \
            src/colornode.h \
            src/rendernode.h \
            src/textnode.h \
            src/openscad.h \
+           src/RenderServer.h \
            src/handle_dep.h \
            src/Geometry.h \
            src/Polygon2d.h \
            src/clipper-utils.h \
            src/GeometryUtils.h \
            src/polyset-utils.h \
+           src/quickhull.h \
+           src/mesh-boolean.h \
            src/polyset.h \
+           src/VBOCache.h \
            src/printutils.h \
            src/fileutils.h \
            src/value.h \
@@ -308,13 +316,16 @@ HEADERS += src/typedefs.h \
            src/visitor.h \
            src/state.h \
            src/traverser.h \
+           src/TaskScheduler.h \
            src/nodecache.h \
            src/nodedumper.h \
            src/ModuleCache.h \
            src/GeometryCache.h \
+           src/TransformedGeometry.h \
            src/GeometryEvaluator.h \
            src/CSGTermEvaluator.h \
            src/Tree.h \
+           src/hash-utils.h \
 src/DrawingCallback.h \
 src/FreetypeRenderer.h \
 src/FontCache.h \
@@ -351,8 +362,10 @@ SOURCES += src/version_check.cc \
            src/handle_dep.cc \
            src/value.cc \
            src/expr.cc \
+           src/bytecode.cc \
            src/stackcheck.cc \
            src/func.cc \
+           src/FunctionCache.cc \
            src/localscope.cc \
            src/module.cc \
            src/feature.cc \
@@ -366,8 +379,11 @@ SOURCES += src/version_check.cc \
            src/Polygon2d.cc \
            src/clipper-utils.cc \
            src/polyset-utils.cc \
+           src/quickhull.cc \
+           src/mesh-boolean.cc \
            src/GeometryUtils.cc \
            src/polyset.cc \
+           src/VBOCache.cc \
            src/csgops.cc \
            src/transform.cc \
            src/color.cc \
@@ -394,10 +410,13 @@ SOURCES += src/version_check.cc \
            \
            src/nodedumper.cc \
            src/traverser.cc \
+           src/TaskScheduler.cc \
            src/GeometryEvaluator.cc \
            src/ModuleCache.cc \
            src/GeometryCache.cc \
+           src/TransformedGeometry.cc \
            src/Tree.cc \
+           src/hash-utils.cc \
 	   src/DrawingCallback.cc \
 	   src/FreetypeRenderer.cc \
 	   src/FontCache.cc \
@@ -416,8 +435,10 @@ SOURCES += src/version_check.cc \
            src/builtin.cc \
            src/calc.cc \
            src/export.cc \
+           src/BufferedWriter.cc \
            src/export_png.cc \
            src/import.cc \
+           src/import-stl.cc \
            src/renderer.cc \
            src/colormap.cc \
            src/ThrownTogetherRenderer.cc \
@@ -430,6 +451,7 @@ SOURCES += src/version_check.cc \
            src/lodepng.cpp \
            \
            src/openscad.cc \
+           src/RenderServer.cc \
            src/mainwin.cc \
            src/UIUtils.cc \
            src/Dock.cc \
@@ -485,6 +507,7 @@ HEADERS += src/cgal.h \
            src/cgalutils.h \
            src/Reindexer.h \
            src/CGALCache.h \
+           src/DiskCache.h \
            src/CGALRenderer.h \
            src/CGAL_Nef_polyhedron.h \
            src/CGAL_Nef3_workaround.h \
@@ -496,6 +519,7 @@ SOURCES += src/cgalutils.cc \
            src/cgalutils-tess.cc \
            src/cgalutils-polyhedron.cc \
            src/CGALCache.cc \
+           src/DiskCache.cc \
            src/CGALRenderer.cc \
            src/CGAL_Nef_polyhedron.cc \
            src/CGAL_Nef_polyhedron_DxfData.cc \
@@ -0,0 +1,134 @@
+#!/usr/bin/env python
+#
+# Client for openscad --server. Accepts the command line of openscad for
+# exporting, so it can replace the openscad binary in build scripts:
+#
+#   openscad-client.py [ --socket=path ] -o output_file [ -D var=val [..] ]
+#                      [ --render[=cgal] | --preview[=throwntogether] ] filename
+#
+# Use - as filename to read the source from stdin. Relative paths in it
+# are resolved against the current directory.
+#
+#   openscad-client.py [ --socket=path ] --shutdown
+#
+# stops the server. The socket defaults to $OPENSCAD_SOCKET,
+# $XDG_RUNTIME_DIR/openscad.sock or /tmp/openscad-<uid>/server.sock, like for
+# openscad --server.
+#
+# Returns the exit code of the job, or 2 on invalid cmd-line options or
+# if the server can't be reached.
+#
+
+from __future__ import print_function
+
+import sys
+import os
+import socket
+import getopt
+
+def default_socket_path():
+    path = os.getenv("OPENSCAD_SOCKET")
+    if path: return path
+    runtimedir = os.getenv("XDG_RUNTIME_DIR")
+    if runtimedir: return os.path.join(runtimedir, "openscad.sock")
+    return "/tmp/openscad-%d/server.sock" % os.getuid()
+
+def usage():
+    print("Usage: " + sys.argv[0] + " [ --socket=path ] -o output_file [ -D var=val [..] ]", file=sys.stderr)
+    print("       [ --render[=cgal] | --preview[=throwntogether] ] filename", file=sys.stderr)
+    print("       " + sys.argv[0] + " [ --socket=path ] --shutdown", file=sys.stderr)
+
+class Response:
+    """Reads the response of the server, see RenderServer.h"""
+    def __init__(self, sock):
+        self.sock = sock
+        self.buffer = b""
+
+    def fill(self):
+        data = self.sock.recv(65536)
+        if not data: raise IOError("Connection closed by server")
+        self.buffer += data
+
+    def readline(self):
+        while b"\n" not in self.buffer: self.fill()
+        line, self.buffer = self.buffer.split(b"\n", 1)
+        return line.decode("utf-8", "replace")
+
+    def read(self, n):
+        while len(self.buffer) < n: self.fill()
+        data, self.buffer = self.buffer[:n], self.buffer[n:]
+        return data
+
+def request(socketpath, data, output_file):
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    try:
+        sock.connect(socketpath)
+    except socket.error as e:
+        print("Can't connect to openscad server at %s: %s" % (socketpath, e), file=sys.stderr)
+        return 2
+    try:
+        sock.sendall(data)
+        response = Response(sock)
+        while True:
+            line = response.readline()
+            if line.startswith("log "):
+                print(line[4:], file=sys.stderr)
+            elif line.startswith("result "):
+                rc, size = [int(x) for x in line.split()[1:3]]
+                output = response.read(size)
+                if output_file and (rc == 0 or size > 0):
+                    with open(output_file, "wb") as f:
+                        f.write(output)
+                return rc
+    except IOError as e:
+        print("Error: %s" % e, file=sys.stderr)
+        return 2
+    finally:
+        sock.close()
+
+if __name__ == '__main__':
+    # --render and --preview take optional values, which getopt can't express
+    argv = [a + "=" if a in ("--render", "--preview") else a for a in sys.argv[1:]]
+    try:
+        opts, args = getopt.getopt(argv, "o:D:", ["socket=", "render=", "preview=", "shutdown"])
+    except getopt.GetoptError as err:
+        usage()
+        sys.exit(2)
+
+    socketpath = default_socket_path()
+    output_file = None
+    defines = []
+    mode = "opencsg"
+    shutdown = False
+    for o, a in opts:
+        if o == "--socket": socketpath = a
+        elif o == "-o": output_file = a
+        elif o == "-D": defines.append(a)
+        elif o == "--render": mode = "cgal" if a == "cgal" else "geometry"
+        elif o == "--preview": mode = "throwntogether" if a == "throwntogether" else "opencsg"
+        elif o == "--shutdown": shutdown = True
+
+    if shutdown:
+        sys.exit(request(socketpath, b"shutdown\n", None))
+
+    if not output_file or len(args) != 1:
+        usage()
+        sys.exit(2)
+
+    lines = []
+    source = None
+    if args[0] == "-":
+        lines.append("file " + os.path.join(os.getcwd(), "stdin.scad"))
+        source = sys.stdin.read()
+        if not isinstance(source, bytes): source = source.encode("utf-8")
+    else:
+        lines.append("file " + os.path.abspath(args[0]))
+    for d in defines: lines.append("D " + d)
+    lines.append("format " + os.path.splitext(output_file)[1][1:].lower())
+    lines.append("mode " + mode)
+
+    data = b""
+    if source is not None:
+        data += ("source %d\n" % len(source)).encode("utf-8") + source
+    data += ("\n".join(lines) + "\nend\n").encode("utf-8")
+    sys.exit(request(socketpath, data, output_file))
@@ -0,0 +1,74 @@
+#include "BufferedWriter.h"
+
+#include <cstdio>
+#include <clocale>
+
+size_t BufferedWriter::formatDouble(double d, char *buf)
+{
+	int len = snprintf(buf, MAX_DOUBLE_LENGTH, "%g", d);
+	if (len < 0) len = 0;
+	if (len >= MAX_DOUBLE_LENGTH) len = MAX_DOUBLE_LENGTH - 1;
+
+	// %g output only consists of sign, digits, exponent and the radix, so
+	// the locale's radix can safely be replaced. This avoids having to
+	// change the global locale, which isn't thread safe.
+	const char *point = localeconv()->decimal_point;
+	if (point && point[0] != '.' && point[0] != '\0') {
+		size_t pointlen = strlen(point);
+		char *p = strstr(buf, point);
+		if (p) {
+			*p = '.';
+			if (pointlen > 1) {
+				memmove(p + 1, p + pointlen, len - (p - buf) - pointlen + 1);
+				len -= pointlen - 1;
+			}
+		}
+	}
+	return len;
+}
+
+void BufferedWriter::write(double d)
+{
+	if (this->pos + MAX_DOUBLE_LENGTH > BUFFER_SIZE) flush();
+	this->pos += formatDouble(d, this->buffer + this->pos);
+}
+
+void BufferedWriter::write(unsigned long n)
+{
+	char buf[24];
+	char *p = buf + sizeof(buf);
+	do {
+		*--p = '0' + n % 10;
+		n /= 10;
+	} while (n > 0);
+	write(p, buf + sizeof(buf) - p);
+}
+
+void BufferedWriter::writeLittleEndian(boost::uint16_t n)
+{
+	char bytes[2] = { char(n & 0xff), char((n >> 8) & 0xff) };
+	write(bytes, 2);
+}
+
+void BufferedWriter::writeLittleEndian(boost::uint32_t n)
+{
+	char bytes[4] = { char(n & 0xff), char((n >> 8) & 0xff),
+										char((n >> 16) & 0xff), char((n >> 24) & 0xff) };
+	write(bytes, 4);
+}
+
+// Assumes float is an IEEE 754 binary32, as does the STL importer.
+void BufferedWriter::writeLittleEndian(float f)
+{
+	boost::uint32_t n;
+	memcpy(&n, &f, sizeof(n));
+	writeLittleEndian(n);
+}
+
+void BufferedWriter::flush()
+{
+	if (this->pos > 0) {
+		this->stream.write(this->buffer, this->pos);
+		this->pos = 0;
+	}
+}
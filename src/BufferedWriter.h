@@ -0,0 +1,64 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <boost/cstdint.hpp>
+
+/*!
+	Writes to an ostream through a fixed-size buffer.
+
+	Used by the exporters to stream large meshes without going through
+	per-value ostream formatting or intermediate stringstreams. Doubles are
+	formatted like ostream's default (%g, precision 6) but always with '.'
+	as radix, independently of the current locale.
+
+	The buffer is only written to the stream when it fills up or on
+	flush(), so flush() must be called when done. Stream errors are reported
+	the same way as by the stream itself.
+*/
+class BufferedWriter
+{
+public:
+	BufferedWriter(std::ostream &stream) : stream(stream), pos(0) {}
+
+	void write(const char *data, size_t len) {
+		if (this->pos + len > BUFFER_SIZE) {
+			flush();
+			if (len > BUFFER_SIZE) {
+				this->stream.write(data, len);
+				return;
+			}
+		}
+		memcpy(this->buffer + this->pos, data, len);
+		this->pos += len;
+	}
+	void write(const char *str) { write(str, strlen(str)); }
+	void write(const std::string &str) { write(str.data(), str.size()); }
+	void write(char c) {
+		if (this->pos == BUFFER_SIZE) flush();
+		this->buffer[this->pos++] = c;
+	}
+	void write(double d);
+	void write(unsigned long n);
+
+	void writeLittleEndian(boost::uint16_t n);
+	void writeLittleEndian(boost::uint32_t n);
+	void writeLittleEndian(float f);
+
+	void flush();
+
+	/*!
+		Formats a double into buf, which must hold at least MAX_DOUBLE_LENGTH
+		bytes. Returns the number of characters written (without terminator).
+	*/
+	static size_t formatDouble(double d, char *buf);
+	enum { MAX_DOUBLE_LENGTH = 32 };
+
+private:
+	enum { BUFFER_SIZE = 65536 };
+
+	std::ostream &stream;
+	size_t pos;
+	char buffer[BUFFER_SIZE];
+};
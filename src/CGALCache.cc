@@ -4,48 +4,99 @@
 
 CGALCache *CGALCache::inst = NULL;
 
-CGALCache::CGALCache(size_t limit) : cache(limit)
+CGALCache::CGALCache(boost::uint64_t limit) : cache(limit)
 {
 }
 
+bool CGALCache::contains(const std::string &id) const
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	return this->cache.contains(id);
+}
+
 shared_ptr<const CGAL_Nef_polyhedron> CGALCache::get(const std::string &id) const
 {
-	const shared_ptr<const CGAL_Nef_polyhedron> &N = this->cache[id]->N;
+	shared_ptr<const CGAL_Nef_polyhedron> N;
+	lookup(id, N);
+	return N;
+}
+
+/*!
+	Looks up and fetches the polyhedron in one step. Returns false if it's
+	not cached.
+*/
+bool CGALCache::lookup(const std::string &id, shared_ptr<const CGAL_Nef_polyhedron> &N) const
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	const cache_entry *entry = this->cache.find(id);
+	if (!entry) return false;
+	N = entry->N;
 #ifdef DEBUG
 	PRINTB("CGAL Cache hit: %s (%d bytes)", id.substr(0, 40) % (N ? N->memsize() : 0));
 #endif
-	return N;
+	return true;
 }
 
 bool CGALCache::insert(const std::string &id, const shared_ptr<const CGAL_Nef_polyhedron> &N)
 {
-	bool inserted = this->cache.insert(id, new cache_entry(N), N ? N->memsize() : 0);
+	// Computed outside the lock, memsize() traverses the polyhedron
+	size_t size = N ? N->memsize() : 0;
+	boost::mutex::scoped_lock lock(this->mutex);
+	bool inserted = this->cache.insert(id, new cache_entry(N), size);
 #ifdef DEBUG
-	if (inserted) PRINTB("CGAL Cache insert: %s (%d bytes)", id.substr(0, 40) % (N ? N->memsize() : 0));
-	else PRINTB("CGAL Cache insert failed: %s (%d bytes)", id.substr(0, 40) % (N ? N->memsize() : 0));
+	if (inserted) PRINTB("CGAL Cache insert: %s (%d bytes)", id.substr(0, 40) % size);
+	else PRINTB("CGAL Cache insert failed: %s (%d bytes)", id.substr(0, 40) % size);
 #endif
 	return inserted;
 }
 
-size_t CGALCache::maxSize() const
+boost::uint64_t CGALCache::maxSize() const
 {
+	boost::mutex::scoped_lock lock(this->mutex);
 	return this->cache.maxCost();
 }
 
-void CGALCache::setMaxSize(size_t limit)
+void CGALCache::setMaxSize(boost::uint64_t limit)
 {
+	boost::mutex::scoped_lock lock(this->mutex);
 	this->cache.setMaxCost(limit);
 }
 
 void CGALCache::clear()
 {
+	boost::mutex::scoped_lock lock(this->mutex);
 	cache.clear();
 }
 
 void CGALCache::print()
 {
+	boost::mutex::scoped_lock lock(this->mutex);
 	PRINTB("CGAL Polyhedrons in cache: %d", this->cache.size());
 	PRINTB("CGAL cache size in bytes: %d", this->cache.totalCost());
+	CacheStatistics stats = this->cache.statistics();
+	PRINTB("CGAL cache hits: %d, misses: %d, evictions: %d", stats.hits % stats.misses % stats.evictions);
+}
+
+/*!
+	Hits and misses are counted by the caller, since one logical lookup may
+	query both the geometry and the CGAL cache.
+*/
+void CGALCache::recordHit() const
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	this->cache.recordHit();
+}
+
+void CGALCache::recordMiss() const
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	this->cache.recordMiss();
+}
+
+CacheStatistics CGALCache::statistics() const
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	return this->cache.statistics();
 }
 
 CGALCache::cache_entry::cache_entry(const shared_ptr<const CGAL_Nef_polyhedron> &N)
@@ -3,22 +3,28 @@
 #include "cache.h"
 #include "memory.h"
 
+#include <boost/thread/mutex.hpp>
+
 /*!
 */
 class CGALCache
 {
 public:	
-	CGALCache(size_t limit = 100*1024*1024);
+	CGALCache(boost::uint64_t limit = 100*1024*1024);
 
 	static CGALCache *instance() { if (!inst) inst = new CGALCache; return inst; }
 
-	bool contains(const std::string &id) const { return this->cache.contains(id); }
+	bool contains(const std::string &id) const;
 	shared_ptr<const class CGAL_Nef_polyhedron> get(const std::string &id) const;
+	bool lookup(const std::string &id, shared_ptr<const CGAL_Nef_polyhedron> &N) const;
 	bool insert(const std::string &id, const shared_ptr<const CGAL_Nef_polyhedron> &N);
-	size_t maxSize() const;
-	void setMaxSize(size_t limit);
+	boost::uint64_t maxSize() const;
+	void setMaxSize(boost::uint64_t limit);
 	void clear();
 	void print();
+	CacheStatistics statistics() const;
+	void recordHit() const;
+	void recordMiss() const;
 
 private:
 	static CGALCache *inst;
@@ -31,4 +37,6 @@ private:
 	};
 
 	Cache<std::string, cache_entry> cache;
+	// All access is serialized to allow parallel geometry evaluation
+	mutable boost::mutex mutex;
 };
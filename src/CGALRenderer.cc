@@ -105,10 +105,11 @@ void CGALRenderer::draw(bool showfaces, bool showedges) const
 // FIXME:		const QColor &col = Preferences::inst()->color(Preferences::CGAL_FACE_2D_COLOR);
 			glColor3f(0.0f, 0.75f, 0.60f);
 
-			for (size_t i=0; i < this->polyset->polygons.size(); i++) {
+			for (size_t i=0; i < this->polyset->numPolygons(); i++) {
+				const PolySet::Face face = this->polyset->getFace(i);
 				glBegin(GL_POLYGON);
-				for (size_t j=0; j < this->polyset->polygons[i].size(); j++) {
-					const Vector3d &p = this->polyset->polygons[i][j];
+				for (size_t j=0; j < face.size(); j++) {
+					const Vector3d &p = face[j];
 					glVertex3d(p[0], p[1], -0.1);
 				}
 				glEnd();
@@ -4,6 +4,8 @@
 #include "printutils.h"
 #include "polyset.h"
 
+#include <boost/unordered_set.hpp>
+
 CGAL_Nef_polyhedron::CGAL_Nef_polyhedron(CGAL_Nef_polyhedron3 *p)
 {
 	if (p) p3.reset(p);
@@ -39,12 +41,77 @@ CGAL_Nef_polyhedron &CGAL_Nef_polyhedron::minkowski(const CGAL_Nef_polyhedron &o
 	return *this;
 }
 
+namespace {
+	/*!
+		Estimates heap memory used by the exact numbers of one kind of element
+		from the first SAMPLES elements. CGAL::Gmpq is reference counted, so
+		shared numbers are only counted once within the sample.
+	*/
+	class GmpqMemsize
+	{
+	public:
+		static const size_t SAMPLES = 64;
+
+		GmpqMemsize() : total(0), samples(0) {}
+		bool full() const { return this->samples == SAMPLES; }
+		template <class T> void sample(const T &x) { add(x); this->samples++; }
+		// Extrapolated to count elements
+		size_t estimate(size_t count) const {
+			return this->samples ? size_t(double(this->total) * count / this->samples) : 0;
+		}
+	private:
+		void add(const NT3 &q) {
+			mpq_srcptr ptr = q.mpq();
+			if (!this->seen.insert(ptr).second) return;
+			this->total += sizeof(__mpq_struct) + sizeof(unsigned int) +
+				(mpz_size(mpq_numref(ptr)) + mpz_size(mpq_denref(ptr))) * sizeof(mp_limb_t);
+		}
+		void add(const CGAL_Point_3 &p) { add(p.x()); add(p.y()); add(p.z()); }
+		void add(const CGAL_Nef_polyhedron3::Plane_3 &p) { add(p.a()); add(p.b()); add(p.c()); add(p.d()); }
+
+		size_t total, samples;
+		boost::unordered_set<mpq_srcptr> seen;
+	};
+}
+
+/*!
+	bytes() only accounts for the combinatorial structure, so we add the
+	memory held by the coordinates, which usually dominates. This is called
+	for every cache insertion, so the coordinates are only sampled instead of
+	traversing the whole polyhedron.
+*/
 size_t CGAL_Nef_polyhedron::memsize() const
 {
 	if (this->isEmpty()) return 0;
 
 	size_t memsize = sizeof(CGAL_Nef_polyhedron);
 	memsize += this->p3->bytes();
+
+	GmpqMemsize vertices, halfedges, halffacets, shalfedges;
+	CGAL_Nef_polyhedron3::Vertex_const_iterator vi;
+	CGAL_forall_vertices(vi, *this->p3) {
+		if (vertices.full()) break;
+		vertices.sample(vi->point());
+	}
+	CGAL_Nef_polyhedron3::Halfedge_const_iterator ei;
+	CGAL_forall_halfedges(ei, *this->p3) {
+		if (halfedges.full()) break;
+		halfedges.sample(ei->point());
+	}
+	CGAL_Nef_polyhedron3::Halffacet_const_iterator fi;
+	CGAL_forall_halffacets(fi, *this->p3) {
+		if (halffacets.full()) break;
+		halffacets.sample(fi->plane());
+	}
+	CGAL_Nef_polyhedron3::SHalfedge_const_iterator si;
+	CGAL_forall_shalfedges(si, *this->p3) {
+		if (shalfedges.full()) break;
+		shalfedges.sample(si->circle());
+	}
+	memsize += vertices.estimate(this->p3->number_of_vertices());
+	memsize += halfedges.estimate(this->p3->number_of_halfedges());
+	memsize += halffacets.estimate(this->p3->number_of_halffacets());
+	memsize += shalfedges.estimate(this->p3->number_of_shalfedges());
 	return memsize;
 }
 
@@ -53,6 +120,18 @@ bool CGAL_Nef_polyhedron::isEmpty() const
 	return !this->p3 || this->p3->is_empty();
 }
 
+/*!
+	Rounded to double precision, which is enough for culling and bounding
+	box tests. Exact bounds are available from CGALUtils::boundingBox().
+*/
+BoundingBox CGAL_Nef_polyhedron::getBoundingBox() const
+{
+	if (this->isEmpty()) return BoundingBox();
+	CGAL_Iso_cuboid_3 box = CGALUtils::boundingBox(*this->p3);
+	return BoundingBox(Vector3d(CGAL::to_double(box.xmin()), CGAL::to_double(box.ymin()), CGAL::to_double(box.zmin())),
+										 Vector3d(CGAL::to_double(box.xmax()), CGAL::to_double(box.ymax()), CGAL::to_double(box.zmax())));
+}
+
 /*!
 	Creates a new PolySet and initializes it with the data from this polyhedron
 
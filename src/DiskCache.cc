@@ -0,0 +1,399 @@
+#include "DiskCache.h"
+#include "printutils.h"
+#include "boosty.h"
+#include "polyset.h"
+#include "Polygon2d.h"
+#include "CGAL_Nef_polyhedron.h"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <CGAL/IO/Nef_polyhedron_iostream_3.h>
+
+// Bump this whenever the file format or the geometry semantics change
+#define DISKCACHE_FORMAT "OpenSCAD geometry cache 3"
+
+DiskCache *DiskCache::inst = NULL;
+
+std::string DiskCache::filename(const std::string &id) const
+{
+	return boosty::stringy(fs::path(this->path) / (id + ".geom"));
+}
+
+/*!
+	Enables the cache using the given directory, which is created if
+	necessary. Existing cache files are indexed for size accounting.
+*/
+bool DiskCache::setPath(const std::string &path)
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	this->enabled = false;
+	this->files.clear();
+	this->totalsize = 0;
+	try {
+		fs::path dir(path);
+		if (!fs::exists(dir)) fs::create_directories(dir);
+		if (!fs::is_directory(dir)) {
+			PRINTB("WARNING: Geometry cache directory %s is not a directory", path);
+			return false;
+		}
+		for (fs::directory_iterator it(dir); it != fs::directory_iterator(); ++it) {
+			const fs::path &p = it->path();
+			if (!fs::is_regular_file(p) || p.extension() != ".geom") continue;
+			file_entry &entry = this->files[boosty::stringy(p.stem())];
+			entry.size = fs::file_size(p);
+			entry.lastused = fs::last_write_time(p);
+			this->totalsize += entry.size;
+		}
+	}
+	catch (const fs::filesystem_error &e) {
+		PRINTB("WARNING: Unable to use geometry cache directory %s: %s", path % e.what());
+		return false;
+	}
+	this->path = path;
+	this->enabled = true;
+	evict();
+	return true;
+}
+
+boost::uint64_t DiskCache::maxSize() const
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	return this->maxsize;
+}
+
+void DiskCache::setMaxSize(boost::uint64_t limit)
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	this->maxsize = limit;
+	if (this->enabled) evict();
+}
+
+/*!
+	Marks the file as recently used, both in our index and on disk, so
+	other processes sharing the directory see the same LRU order.
+	Must be called with the mutex held.
+*/
+void DiskCache::touch(const std::string &id)
+{
+	std::time_t now = std::time(NULL);
+	this->files[id].lastused = now;
+	boost::system::error_code ec;
+	fs::last_write_time(filename(id), now, ec);
+}
+
+/*!
+	Deletes the file and drops it from our index.
+	Must be called with the mutex held.
+*/
+void DiskCache::remove(const std::string &id)
+{
+	boost::system::error_code ec;
+	fs::remove(filename(id), ec);
+	std::map<std::string, file_entry>::iterator it = this->files.find(id);
+	if (it != this->files.end()) {
+		this->totalsize -= it->second.size;
+		this->files.erase(it);
+	}
+}
+
+static bool lru_compare(const std::pair<std::time_t, std::string> &a, const std::pair<std::time_t, std::string> &b)
+{
+	return a.first < b.first;
+}
+
+/*!
+	Removes least recently used files until the total size is within limits.
+	Must be called with the mutex held.
+*/
+void DiskCache::evict()
+{
+	if (this->totalsize <= this->maxsize) return;
+
+	std::vector<std::pair<std::time_t, std::string> > lru;
+	for (std::map<std::string, file_entry>::const_iterator it = this->files.begin(); it != this->files.end(); it++) {
+		lru.push_back(std::make_pair(it->second.lastused, it->first));
+	}
+	std::sort(lru.begin(), lru.end(), lru_compare);
+	for (size_t i=0;i<lru.size() && this->totalsize > this->maxsize;i++) {
+		boost::system::error_code ec;
+		fs::remove(filename(lru[i].second), ec);
+		this->totalsize -= this->files[lru[i].second].size;
+		this->files.erase(lru[i].second);
+		this->stats.evictions++;
+		PRINTDB("Geometry disk cache evict: %s", lru[i].second);
+	}
+}
+
+static bool write_geometry(std::ostream &out, const Geometry &geom)
+{
+	out << std::setprecision(17);
+	if (const PolySet *ps = dynamic_cast<const PolySet *>(&geom)) {
+		// 2D PolySets carry their originating Polygon2d, which we don't store
+		if (ps->getDimension() != 3) return false;
+		const std::vector<Vector3d> &vertices = ps->getVertices();
+		out << "polyset " << ps->getConvexity() << " " << vertices.size() << " " << ps->numPolygons() << "\n";
+		BOOST_FOREACH(const Vector3d &v, vertices) {
+			out << v[0] << " " << v[1] << " " << v[2] << "\n";
+		}
+		for (size_t i=0;i<ps->numPolygons();i++) {
+			const PolySet::Face p = ps->getFace(i);
+			out << p.size();
+			for (size_t j=0;j<p.size();j++) out << " " << p.index(j);
+			out << "\n";
+		}
+	}
+	else if (const Polygon2d *poly = dynamic_cast<const Polygon2d *>(&geom)) {
+		out << "polygon2d " << poly->getConvexity() << " " << poly->isSanitized() << " " << poly->outlines().size() << "\n";
+		BOOST_FOREACH(const Outline2d &o, poly->outlines()) {
+			out << o.positive << " " << o.vertices.size();
+			BOOST_FOREACH(const Vector2d &v, o.vertices) {
+				out << " " << v[0] << " " << v[1];
+			}
+			out << "\n";
+		}
+	}
+	else if (const CGAL_Nef_polyhedron *N = dynamic_cast<const CGAL_Nef_polyhedron *>(&geom)) {
+		out << "nef " << N->getConvexity() << " " << (N->p3 ? 1 : 0) << "\n";
+		if (N->p3) out << *N->p3;
+	}
+	else {
+		return false;
+	}
+	return out.good();
+}
+
+/*!
+	Counts read from the file must be backed by at least minbytes bytes each
+	in the rest of the file, so a corrupt count can't make us allocate
+	arbitrary amounts of memory.
+*/
+static bool check_count(std::istream &in, size_t count, size_t minbytes, boost::uint64_t filesize)
+{
+	std::streamoff pos = in.tellg();
+	if (in.fail() || pos < 0 || boost::uint64_t(pos) > filesize ||
+			count > (filesize - boost::uint64_t(pos)) / minbytes) {
+		in.setstate(std::ios::failbit);
+		return false;
+	}
+	return true;
+}
+
+static Geometry *read_geometry(std::istream &in, boost::uint64_t filesize)
+{
+	std::string type;
+	int convexity;
+	in >> type >> convexity;
+	if (type == "polyset") {
+		size_t numvertices, numpolygons;
+		in >> numvertices >> numpolygons;
+		// At least "x y z\n" per vertex and "n\n" per polygon
+		if (!check_count(in, numvertices, 6, filesize) ||
+				!check_count(in, numpolygons, 2, filesize)) return NULL;
+		std::vector<Vector3d> vertices(numvertices);
+		for (size_t i=0;in.good() && i<numvertices;i++) in >> vertices[i][0] >> vertices[i][1] >> vertices[i][2];
+		PolySet *ps = new PolySet(3);
+		ps->setConvexity(convexity);
+		for (size_t i=0;in.good() && i<numpolygons;i++) {
+			size_t size;
+			in >> size;
+			if (!check_count(in, size, 2, filesize)) break;
+			ps->append_poly();
+			for (size_t j=0;in.good() && j<size;j++) {
+				size_t idx;
+				in >> idx;
+				if (idx >= numvertices) in.setstate(std::ios::failbit);
+				else ps->append_vertex(vertices[idx]);
+			}
+		}
+		if (!in.fail()) return ps;
+		delete ps;
+	}
+	else if (type == "polygon2d") {
+		bool sanitized;
+		size_t numoutlines;
+		in >> sanitized >> numoutlines;
+		// At least "p n\n" per outline and " x y" per vertex
+		if (!check_count(in, numoutlines, 4, filesize)) return NULL;
+		Polygon2d *poly = new Polygon2d();
+		poly->setConvexity(convexity);
+		poly->setSanitized(sanitized);
+		for (size_t i=0;in.good() && i<numoutlines;i++) {
+			Outline2d o;
+			size_t numvertices;
+			in >> o.positive >> numvertices;
+			if (!check_count(in, numvertices, 4, filesize)) break;
+			o.vertices.resize(numvertices);
+			for (size_t j=0;in.good() && j<numvertices;j++) in >> o.vertices[j][0] >> o.vertices[j][1];
+			poly->addOutline(o);
+		}
+		if (!in.fail()) return poly;
+		delete poly;
+	}
+	else if (type == "nef") {
+		int hasp3;
+		in >> hasp3;
+		// Read into a shared_ptr first, the CGAL reader may throw
+		shared_ptr<CGAL_Nef_polyhedron3> p3;
+		if (hasp3) {
+			p3.reset(new CGAL_Nef_polyhedron3);
+			in >> *p3;
+		}
+		if (in.fail()) return NULL;
+		CGAL_Nef_polyhedron *N = new CGAL_Nef_polyhedron;
+		N->setConvexity(convexity);
+		N->p3 = p3;
+		return N;
+	}
+	return NULL;
+}
+
+/*!
+	Reads the cache file, returning NULL if it doesn't exist or can't be used.
+	Sets corrupt if the file has the current format but couldn't be parsed.
+*/
+Geometry *DiskCache::load(const std::string &id, bool &corrupt) const
+{
+	corrupt = false;
+	// Don't rely on our index only, other processes may have added the file
+	std::ifstream in(filename(id).c_str(), std::ios::in | std::ios::binary);
+	if (!in.is_open()) return NULL;
+	std::string format;
+	std::getline(in, format);
+	if (!in.good() || format != DISKCACHE_FORMAT) return NULL;
+
+	boost::system::error_code ec;
+	boost::uint64_t filesize = fs::file_size(filename(id), ec);
+	if (ec) return NULL;
+
+	Geometry *g = NULL;
+	try {
+		g = read_geometry(in, filesize);
+	}
+	catch (const std::exception &e) {
+		// CGAL::Failure_exception from the Nef reader, or bad_alloc
+		g = NULL;
+	}
+	if (!g) {
+		PRINTB("WARNING: Corrupt geometry cache file %s, removing it", filename(id));
+		corrupt = true;
+	}
+	return g;
+}
+
+/*!
+	Loads the geometry for the given id string from disk.
+	Returns false on a cache miss or if the file couldn't be read.
+*/
+bool DiskCache::lookup(const std::string &id, shared_ptr<const Geometry> &geom)
+{
+	{
+		boost::mutex::scoped_lock lock(this->mutex);
+		if (!this->enabled) return false;
+	}
+
+	bool corrupt;
+	Geometry *g = load(id, corrupt);
+	boost::mutex::scoped_lock lock(this->mutex);
+	if (!g) {
+		this->stats.misses++;
+		if (corrupt) remove(id);
+		return false;
+	}
+	geom.reset(g);
+	this->stats.hits++;
+
+	file_entry &entry = this->files[id];
+	if (entry.size == 0) {
+		boost::system::error_code ec;
+		entry.size = fs::file_size(filename(id), ec);
+		if (ec) entry.size = 0;
+		this->totalsize += entry.size;
+	}
+	touch(id);
+	PRINTDB("Geometry disk cache hit: %s", id);
+	return true;
+}
+
+/*!
+	Stores the geometry for the given id string on disk.
+	Returns false if the geometry type cannot be stored or writing failed.
+*/
+bool DiskCache::insert(const std::string &id, const shared_ptr<const Geometry> &geom)
+{
+	if (!geom) return false;
+	std::string tmpname;
+	{
+		boost::mutex::scoped_lock lock(this->mutex);
+		if (!this->enabled) return false;
+		if (this->files.find(id) != this->files.end()) return true;
+		if (fs::exists(filename(id))) return true;
+		// Unique per process and per call, as several threads or processes may
+		// write the same entry concurrently
+		static unsigned long counter = 0;
+		tmpname = filename(id) + "." + boost::lexical_cast<std::string>(counter++) + "." +
+			boost::lexical_cast<std::string>(std::time(NULL)) + ".tmp";
+	}
+
+	bool ok;
+	{
+		std::ofstream out(tmpname.c_str(), std::ios::out | std::ios::binary);
+		out << DISKCACHE_FORMAT << "\n";
+		ok = out.good() && write_geometry(out, *geom);
+	}
+	boost::system::error_code ec;
+	if (ok) fs::rename(tmpname, filename(id), ec);
+	if (!ok || ec) {
+		fs::remove(tmpname, ec);
+		return false;
+	}
+
+	boost::mutex::scoped_lock lock(this->mutex);
+	file_entry &entry = this->files[id];
+	this->totalsize -= entry.size;
+	entry.size = fs::file_size(filename(id), ec);
+	if (ec) entry.size = 0;
+	entry.lastused = std::time(NULL);
+	this->totalsize += entry.size;
+	this->stats.insertions++;
+	PRINTDB("Geometry disk cache insert: %s (%d bytes)", id % entry.size);
+	evict();
+	return true;
+}
+
+/*!
+	Removes all cache files.
+*/
+void DiskCache::clear()
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	for (std::map<std::string, file_entry>::const_iterator it = this->files.begin(); it != this->files.end(); it++) {
+		boost::system::error_code ec;
+		fs::remove(filename(it->first), ec);
+	}
+	this->files.clear();
+	this->totalsize = 0;
+}
+
+void DiskCache::print()
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	PRINTB("Geometries in disk cache: %d", this->files.size());
+	PRINTB("Geometry disk cache size in bytes: %d", this->totalsize);
+	PRINTB("Geometry disk cache hits: %d, misses: %d, evictions: %d",
+				 this->stats.hits % this->stats.misses % this->stats.evictions);
+}
+
+CacheStatistics DiskCache::statistics() const
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	CacheStatistics stats = this->stats;
+	stats.entries = this->files.size();
+	stats.size = this->totalsize;
+	stats.maxsize = this->maxsize;
+	return stats;
+}
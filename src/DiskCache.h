@@ -0,0 +1,67 @@
+#pragma once
+
+#include "memory.h"
+#include "Geometry.h"
+#include "cache.h"
+
+#include <map>
+#include <string>
+#include <ctime>
+#include <boost/thread/mutex.hpp>
+
+/*!
+	Persistent geometry cache.
+
+	Stores evaluated geometry (PolySet, Polygon2d and Nef polyhedra) in a
+	directory, one file per node. Ids are the 128-bit structural hashes from
+	Tree::getIdString() and are used directly as file names. A collision of
+	two different subtrees would return the wrong geometry, but at 128 bits
+	this is not a practical concern.
+
+	The total size of the directory is kept below maxSize() by evicting the
+	least recently used files. Several processes may share one directory;
+	files are written to a temporary name and renamed into place.
+
+	The cache is disabled until setPath() has been called.
+*/
+class DiskCache
+{
+public:
+	DiskCache() : enabled(false), maxsize(1024*1024*1024), totalsize(0) {}
+
+	static DiskCache *instance() { if (!inst) inst = new DiskCache; return inst; }
+
+	bool setPath(const std::string &path);
+	bool isEnabled() const { return this->enabled; }
+	boost::uint64_t maxSize() const;
+	void setMaxSize(boost::uint64_t limit);
+
+	bool lookup(const std::string &id, shared_ptr<const Geometry> &geom);
+	bool insert(const std::string &id, const shared_ptr<const Geometry> &geom);
+	void clear();
+	void print();
+	CacheStatistics statistics() const;
+
+private:
+	static DiskCache *inst;
+
+	struct file_entry {
+		file_entry() : size(0), lastused(0) {}
+		boost::uint64_t size;
+		std::time_t lastused;
+	};
+
+	std::string filename(const std::string &id) const;
+	Geometry *load(const std::string &id, bool &corrupt) const;
+	void touch(const std::string &id);
+	void remove(const std::string &id);
+	void evict();
+
+	bool enabled;
+	std::string path;
+	boost::uint64_t maxsize;
+	boost::uint64_t totalsize;
+	std::map<std::string, file_entry> files;
+	CacheStatistics stats;
+	mutable boost::mutex mutex;
+};
@@ -27,6 +27,7 @@
 
 #include <iostream>
 #include <algorithm>
+#include <boost/foreach.hpp>
 
 #include "Polygon2d.h"
 #include "DrawingCallback.h"
@@ -106,6 +107,22 @@ void DrawingCallback::curve_to(Vector2d c1, Vector2d to)
 	pen = to;
 }
 
+/*!
+	Adds an already flattened outline, relative to the glyph origin.
+*/
+void DrawingCallback::add_outline(const Outline2d &outline)
+{
+	if (this->outline.vertices.size() > 0) {
+		this->polygon->addOutline(this->outline);
+		this->outline.vertices.clear();
+	}
+	Outline2d o = outline;
+	BOOST_FOREACH(Vector2d &v, o.vertices) {
+		v = v + offset + advance;
+	}
+	this->polygon->addOutline(o);
+}
+
 void DrawingCallback::curve_to(Vector2d c1, Vector2d c2, Vector2d to)
 {
 	for (unsigned long idx = 1;idx <= fn;idx++) {
@@ -45,6 +45,7 @@ public:
     void line_to(Vector2d to);
     void curve_to(Vector2d c1, Vector2d to);
     void curve_to(Vector2d c1, Vector2d c2, Vector2d to);
+    void add_outline(const Outline2d &outline);
 private:
     unsigned long fn;
     Vector2d pen;
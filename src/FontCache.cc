@@ -25,6 +25,7 @@
  */
 
 #include <iostream>
+#include <limits>
 
 #include <boost/foreach.hpp>
 #include <boost/filesystem.hpp>
@@ -236,6 +237,8 @@ bool FontCache::is_init_ok() const
 void FontCache::clear()
 {
 	this->cache.clear();
+	clear_hb_fonts();
+	clear_glyphs();
 }
 
 void FontCache::dump_cache(const std::string &info)
@@ -259,10 +262,73 @@ void FontCache::check_cleanup()
 			pos = it;
 		}
 	}
+	clear_hb_fonts((*pos).second.first);
+	clear_glyphs((*pos).second.first);
 	FT_Done_Face((*pos).second.first);
 	this->cache.erase(pos);
 }
 
+/**
+ * Destroys the HarfBuzz fonts of the given face, or all of them.
+ */
+void FontCache::clear_hb_fonts(FT_Face face)
+{
+	for (hb_font_cache_t::iterator it = this->hb_fonts.begin(); it != this->hb_fonts.end();) {
+		if (!face || (*it).first.first == face) {
+			hb_font_destroy((*it).second);
+			this->hb_fonts.erase(it++);
+		} else {
+			it++;
+		}
+	}
+}
+
+/**
+ * Drops the cached glyphs of the given face, or all of them.
+ */
+void FontCache::clear_glyphs(FT_Face face)
+{
+	if (face) {
+		this->glyphs.erase(this->glyphs.lower_bound(glyph_key_t(face, 0, std::numeric_limits<FT_F26Dot6>::min(), 0)),
+											 this->glyphs.upper_bound(glyph_key_t(face, ~FT_UInt(0), std::numeric_limits<FT_F26Dot6>::max(), ~0UL)));
+	} else {
+		this->glyphs.clear();
+	}
+}
+
+/**
+ * Returns a HarfBuzz font for the face, which must currently be set to the
+ * given character size. The font is owned by the cache.
+ */
+hb_font_t *FontCache::get_hb_font(FT_Face face, FT_F26Dot6 size)
+{
+	const std::pair<FT_Face, FT_F26Dot6> key(face, size);
+	hb_font_cache_t::iterator it = this->hb_fonts.find(key);
+	if (it != this->hb_fonts.end()) {
+		return (*it).second;
+	}
+	if (this->hb_fonts.size() >= MAX_NR_OF_HB_FONTS) {
+		clear_hb_fonts();
+	}
+	hb_font_t *font = hb_ft_font_create(face, NULL);
+	this->hb_fonts[key] = font;
+	return font;
+}
+
+shared_ptr<const GlyphOutline> FontCache::get_glyph(FT_Face face, FT_UInt glyph_index, FT_F26Dot6 size, unsigned long segments) const
+{
+	glyph_cache_t::const_iterator it = this->glyphs.find(glyph_key_t(face, glyph_index, size, segments));
+	return it == this->glyphs.end() ? shared_ptr<const GlyphOutline>() : (*it).second;
+}
+
+void FontCache::add_glyph(FT_Face face, FT_UInt glyph_index, FT_F26Dot6 size, unsigned long segments, shared_ptr<const GlyphOutline> glyph)
+{
+	if (this->glyphs.size() >= MAX_NR_OF_GLYPHS) {
+		clear_glyphs();
+	}
+	this->glyphs[glyph_key_t(face, glyph_index, size, segments)] = glyph;
+}
+
 FT_Face FontCache::get_font(const std::string &font)
 {
 	FT_Face face;
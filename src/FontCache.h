@@ -42,6 +42,12 @@
 #include <hb.h>
 #include <hb-ft.h>
 
+#include <boost/tuple/tuple.hpp>
+#include <boost/tuple/tuple_comparison.hpp>
+
+#include "memory.h"
+#include "Polygon2d.h"
+
 class FontInfo {
 public:
     FontInfo(const std::string &family, const std::string &style, const std::string &file);
@@ -59,6 +65,17 @@ private:
 
 typedef std::vector<FontInfo> FontInfoList;
 
+/**
+ * Outline of a glyph, flattened with a fixed number of segments per curve,
+ * and its grid fitted control box. Vertices are relative to the glyph
+ * origin.
+ */
+class GlyphOutline {
+public:
+    std::vector<Outline2d> outlines;
+    FT_BBox cbox;
+};
+
 /**
  * Slow call of the font cache initialization. This is separated here so it
  * can be passed to the GUI to run in a separate thread while showing a
@@ -76,6 +93,8 @@ class FontCache {
 public:
     const static std::string DEFAULT_FONT;
     const static unsigned int MAX_NR_OF_CACHE_ENTRIES = 3;
+    const static unsigned int MAX_NR_OF_HB_FONTS = 32;
+    const static unsigned int MAX_NR_OF_GLYPHS = 20000;
     
     FontCache();
     virtual ~FontCache();
@@ -83,6 +102,9 @@ public:
     bool is_init_ok() const;
     FT_Face get_font(const std::string &font);
     bool is_windows_symbol_font(const FT_Face &face) const;
+    hb_font_t *get_hb_font(FT_Face face, FT_F26Dot6 size);
+    shared_ptr<const GlyphOutline> get_glyph(FT_Face face, FT_UInt glyph_index, FT_F26Dot6 size, unsigned long segments) const;
+    void add_glyph(FT_Face face, FT_UInt glyph_index, FT_F26Dot6 size, unsigned long segments, shared_ptr<const GlyphOutline> glyph);
     void register_font_file(const std::string &path);
     void clear();
     FontInfoList *list_fonts() const;
@@ -95,6 +117,11 @@ public:
 private:
     typedef std::pair<FT_Face, time_t> cache_entry_t;
     typedef std::map<std::string, cache_entry_t> cache_t;
+    // HarfBuzz fonts by face and character size
+    typedef std::map<std::pair<FT_Face, FT_F26Dot6>, hb_font_t *> hb_font_cache_t;
+    // Glyphs by face, glyph index, character size and segments per curve
+    typedef boost::tuple<FT_Face, FT_UInt, FT_F26Dot6, unsigned long> glyph_key_t;
+    typedef std::map<glyph_key_t, shared_ptr<const GlyphOutline> > glyph_cache_t;
 
     static FontCache *self;
     static InitHandlerFunc *cb_handler;
@@ -104,10 +131,14 @@ private:
 
     bool init_ok;
     cache_t cache;
+    hb_font_cache_t hb_fonts;
+    glyph_cache_t glyphs;
     FcConfig *config;
     FT_Library library;
 
     void check_cleanup();
+    void clear_hb_fonts(FT_Face face = NULL);
+    void clear_glyphs(FT_Face face = NULL);
     void dump_cache(const std::string &info);
     
     void add_font_dir(const std::string &path);
@@ -30,6 +30,8 @@
 
 #include <glib.h>
 
+#include <boost/foreach.hpp>
+
 #include <fontconfig/fontconfig.h>
 
 #include "printutils.h"
@@ -122,11 +124,49 @@ double FreetypeRenderer::calc_y_offset(std::string valign, double ascend, double
 	}
 }
 
+/*!
+	Returns the outline of a glyph of the face, which must currently be set
+	to the given character size. Outlines are flattened once and then shared
+	through the FontCache. Returns NULL if the glyph can't be loaded.
+*/
+shared_ptr<const GlyphOutline> FreetypeRenderer::load_glyph(FT_Face face, FT_UInt glyph_index, FT_F26Dot6 size, unsigned long segments) const
+{
+	FontCache *cache = FontCache::instance();
+	shared_ptr<const GlyphOutline> cached = cache->get_glyph(face, glyph_index, size, segments);
+	if (cached) return cached;
+
+	FT_Error error = FT_Load_Glyph(face, glyph_index, FT_LOAD_DEFAULT);
+	if (error) return shared_ptr<const GlyphOutline>();
+
+	FT_Glyph glyph;
+	error = FT_Get_Glyph(face->glyph, &glyph);
+	if (error) return shared_ptr<const GlyphOutline>();
+
+	GlyphOutline *glyph_outline = new GlyphOutline();
+	FT_Glyph_Get_CBox(glyph, FT_GLYPH_BBOX_GRIDFIT, &glyph_outline->cbox);
+
+	DrawingCallback callback(segments);
+	callback.start_glyph();
+	FT_Outline outline = reinterpret_cast<FT_OutlineGlyph>(glyph)->outline;
+	FT_Outline_Decompose(&outline, &funcs, &callback);
+	callback.finish_glyph();
+	BOOST_FOREACH(const Geometry *geom, callback.get_result()) {
+		glyph_outline->outlines = static_cast<const Polygon2d *>(geom)->outlines();
+		delete geom;
+	}
+	FT_Done_Glyph(glyph);
+
+	shared_ptr<const GlyphOutline> result(glyph_outline);
+	cache->add_glyph(face, glyph_index, size, segments, result);
+	return result;
+}
+
 std::vector<const Geometry *> FreetypeRenderer::render(const FreetypeRenderer::Params &params) const
 {
 	FT_Face face;
 	FT_Error error;
-	DrawingCallback callback(params.segments);
+	const unsigned long segments = params.segments;
+	DrawingCallback callback(segments);
 	
 	FontCache *cache = FontCache::instance();
 	if (!cache->is_init_ok()) {
@@ -138,13 +178,14 @@ std::vector<const Geometry *> FreetypeRenderer::render(const FreetypeRenderer::P
 		return std::vector<const Geometry *>();
 	}
 	
-	error = FT_Set_Char_Size(face, 0, params.size * scale, 100, 100);
+	const FT_F26Dot6 size = params.size * scale;
+	error = FT_Set_Char_Size(face, 0, size, 100, 100);
 	if (error) {
 		PRINTB("Can't set font size for font %s", params.font);
 		return std::vector<const Geometry *>();
 	}
 	
-	hb_font_t *hb_ft_font = hb_ft_font_create(face, NULL);
+	hb_font_t *hb_ft_font = cache->get_hb_font(face, size);
 
 	hb_buffer_t *hb_buf = hb_buffer_create();
 	hb_buffer_set_direction(hb_buf, hb_direction_from_string(params.direction.c_str(), -1));
@@ -185,18 +226,11 @@ std::vector<const Geometry *> FreetypeRenderer::render(const FreetypeRenderer::P
 	GlyphArray glyph_array;
 	for (unsigned int idx = 0;idx < glyph_count;idx++) {
 		FT_UInt glyph_index = glyph_info[idx].codepoint;
-		error = FT_Load_Glyph(face, glyph_index, FT_LOAD_DEFAULT);
-		if (error) {
+		shared_ptr<const GlyphOutline> glyph = load_glyph(face, glyph_index, size, segments);
+		if (!glyph) {
 			PRINTB("Could not load glyph %u for char at index %u in text '%s'", glyph_index % idx % params.text);
 			continue;
 		}
-
-		FT_Glyph glyph;
-		error = FT_Get_Glyph(face->glyph, &glyph);
-		if (error) {
-			PRINTB("Could not get glyph %u for char at index %u in text '%s'", glyph_index % idx % params.text);
-			continue;
-		}
 		const GlyphData *glyph_data = new GlyphData(glyph, idx, &glyph_info[idx], &glyph_pos[idx]);
 		glyph_array.push_back(glyph_data);
 	}
@@ -205,8 +239,7 @@ std::vector<const Geometry *> FreetypeRenderer::render(const FreetypeRenderer::P
 	for (GlyphArray::iterator it = glyph_array.begin();it != glyph_array.end();it++) {
 		const GlyphData *glyph = (*it);
 		
-		FT_BBox bbox;
-		FT_Glyph_Get_CBox(glyph->get_glyph(), FT_GLYPH_BBOX_GRIDFIT, &bbox);
+		const FT_BBox &bbox = glyph->get_glyph().cbox;
 		
 		if (HB_DIRECTION_IS_HORIZONTAL(hb_buffer_get_direction(hb_buf))) {
 			double asc = std::max(0.0, bbox.yMax / 64.0 / 16.0);
@@ -229,8 +262,9 @@ std::vector<const Geometry *> FreetypeRenderer::render(const FreetypeRenderer::P
 		
 		callback.start_glyph();
 		callback.set_glyph_offset(x_offset + glyph->get_x_offset(), y_offset + glyph->get_y_offset());
-		FT_Outline outline = reinterpret_cast<FT_OutlineGlyph>(glyph->get_glyph())->outline;
-		FT_Outline_Decompose(&outline, &funcs, &callback);
+		BOOST_FOREACH(const Outline2d &outline, glyph->get_glyph().outlines) {
+			callback.add_outline(outline);
+		}
 
 		double adv_x  = glyph->get_x_advance() * params.spacing;
 		double adv_y  = glyph->get_y_advance() * params.spacing;
@@ -239,7 +273,6 @@ std::vector<const Geometry *> FreetypeRenderer::render(const FreetypeRenderer::P
 	}
 
 	hb_buffer_destroy(hb_buf);
-        hb_font_destroy(hb_ft_font);
 	
 	return callback.get_result();
 }
@@ -29,11 +29,15 @@
 #include <vector>
 #include <ostream>
 
+#include "memory.h"
+
 #include <hb.h>
 #include <ft2build.h>
 #include FT_FREETYPE_H
 #include FT_GLYPH_H
 
+class GlyphOutline;
+
 class FreetypeRenderer {
 public:
     class Params {
@@ -109,15 +113,15 @@ private:
     
     class GlyphData {
     public:
-        GlyphData(FT_Glyph glyph, unsigned int idx, hb_glyph_info_t *glyph_info, hb_glyph_position_t *glyph_pos) : glyph(glyph), idx(idx), glyph_pos(glyph_pos), glyph_info(glyph_info) {}
+        GlyphData(shared_ptr<const GlyphOutline> glyph, unsigned int idx, hb_glyph_info_t *glyph_info, hb_glyph_position_t *glyph_pos) : glyph(glyph), idx(idx), glyph_pos(glyph_pos), glyph_info(glyph_info) {}
         unsigned int get_idx() const { return idx; };
-        FT_Glyph get_glyph() const { return glyph; };
+        const GlyphOutline &get_glyph() const { return *glyph; };
         double get_x_offset() const { return glyph_pos->x_offset / 64.0 / 16.0; };
         double get_y_offset() const { return glyph_pos->y_offset / 64.0 / 16.0; };
         double get_x_advance() const { return glyph_pos->x_advance / 64.0 / 16.0; };
         double get_y_advance() const { return glyph_pos->y_advance / 64.0 / 16.0; };
     private:
-        FT_Glyph glyph;
+        shared_ptr<const GlyphOutline> glyph;
         unsigned int idx;
         hb_glyph_position_t *glyph_pos;
         hb_glyph_info_t *glyph_info;
@@ -125,7 +129,6 @@ private:
 
     struct done_glyph : public std::unary_function<const GlyphData *, void> {
         void operator() (const GlyphData *glyph_data) {
-            FT_Done_Glyph(glyph_data->get_glyph());
             delete glyph_data;
         }
     };
@@ -139,6 +142,7 @@ private:
 
     double calc_x_offset(std::string halign, double width) const;
     double calc_y_offset(std::string valign, double ascend, double descend) const;
+    shared_ptr<const GlyphOutline> load_glyph(FT_Face face, FT_UInt glyph_index, FT_F26Dot6 size, unsigned long segments) const;
     
     static int outline_move_to_func(const FT_Vector *to, void *user);
     static int outline_line_to_func(const FT_Vector *to, void *user);
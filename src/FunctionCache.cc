@@ -0,0 +1,126 @@
+#include "FunctionCache.h"
+#include "printutils.h"
+
+#include <boost/foreach.hpp>
+
+FunctionCache *FunctionCache::inst = NULL;
+unsigned long FunctionCache::uncacheable = 0;
+
+// Vectors with more elements are keyed by the address of their elements
+static const size_t max_vector_key = 16;
+
+static void append_raw(std::string &key, const void *data, size_t size)
+{
+	key.append(static_cast<const char *>(data), size);
+}
+
+static void append_double(std::string &key, double d)
+{
+	if (d == 0) d = 0; // -0 == 0
+	append_raw(key, &d, sizeof(d));
+}
+
+static void append_value(std::string &key, const Value &value)
+{
+	switch (value.type()) {
+	case Value::UNDEFINED:
+		key += 'u';
+		break;
+	case Value::BOOL:
+		key += value.toBool() ? 't' : 'f';
+		break;
+	case Value::NUMBER:
+		key += 'n';
+		append_double(key, value.toDouble());
+		break;
+	case Value::STRING: {
+		std::string str = value.toString();
+		size_t size = str.size();
+		key += 's';
+		append_raw(key, &size, sizeof(size));
+		key += str;
+		break;
+	}
+	case Value::VECTOR: {
+		const Value::VectorType &vec = value.toVector();
+		size_t size = vec.size();
+		if (size > max_vector_key) {
+			const Value *elements = &vec[0];
+			key += 'p';
+			append_raw(key, &elements, sizeof(elements));
+		}
+		else {
+			key += 'v';
+			append_raw(key, &size, sizeof(size));
+			BOOST_FOREACH(const Value &v, vec) append_value(key, v);
+		}
+		break;
+	}
+	case Value::RANGE: {
+		Value::RangeType range = value.toRange();
+		key += 'r';
+		append_double(key, range.begin_value());
+		append_double(key, range.step_value());
+		append_double(key, range.end_value());
+		break;
+	}
+	}
+}
+
+void FunctionCache::appendKey(std::string &key, const std::string &str)
+{
+	size_t size = str.size();
+	append_raw(key, &size, sizeof(size));
+	key += str;
+}
+
+/*!
+	Appends a value to a key. Values which compare equal give the same key,
+	except for large vectors which only give the same key if they share
+	their elements.
+*/
+void FunctionCache::appendKey(std::string &key, const ValuePtr &value)
+{
+	if (!value.get()) key += 'x';
+	else append_value(key, *value);
+}
+
+bool FunctionCache::lookup(const std::string &key, ValuePtr &result) const
+{
+	const cache_entry *entry = this->cache[key];
+	if (!entry) return false;
+	result = entry->result;
+	return true;
+}
+
+bool FunctionCache::insert(const std::string &key, const ValuePtr &result, const std::vector<ValuePtr> &values)
+{
+	return this->cache.insert(key, new cache_entry(result, values));
+}
+
+size_t FunctionCache::maxSize() const
+{
+	return this->cache.maxCost();
+}
+
+void FunctionCache::setMaxSize(size_t limit)
+{
+	this->cache.setMaxCost(limit);
+}
+
+void FunctionCache::clear()
+{
+	this->cache.clear();
+}
+
+void FunctionCache::print()
+{
+	PRINTB("Function results in cache: %d", this->cache.size());
+	CacheStatistics stats = this->cache.statistics();
+	PRINTB("Function cache hits: %d, misses: %d, evictions: %d", stats.hits % stats.misses % stats.evictions);
+}
+
+CacheStatistics FunctionCache::statistics() const
+{
+	return this->cache.statistics();
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "cache.h"
+#include "value.h"
+
+#include <string>
+#include <vector>
+
+/*!
+	Results of user defined functions, see Function::evaluate().
+
+	Keys are built by the caller with appendKey() from the evaluated
+	arguments and any other values the result depends on. The values used
+	to build a key are kept alive with the entry, so large vectors can be
+	keyed by the address of their shared elements instead of by content.
+
+	The size limit is in number of entries.
+*/
+class FunctionCache
+{
+public:
+	FunctionCache(size_t limit = 100000) : cache(limit) {}
+
+	static FunctionCache *instance() { if (!inst) inst = new FunctionCache; return inst; }
+
+	bool lookup(const std::string &key, ValuePtr &result) const;
+	bool insert(const std::string &key, const ValuePtr &result, const std::vector<ValuePtr> &values);
+	size_t maxSize() const;
+	void setMaxSize(size_t limit);
+	void clear();
+	void print();
+	CacheStatistics statistics() const;
+
+	static void appendKey(std::string &key, const std::string &str);
+	static void appendKey(std::string &key, const ValuePtr &value);
+
+	/*!
+		Called when evaluation depends on state which can't be part of a
+		key, like $ variables or random numbers. Results evaluated while
+		this happened must not be cached.
+	*/
+	static void markUncacheable() { uncacheable++; }
+	static unsigned long uncacheableCount() { return uncacheable; }
+
+private:
+	static FunctionCache *inst;
+	static unsigned long uncacheable;
+
+	struct cache_entry {
+		ValuePtr result;
+		std::vector<ValuePtr> values;
+		cache_entry(const ValuePtr &result, const std::vector<ValuePtr> &values)
+			: result(result), values(values) {}
+	};
+
+	Cache<std::string, cache_entry> cache;
+};
@@ -6,6 +6,7 @@
 #include "mathc99.h"
 #include "printutils.h"
 #include "renderer.h"
+#include "VBOCache.h"
 
 #ifdef _WIN32
 #include <GL/wglew.h>
@@ -40,6 +41,11 @@ GLView::GLView()
 #endif
 }
 
+GLView::~GLView()
+{
+  VBOCache::instance()->removeContext(this);
+}
+
 void GLView::setRenderer(Renderer* r)
 {
   renderer = r;
@@ -187,6 +193,7 @@ void GLView::paintGL()
     // FIXME: This belongs in the OpenCSG renderer, but it doesn't know about this ID yet
     OpenCSG::setContext(this->opencsg_id);
 #endif
+    VBOCache::instance()->setContext(this);
     this->renderer->draw(showfaces, showedges);
   }
 
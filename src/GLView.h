@@ -32,6 +32,7 @@ class GLView
 {
 public:
 	GLView();
+	virtual ~GLView();
 	void setRenderer(class Renderer* r);
 	Renderer *getRenderer() const { return this->renderer; }
 
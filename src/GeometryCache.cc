@@ -10,42 +10,103 @@
 
 GeometryCache *GeometryCache::inst = NULL;
 
+bool GeometryCache::contains(const std::string &id) const
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	return this->cache.contains(id);
+}
+
 shared_ptr<const Geometry> GeometryCache::get(const std::string &id) const
 {
-	const shared_ptr<const Geometry> &geom = this->cache[id]->geom;
+	shared_ptr<const Geometry> geom;
+	lookup(id, geom);
+	return geom;
+}
+
+/*!
+	Looks up and fetches the geometry in one step. Returns false if the
+	geometry is not cached. Use this rather than contains() + get() if other
+	threads may modify the cache in between.
+*/
+bool GeometryCache::lookup(const std::string &id, shared_ptr<const Geometry> &geom) const
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	const cache_entry *entry = this->cache.find(id);
+	if (!entry) return false;
+	geom = entry->geom;
 #ifdef DEBUG
 	PRINTB("Geometry Cache hit: %s (%d bytes)", id.substr(0, 40) % (geom ? geom->memsize() : 0));
 #endif
-	return geom;
+	return true;
 }
 
 bool GeometryCache::insert(const std::string &id, const shared_ptr<const Geometry> &geom)
 {
-	bool inserted = this->cache.insert(id, new cache_entry(geom), geom ? geom->memsize() : 0);
+	// Computed outside the lock, memsize() may have to traverse the geometry
+	size_t size = geom ? geom->memsize() : 0;
+	boost::mutex::scoped_lock lock(this->mutex);
+	bool inserted = this->cache.insert(id, new cache_entry(geom), size);
 #ifdef DEBUG
 	assert(!dynamic_cast<const CGAL_Nef_polyhedron*>(geom.get()));
-	if (inserted) PRINTB("Geometry Cache insert: %s (%d bytes)", 
-                         id.substr(0, 40) % (geom ? geom->memsize() : 0));
-	else PRINTB("Geometry Cache insert failed: %s (%d bytes)",
-                id.substr(0, 40) % (geom ? geom->memsize() : 0));
+	if (inserted) PRINTB("Geometry Cache insert: %s (%d bytes)", id.substr(0, 40) % size);
+	else PRINTB("Geometry Cache insert failed: %s (%d bytes)", id.substr(0, 40) % size);
 #endif
 	return inserted;
 }
 
-size_t GeometryCache::maxSize() const
+bool GeometryCache::remove(const std::string &id)
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	return this->cache.remove(id);
+}
+
+boost::uint64_t GeometryCache::maxSize() const
 {
+	boost::mutex::scoped_lock lock(this->mutex);
 	return this->cache.maxCost();
 }
 
-void GeometryCache::setMaxSize(size_t limit)
+void GeometryCache::setMaxSize(boost::uint64_t limit)
 {
+	boost::mutex::scoped_lock lock(this->mutex);
 	this->cache.setMaxCost(limit);
 }
 
+void GeometryCache::clear()
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	this->cache.clear();
+}
+
 void GeometryCache::print()
 {
+	boost::mutex::scoped_lock lock(this->mutex);
 	PRINTB("Geometries in cache: %d", this->cache.size());
 	PRINTB("Geometry cache size in bytes: %d", this->cache.totalCost());
+	CacheStatistics stats = this->cache.statistics();
+	PRINTB("Geometry cache hits: %d, misses: %d, evictions: %d", stats.hits % stats.misses % stats.evictions);
+}
+
+/*!
+	Hits and misses are counted by the caller, since one logical lookup may
+	query both the geometry and the CGAL cache.
+*/
+void GeometryCache::recordHit() const
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	this->cache.recordHit();
+}
+
+void GeometryCache::recordMiss() const
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	this->cache.recordMiss();
+}
+
+CacheStatistics GeometryCache::statistics() const
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	return this->cache.statistics();
 }
 
 GeometryCache::cache_entry::cache_entry(const shared_ptr<const Geometry> &geom)
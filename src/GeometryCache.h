@@ -4,20 +4,27 @@
 #include "memory.h"
 #include "Geometry.h"
 
+#include <boost/thread/mutex.hpp>
+
 class GeometryCache
 {
 public:	
-	GeometryCache(size_t memorylimit = 100*1024*1024) : cache(memorylimit) {}
+	GeometryCache(boost::uint64_t memorylimit = 100*1024*1024) : cache(memorylimit) {}
 
 	static GeometryCache *instance() { if (!inst) inst = new GeometryCache; return inst; }
 
-	bool contains(const std::string &id) const { return this->cache.contains(id); }
+	bool contains(const std::string &id) const;
 	shared_ptr<const class Geometry> get(const std::string &id) const;
+	bool lookup(const std::string &id, shared_ptr<const class Geometry> &geom) const;
 	bool insert(const std::string &id, const shared_ptr<const Geometry> &geom);
-	size_t maxSize() const;
-	void setMaxSize(size_t limit);
-	void clear() { cache.clear(); }
+	bool remove(const std::string &id);
+	boost::uint64_t maxSize() const;
+	void setMaxSize(boost::uint64_t limit);
+	void clear();
 	void print();
+	CacheStatistics statistics() const;
+	void recordHit() const;
+	void recordMiss() const;
 
 private:
 	static GeometryCache *inst;
@@ -30,4 +37,6 @@ private:
 	};
 
 	Cache<std::string, cache_entry> cache;
+	// All access is serialized to allow parallel geometry evaluation
+	mutable boost::mutex mutex;
 };
@@ -25,18 +25,51 @@
 #include "svg.h"
 #include "calc.h"
 #include "dxfdata.h"
+#include "TaskScheduler.h"
+#include "DiskCache.h"
+#include "mesh-boolean.h"
+#include "TransformedGeometry.h"
 
 #include <algorithm>
 #include <boost/foreach.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/exception_ptr.hpp>
 
 #include <CGAL/convex_hull_2.h>
 #include <CGAL/Point_2.h>
 
 GeometryEvaluator::GeometryEvaluator(const class Tree &tree):
-	tree(tree)
+	tree(tree), numjobs(1), backend(BACKEND_NEF)
 {
 }
 
+void GeometryEvaluator::Statistics::add(const Statistics &other)
+{
+	this->meshoperations += other.meshoperations;
+	this->meshfallbacks += other.meshfallbacks;
+	this->unionchildren += other.unionchildren;
+	this->unionfastpath += other.unionfastpath;
+	this->deferredtransforms += other.deferredtransforms;
+	this->foldedtransforms += other.foldedtransforms;
+}
+
+void GeometryEvaluator::printStatistics() const
+{
+	if (this->backend == BACKEND_MESH) {
+		PRINTB("Mesh backend: %d boolean operations on meshes, %d fell back to Nef",
+					 this->stats.meshoperations % this->stats.meshfallbacks);
+	}
+	if (this->stats.unionfastpath > 0) {
+		PRINTB("Union fast path: %d of %d children didn't overlap any other child",
+					 this->stats.unionfastpath % this->stats.unionchildren);
+	}
+	if (this->stats.deferredtransforms > 0) {
+		PRINTB("Deferred transforms: %d transformed objects shared their geometry, %d transforms applied",
+					 this->stats.deferredtransforms % this->stats.foldedtransforms);
+	}
+}
+
 /*!
 	Set allownef to false to force the result to _not_ be a Nef polyhedron
 */
@@ -44,19 +77,27 @@ shared_ptr<const Geometry> GeometryEvaluator::evaluateGeometry(const AbstractNod
 																															 bool allownef)
 {
 	if (!GeometryCache::instance()->contains(this->tree.getIdString(node))) {
+		this->stats = Statistics();
 		shared_ptr<const CGAL_Nef_polyhedron> N;
 		if (CGALCache::instance()->contains(this->tree.getIdString(node))) {
 			N = CGALCache::instance()->get(this->tree.getIdString(node));
 		}
 
-		// If not found in any caches, we need to evaluate the geometry
+		// If not found in any caches, we need to evaluate the geometry.
+		// Misses are counted by the evaluation.
 		if (N) {
+			CGALCache::instance()->recordHit();
 			this->root = N;
 		}	
+    else if (this->numjobs != 1) {
+			this->root = evaluateParallel(node);
+		}
     else {
 			Traverser trav(*this, node, Traverser::PRE_AND_POSTFIX);
 			trav.execute();
 		}
+		this->root = foldCachedTransform(node, this->root);
+		printStatistics();
 
 		if (!allownef) {
 			if (shared_ptr<const CGAL_Nef_polyhedron> N = dynamic_pointer_cast<const CGAL_Nef_polyhedron>(this->root)) {
@@ -75,7 +116,327 @@ shared_ptr<const Geometry> GeometryEvaluator::evaluateGeometry(const AbstractNod
 		}
 		return this->root;
 	}
-	return GeometryCache::instance()->get(this->tree.getIdString(node));
+	GeometryCache::instance()->recordHit();
+	return foldCachedTransform(node, GeometryCache::instance()->get(this->tree.getIdString(node)));
+}
+
+/*!
+	Applies a deferred transformation, creating new geometry.
+*/
+Geometry *GeometryEvaluator::applyTransform(const TransformedGeometry &tg)
+{
+	this->stats.foldedtransforms++;
+	Geometry *result;
+	if (const PolySet *ps = dynamic_cast<const PolySet *>(tg.getBase().get())) {
+		PolySet *newps = new PolySet(*ps);
+		newps->transform(tg.getMatrix());
+		result = newps;
+	}
+	else {
+		const CGAL_Nef_polyhedron *N = dynamic_cast<const CGAL_Nef_polyhedron *>(tg.getBase().get());
+		assert(N);
+		CGAL_Nef_polyhedron *newN = static_cast<CGAL_Nef_polyhedron *>(N->copy());
+		newN->transform(tg.getMatrix());
+		result = newN;
+	}
+	result->setConvexity(tg.getConvexity());
+	return result;
+}
+
+/*!
+	Returns concrete geometry: Deferred transformations are applied, other
+	geometry is returned as is.
+*/
+shared_ptr<const Geometry> GeometryEvaluator::foldTransform(const shared_ptr<const Geometry> &geom)
+{
+	if (const TransformedGeometry *tg = dynamic_cast<const TransformedGeometry *>(geom.get())) {
+		return shared_ptr<const Geometry>(applyTransform(*tg));
+	}
+	return geom;
+}
+
+Geometry::ChildList GeometryEvaluator::foldTransforms(const Geometry::ChildList &children)
+{
+	Geometry::ChildList result;
+	BOOST_FOREACH(const Geometry::ChildItem &item, children) {
+		result.push_back(std::make_pair(item.first, foldTransform(item.second)));
+	}
+	return result;
+}
+
+/*!
+	Like foldTransform(), for results. The returned result is writable if
+	a transformation was applied.
+*/
+GeometryEvaluator::ResultObject GeometryEvaluator::foldTransform(const ResultObject &res)
+{
+	if (const TransformedGeometry *tg = dynamic_cast<const TransformedGeometry *>(res.constptr().get())) {
+		return ResultObject(applyTransform(*tg));
+	}
+	return res;
+}
+
+/*!
+	Applies a deferred transformation of the result of \a node, and
+	replaces the cached deferred transformation by the result so it's
+	only applied once.
+*/
+shared_ptr<const Geometry> GeometryEvaluator::foldCachedTransform(const AbstractNode &node, const shared_ptr<const Geometry> &geom)
+{
+	if (!dynamic_cast<const TransformedGeometry *>(geom.get())) return geom;
+	shared_ptr<const Geometry> folded = foldTransform(geom);
+	GeometryCache::instance()->remove(this->tree.getIdString(node));
+	smartCacheInsert(node, folded);
+	return folded;
+}
+
+/*!
+	Evaluation of one node. Node tasks never wait for other jobs, as a
+	waiting thread may run other tasks, including the ones of jobs which
+	depend on the job further down its stack. Instead, the task evaluating
+	a node's prefix schedules the children, and the last child to finish
+	schedules the task evaluating the node's postfix.
+*/
+struct GeometryEvaluator::ParallelJob
+{
+	ParallelJob(const AbstractNode *node, bool preferNef)
+		: node(node), preferNef(preferNef), childrenPreferNef(false), pendingchildren(0), done(false) {}
+	const AbstractNode *node;
+	bool preferNef;
+	shared_ptr<const Geometry> geom;
+
+	// Kept from the prefix to the postfix
+	shared_ptr<GeometryEvaluator> sub;
+	bool childrenPreferNef;
+	std::vector<ParallelJob *> childjobs;
+
+	// Guarded by ParallelContext::mutex
+	unsigned int pendingchildren;
+	bool done;
+	std::vector<ParallelJob *> parents; // Jobs waiting for this one
+};
+
+struct GeometryEvaluator::ParallelContext
+{
+	ParallelContext(unsigned int numthreads) : scheduler(numthreads), failed(false) {}
+
+	/*! Records the exception being handled, unless one was recorded before.
+	    Must be called from a catch block. */
+	void fail() {
+		boost::mutex::scoped_lock lock(this->mutex);
+		if (!this->failed) this->error = boost::current_exception();
+		this->failed = true;
+	}
+	bool hasFailed() {
+		boost::mutex::scoped_lock lock(this->mutex);
+		return this->failed;
+	}
+
+	TaskScheduler scheduler;
+	// All tasks of the evaluation
+	TaskScheduler::TaskGroup group;
+	boost::mutex mutex;
+	// One job per unique id string; identical subtrees are only evaluated
+	// once. The result depends on preferNef, so that's part of the key.
+	std::map<std::pair<std::string, bool>, shared_ptr<ParallelJob> > jobs;
+	// FreetypeRenderer and FontCache are not thread-safe
+	boost::mutex textmutex;
+	// Tasks must not throw, so the first exception is kept here and
+	// rethrown by evaluateParallel(). Guarded by mutex.
+	bool failed;
+	boost::exception_ptr error;
+};
+
+static void collectIdStrings(const Tree &tree, const AbstractNode &node)
+{
+	tree.getIdString(node);
+	BOOST_FOREACH(const AbstractNode *chnode, node.getChildren()) {
+		collectIdStrings(tree, *chnode);
+	}
+}
+
+/*!
+	Evaluates the subtree rooted by \a node using multiple threads.
+
+	Each node becomes a job which evaluates its children as separate jobs
+	and then combines their results using a private GeometryEvaluator.
+	Children are combined in the same order as during serial traversal, so the
+	result is identical to the serial result. Exceptions thrown while
+	evaluating a node are rethrown once all started jobs are done.
+*/
+shared_ptr<const Geometry> GeometryEvaluator::evaluateParallel(const AbstractNode &node)
+{
+	// Build all id strings up front, as the Tree caches are not thread-safe
+	collectIdStrings(this->tree, node);
+
+	unsigned int numthreads = this->numjobs ? this->numjobs : TaskScheduler::hardwareConcurrency();
+	PRINTDB("Evaluating geometry using %d threads", numthreads);
+
+	// CGAL::set_error_behaviour() is global, make sure concurrent callers
+	// restore a sane value.
+	CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
+	shared_ptr<const Geometry> geom;
+	bool failed;
+	boost::exception_ptr error;
+	{
+		// The calling thread acts as a worker while waiting. It's not
+		// evaluating any job, so this can't block a job it depends on.
+		ParallelContext ctx(numthreads - 1);
+		ParallelJob *job = scheduleJob(ctx, node, false, NULL);
+		ctx.scheduler.wait(ctx.group);
+		geom = job->geom;
+		failed = ctx.failed;
+		error = ctx.error;
+	}
+	CGAL::set_error_behaviour(old_behaviour);
+	if (failed) boost::rethrow_exception(error);
+	return geom;
+}
+
+/*!
+	Returns the job evaluating \a node, and starts it if it's new. Unless
+	the job is done already, \a parent (if any) is notified when it is.
+*/
+GeometryEvaluator::ParallelJob *GeometryEvaluator::scheduleJob(ParallelContext &ctx, const AbstractNode &node, bool preferNef, ParallelJob *parent)
+{
+	const std::pair<std::string, bool> key(this->tree.getIdString(node), preferNef);
+	ParallelJob *job;
+	{
+		boost::mutex::scoped_lock lock(ctx.mutex);
+		shared_ptr<ParallelJob> &entry = ctx.jobs[key];
+		if (entry) {
+			if (parent && !entry->done) {
+				entry->parents.push_back(parent);
+				parent->pendingchildren++;
+			}
+			return entry.get();
+		}
+		entry.reset(new ParallelJob(&node, preferNef));
+		job = entry.get();
+		if (parent) {
+			job->parents.push_back(parent);
+			parent->pendingchildren++;
+		}
+	}
+	ctx.scheduler.spawn(ctx.group, boost::bind(&GeometryEvaluator::evaluateJobPrefix, this, boost::ref(ctx), job));
+	return job;
+}
+
+/*!
+	Task body: Evaluates the prefix of a node and schedules its children.
+*/
+void GeometryEvaluator::evaluateJobPrefix(ParallelContext &ctx, ParallelJob *job)
+{
+	const AbstractNode *node = job->node;
+	Response response;
+	bool done = false;
+	try {
+		// After a failure, the remaining jobs are only finished
+		if (ctx.hasFailed() || smartCacheLookup(*node, job->preferNef, job->geom)) {
+			done = true;
+		}
+		else {
+			job->sub.reset(new GeometryEvaluator(this->tree));
+			job->sub->backend = this->backend;
+			State state(NULL);
+			state.setNumChildren(node->getChildren().size());
+			state.setPreferNef(job->preferNef);
+			state.setPrefix(true);
+			{
+				boost::mutex::scoped_lock textlock(ctx.textmutex, boost::defer_lock);
+				if (dynamic_cast<const TextNode *>(node)) textlock.lock();
+				response = node->accept(state, *job->sub);
+			}
+			job->childrenPreferNef = state.preferNef();
+		}
+	}
+	catch (...) {
+		ctx.fail();
+		done = true;
+	}
+	if (done) {
+		job->sub.reset();
+		finishJob(ctx, job);
+		return;
+	}
+
+	if (response == ContinueTraversal && !node->getChildren().empty()) {
+		{
+			// Holds back the postfix until all children are scheduled
+			boost::mutex::scoped_lock lock(ctx.mutex);
+			job->pendingchildren = 1;
+		}
+		BOOST_FOREACH(const AbstractNode *chnode, node->getChildren()) {
+			job->childjobs.push_back(scheduleJob(ctx, *chnode, job->childrenPreferNef, job));
+		}
+		childDone(ctx, job);
+	}
+	else {
+		evaluateJobPostfix(ctx, job);
+	}
+}
+
+/*!
+	Called when a child of \a job is done. The last child schedules the
+	postfix of the job.
+*/
+void GeometryEvaluator::childDone(ParallelContext &ctx, ParallelJob *job)
+{
+	{
+		boost::mutex::scoped_lock lock(ctx.mutex);
+		if (--job->pendingchildren > 0) return;
+	}
+	ctx.scheduler.spawn(ctx.group, boost::bind(&GeometryEvaluator::evaluateJobPostfix, this, boost::ref(ctx), job));
+}
+
+/*!
+	Task body: Evaluates the postfix of a node after its children are done.
+*/
+void GeometryEvaluator::evaluateJobPostfix(ParallelContext &ctx, ParallelJob *job)
+{
+	const AbstractNode *node = job->node;
+	// After a failure, children may be missing their results
+	if (!ctx.hasFailed()) {
+		try {
+			GeometryEvaluator &sub = *job->sub;
+			Geometry::ChildList &children = sub.visitedchildren[node->index()];
+			for (size_t i=0;i<job->childjobs.size();i++) {
+				children.push_back(std::make_pair(node->getChildren()[i], job->childjobs[i]->geom));
+			}
+
+			State state(NULL);
+			state.setNumChildren(node->getChildren().size());
+			state.setPreferNef(job->childrenPreferNef);
+			state.setPostfix(true);
+			{
+				boost::mutex::scoped_lock textlock(ctx.textmutex, boost::defer_lock);
+				if (dynamic_cast<const TextNode *>(node)) textlock.lock();
+				node->accept(state, sub);
+			}
+			job->geom = sub.root;
+			boost::mutex::scoped_lock lock(ctx.mutex);
+			this->stats.add(sub.stats);
+		}
+		catch (...) {
+			ctx.fail();
+		}
+	}
+	job->sub.reset();
+	finishJob(ctx, job);
+}
+
+/*!
+	Marks \a job as done and notifies the jobs waiting for it.
+*/
+void GeometryEvaluator::finishJob(ParallelContext &ctx, ParallelJob *job)
+{
+	std::vector<ParallelJob *> parents;
+	{
+		boost::mutex::scoped_lock lock(ctx.mutex);
+		job->done = true;
+		parents.swap(job->parents);
+	}
+	BOOST_FOREACH(ParallelJob *parent, parents) childDone(ctx, parent);
 }
 
 GeometryEvaluator::ResultObject GeometryEvaluator::applyToChildren(const AbstractNode &node, OpenSCADOperator op)
@@ -112,7 +473,7 @@ GeometryEvaluator::ResultObject GeometryEvaluator::applyToChildren3D(const Abstr
 	if (op == OPENSCAD_HULL) {
 		PolySet *ps = new PolySet(3, true);
 
-		if (CGALUtils::applyHull(children, *ps)) {
+		if (CGALUtils::applyHull(foldTransforms(children), *ps)) {
 			return ps;
 		}
 
@@ -130,7 +491,27 @@ GeometryEvaluator::ResultObject GeometryEvaluator::applyToChildren3D(const Abstr
 		}
 		if (actualchildren.empty()) return ResultObject();
 		if (actualchildren.size() == 1) return ResultObject(actualchildren.front().second);
-		return ResultObject(CGALUtils::applyMinkowski(actualchildren));
+		return ResultObject(CGALUtils::applyMinkowski(foldTransforms(actualchildren)));
+	}
+
+	if (op == OPENSCAD_UNION) return applyUnion3D(node, children);
+	return applyOperator3D(node, children, op);
+}
+
+/*!
+	Applies a boolean operator to the given children using the selected backend.
+*/
+GeometryEvaluator::ResultObject GeometryEvaluator::applyOperator3D(const AbstractNode &node, const Geometry::ChildList &deferredchildren, OpenSCADOperator op)
+{
+	Geometry::ChildList children = foldTransforms(deferredchildren);
+	if (this->backend == BACKEND_MESH &&
+			(op == OPENSCAD_UNION || op == OPENSCAD_INTERSECTION || op == OPENSCAD_DIFFERENCE)) {
+		if (PolySet *ps = MeshBoolean::applyOperator(children, op)) {
+			this->stats.meshoperations++;
+			return ResultObject(ps);
+		}
+		PRINTDB("Mesh boolean failed, falling back to Nef: %s", node.toString());
+		this->stats.meshfallbacks++;
 	}
 
 	CGAL_Nef_polyhedron *N = CGALUtils::applyOperator(children, op);
@@ -139,6 +520,114 @@ GeometryEvaluator::ResultObject GeometryEvaluator::applyToChildren3D(const Abstr
 	return ResultObject(N);
 }
 
+static int find_cluster(std::vector<int> &parent, int i)
+{
+	while (parent[i] != i) i = parent[i] = parent[parent[i]];
+	return i;
+}
+
+struct BoundingBoxMinXCompare {
+	BoundingBoxMinXCompare(const std::vector<BoundingBox> &bboxes) : bboxes(bboxes) {}
+	bool operator()(int a, int b) const { return this->bboxes[a].min()[0] < this->bboxes[b].min()[0]; }
+	const std::vector<BoundingBox> &bboxes;
+};
+
+/*!
+	Union of 3D children. Children are clustered by overlapping bounding
+	boxes, and only clusters with more than one member need a boolean
+	operation. Since clusters don't touch each other, the result is the
+	concatenation of the clusters' meshes. Nef results of overlapping
+	clusters are converted to meshes for this. Nef polyhedra among the
+	children are kept exact; if there are any, they are joined with the
+	concatenated meshes by a single Nef union.
+*/
+GeometryEvaluator::ResultObject GeometryEvaluator::applyUnion3D(const AbstractNode &node, const Geometry::ChildList &children)
+{
+	std::vector<Geometry::ChildItem> actualchildren;
+	std::vector<BoundingBox> bboxes;
+	BOOST_FOREACH(const Geometry::ChildItem &item, children) {
+		if (!item.second || item.second->isEmpty()) continue;
+		bboxes.push_back(item.second->getBoundingBox());
+		actualchildren.push_back(item);
+	}
+	if (actualchildren.size() < 2) return applyOperator3D(node, children, OPENSCAD_UNION);
+
+	// Sweep along x, joining children with overlapping or touching bounding boxes
+	std::vector<int> order(actualchildren.size());
+	std::vector<int> parent(actualchildren.size());
+	for (size_t i=0;i<order.size();i++) order[i] = parent[i] = i;
+	std::sort(order.begin(), order.end(), BoundingBoxMinXCompare(bboxes));
+	for (size_t i=0;i<order.size();i++) {
+		const BoundingBox &bbox = bboxes[order[i]];
+		for (size_t j=i+1;j<order.size() && bboxes[order[j]].min()[0] <= bbox.max()[0];j++) {
+			if (!bbox.intersection(bboxes[order[j]]).isEmpty()) {
+				parent[find_cluster(parent, order[j])] = find_cluster(parent, order[i]);
+			}
+		}
+	}
+
+	std::map<int, Geometry::ChildList> clusters;
+	for (size_t i=0;i<actualchildren.size();i++) {
+		clusters[find_cluster(parent, i)].push_back(actualchildren[i]);
+	}
+	this->stats.unionchildren += actualchildren.size();
+	if (clusters.size() == 1) return applyOperator3D(node, children, OPENSCAD_UNION);
+
+	PolySet *ps = new PolySet(3);
+	Geometry::ChildList nefchildren;
+	unsigned int fastpath = 0;
+	for (std::map<int, Geometry::ChildList>::iterator it = clusters.begin(); it != clusters.end(); it++) {
+		shared_ptr<const Geometry> geom;
+		if (it->second.size() == 1) {
+			fastpath++;
+			geom = it->second.front().second;
+			if (const TransformedGeometry *tg = dynamic_cast<const TransformedGeometry *>(geom.get())) {
+				// Transform while appending, rather than copying first
+				if (const PolySet *childps = dynamic_cast<const PolySet *>(tg->getBase().get())) {
+					ps->setConvexity(std::max(ps->getConvexity(), tg->getConvexity()));
+					ps->append(*childps, tg->getMatrix());
+					continue;
+				}
+				geom = foldTransform(geom);
+			}
+		}
+		else {
+			geom = applyOperator3D(node, it->second, OPENSCAD_UNION).constptr();
+			// Overlapping clusters are only joined with the others by concatenation,
+			// so their Nef results are converted rather than unioned again
+			const CGAL_Nef_polyhedron *N = dynamic_cast<const CGAL_Nef_polyhedron *>(geom.get());
+			if (N && !N->isEmpty()) {
+				PolySet clusterps(3);
+				if (!CGALUtils::createPolySetFromNefPolyhedron3(*N->p3, clusterps)) {
+					ps->setConvexity(std::max(ps->getConvexity(), N->getConvexity()));
+					ps->append(clusterps);
+					continue;
+				}
+			}
+		}
+		if (const PolySet *childps = dynamic_cast<const PolySet *>(geom.get())) {
+			ps->setConvexity(std::max(ps->getConvexity(), geom->getConvexity()));
+			ps->append(*childps);
+		}
+		else {
+			// Nef polyhedra stay exact and are joined below
+			nefchildren.push_back(std::make_pair(it->second.front().first, geom));
+		}
+	}
+	PRINTDB("Union fast path: %d clusters, %d children without overlap", clusters.size() % fastpath);
+	this->stats.unionfastpath += fastpath;
+	if (nefchildren.empty()) return ResultObject(ps);
+
+	// Nef polyhedra can't be concatenated, so the Nef clusters and the
+	// concatenated meshes need one (cheap, since disjoint) Nef union
+	if (ps->isEmpty()) delete ps;
+	else nefchildren.push_back(std::make_pair(&node, shared_ptr<const Geometry>(ps)));
+	if (nefchildren.size() == 1) return ResultObject(nefchildren.front().second);
+	CGAL_Nef_polyhedron *N = CGALUtils::applyOperator(nefchildren, OPENSCAD_UNION);
+	if (!N) N = new CGAL_Nef_polyhedron;
+	return ResultObject(N);
+}
+
 
 
 /*!
@@ -178,7 +667,7 @@ Polygon2d *GeometryEvaluator::applyHull2D(const AbstractNode &node)
 
 Geometry *GeometryEvaluator::applyHull3D(const AbstractNode &node)
 {
-	Geometry::ChildList children = collectChildren3D(node);
+	Geometry::ChildList children = foldTransforms(collectChildren3D(node));
 
 	PolySet *P = new PolySet(3);
 	if (CGALUtils::applyHull(children, *P)) {
@@ -234,30 +723,101 @@ std::vector<const class Polygon2d *> GeometryEvaluator::collectChildren2D(const
 	Since we can generate both Nef and non-Nef geometry, we need to insert it into
 	the appropriate cache.
 	This method inserts the geometry into the appropriate cache if it's not already cached.
+
+	Results of operations are also written to the persistent cache, if enabled.
+	Leaf nodes and deferred transformations are cheaper to recreate than to
+	load, so they're not persisted.
 */
 void GeometryEvaluator::smartCacheInsert(const AbstractNode &node, 
 																				 const shared_ptr<const Geometry> &geom)
 {
 	const std::string &key = this->tree.getIdString(node);
 
+	bool inserted = false;
 	shared_ptr<const CGAL_Nef_polyhedron> N = dynamic_pointer_cast<const CGAL_Nef_polyhedron>(geom);
 	if (N) {
-		if (!CGALCache::instance()->contains(key)) CGALCache::instance()->insert(key, N);
+		if (!CGALCache::instance()->contains(key)) {
+			CGALCache::instance()->insert(key, N);
+			inserted = true;
+		}
 	}
 	else {
 		if (!GeometryCache::instance()->contains(key)) {
 			if (!GeometryCache::instance()->insert(key, geom)) {
 				PRINT("WARNING: GeometryEvaluator: Node didn't fit into cache");
 			}
+			inserted = true;
 		}
 	}
+	if (inserted && geom && !node.getChildren().empty() && DiskCache::instance()->isEnabled() &&
+			!dynamic_cast<const TransformedGeometry *>(geom.get())) {
+		DiskCache::instance()->insert(key, geom);
+	}
+}
+
+/*!
+	Loads geometry from the persistent cache and makes it available in the
+	in-memory caches. Returns false if not found.
+*/
+static bool load_from_disk_cache(const std::string &key, shared_ptr<const Geometry> &geom)
+{
+	if (!DiskCache::instance()->isEnabled()) return false;
+	if (!DiskCache::instance()->lookup(key, geom)) return false;
+	shared_ptr<const CGAL_Nef_polyhedron> N = dynamic_pointer_cast<const CGAL_Nef_polyhedron>(geom);
+	if (N) return CGALCache::instance()->insert(key, N);
+	return GeometryCache::instance()->insert(key, geom);
+}
+
+/*!
+	Looks up the cached geometry of \a node. Unlike isSmartCached() followed by
+	smartCacheGet(), this cannot be affected by concurrent cache evictions.
+
+	Only hits are counted: On a miss, the node is evaluated by a visitor,
+	which counts the miss in smartCacheMiss().
+*/
+bool GeometryEvaluator::smartCacheLookup(const AbstractNode &node, bool preferNef,
+																				 shared_ptr<const Geometry> &geom)
+{
+	const std::string &key = this->tree.getIdString(node);
+	shared_ptr<const CGAL_Nef_polyhedron> N;
+	shared_ptr<const Geometry> G;
+	bool hasnef = CGALCache::instance()->lookup(key, N);
+	bool hasgeom = GeometryCache::instance()->lookup(key, G);
+	if (hasnef && (preferNef || !hasgeom)) {
+		geom = N;
+		CGALCache::instance()->recordHit();
+	}
+	else if (hasgeom) {
+		geom = G;
+		GeometryCache::instance()->recordHit();
+	}
+	else {
+		load_from_disk_cache(key, geom);
+		return geom.get() != NULL;
+	}
+	return true;
 }
 
 bool GeometryEvaluator::isSmartCached(const AbstractNode &node)
 {
 	const std::string &key = this->tree.getIdString(node);
-	return (GeometryCache::instance()->contains(key) ||
-					CGALCache::instance()->contains(key));
+	if (GeometryCache::instance()->contains(key) ||
+			CGALCache::instance()->contains(key)) return true;
+	shared_ptr<const Geometry> geom;
+	return load_from_disk_cache(key, geom);
+}
+
+/*!
+	Returns true if \a node isn't cached and has to be evaluated. Each
+	node is looked up once this way, so the miss is counted here, in both
+	caches. Hits are counted by smartCacheGet().
+*/
+bool GeometryEvaluator::smartCacheMiss(const AbstractNode &node)
+{
+	if (isSmartCached(node)) return false;
+	GeometryCache::instance()->recordMiss();
+	CGALCache::instance()->recordMiss();
+	return true;
 }
 
 shared_ptr<const Geometry> GeometryEvaluator::smartCacheGet(const AbstractNode &node, bool preferNef)
@@ -266,8 +826,14 @@ shared_ptr<const Geometry> GeometryEvaluator::smartCacheGet(const AbstractNode &
 	shared_ptr<const Geometry> geom;
 	bool hasgeom = GeometryCache::instance()->contains(key);
 	bool hascgal = CGALCache::instance()->contains(key);
-	if (hascgal && (preferNef || !hasgeom)) geom = CGALCache::instance()->get(key);
-	else if (hasgeom) geom = GeometryCache::instance()->get(key);
+	if (hascgal && (preferNef || !hasgeom)) {
+		geom = CGALCache::instance()->get(key);
+		CGALCache::instance()->recordHit();
+	}
+	else if (hasgeom) {
+		geom = GeometryCache::instance()->get(key);
+		GeometryCache::instance()->recordHit();
+	}
 	return geom;
 }
 
@@ -376,11 +942,12 @@ Response GeometryEvaluator::visit(State &state, const AbstractNode &node)
 {
 	if (state.isPrefix()) {
 		if (isSmartCached(node)) return PruneTraversal;
-		state.setPreferNef(true); // Improve quality of CSG by avoiding conversion loss
+		// Improve quality of CSG by avoiding conversion loss
+		state.setPreferNef(this->backend == BACKEND_NEF);
 	}
 	if (state.isPostfix()) {
 		shared_ptr<const class Geometry> geom;
-		if (!isSmartCached(node)) {
+		if (smartCacheMiss(node)) {
 			geom = applyToChildren(node, OPENSCAD_UNION).constptr();
 		}
 		else {
@@ -396,7 +963,7 @@ Response GeometryEvaluator::visit(State &state, const OffsetNode &node)
 	if (state.isPrefix() && isSmartCached(node)) return PruneTraversal;
 	if (state.isPostfix()) {
 		shared_ptr<const Geometry> geom;
-		if (!isSmartCached(node)) {
+		if (smartCacheMiss(node)) {
 			const Geometry *geometry = applyToChildren2D(node, OPENSCAD_UNION);
 			if (geometry) {
 				const Polygon2d *polygon = dynamic_cast<const Polygon2d*>(geometry);
@@ -425,12 +992,13 @@ Response GeometryEvaluator::visit(State &state, const RenderNode &node)
 {
 	if (state.isPrefix()) {
 		if (isSmartCached(node)) return PruneTraversal;
-		state.setPreferNef(true); // Improve quality of CSG by avoiding conversion loss
+		// Improve quality of CSG by avoiding conversion loss
+		state.setPreferNef(this->backend == BACKEND_NEF);
 	}
 	if (state.isPostfix()) {
 		shared_ptr<const class Geometry> geom;
-		if (!isSmartCached(node)) {
-			ResultObject res = applyToChildren(node, OPENSCAD_UNION);
+		if (smartCacheMiss(node)) {
+			ResultObject res = foldTransform(applyToChildren(node, OPENSCAD_UNION));
 
 			geom = res.constptr();
 			if (shared_ptr<const PolySet> ps = dynamic_pointer_cast<const PolySet>(geom)) {
@@ -468,7 +1036,7 @@ Response GeometryEvaluator::visit(State &state, const LeafNode &node)
 {
 	if (state.isPrefix()) {
 		shared_ptr<const Geometry> geom;
-		if (!isSmartCached(node)) {
+		if (smartCacheMiss(node)) {
 			const Geometry *geometry = node.createGeometry();
             assert(geometry);
 			if (const Polygon2d *polygon = dynamic_cast<const Polygon2d*>(geometry)) {
@@ -490,7 +1058,7 @@ Response GeometryEvaluator::visit(State &state, const TextNode &node)
 {
 	if (state.isPrefix()) {
 		shared_ptr<const Geometry> geom;
-		if (!isSmartCached(node)) {
+		if (smartCacheMiss(node)) {
 			std::vector<const Geometry *> geometrylist = node.createGeometryList();
 			std::vector<const Polygon2d *> polygonlist;
 			BOOST_FOREACH(const Geometry *geometry, geometrylist) {
@@ -500,7 +1068,7 @@ Response GeometryEvaluator::visit(State &state, const TextNode &node)
 			}
 			geom.reset(ClipperUtils::apply(polygonlist, ClipperLib::ctUnion));
 		}
-		else geom = GeometryCache::instance()->get(this->tree.getIdString(node));
+		else geom = smartCacheGet(node, false);
 		addToParent(state, node, geom);
 	}
 	return PruneTraversal;
@@ -517,11 +1085,12 @@ Response GeometryEvaluator::visit(State &state, const CsgNode &node)
 {
 	if (state.isPrefix()) {
 		if (isSmartCached(node)) return PruneTraversal;
-		state.setPreferNef(true); // Improve quality of CSG by avoiding conversion loss
+		// Improve quality of CSG by avoiding conversion loss
+		state.setPreferNef(this->backend == BACKEND_NEF);
 	}
 	if (state.isPostfix()) {
 		shared_ptr<const Geometry> geom;
-		if (!isSmartCached(node)) {
+		if (smartCacheMiss(node)) {
 			geom = applyToChildren(node, node.type).constptr();
 		}
 		else {
@@ -544,7 +1113,7 @@ Response GeometryEvaluator::visit(State &state, const TransformNode &node)
 	if (state.isPrefix() && isSmartCached(node)) return PruneTraversal;
 	if (state.isPostfix()) {
 		shared_ptr<const class Geometry> geom;
-		if (!isSmartCached(node)) {
+		if (smartCacheMiss(node)) {
 			if (matrix_contains_infinity(node.matrix) || matrix_contains_nan(node.matrix)) {
 				// due to the way parse/eval works we can't currently distinguish between NaN and Inf
 				PRINT("WARNING: Transformation matrix contains Not-a-Number and/or Infinity - removing object.");
@@ -575,25 +1144,21 @@ Response GeometryEvaluator::visit(State &state, const TransformNode &node)
 							geom.reset(ClipperUtils::sanitize(*newpoly));
 						}
 					}
+					else if (geom->getDimension() == 3 && res.isConst()) {
+						// The geometry is shared, e.g. with the cache. Rather than
+						// copying it, defer the transformation until needed.
+						geom.reset(new TransformedGeometry(geom, node.matrix));
+						this->stats.deferredtransforms++;
+					}
 					else if (geom->getDimension() == 3) {
-						shared_ptr<const PolySet> ps = dynamic_pointer_cast<const PolySet>(geom);
-						if (ps) {
-							// If we got a const object, make a copy
-							shared_ptr<PolySet> newps;
-							if (res.isConst()) newps.reset(new PolySet(*ps));
-							else newps = dynamic_pointer_cast<PolySet>(res.ptr());
+						// We got a new object, transform it in place
+						if (shared_ptr<PolySet> newps = dynamic_pointer_cast<PolySet>(res.ptr())) {
 							newps->transform(node.matrix);
-							geom = newps;
 						}
 						else {
-							shared_ptr<const CGAL_Nef_polyhedron> N = dynamic_pointer_cast<const CGAL_Nef_polyhedron>(geom);
-							assert(N);
-							// If we got a const object, make a copy
-							shared_ptr<CGAL_Nef_polyhedron> newN;
-							if (res.isConst()) newN.reset((CGAL_Nef_polyhedron*)N->copy());
-							else newN = dynamic_pointer_cast<CGAL_Nef_polyhedron>(res.ptr());
+							shared_ptr<CGAL_Nef_polyhedron> newN = dynamic_pointer_cast<CGAL_Nef_polyhedron>(res.ptr());
+							assert(newN);
 							newN->transform(node.matrix);
-							geom = newN;
 						}
 					}
 				}
@@ -609,11 +1174,7 @@ Response GeometryEvaluator::visit(State &state, const TransformNode &node)
 
 static void translate_PolySet(PolySet &ps, const Vector3d &translation)
 {
-	BOOST_FOREACH(Polygon &p, ps.polygons) {
-		BOOST_FOREACH(Vector3d &v, p) {
-			v += translation;
-		}
-	}
+	ps.transform(Transform3d(Eigen::Translation3d(translation)));
 }
 
 static void add_slice(PolySet *ps, const Polygon2d &poly, 
@@ -687,9 +1248,7 @@ static Geometry *extrudePolygon(const LinearExtrudeNode &node, const Polygon2d &
 	PolySet *ps_bottom = poly.tessellate(); // bottom
 	
 	// Flip vertex ordering for bottom polygon
-	BOOST_FOREACH(Polygon &p, ps_bottom->polygons) {
-		std::reverse(p.begin(), p.end());
-	}
+	ps_bottom->reverseFaces();
 	translate_PolySet(*ps_bottom, Vector3d(0,0,h1));
 
 	ps->append(*ps_bottom);
@@ -733,7 +1292,7 @@ Response GeometryEvaluator::visit(State &state, const LinearExtrudeNode &node)
 	if (state.isPrefix() && isSmartCached(node)) return PruneTraversal;
 	if (state.isPostfix()) {
 		shared_ptr<const Geometry> geom;
-		if (!isSmartCached(node)) {
+		if (smartCacheMiss(node)) {
 			const Geometry *geometry = NULL;
 			if (!node.filename.empty()) {
 				DxfData dxf(node.fn, node.fs, node.fa, node.filename, node.layername, node.origin_x, node.origin_y, node.scale_x);
@@ -843,7 +1402,7 @@ Response GeometryEvaluator::visit(State &state, const RotateExtrudeNode &node)
 	if (state.isPrefix() && isSmartCached(node)) return PruneTraversal;
 	if (state.isPostfix()) {
 		shared_ptr<const Geometry> geom;
-		if (!isSmartCached(node)) {
+		if (smartCacheMiss(node)) {
 			const Geometry *geometry = NULL;
 			if (!node.filename.empty()) {
 				DxfData dxf(node.fn, node.fs, node.fa, node.filename, node.layername, node.origin_x, node.origin_y, node.scale);
@@ -889,18 +1448,16 @@ Response GeometryEvaluator::visit(State &state, const ProjectionNode &node)
 	if (state.isPrefix() && isSmartCached(node)) return PruneTraversal;
 	if (state.isPostfix()) {
 		shared_ptr<const class Geometry> geom;
-		if (!isSmartCached(node)) {
+		if (smartCacheMiss(node)) {
 
 			if (!node.cut_mode) {
-				ClipperLib::Clipper sumclipper;
+				std::vector<shared_ptr<const PolySet> > polysets;
 				BOOST_FOREACH(const Geometry::ChildItem &item, this->visitedchildren[node.index()]) {
 					const AbstractNode *chnode = item.first;
-					const shared_ptr<const Geometry> &chgeom = item.second;
+					const shared_ptr<const Geometry> chgeom = foldTransform(item.second);
 					// FIXME: Don't use deep access to modinst members
 					if (chnode->modinst->isBackground()) continue;
 
-					const Polygon2d *poly = NULL;
-
 // CGAL version of Geometry projection
 // Causes crashes in createNefPolyhedronFromGeometry() for this model:
 // projection(cut=false) {
@@ -911,6 +1468,7 @@ Response GeometryEvaluator::visit(State &state, const ProjectionNode &node)
 //    }
 // }
 #if 0
+					const Polygon2d *poly = NULL;
 					shared_ptr<const PolySet> chPS = dynamic_pointer_cast<const PolySet>(chgeom);
 					const PolySet *ps2d = NULL;
 					shared_ptr<const CGAL_Nef_polyhedron> chN = dynamic_pointer_cast<const CGAL_Nef_polyhedron>(chgeom);
@@ -941,28 +1499,15 @@ Response GeometryEvaluator::visit(State &state, const ProjectionNode &node)
 							}
 						}
 					}
-					if (chPS) poly = PolysetUtils::project(*chPS);
+					if (chPS) polysets.push_back(chPS);
 #endif
-
-					if (poly) {
-						ClipperLib::Paths result = ClipperUtils::fromPolygon2d(*poly);
-						// Using NonZero ensures that we don't create holes from polygons sharing
-						// edges since we're unioning a mesh
-						result = ClipperUtils::process(result, 
-																					 ClipperLib::ctUnion, 
-																					 ClipperLib::pftNonZero);
-						// Add correctly winded polygons to the main clipper
-						sumclipper.AddPaths(result, ClipperLib::ptSubject, true);
-					}
 				}
-				ClipperLib::PolyTree sumresult;
-				// This is key - without StrictlySimple, we tend to get self-intersecting results
-				sumclipper.StrictlySimple(true);
-				sumclipper.Execute(ClipperLib::ctUnion, sumresult, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
-				if (sumresult.Total() > 0) geom.reset(ClipperUtils::toPolygon2d(sumresult));
+				std::vector<const PolySet *> chpolysets;
+				BOOST_FOREACH(const shared_ptr<const PolySet> &ps, polysets) chpolysets.push_back(ps.get());
+				geom.reset(PolysetUtils::projectUnion(chpolysets));
 			}
 			else {
-				shared_ptr<const Geometry> newgeom = applyToChildren3D(node, OPENSCAD_UNION).constptr();
+				shared_ptr<const Geometry> newgeom = foldTransform(applyToChildren3D(node, OPENSCAD_UNION).constptr());
 				if (newgeom) {
 					shared_ptr<const CGAL_Nef_polyhedron> Nptr = dynamic_pointer_cast<const CGAL_Nef_polyhedron>(newgeom);
 					if (!Nptr) {
@@ -997,7 +1542,7 @@ Response GeometryEvaluator::visit(State &state, const CgaladvNode &node)
 	if (state.isPrefix() && isSmartCached(node)) return PruneTraversal;
 	if (state.isPostfix()) {
 		shared_ptr<const Geometry> geom;
-		if (!isSmartCached(node)) {
+		if (smartCacheMiss(node)) {
 			switch (node.type) {
 			case MINKOWSKI: {
 				ResultObject res = applyToChildren(node, OPENSCAD_MINKOWSKI);
@@ -1018,7 +1563,7 @@ Response GeometryEvaluator::visit(State &state, const CgaladvNode &node)
 				break;
 			}
 			case RESIZE: {
-				ResultObject res = applyToChildren(node, OPENSCAD_UNION);
+				ResultObject res = foldTransform(applyToChildren(node, OPENSCAD_UNION));
 				geom = res.constptr();
 				if (geom) {
 					shared_ptr<Geometry> editablegeom;
@@ -1066,11 +1611,12 @@ Response GeometryEvaluator::visit(State &state, const AbstractIntersectionNode &
 {
 	if (state.isPrefix()) {
 		if (isSmartCached(node)) return PruneTraversal;
-		state.setPreferNef(true); // Improve quality of CSG by avoiding conversion loss
+		// Improve quality of CSG by avoiding conversion loss
+		state.setPreferNef(this->backend == BACKEND_NEF);
 	}
 	if (state.isPostfix()) {
 		shared_ptr<const class Geometry> geom;
-		if (!isSmartCached(node)) {
+		if (smartCacheMiss(node)) {
 			geom = applyToChildren(node, OPENSCAD_INTERSECTION).constptr();
 		}
 		else {
@@ -18,6 +18,17 @@ public:
 
 	shared_ptr<const Geometry> evaluateGeometry(const AbstractNode &node, bool allownef);
 
+	/*! Number of threads used for evaluating independent subtrees. 1 means
+	    serial evaluation, 0 means one thread per core. */
+	void setNumJobs(unsigned int jobs) { this->numjobs = jobs; }
+	unsigned int numJobs() const { return this->numjobs; }
+
+	/*! Engine used for 3D union, intersection and difference. The mesh
+	    backend falls back to Nef polyhedra on failure. */
+	enum Backend { BACKEND_NEF, BACKEND_MESH };
+	void setBackend(Backend backend) { this->backend = backend; }
+	Backend getBackend() const { return this->backend; }
+
 	virtual Response visit(State &state, const AbstractNode &node);
 	virtual Response visit(State &state, const AbstractIntersectionNode &node);
 	virtual Response visit(State &state, const AbstractPolyNode &node);
@@ -55,7 +66,9 @@ private:
 
 	void smartCacheInsert(const AbstractNode &node, const shared_ptr<const Geometry> &geom);
 	shared_ptr<const Geometry> smartCacheGet(const AbstractNode &node, bool preferNef);
+	bool smartCacheLookup(const AbstractNode &node, bool preferNef, shared_ptr<const Geometry> &geom);
 	bool isSmartCached(const AbstractNode &node);
+	bool smartCacheMiss(const AbstractNode &node);
 	std::vector<const class Polygon2d *> collectChildren2D(const AbstractNode &node);
 	Geometry::ChildList collectChildren3D(const AbstractNode &node);
 	Polygon2d *applyMinkowski2D(const AbstractNode &node);
@@ -64,12 +77,50 @@ private:
 	void applyResize3D(class CGAL_Nef_polyhedron &N, const Vector3d &newsize, const Eigen::Matrix<bool,3,1> &autosize);
 	Polygon2d *applyToChildren2D(const AbstractNode &node, OpenSCADOperator op);
 	ResultObject applyToChildren3D(const AbstractNode &node, OpenSCADOperator op);
+	ResultObject applyOperator3D(const AbstractNode &node, const Geometry::ChildList &children, OpenSCADOperator op);
+	ResultObject applyUnion3D(const AbstractNode &node, const Geometry::ChildList &children);
 	ResultObject applyToChildren(const AbstractNode &node, OpenSCADOperator op);
 	void addToParent(const State &state, const AbstractNode &node, const shared_ptr<const Geometry> &geom);
+	Geometry *applyTransform(const class TransformedGeometry &tg);
+	shared_ptr<const Geometry> foldTransform(const shared_ptr<const Geometry> &geom);
+	Geometry::ChildList foldTransforms(const Geometry::ChildList &children);
+	ResultObject foldTransform(const ResultObject &res);
+	shared_ptr<const Geometry> foldCachedTransform(const AbstractNode &node, const shared_ptr<const Geometry> &geom);
+
+	struct ParallelJob;
+	struct ParallelContext;
+	shared_ptr<const Geometry> evaluateParallel(const AbstractNode &node);
+	ParallelJob *scheduleJob(ParallelContext &ctx, const AbstractNode &node, bool preferNef, ParallelJob *parent);
+	void evaluateJobPrefix(ParallelContext &ctx, ParallelJob *job);
+	void evaluateJobPostfix(ParallelContext &ctx, ParallelJob *job);
+	void childDone(ParallelContext &ctx, ParallelJob *job);
+	void finishJob(ParallelContext &ctx, ParallelJob *job);
 
 	std::map<int, Geometry::ChildList> visitedchildren;
 	const Tree &tree;
 	shared_ptr<const Geometry> root;
+	unsigned int numjobs;
+	Backend backend;
+
+	// Counters reported after each evaluation
+	struct Statistics {
+		Statistics() : meshoperations(0), meshfallbacks(0), unionchildren(0), unionfastpath(0),
+									 deferredtransforms(0), foldedtransforms(0) {}
+		void add(const Statistics &other);
+		// Boolean operations done using the mesh backend, and fallbacks to Nef
+		unsigned int meshoperations;
+		unsigned int meshfallbacks;
+		// Children of 3D unions, and how many of them didn't need a boolean
+		// operation with a sibling since they don't overlap any
+		unsigned int unionchildren;
+		unsigned int unionfastpath;
+		// 3D transformations which were deferred instead of copying the
+		// geometry, and how many times a deferred transformation was applied
+		unsigned int deferredtransforms;
+		unsigned int foldedtransforms;
+	};
+	Statistics stats;
+	void printStatistics() const;
 
 public:
 };
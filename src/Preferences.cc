@@ -31,6 +31,7 @@
 #include <QKeyEvent>
 #include <QSettings>
 #include <QStatusBar>
+#include <QRegExpValidator>
 #include <boost/algorithm/string.hpp>
 #include "GeometryCache.h"
 #include "AutoUpdater.h"
@@ -161,9 +162,9 @@ void Preferences::init() {
 	// Setup default settings
 	this->defaultmap["advanced/opencsg_show_warning"] = true;
 	this->defaultmap["advanced/enable_opencsg_opengl1x"] = true;
-	this->defaultmap["advanced/polysetCacheSize"] = uint(GeometryCache::instance()->maxSize());
+	this->defaultmap["advanced/polysetCacheSize"] = qulonglong(GeometryCache::instance()->maxSize());
 #ifdef ENABLE_CGAL
-	this->defaultmap["advanced/cgalCacheSize"] = uint(CGALCache::instance()->maxSize());
+	this->defaultmap["advanced/cgalCacheSize"] = qulonglong(CGALCache::instance()->maxSize());
 #endif
 	this->defaultmap["advanced/openCSGLimit"] = RenderSettings::inst()->openCSGTermLimit;
 	this->defaultmap["advanced/forceGoldfeather"] = false;
@@ -198,10 +199,12 @@ void Preferences::init() {
 
   // Advanced pane	
 	QValidator *validator = new QIntValidator(this);
+	// Cache sizes are in bytes and may exceed the range of int
+	QValidator *sizevalidator = new QRegExpValidator(QRegExp("[0-9]{1,19}"), this);
 #ifdef ENABLE_CGAL
-	this->cgalCacheSizeEdit->setValidator(validator);
+	this->cgalCacheSizeEdit->setValidator(sizevalidator);
 #endif
-	this->polysetCacheSizeEdit->setValidator(validator);
+	this->polysetCacheSizeEdit->setValidator(sizevalidator);
 	this->opencsgLimitEdit->setValidator(validator);
 
 	initComboBox(this->comboBoxIndentUsing, Settings::Settings::indentStyle);
@@ -442,7 +445,7 @@ void Preferences::on_cgalCacheSizeEdit_textChanged(const QString &text)
 	QSettings settings;
 	settings.setValue("advanced/cgalCacheSize", text);
 #ifdef ENABLE_CGAL
-	CGALCache::instance()->setMaxSize(text.toULong());
+	CGALCache::instance()->setMaxSize(text.toULongLong());
 #endif
 }
 
@@ -450,7 +453,7 @@ void Preferences::on_polysetCacheSizeEdit_textChanged(const QString &text)
 {
 	QSettings settings;
 	settings.setValue("advanced/polysetCacheSize", text);
-	GeometryCache::instance()->setMaxSize(text.toULong());
+	GeometryCache::instance()->setMaxSize(text.toULongLong());
 }
 
 void Preferences::on_opencsgLimitEdit_textChanged(const QString &text)
@@ -0,0 +1,334 @@
+#include "RenderServer.h"
+#include "printutils.h"
+#include "boosty.h"
+
+#include <fstream>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace fs = boost::filesystem;
+
+RenderServer::RenderServer(const std::string &path, unsigned int maxconnections, const RenderFunction &render)
+	: path(path), maxconnections(maxconnections ? maxconnections : 1), render(render), clients(0), shutdown(false), jobcounter(0)
+{
+}
+
+#ifdef _WIN32
+
+std::string RenderServer::defaultSocketPath()
+{
+	PRINT("ERROR: --server is not supported on Windows");
+	return "";
+}
+
+int RenderServer::run()
+{
+	PRINT("ERROR: --server is not supported on Windows");
+	return 1;
+}
+
+void RenderServer::serveClient(int fd) {}
+int RenderServer::serve(int fd) { return 1; }
+
+#else
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/*!
+	Returns $OPENSCAD_SOCKET, or openscad.sock in $XDG_RUNTIME_DIR, or
+	server.sock in the directory /tmp/openscad-<uid>, which is created
+	private to the user. Returns an empty string if that directory exists,
+	but isn't private to the user. Keep this in sync with
+	scripts/openscad-client.py.
+*/
+std::string RenderServer::defaultSocketPath()
+{
+	const char *path = getenv("OPENSCAD_SOCKET");
+	if (path && *path) return path;
+	const char *runtimedir = getenv("XDG_RUNTIME_DIR");
+	if (runtimedir && *runtimedir) return boosty::stringy(fs::path(runtimedir) / "openscad.sock");
+
+	// Another user may have created the directory first, to listen in
+	const std::string dir = str(boost::format("/tmp/openscad-%d") % getuid());
+	struct stat st;
+	if (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST) {
+		PRINTB("ERROR: Can't create directory '%s': %s", dir % strerror(errno));
+		return "";
+	}
+	if (lstat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) ||
+			st.st_uid != getuid() || (st.st_mode & 077) != 0) {
+		PRINTB("ERROR: '%s' is not a directory private to this user", dir);
+		return "";
+	}
+	return dir + "/server.sock";
+}
+
+namespace /* anonymous */ {
+
+	bool write_all(int fd, const std::string &data)
+	{
+		size_t written = 0;
+		while (written < data.size()) {
+			ssize_t n = write(fd, data.data() + written, data.size() - written);
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) return false;
+			written += n;
+		}
+		return true;
+	}
+
+	class SocketReader
+	{
+	public:
+		SocketReader(int fd) : fd(fd) {}
+
+		bool readLine(std::string &line) {
+			size_t pos;
+			while ((pos = this->buffer.find('\n')) == std::string::npos) {
+				if (!fill()) return false;
+			}
+			line = this->buffer.substr(0, pos);
+			this->buffer.erase(0, pos + 1);
+			return true;
+		}
+
+		bool read(size_t n, std::string &data) {
+			while (this->buffer.size() < n) {
+				if (!fill()) return false;
+			}
+			data = this->buffer.substr(0, n);
+			this->buffer.erase(0, n);
+			return true;
+		}
+
+	private:
+		bool fill() {
+			char chunk[4096];
+			ssize_t n;
+			do {
+				n = ::read(this->fd, chunk, sizeof(chunk));
+			} while (n < 0 && errno == EINTR);
+			if (n <= 0) return false;
+			this->buffer.append(chunk, n);
+			return true;
+		}
+
+		int fd;
+		std::string buffer;
+	};
+
+	// Output handler forwarding console output of a job to its client
+	void send_log(const std::string &msg, void *userdata)
+	{
+		int fd = *static_cast<int *>(userdata);
+		std::vector<std::string> lines;
+		boost::split(lines, msg, boost::is_any_of("\n"));
+		std::string data;
+		BOOST_FOREACH(const std::string &line, lines) data += "log " + line + "\n";
+		write_all(fd, data);
+	}
+
+	bool valid_format(const std::string &format)
+	{
+		if (format.empty()) return false;
+		BOOST_FOREACH(char c, format) {
+			if (!isalnum(c)) return false;
+		}
+		return true;
+	}
+
+}
+
+int RenderServer::run()
+{
+	signal(SIGPIPE, SIG_IGN);
+
+	sockaddr_un addr;
+	if (this->path.size() >= sizeof(addr.sun_path)) {
+		PRINTB("ERROR: Socket path '%s' is too long", this->path);
+		return 1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, this->path.c_str());
+
+	int listenfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listenfd < 0) {
+		PRINTB("ERROR: Can't create socket: %s", strerror(errno));
+		return 1;
+	}
+	// Replace the socket of a server which is gone, but not of one which is running
+	if (connect(listenfd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0) {
+		PRINTB("ERROR: A server is already listening on '%s'", this->path);
+		close(listenfd);
+		return 1;
+	}
+	close(listenfd);
+	unlink(this->path.c_str());
+
+	// Only this user may connect and have jobs rendered with its permissions
+	listenfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	mode_t oldmask = umask(077);
+	bool bound = listenfd >= 0 && bind(listenfd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0;
+	umask(oldmask);
+	if (!bound || chmod(this->path.c_str(), 0600) != 0 || listen(listenfd, 16) != 0) {
+		PRINTB("ERROR: Can't listen on '%s': %s", this->path % strerror(errno));
+		if (listenfd >= 0) close(listenfd);
+		return 1;
+	}
+	// Outputs are written to a directory only we can access, so other users
+	// can't plant files or symlinks at their paths
+	const char *tmpdir = getenv("TMPDIR");
+	std::string workdir = boosty::stringy(fs::path(tmpdir && *tmpdir ? tmpdir : "/tmp") / "openscad-server-XXXXXX");
+	std::vector<char> workdirbuf(workdir.begin(), workdir.end());
+	workdirbuf.push_back('\0');
+	if (!mkdtemp(&workdirbuf[0])) {
+		PRINTB("ERROR: Can't create a directory for job outputs: %s", strerror(errno));
+		close(listenfd);
+		unlink(this->path.c_str());
+		return 1;
+	}
+	this->workdir = &workdirbuf[0];
+	PRINTB("Listening on %s", this->path);
+
+	while (true) {
+		{
+			boost::mutex::scoped_lock lock(this->mutex);
+			while (this->clients >= this->maxconnections && !this->shutdown) this->clientdone.wait(lock);
+			if (this->shutdown) break;
+		}
+		// Wake up regularly to notice a shutdown request
+		pollfd pfd;
+		pfd.fd = listenfd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, 250) <= 0) continue;
+		int fd = accept(listenfd, NULL, NULL);
+		if (fd < 0) continue;
+		{
+			boost::mutex::scoped_lock lock(this->mutex);
+			this->clients++;
+		}
+		boost::thread(boost::bind(&RenderServer::serveClient, this, fd)).detach();
+	}
+
+	close(listenfd);
+	unlink(this->path.c_str());
+	boost::mutex::scoped_lock lock(this->mutex);
+	while (this->clients > 0) this->clientdone.wait(lock);
+	boost::system::error_code ec;
+	fs::remove_all(this->workdir, ec);
+	PRINT("Server stopped");
+	return 0;
+}
+
+void RenderServer::serveClient(int fd)
+{
+	serve(fd);
+	close(fd);
+	boost::mutex::scoped_lock lock(this->mutex);
+	this->clients--;
+	this->clientdone.notify_all();
+}
+
+/*!
+	Reads one request from fd and sends the response. Returns the exit code
+	sent to the client.
+*/
+int RenderServer::serve(int fd)
+{
+	SocketReader reader(fd);
+	RenderJob job;
+	job.mode = "opencsg";
+	std::string line;
+	std::string error;
+	bool complete = false, stop = false;
+	while (!complete && reader.readLine(line)) {
+		std::string key = line.substr(0, line.find(' '));
+		std::string value = key.size() < line.size() ? line.substr(key.size() + 1) : "";
+		if (key == "file") job.filename = value;
+		else if (key == "source") {
+			std::string source;
+			try {
+				if (!reader.read(boost::lexical_cast<size_t>(value), source)) return 1;
+			}
+			catch (const boost::bad_lexical_cast &) {
+				error = "Invalid source length " + value;
+				break;
+			}
+			job.source = source;
+		}
+		else if (key == "D") job.commands += value + ";\n";
+		else if (key == "format") job.format = value;
+		else if (key == "mode") job.mode = value;
+		else if (key == "end") complete = true;
+		else if (key == "shutdown") stop = complete = true;
+		else {
+			error = "Unknown request " + key;
+			break;
+		}
+	}
+	if (!complete && error.empty()) return 1; // The client is gone
+
+	if (error.empty() && !stop) {
+		if (!boosty::is_absolute(fs::path(job.filename))) error = "The input file must be an absolute path";
+		else if (!valid_format(job.format)) error = "Invalid output format '" + job.format + "'";
+	}
+	if (!error.empty()) {
+		write_all(fd, "log ERROR: " + error + "\nresult 2 0\n");
+		return 2;
+	}
+	if (stop) {
+		boost::mutex::scoped_lock lock(this->mutex);
+		this->shutdown = true;
+		write_all(fd, "result 0 0\n");
+		return 0;
+	}
+
+	int rc = 1;
+	std::string output;
+	{
+		boost::mutex::scoped_lock lock(this->rendermutex);
+		unsigned int id = ++this->jobcounter;
+		std::string output_file = boosty::stringy(fs::path(this->workdir) / str(boost::format("job-%d.%s") % id % job.format));
+		boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+
+		OutputHandlerFunc *prevhandler = outputhandler;
+		void *prevdata = outputhandler_data;
+		set_output_handler(send_log, &fd);
+		try {
+			rc = this->render(job, output_file);
+		}
+		catch (const std::exception &e) {
+			PRINTB("ERROR: %s", e.what());
+			rc = 1;
+		}
+		set_output_handler(prevhandler, prevdata);
+
+		std::ifstream ifs(output_file.c_str(), std::ios::in | std::ios::binary);
+		if (ifs.is_open()) {
+			output.assign((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+			ifs.close();
+		}
+		boost::system::error_code ec;
+		fs::remove(output_file, ec);
+		double seconds = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+		PRINTB("Job %d: %s -> %s %s in %.3f s", id % job.filename % job.format % (rc == 0 ? "done" : "failed") % seconds);
+	}
+	write_all(fd, str(boost::format("result %d %d\n") % rc % output.size()) + output);
+	return rc;
+}
+
+#endif // _WIN32
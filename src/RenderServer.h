@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <boost/function.hpp>
+#include <boost/optional.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+/*!
+	A render or export request received by the RenderServer.
+*/
+struct RenderJob
+{
+	// Absolute path of the input file. Relative paths in the model are
+	// resolved against its directory.
+	std::string filename;
+	// Source to render instead of the contents of filename
+	boost::optional<std::string> source;
+	// Assignments, as passed with -D
+	std::string commands;
+	// Suffix of the output file, e.g. "stl"
+	std::string format;
+	// geometry, cgal, opencsg or throwntogether, like --render and --preview
+	std::string mode;
+};
+
+/*!
+	Serves render jobs on a UNIX domain socket, see --server and
+	scripts/openscad-client.py.
+
+	Requests and responses are line based. A request is a list of
+	<key> <value> lines terminated by "end":
+
+	  file <absolute path of the input file>
+	  source <n>          (optional, followed by n bytes of source)
+	  D <var=val>         (optional, repeatable)
+	  format <suffix>     (e.g. stl, off, png, csg, echo)
+	  mode <mode>         (optional, geometry, cgal, opencsg or throwntogether)
+	  end
+
+	The server streams any console output of the job as "log <line>" lines,
+	followed by "result <exit code> <n>" and the n bytes of the output file.
+	A request consisting of the single line "shutdown" stops the server once
+	the connected clients are done.
+
+	Caches are shared by all jobs, so a client benefits from everything
+	evaluated by earlier jobs. Up to maxconnections clients are connected at
+	once, e.g. to upload their requests, but the jobs themselves are rendered
+	one at a time, since parsing and instantiation use process wide state.
+	Geometry evaluation of each job is parallelized by --jobs.
+*/
+class RenderServer
+{
+public:
+	typedef boost::function<int (const RenderJob &job, const std::string &output_file)> RenderFunction;
+
+	RenderServer(const std::string &path, unsigned int maxconnections, const RenderFunction &render);
+
+	int run();
+
+	static std::string defaultSocketPath();
+
+private:
+	void serveClient(int fd);
+	int serve(int fd);
+
+	std::string path;
+	unsigned int maxconnections;
+	RenderFunction render;
+
+	boost::mutex mutex; // Guards clients and shutdown
+	boost::condition_variable clientdone;
+	unsigned int clients;
+	bool shutdown;
+
+	boost::mutex rendermutex; // Serializes jobs
+	unsigned int jobcounter;
+	// Private directory for the output files of jobs
+	std::string workdir;
+};
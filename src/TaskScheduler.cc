@@ -0,0 +1,134 @@
+#include "TaskScheduler.h"
+
+#include <boost/bind.hpp>
+
+// The schedulers aren't owned by the threads
+static void keepScheduler(TaskScheduler *) {}
+boost::thread_specific_ptr<TaskScheduler> TaskScheduler::currentscheduler(&keepScheduler);
+
+TaskScheduler::TaskScheduler(unsigned int numthreads)
+	: numthreads(numthreads), queued(0), stopping(false)
+{
+	for (unsigned int i=0;i<=numthreads;i++) this->queues.push_back(new Queue);
+	for (unsigned int i=0;i<numthreads;i++) {
+		this->workers.create_thread(boost::bind(&TaskScheduler::workerMain, this, i));
+	}
+}
+
+TaskScheduler::~TaskScheduler()
+{
+	{
+		boost::mutex::scoped_lock lock(this->mutex);
+		this->stopping = true;
+	}
+	this->cond.notify_all();
+	this->workers.join_all();
+	for (size_t i=0;i<this->queues.size();i++) delete this->queues[i];
+}
+
+unsigned int TaskScheduler::hardwareConcurrency()
+{
+	unsigned int n = boost::thread::hardware_concurrency();
+	return n > 0 ? n : 1;
+}
+
+TaskScheduler *TaskScheduler::current()
+{
+	return currentscheduler.get();
+}
+
+/*!
+	Returns the index of the queue owned by the calling thread.
+*/
+size_t TaskScheduler::currentQueue() const
+{
+	const size_t *idx = this->workerindex.get();
+	return idx ? *idx : this->numthreads;
+}
+
+void TaskScheduler::spawn(TaskGroup &group, const Task &task)
+{
+	Queue &q = *this->queues[currentQueue()];
+	{
+		boost::mutex::scoped_lock lock(this->mutex);
+		group.pending++;
+		this->queued++;
+		boost::mutex::scoped_lock qlock(q.mutex);
+		q.items.push_back(Item(task, &group));
+	}
+	this->cond.notify_one();
+}
+
+/*!
+	Executes one task, either from our own queue or stolen from another queue.
+	Returns false if all queues were empty.
+*/
+bool TaskScheduler::runOne(size_t self)
+{
+	Item item;
+	bool found = false;
+	{
+		Queue &q = *this->queues[self];
+		boost::mutex::scoped_lock qlock(q.mutex);
+		if (!q.items.empty()) {
+			item = q.items.back();
+			q.items.pop_back();
+			found = true;
+		}
+	}
+	for (size_t i=1;!found && i<this->queues.size();i++) {
+		Queue &q = *this->queues[(self + i) % this->queues.size()];
+		boost::mutex::scoped_lock qlock(q.mutex);
+		if (!q.items.empty()) {
+			item = q.items.front();
+			q.items.pop_front();
+			found = true;
+		}
+	}
+	if (!found) return false;
+
+	{
+		boost::mutex::scoped_lock lock(this->mutex);
+		this->queued--;
+	}
+	item.task();
+	{
+		boost::mutex::scoped_lock lock(this->mutex);
+		if (--item.group->pending == 0) this->cond.notify_all();
+	}
+	return true;
+}
+
+void TaskScheduler::workerMain(size_t self)
+{
+	this->workerindex.reset(new size_t(self));
+	currentscheduler.reset(this);
+	while (true) {
+		if (runOne(self)) continue;
+		boost::mutex::scoped_lock lock(this->mutex);
+		while (!this->stopping && this->queued <= 0) this->cond.wait(lock);
+		if (this->stopping && this->queued <= 0) return;
+	}
+}
+
+/*!
+	Waits for all tasks in the given group to finish.
+	While waiting, the calling thread helps executing queued tasks.
+*/
+void TaskScheduler::wait(TaskGroup &group)
+{
+	size_t self = currentQueue();
+	TaskScheduler *previous = currentscheduler.get();
+	currentscheduler.reset(this);
+	while (true) {
+		{
+			boost::mutex::scoped_lock lock(this->mutex);
+			if (group.pending == 0) break;
+		}
+		if (runOne(self)) continue;
+		boost::mutex::scoped_lock lock(this->mutex);
+		if (group.pending == 0) break;
+		if (this->queued <= 0) this->cond.wait(lock);
+	}
+	currentscheduler.reset(previous);
+}
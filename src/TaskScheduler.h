@@ -0,0 +1,83 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+/*!
+	A small work-stealing task scheduler.
+
+	Each worker thread owns a deque of tasks. A thread pushes tasks it spawns
+	to the back of its own deque and pops from the back (LIFO), while idle
+	workers steal from the front of other deques (FIFO). Threads which are not
+	workers of this scheduler share one extra deque.
+
+	Tasks are organized in TaskGroups. wait() doesn't block while there is
+	work left to do; the waiting thread executes pending tasks instead. This
+	allows tasks to spawn subtasks and wait for them without starving the pool.
+	Since any pending task may end up running on top of the waiting task, a
+	task may only wait for tasks which don't depend on tasks that are already
+	running, like its own subtasks. Other dependencies are expressed by
+	letting the last dependency spawn the dependent task.
+
+	Tasks must not throw exceptions.
+*/
+class TaskScheduler
+{
+public:
+	typedef boost::function<void()> Task;
+
+	class TaskGroup
+	{
+	public:
+		TaskGroup() : pending(0) {}
+	private:
+		friend class TaskScheduler;
+		unsigned int pending; // Guarded by TaskScheduler::mutex
+	};
+
+	TaskScheduler(unsigned int numthreads);
+	~TaskScheduler();
+
+	unsigned int numThreads() const { return this->numthreads; }
+
+	void spawn(TaskGroup &group, const Task &task);
+	void wait(TaskGroup &group);
+
+	static unsigned int hardwareConcurrency();
+
+	/*! The scheduler whose task the calling thread is executing, or NULL.
+	    Code running inside a task spawns its subtasks there instead of
+	    starting threads of its own. */
+	static TaskScheduler *current();
+
+private:
+	struct Item {
+		Item() : group(NULL) {}
+		Item(const Task &task, TaskGroup *group) : task(task), group(group) {}
+		Task task;
+		TaskGroup *group;
+	};
+
+	struct Queue {
+		boost::mutex mutex;
+		std::deque<Item> items;
+	};
+
+	size_t currentQueue() const;
+	bool runOne(size_t self);
+	void workerMain(size_t self);
+
+	unsigned int numthreads;
+	// queues[0..numthreads-1] belong to the workers, queues[numthreads] is shared by other threads
+	std::vector<Queue *> queues;
+	boost::thread_group workers;
+	boost::thread_specific_ptr<size_t> workerindex;
+	static boost::thread_specific_ptr<TaskScheduler> currentscheduler;
+
+	boost::mutex mutex;
+	boost::condition_variable cond;
+	int queued; // Number of tasks sitting in queues, guarded by mutex
+	bool stopping;
+};
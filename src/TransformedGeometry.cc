@@ -0,0 +1,42 @@
+#include "TransformedGeometry.h"
+#include "polyset.h"
+
+#include <sstream>
+#include <boost/foreach.hpp>
+
+/*!
+	If \a geom already has a deferred transformation, the matrices are
+	composed so the base geometry is never a TransformedGeometry.
+*/
+TransformedGeometry::TransformedGeometry(const shared_ptr<const Geometry> &geom, const Transform3d &matrix)
+	: base(geom), matrix(matrix)
+{
+	if (const TransformedGeometry *tg = dynamic_cast<const TransformedGeometry *>(geom.get())) {
+		this->base = tg->base;
+		this->matrix = matrix * tg->matrix;
+	}
+	this->convexity = geom->getConvexity();
+}
+
+/*!
+	Exact for PolySets. Other geometry gets the bounding box of its
+	transformed bounding box.
+*/
+BoundingBox TransformedGeometry::getBoundingBox() const
+{
+	if (const PolySet *ps = dynamic_cast<const PolySet *>(this->base.get())) {
+		BoundingBox bbox;
+		BOOST_FOREACH(const Vector3d &v, ps->getVertices()) bbox.extend(this->matrix * v);
+		return bbox;
+	}
+	return this->matrix * this->base->getBoundingBox();
+}
+
+std::string TransformedGeometry::dump() const
+{
+	std::stringstream out;
+	out << "TransformedGeometry:"
+			<< "\n matrix:\n" << this->matrix.matrix()
+			<< "\n base:\n" << this->base->dump();
+	return out.str();
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Geometry.h"
+#include "linalg.h"
+
+/*!
+	3D geometry with a deferred affine transformation.
+
+	Refers to a shared, immutable base geometry (a PolySet or a Nef
+	polyhedron) instead of copying it, so transformed instances of the same
+	object share one mesh in memory and in the caches. Nested transforms are
+	composed into one matrix.
+
+	GeometryEvaluator applies the transformation only when an operation
+	needs concrete coordinates, and never returns this type to its callers.
+*/
+class TransformedGeometry : public Geometry
+{
+public:
+	TransformedGeometry(const shared_ptr<const Geometry> &geom, const Transform3d &matrix);
+	virtual ~TransformedGeometry() {}
+
+	virtual size_t memsize() const { return sizeof(TransformedGeometry); }
+	virtual BoundingBox getBoundingBox() const;
+	virtual std::string dump() const;
+	virtual unsigned int getDimension() const { return 3; }
+	virtual bool isEmpty() const { return this->base->isEmpty(); }
+	virtual Geometry *copy() const { return new TransformedGeometry(*this); }
+
+	const shared_ptr<const Geometry> &getBase() const { return this->base; }
+	const Transform3d &getMatrix() const { return this->matrix; }
+
+private:
+	shared_ptr<const Geometry> base;
+	Transform3d matrix;
+};
@@ -1,16 +1,18 @@
 #include "Tree.h"
 #include "nodedumper.h"
 #include "printutils.h"
+#include "hash-utils.h"
+#include "module.h"
 
 #include <assert.h>
-#include <algorithm>
 #include <sstream>
-#include <boost/regex.hpp>
+#include <boost/foreach.hpp>
 
 Tree::~Tree()
 {
 	this->nodecache.clear();
 	this->nodeidcache.clear();
+	this->nodetextcache.clear();
 }
 
 /*!
@@ -22,7 +24,6 @@ const std::string &Tree::getString(const AbstractNode &node) const
 	assert(this->root_node);
 	if (!this->nodecache.contains(node)) {
 		this->nodecache.clear();
-		this->nodeidcache.clear();
 		NodeDumper dumper(this->nodecache, false);
 		Traverser trav(dumper, *this->root_node, Traverser::PRE_AND_POSTFIX);
 		trav.execute();
@@ -33,25 +34,45 @@ const std::string &Tree::getString(const AbstractNode &node) const
 }
 
 /*!
-	Returns the cached ID string representation of the subtree rooted by \a node.
-	If node is not cached, the cache will be rebuilt.
+	Returns the cached text of \a node itself, including the modifiers of its
+	children. Together with the IDs of the children, it determines the ID.
+*/
+const std::string &Tree::getNodeText(const AbstractNode &node) const
+{
+	if (!this->nodetextcache.contains(node)) {
+		std::stringstream sstream;
+		sstream << node;
+		BOOST_FOREACH(const AbstractNode *chnode, node.getChildren()) {
+			if (chnode->modinst->isBackground()) sstream << "%";
+			if (chnode->modinst->isHighlight()) sstream << "#";
+			sstream << ";";
+		}
+		return this->nodetextcache.insert(node, sstream.str());
+	}
+	return this->nodetextcache[node];
+}
+
+/*!
+	Returns the cached ID string of the subtree rooted by \a node, used as
+	a key for geometry caching.
 
-	The difference between this method and getString() is that the ID string
-	is stripped for whitespace. Especially indentation whitespace is important to
-	strip to enable cache hits for equivalent nodes from different scopes.
+	The ID is a Merkle-style 128-bit structural hash, computed bottom-up
+	from the node's own parameters and the IDs of its children, so the cost
+	is linear in the size of the tree. Equivalent subtrees from different
+	scopes get the same ID. Use getString() for a readable representation.
 */
 const std::string &Tree::getIdString(const AbstractNode &node) const
 {
 	assert(this->root_node);
 
 	if (!this->nodeidcache.contains(node)) {
-		const std::string &nodestr = getString(node);
-		const boost::regex re("[^\\s\\\"]+|\\\"(?:[^\\\"\\\\]|\\\\.)*\\\"");
-		std::stringstream sstream;
-		boost::sregex_token_iterator i(nodestr.begin(), nodestr.end(), re, 0);
-		std::copy(i, boost::sregex_token_iterator(), std::ostream_iterator<std::string>(sstream));
+		// Copy, as the cache may be resized by the recursion
+		std::string input = getNodeText(node);
+		BOOST_FOREACH(const AbstractNode *chnode, node.getChildren()) {
+			input += "{" + getIdString(*chnode) + "}";
+		}
 
-		const std::string & result = this->nodeidcache.insert(node, sstream.str());
+		const std::string &result = this->nodeidcache.insert(node, HashUtils::hash128(input).toString());
 		PRINTDB("Id Cache MISS: %s", result);
 		return result;
 	} else {
@@ -62,10 +83,67 @@ const std::string &Tree::getIdString(const AbstractNode &node) const
 }
 
 /*!
-	Sets a new root. Will clear the existing cache.
+	Appends the records of the subtree rooted by \a node to the previous
+	root. Nodes without an ID yet get an empty ID, which never matches.
+*/
+void Tree::recordNode(const AbstractNode &node)
+{
+	size_t index = this->previous.size();
+	NodeRecord record;
+	record.text = this->nodetextcache[node];
+	record.id = this->nodeidcache[node];
+	this->previous.push_back(record);
+	BOOST_FOREACH(const AbstractNode *chnode, node.getChildren()) {
+		recordNode(*chnode);
+	}
+	this->previous[index].end = this->previous.size();
+}
+
+/*!
+	Compares the subtree rooted by \a node against the record at \a previndex
+	of the previous root, matching children by position. If the node text
+	and all children are unchanged, the previous ID is reused. Returns true
+	in that case.
+
+	Children are compared even below changed nodes, so unchanged parts of a
+	changed subtree keep their IDs as well.
+*/
+bool Tree::reuseIdStrings(const AbstractNode &node, size_t previndex)
+{
+	const NodeRecord *prev = previndex < this->previous.size() ? &this->previous[previndex] : NULL;
+	bool unchanged = prev && !prev->id.empty() && getNodeText(node) == prev->text;
+	size_t chindex = previndex + 1;
+	BOOST_FOREACH(const AbstractNode *chnode, node.getChildren()) {
+		bool haschild = prev && chindex < prev->end;
+		unchanged = reuseIdStrings(*chnode, haschild ? chindex : this->previous.size()) && unchanged;
+		if (haschild) chindex = this->previous[chindex].end;
+	}
+	// Children were removed
+	if (prev && chindex < prev->end) unchanged = false;
+
+	if (unchanged) this->nodeidcache.insert(node, prev->id);
+	return unchanged;
+}
+
+/*!
+	Sets a new root. Will clear the existing caches.
+
+	The ID strings of the old root are remembered first, so its nodes must
+	still exist. Setting a NULL root in between keeps them until the next
+	non-NULL root has been compared against them.
  */
 void Tree::setRoot(const AbstractNode *root)
 {
+	if (this->root_node && this->nodeidcache.contains(*this->root_node)) {
+		this->previous.clear();
+		recordNode(*this->root_node);
+	}
 	this->root_node = root; 
 	this->nodecache.clear();
+	this->nodeidcache.clear();
+	this->nodetextcache.clear();
+	if (this->root_node && !this->previous.empty()) {
+		reuseIdStrings(*this->root_node, 0);
+		this->previous.clear();
+	}
 }
@@ -1,12 +1,17 @@
 #pragma once
 
 #include "nodecache.h"
+#include <vector>
 
 /*!  
 	For now, just an abstraction of the node tree which keeps a dump
 	cache based on node indices around.
 
 	Note that since node trees don't survive a recompilation, the tree cannot either.
+	It does however remember the ID strings of the previous root. When a new
+	root is set, it is compared against them, and unchanged subtrees get
+	their previous IDs without hashing them again. Their geometry is then
+	found in the geometry caches, so only changed paths are evaluated.
  */
 class Tree
 {
@@ -21,7 +26,21 @@ public:
 	const std::string &getIdString(const AbstractNode &node) const;
 
 private:
+	// A node of the previous root, in pre-order. The children of a record
+	// follow it, up to the index end.
+	struct NodeRecord {
+		std::string text;
+		std::string id;
+		size_t end;
+	};
+
+	const std::string &getNodeText(const AbstractNode &node) const;
+	void recordNode(const AbstractNode &node);
+	bool reuseIdStrings(const AbstractNode &node, size_t previndex);
+
 	const AbstractNode *root_node;
   mutable NodeCache nodecache;
   mutable NodeCache nodeidcache;
+	mutable NodeCache nodetextcache;
+	std::vector<NodeRecord> previous;
 };
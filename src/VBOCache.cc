@@ -0,0 +1,196 @@
+#include "VBOCache.h"
+#include "polyset.h"
+#include "printutils.h"
+
+#ifndef NULLGL
+
+VBOCache *VBOCache::inst = NULL;
+
+// Floats per vertex, see PolySet::buildSurface()
+static const int surface_stride = 6;
+static const int edgeattrib_stride = 12;
+
+static bool have_vbo()
+{
+	return GLEW_VERSION_1_5;
+}
+
+VBOCache::Entry &VBOCache::lookup(const Key &key)
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	return this->entries[key];
+}
+
+/*!
+	Moves data into buffer idx of entry.
+*/
+void VBOCache::upload(Entry &entry, int idx, std::vector<float> &data)
+{
+	if (have_vbo()) {
+		glGenBuffers(1, &entry.buffers[idx]);
+		glBindBuffer(GL_ARRAY_BUFFER, entry.buffers[idx]);
+		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), data.empty() ? NULL : &data[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	else {
+		entry.arrays[idx].swap(data);
+	}
+}
+
+/*!
+	Binds buffer idx of entry and returns the pointer to pass to the
+	gl*Pointer() functions.
+*/
+const float *VBOCache::bind(const Entry &entry, int idx)
+{
+	if (entry.buffers[idx]) {
+		glBindBuffer(GL_ARRAY_BUFFER, entry.buffers[idx]);
+		return NULL;
+	}
+	return entry.arrays[idx].empty() ? NULL : &entry.arrays[idx][0];
+}
+
+/*!
+	Deletes the dropped buffers of the current context.
+*/
+void VBOCache::collectGarbage()
+{
+	std::vector<GLuint> buffers;
+	{
+		boost::mutex::scoped_lock lock(this->mutex);
+		size_t kept = 0;
+		for (size_t i = 0; i < this->garbage.size(); i++) {
+			if (this->garbage[i].first == this->context) buffers.push_back(this->garbage[i].second);
+			else this->garbage[kept++] = this->garbage[i];
+		}
+		this->garbage.resize(kept);
+	}
+	if (!buffers.empty()) glDeleteBuffers(buffers.size(), &buffers[0]);
+}
+
+/*!
+	Sets the context which subsequent draw calls use. Must be called with
+	the GL context of the given view current.
+*/
+void VBOCache::setContext(const void *context)
+{
+	this->context = context;
+}
+
+/*!
+	Drops all entries of a view whose GL context is being destroyed. The
+	buffers are freed along with the context, so they aren't deleted here.
+*/
+void VBOCache::removeContext(const void *context)
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	for (std::map<Key, Entry>::iterator it = this->entries.begin(); it != this->entries.end();) {
+		if (it->first.context == context) this->entries.erase(it++);
+		else ++it;
+	}
+	size_t kept = 0;
+	for (size_t i = 0; i < this->garbage.size(); i++) {
+		if (this->garbage[i].first != context) this->garbage[kept++] = this->garbage[i];
+	}
+	this->garbage.resize(kept);
+	if (this->context == context) this->context = NULL;
+}
+
+void VBOCache::drawSurface(const PolySet &ps, Renderer::csgmode_e csgmode, bool mirrored, GLint *shaderinfo)
+{
+	collectGarbage();
+	bool difference = ps.getDimension() == 2 && (csgmode & CSGMODE_DIFFERENCE_FLAG);
+	Entry &entry = lookup(Key(&ps, this->context, difference ? SURFACE_DIFFERENCE : SURFACE));
+#ifndef ENABLE_OPENCSG
+	shaderinfo = NULL;
+#endif
+	bool needattribs = shaderinfo && !entry.buffers[1] && entry.arrays[1].empty();
+	if (entry.count == 0 || needattribs) {
+		std::vector<float> vertices, edgeattribs;
+		ps.buildSurface(csgmode, vertices, shaderinfo ? &edgeattribs : NULL);
+		size_t count = vertices.size() / surface_stride;
+		if (count == 0) return;
+		if (entry.count == 0) upload(entry, 0, vertices);
+		if (needattribs) upload(entry, 1, edgeattribs);
+		entry.count = count;
+	}
+
+	const float *ptr = bind(entry, 0);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glVertexPointer(3, GL_FLOAT, surface_stride * sizeof(float), ptr);
+	glNormalPointer(GL_FLOAT, surface_stride * sizeof(float), ptr + 3);
+#ifdef ENABLE_OPENCSG
+	if (shaderinfo) {
+		ptr = bind(entry, 1);
+		for (int i = 0; i < 4; i++) {
+			if (shaderinfo[3 + i] < 0) continue;
+			glEnableVertexAttribArray(shaderinfo[3 + i]);
+			glVertexAttribPointer(shaderinfo[3 + i], 3, GL_FLOAT, GL_FALSE, edgeattrib_stride * sizeof(float), ptr + 3 * i);
+		}
+	}
+#endif
+	if (have_vbo()) glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// Reversing the winding of the triangles and flipping the front face
+	// convention is equivalent.
+	if (mirrored) glFrontFace(GL_CW);
+	glDrawArrays(GL_TRIANGLES, 0, entry.count);
+	if (mirrored) glFrontFace(GL_CCW);
+
+#ifdef ENABLE_OPENCSG
+	if (shaderinfo) {
+		for (int i = 0; i < 4; i++) {
+			if (shaderinfo[3 + i] >= 0) glDisableVertexAttribArray(shaderinfo[3 + i]);
+		}
+	}
+#endif
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+void VBOCache::drawEdges(const PolySet &ps, Renderer::csgmode_e csgmode)
+{
+	collectGarbage();
+	int variant = EDGES;
+	if (ps.getDimension() == 2) {
+		if (csgmode == Renderer::CSGMODE_NONE) variant = EDGES_2D_OUTLINE;
+		else if (csgmode & CSGMODE_DIFFERENCE_FLAG) variant = EDGES_2D_DIFFERENCE;
+	}
+	Entry &entry = lookup(Key(&ps, this->context, variant));
+	if (entry.count == 0) {
+		std::vector<float> lines;
+		ps.buildEdges(csgmode, lines);
+		entry.count = lines.size() / 3;
+		if (entry.count == 0) return;
+		upload(entry, 0, lines);
+	}
+
+	const float *ptr = bind(entry, 0);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, ptr);
+	if (have_vbo()) glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glDrawArrays(GL_LINES, 0, entry.count);
+	glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+/*!
+	Drops all entries of ps. May be called from any thread.
+*/
+void VBOCache::remove(const PolySet *ps)
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	std::map<Key, Entry>::iterator begin = this->entries.lower_bound(Key(ps, NULL, SURFACE));
+	std::map<Key, Entry>::iterator end = begin;
+	while (end != this->entries.end() && end->first.ps == ps) {
+		for (int i = 0; i < 2; i++) {
+			if (end->second.buffers[i]) {
+				this->garbage.push_back(std::make_pair(end->first.context, end->second.buffers[i]));
+			}
+		}
+		++end;
+	}
+	this->entries.erase(begin, end);
+}
+
+#endif // NULLGL
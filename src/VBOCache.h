@@ -0,0 +1,79 @@
+#pragma once
+
+#include "system-gl.h"
+#include "renderer.h"
+
+#include <map>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+
+class PolySet;
+
+/*!
+	Vertex data of rendered PolySets, uploaded once into vertex buffer
+	objects and reused for every frame and by every renderer.
+
+	Buffer names belong to one GL context, and the views don't share their
+	contexts. Entries are therefore keyed by the context they were uploaded
+	to, as set by setContext() before drawing, as well as by PolySet
+	identity and by what is drawn, since surfaces and edges of 2D objects
+	depend on the csgmode. A PolySet must not be modified once it has been
+	rendered.
+
+	Entries are dropped when their PolySet is destroyed. This can happen in
+	any thread, so the buffers are deleted by the next draw call with their
+	context current. When a context is destroyed, its entries are dropped
+	by removeContext(), and its buffers are freed along with the context.
+
+	Without vertex buffer object support, the data is kept in client memory
+	and drawn as vertex arrays.
+*/
+class VBOCache
+{
+public:
+	static VBOCache *instance() { if (!inst) inst = new VBOCache; return inst; }
+
+	void drawSurface(const PolySet &ps, Renderer::csgmode_e csgmode, bool mirrored, GLint *shaderinfo);
+	void drawEdges(const PolySet &ps, Renderer::csgmode_e csgmode);
+	void remove(const PolySet *ps);
+	void setContext(const void *context);
+	void removeContext(const void *context);
+
+private:
+	VBOCache() : context(NULL) {}
+
+	static VBOCache *inst;
+
+	enum { SURFACE = 0, SURFACE_DIFFERENCE, EDGES, EDGES_2D_OUTLINE, EDGES_2D_DIFFERENCE };
+	struct Key {
+		Key(const PolySet *ps, const void *context, int variant) : ps(ps), context(context), variant(variant) {}
+		bool operator<(const Key &other) const {
+			if (this->ps != other.ps) return this->ps < other.ps;
+			if (this->context != other.context) return this->context < other.context;
+			return this->variant < other.variant;
+		}
+		const PolySet *ps;
+		const void *context;
+		int variant;
+	};
+
+	struct Entry {
+		Entry() : count(0) { buffers[0] = buffers[1] = 0; }
+		size_t count; // Number of vertices
+		// Buffer objects, or client side arrays if they aren't supported
+		GLuint buffers[2];
+		std::vector<float> arrays[2];
+	};
+
+	Entry &lookup(const Key &key);
+	void upload(Entry &entry, int idx, std::vector<float> &data);
+	const float *bind(const Entry &entry, int idx);
+	void collectGarbage();
+
+	boost::mutex mutex; // Guards entries and garbage
+	std::map<Key, Entry> entries;
+	// Buffers to delete, by context
+	std::vector<std::pair<const void *, GLuint> > garbage;
+	// Context of the view currently drawing
+	const void *context;
+};
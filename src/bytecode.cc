@@ -0,0 +1,709 @@
+#include "bytecode.h"
+#include "expression.h"
+#include "function.h"
+#include "evalcontext.h"
+#include "printutils.h"
+#include "stackcheck.h"
+#include "exceptions.h"
+#include "feature.h"
+#include "mathc99.h"
+#include <boost/foreach.hpp>
+
+/*!
+	Translates expression trees to Bytecode.
+
+	Registers are allocated like a stack. Each compiled expression leaves
+	its result either in a register bound to a variable of an enclosing
+	scope, or in the first register allocated for it, which is the only
+	register it keeps allocated.
+*/
+class BytecodeCompiler
+{
+public:
+	BytecodeCompiler(Bytecode &code) : code(code), top(0), failed(false) {}
+
+	bool bindParameters(const AssignmentList &params);
+	int emit(const Expression *expr, bool tail = false);
+	void emitReturn(int reg) { add(Bytecode::OP_RETURN, -1, reg); }
+
+	bool isFailed() const { return this->failed; }
+
+private:
+	typedef Bytecode::Opcode Opcode;
+
+	int alloc();
+	int result(int base, int reg);
+	void move(int dst, int reg) { if (reg != dst) add(Bytecode::OP_MOVE, dst, reg); }
+	size_t add(Opcode op, int dst, int a = -1, int b = -1, int c = -1);
+	size_t here() const { return this->code.code.size(); }
+	void patch(size_t at, size_t target);
+	void fail() { this->failed = true; }
+
+	int loadConstant(const ValuePtr &value);
+	int lookup(const std::string &name);
+	int emitCall(const ExpressionFunctionCall *call, bool tail);
+	size_t emitAssignments(const AssignmentList &assignments);
+	void emitElements(const Expression *expr);
+	static bool isBindable(const std::string &name);
+	static bool unaryOpcode(const Expression *expr, Opcode &op);
+	static bool binaryOpcode(const Expression *expr, Opcode &op);
+
+	Bytecode &code;
+	std::vector<std::pair<std::string, int> > scope;
+	int top;
+	bool failed;
+};
+
+int BytecodeCompiler::alloc()
+{
+	int reg = this->top++;
+	if (size_t(this->top) > this->code.numregs) this->code.numregs = this->top;
+	return reg;
+}
+
+/*!
+	Ends an expression which started at register base. If the result is
+	in a temporary register, it's moved to base.
+*/
+int BytecodeCompiler::result(int base, int reg)
+{
+	this->top = base;
+	if (reg < base) return reg;
+	move(base, reg);
+	return alloc();
+}
+
+size_t BytecodeCompiler::add(Opcode op, int dst, int a, int b, int c)
+{
+	this->code.code.push_back(Bytecode::Instruction(op, dst, a, b, c));
+	return this->code.code.size() - 1;
+}
+
+void BytecodeCompiler::patch(size_t at, size_t target)
+{
+	Bytecode::Instruction &ins = this->code.code[at];
+	if (ins.op == Bytecode::OP_JUMP || ins.op == Bytecode::OP_ITERNEXT) ins.a = target;
+	else ins.b = target;
+}
+
+// $ variables have dynamic scope and can't be kept in registers
+bool BytecodeCompiler::isBindable(const std::string &name)
+{
+	return name.empty() || name[0] != '$';
+}
+
+bool BytecodeCompiler::bindParameters(const AssignmentList &params)
+{
+	for (size_t i = 0; i < params.size(); i++) {
+		if (!isBindable(params[i].first)) return false;
+		for (size_t j = 0; j < i; j++) {
+			if (params[j].first == params[i].first) return false;
+		}
+		this->scope.push_back(std::make_pair(params[i].first, alloc()));
+	}
+	return true;
+}
+
+int BytecodeCompiler::loadConstant(const ValuePtr &value)
+{
+	this->code.constants.push_back(value);
+	int dst = alloc();
+	add(Bytecode::OP_LOADK, dst, this->code.constants.size() - 1);
+	return dst;
+}
+
+int BytecodeCompiler::lookup(const std::string &name)
+{
+	for (size_t i = this->scope.size(); i-- > 0; ) {
+		if (this->scope[i].first == name) return this->scope[i].second;
+	}
+	this->code.names.push_back(name);
+	int dst = alloc();
+	add(Bytecode::OP_LOOKUP, dst, this->code.names.size() - 1);
+	return dst;
+}
+
+bool BytecodeCompiler::unaryOpcode(const Expression *expr, Opcode &op)
+{
+	if (dynamic_cast<const ExpressionNot *>(expr)) op = Bytecode::OP_NOT;
+	else if (dynamic_cast<const ExpressionInvert *>(expr)) op = Bytecode::OP_NEG;
+	else return false;
+	return true;
+}
+
+bool BytecodeCompiler::binaryOpcode(const Expression *expr, Opcode &op)
+{
+	if (dynamic_cast<const ExpressionMultiply *>(expr)) op = Bytecode::OP_MUL;
+	else if (dynamic_cast<const ExpressionDivision *>(expr)) op = Bytecode::OP_DIV;
+	else if (dynamic_cast<const ExpressionModulo *>(expr)) op = Bytecode::OP_MOD;
+	else if (dynamic_cast<const ExpressionPlus *>(expr)) op = Bytecode::OP_ADD;
+	else if (dynamic_cast<const ExpressionMinus *>(expr)) op = Bytecode::OP_SUB;
+	else if (dynamic_cast<const ExpressionLess *>(expr)) op = Bytecode::OP_LT;
+	else if (dynamic_cast<const ExpressionLessOrEqual *>(expr)) op = Bytecode::OP_LE;
+	else if (dynamic_cast<const ExpressionEqual *>(expr)) op = Bytecode::OP_EQ;
+	else if (dynamic_cast<const ExpressionNotEqual *>(expr)) op = Bytecode::OP_NE;
+	else if (dynamic_cast<const ExpressionGreaterOrEqual *>(expr)) op = Bytecode::OP_GE;
+	else if (dynamic_cast<const ExpressionGreater *>(expr)) op = Bytecode::OP_GT;
+	else if (dynamic_cast<const ExpressionArrayLookup *>(expr)) op = Bytecode::OP_INDEX;
+	else return false;
+	return true;
+}
+
+int BytecodeCompiler::emit(const Expression *expr, bool tail)
+{
+	const int base = this->top;
+	if (this->failed) return base;
+
+	if (dynamic_cast<const ExpressionConst *>(expr)) {
+		return loadConstant(expr->evaluate(NULL));
+	}
+	if (const ExpressionLookup *lookupexpr = dynamic_cast<const ExpressionLookup *>(expr)) {
+		return lookup(lookupexpr->var_name);
+	}
+
+	Opcode op;
+	if (unaryOpcode(expr, op)) {
+		int a = emit(expr->first);
+		this->top = base;
+		int dst = alloc();
+		add(op, dst, a);
+		return dst;
+	}
+	if (binaryOpcode(expr, op)) {
+		int a = emit(expr->first);
+		int b = emit(expr->second);
+		this->top = base;
+		int dst = alloc();
+		add(op, dst, a, b);
+		return dst;
+	}
+	if (dynamic_cast<const ExpressionLogicalAnd *>(expr) ||
+			dynamic_cast<const ExpressionLogicalOr *>(expr)) {
+		// a && b: a ? bool(b) : false
+		// a || b: a ? true : bool(b)
+		bool isand = dynamic_cast<const ExpressionLogicalAnd *>(expr) != NULL;
+		int a = emit(expr->first);
+		this->top = base;
+		int dst = alloc();
+		size_t jumpf = add(Bytecode::OP_JUMPF, -1, a);
+		size_t jump;
+		if (isand) {
+			add(Bytecode::OP_BOOL, dst, emit(expr->second));
+			jump = add(Bytecode::OP_JUMP, -1);
+			patch(jumpf, here());
+			this->top = base;
+			this->code.constants.push_back(ValuePtr(false));
+			add(Bytecode::OP_LOADK, dst, this->code.constants.size() - 1);
+		}
+		else {
+			this->code.constants.push_back(ValuePtr(true));
+			add(Bytecode::OP_LOADK, dst, this->code.constants.size() - 1);
+			jump = add(Bytecode::OP_JUMP, -1);
+			patch(jumpf, here());
+			add(Bytecode::OP_BOOL, dst, emit(expr->second));
+		}
+		patch(jump, here());
+		this->top = dst + 1;
+		return dst;
+	}
+	if (dynamic_cast<const ExpressionTernary *>(expr)) {
+		int cond = emit(expr->first);
+		this->top = base;
+		size_t jumpf = add(Bytecode::OP_JUMPF, -1, cond);
+		move(base, emit(expr->second, tail));
+		this->top = base;
+		size_t jump = add(Bytecode::OP_JUMP, -1);
+		patch(jumpf, here());
+		move(base, emit(expr->third, tail));
+		patch(jump, here());
+		this->top = base;
+		return alloc();
+	}
+	if (dynamic_cast<const ExpressionRange *>(expr)) {
+		// Like ExpressionRange::evaluate(), stop at the first non-number
+		std::vector<size_t> jumps;
+		int a = emit(expr->first);
+		jumps.push_back(add(Bytecode::OP_JUMPNN, -1, a));
+		int b = emit(expr->second);
+		jumps.push_back(add(Bytecode::OP_JUMPNN, -1, b));
+		int c = -1;
+		if (expr->children.size() > 2) {
+			c = emit(expr->third);
+			jumps.push_back(add(Bytecode::OP_JUMPNN, -1, c));
+		}
+		this->top = base;
+		int dst = alloc();
+		add(Bytecode::OP_RANGE, dst, a, b, c);
+		size_t jump = add(Bytecode::OP_JUMP, -1);
+		BOOST_FOREACH(size_t at, jumps) patch(at, here());
+		this->code.constants.push_back(ValuePtr::undefined);
+		add(Bytecode::OP_LOADK, dst, this->code.constants.size() - 1);
+		patch(jump, here());
+		return dst;
+	}
+	if (dynamic_cast<const ExpressionVector *>(expr)) {
+		add(Bytecode::OP_VECBEGIN, -1);
+		BOOST_FOREACH(const Expression *child, expr->children) {
+			add(Bytecode::OP_VECPUSH, -1, emit(child));
+			this->top = base;
+		}
+		int dst = alloc();
+		add(Bytecode::OP_VECEND, dst);
+		return dst;
+	}
+	if (const ExpressionMember *member = dynamic_cast<const ExpressionMember *>(expr)) {
+		static const char *vectormembers[] = { "x", "y", "z" };
+		static const char *rangemembers[] = { "begin", "step", "end" };
+		int vectorindex = -1, rangeindex = -1;
+		for (int i = 0; i < 3; i++) {
+			if (member->member == vectormembers[i]) vectorindex = i;
+			if (member->member == rangemembers[i]) rangeindex = i;
+		}
+		int a = emit(expr->first);
+		this->top = base;
+		int dst = alloc();
+		add(Bytecode::OP_MEMBER, dst, a, vectorindex, rangeindex);
+		return dst;
+	}
+	if (const ExpressionFunctionCall *call = dynamic_cast<const ExpressionFunctionCall *>(expr)) {
+		return emitCall(call, tail);
+	}
+	if (const ExpressionLet *let = dynamic_cast<const ExpressionLet *>(expr)) {
+		size_t bound = emitAssignments(let->call_arguments);
+		int reg = emit(expr->first, tail);
+		this->scope.resize(this->scope.size() - bound);
+		return result(base, reg);
+	}
+	if (dynamic_cast<const ExpressionLcExpression *>(expr) ||
+			dynamic_cast<const ExpressionLc *>(expr)) {
+		add(Bytecode::OP_VECBEGIN, -1);
+		emitElements(dynamic_cast<const ExpressionLc *>(expr) ? expr : expr->first);
+		this->top = base;
+		int dst = alloc();
+		add(Bytecode::OP_VECEND, dst);
+		return dst;
+	}
+
+	fail();
+	return base;
+}
+
+/*!
+	Evaluates a let() assignment list into new registers, returns the
+	number of variables added to the scope.
+*/
+size_t BytecodeCompiler::emitAssignments(const AssignmentList &assignments)
+{
+	for (size_t i = 0; i < assignments.size(); i++) {
+		const Assignment &assignment = assignments[i];
+		if (!isBindable(assignment.first) || !assignment.second) fail();
+		for (size_t j = 0; j < i; j++) {
+			// Duplicates are reported by evaluate_sequential_assignment()
+			if (assignments[j].first == assignment.first) fail();
+		}
+		const int base = this->top;
+		int reg = emit(assignment.second.get());
+		if (reg < base) move(alloc(), reg);
+		this->scope.push_back(std::make_pair(assignment.first, base));
+	}
+	return assignments.size();
+}
+
+/*!
+	Emits the list comprehension element expr, appending its values to
+	the current vector.
+*/
+void BytecodeCompiler::emitElements(const Expression *expr)
+{
+	const int base = this->top;
+	const ExpressionLc *lc = dynamic_cast<const ExpressionLc *>(expr);
+	if (!lc) {
+		add(Bytecode::OP_VECPUSH, -1, emit(expr));
+	}
+	else if (lc->name == "if") {
+		int cond = emit(expr->first);
+		this->top = base;
+		size_t jumpf = add(Bytecode::OP_JUMPF, -1, cond);
+		emitElements(expr->second);
+		patch(jumpf, here());
+	}
+	else if (lc->name == "for") {
+		if (lc->call_arguments.size() != 1) return fail();
+		const Assignment &arg = lc->call_arguments[0];
+		if (!isBindable(arg.first) || !arg.second) return fail();
+		add(Bytecode::OP_ITERBEGIN, -1, emit(arg.second.get()));
+		this->top = base;
+		int var = alloc();
+		size_t loop = add(Bytecode::OP_ITERNEXT, var, -1);
+		this->scope.push_back(std::make_pair(arg.first, var));
+		emitElements(expr->first);
+		this->scope.pop_back();
+		add(Bytecode::OP_JUMP, -1, loop);
+		patch(loop, here());
+	}
+	else if (lc->name == "let" && expr->first->isListComprehension()) {
+		size_t bound = emitAssignments(lc->call_arguments);
+		emitElements(expr->first);
+		this->scope.resize(this->scope.size() - bound);
+	}
+	else {
+		fail();
+	}
+	this->top = base;
+}
+
+int BytecodeCompiler::emitCall(const ExpressionFunctionCall *call, bool tail)
+{
+	const int base = this->top;
+	const Function *function = this->code.function;
+	Bytecode::CallSite site;
+	site.call = call;
+
+	// Calls of the function itself always resolve to the function, as
+	// it's evaluated in the context it was found in.
+	bool recursive = function && call->funcname == function->name;
+	// Recursive calls go through Function::evaluate() to use the FunctionCache
+	if (!tail && Feature::ExperimentalMemoize.is_enabled()) recursive = false;
+	size_t posarg = 0;
+	BOOST_FOREACH(const Assignment &arg, call->call_arguments) {
+		if (!arg.second) fail();
+		site.args.push_back(emit(arg.second.get()));
+		if (!recursive) continue;
+		int param = -1;
+		if (arg.first.empty()) {
+			if (posarg < function->definition_arguments.size()) param = posarg++;
+		}
+		else {
+			for (size_t i = 0; i < function->definition_arguments.size(); i++) {
+				if (function->definition_arguments[i].first == arg.first) param = i;
+			}
+			// Extra named arguments become variables, see Context::setVariables()
+			if (param < 0) recursive = false;
+		}
+		site.params.push_back(param);
+	}
+
+	this->top = base;
+	int dst = alloc();
+	this->code.calls.push_back(site);
+	Opcode op = !recursive ? Bytecode::OP_CALL : tail ? Bytecode::OP_TAILCALL : Bytecode::OP_CALLSELF;
+	add(op, dst, this->code.calls.size() - 1);
+	return dst;
+}
+
+Bytecode::Bytecode(const Function *function)
+	: function(function), numparams(function ? function->definition_arguments.size() : 0), numregs(0)
+{
+}
+
+Bytecode::~Bytecode()
+{
+}
+
+/*!
+	Compiles a single expression, to be evaluated in any context.
+*/
+Bytecode *Bytecode::compile(const Expression &expr)
+{
+	Bytecode *code = new Bytecode(NULL);
+	BytecodeCompiler compiler(*code);
+	compiler.emitReturn(compiler.emit(&expr));
+	if (compiler.isFailed()) {
+		delete code;
+		return NULL;
+	}
+	return code;
+}
+
+/*!
+	Compiles the body of a user defined function, with the parameters in
+	the first registers.
+*/
+Bytecode *Bytecode::compile(const Function &func)
+{
+	if (!func.expr) return NULL;
+	Bytecode *code = new Bytecode(&func);
+	BytecodeCompiler compiler(*code);
+	bool bound = compiler.bindParameters(func.definition_arguments);
+	if (bound) compiler.emitReturn(compiler.emit(func.expr, true));
+	if (!bound || compiler.isFailed()) {
+		delete code;
+		return NULL;
+	}
+	PRINTDB("Compiled function %s to %d instructions", func.name % code->code.size());
+	return code;
+}
+
+ValuePtr Bytecode::evaluate(const Context *ctx) const
+{
+	std::vector<ValuePtr> regs(this->numregs, ValuePtr::undefined);
+	return execute(ctx, regs);
+}
+
+/*!
+	Returns false if the call passes named arguments which aren't
+	parameters. Those are visible as variables in the function body, so
+	the function has to be evaluated from its expression tree.
+*/
+bool Bytecode::accepts(const EvalContext *evalctx) const
+{
+	if (!evalctx || !this->function) return true;
+	for (size_t i = 0; i < evalctx->numArgs(); i++) {
+		const std::string &name = evalctx->getArgName(i);
+		if (name.empty()) continue;
+		bool found = false;
+		BOOST_FOREACH(const Assignment &param, this->function->definition_arguments) {
+			if (param.first == name) found = true;
+		}
+		if (!found) return false;
+	}
+	return true;
+}
+
+/*!
+	Calls the compiled function, like Function::evaluate().
+*/
+ValuePtr Bytecode::call(const Context *ctx, const EvalContext *evalctx) const
+{
+	std::vector<ValuePtr> regs(this->numregs, ValuePtr::undefined);
+	bindDefaults(ctx, regs);
+	if (evalctx) {
+		size_t posarg = 0;
+		for (size_t i = 0; i < evalctx->numArgs(); i++) {
+			const std::string &name = evalctx->getArgName(i);
+			ValuePtr val = evalctx->getArgValue(i);
+			if (name.empty()) {
+				if (posarg < this->numparams) regs[posarg++] = val;
+			}
+			else {
+				for (size_t j = 0; j < this->numparams; j++) {
+					if (this->function->definition_arguments[j].first == name) regs[j] = val;
+				}
+			}
+		}
+	}
+	return execute(ctx, regs);
+}
+
+void Bytecode::bindDefaults(const Context *ctx, std::vector<ValuePtr> &regs) const
+{
+	for (size_t i = 0; i < this->numparams; i++) {
+		const Assignment &param = this->function->definition_arguments[i];
+		regs[i] = param.second ? param.second->evaluate(ctx) : ValuePtr::undefined;
+	}
+}
+
+void Bytecode::bind(const CallSite &site, const std::vector<ValuePtr> &regs, std::vector<ValuePtr> &params) const
+{
+	for (size_t i = 0; i < site.args.size(); i++) {
+		if (site.params[i] >= 0) params[site.params[i]] = regs[site.args[i]];
+	}
+}
+
+// Values are immutable, so boolean results can be shared
+static const ValuePtr &boolValue(bool b)
+{
+	static const ValuePtr truevalue(true), falsevalue(false);
+	return b ? truevalue : falsevalue;
+}
+
+ValuePtr Bytecode::applyBinary(Opcode op, const ValuePtr &a, const ValuePtr &b)
+{
+	if (a->type() == Value::NUMBER && b->type() == Value::NUMBER) {
+		double x = a->toDouble(), y = b->toDouble();
+		switch (op) {
+		case OP_MUL: return ValuePtr(x * y);
+		case OP_DIV: return ValuePtr(x / y);
+		case OP_MOD: return ValuePtr(fmod(x, y));
+		case OP_ADD: return ValuePtr(x + y);
+		case OP_SUB: return ValuePtr(x - y);
+		case OP_LT: return boolValue(x < y);
+		case OP_LE: return boolValue(x <= y);
+		case OP_EQ: return boolValue(x == y);
+		case OP_NE: return boolValue(x != y);
+		case OP_GE: return boolValue(x >= y);
+		case OP_GT: return boolValue(x > y);
+		default: break;
+		}
+	}
+	switch (op) {
+	case OP_MUL: return a * b;
+	case OP_DIV: return a / b;
+	case OP_MOD: return a % b;
+	case OP_ADD: return a + b;
+	case OP_SUB: return a - b;
+	case OP_LT: return boolValue(*a < *b);
+	case OP_LE: return boolValue(*a <= *b);
+	case OP_EQ: return boolValue(*a == *b);
+	case OP_NE: return boolValue(*a != *b);
+	case OP_GE: return boolValue(*a >= *b);
+	case OP_GT: return boolValue(*a > *b);
+	case OP_INDEX: return a[b];
+	default: return ValuePtr::undefined;
+	}
+}
+
+namespace {
+	/*!
+		State of a list comprehension for() loop. Ranges are stepped like
+		Value::RangeType::iterator, vectors by index, and any other defined
+		value is iterated once.
+	*/
+	struct Iterator {
+		Iterator() : isrange(false), index(0), count(0), value(0), step(0), end(0) {}
+		bool isrange;
+		ValuePtr values;
+		size_t index, count;
+		double value, step, end;
+	};
+}
+
+ValuePtr Bytecode::execute(const Context *ctx, std::vector<ValuePtr> &regs) const
+{
+	std::vector<Value::VectorType> vectors;
+	std::vector<Iterator> iterators;
+	std::vector<ValuePtr> params;
+	unsigned int tailcalls = 0;
+	size_t pc = 0;
+
+	for (;;) {
+		const Instruction &ins = this->code[pc++];
+		switch (ins.op) {
+		case OP_LOADK:
+			regs[ins.dst] = this->constants[ins.a];
+			break;
+		case OP_MOVE:
+			regs[ins.dst] = regs[ins.a];
+			break;
+		case OP_LOOKUP:
+			regs[ins.dst] = ctx->lookup_variable(this->names[ins.a]);
+			break;
+		case OP_NOT:
+			regs[ins.dst] = boolValue(!regs[ins.a]->toBool());
+			break;
+		case OP_NEG:
+			regs[ins.dst] = -regs[ins.a];
+			break;
+		case OP_BOOL:
+			regs[ins.dst] = boolValue(regs[ins.a]->toBool());
+			break;
+		case OP_MUL: case OP_DIV: case OP_MOD: case OP_ADD: case OP_SUB:
+		case OP_LT: case OP_LE: case OP_EQ: case OP_NE: case OP_GE: case OP_GT:
+		case OP_INDEX:
+			regs[ins.dst] = applyBinary(ins.op, regs[ins.a], regs[ins.b]);
+			break;
+		case OP_MEMBER: {
+			const ValuePtr &v = regs[ins.a];
+			if (v->type() == Value::VECTOR && ins.b >= 0) regs[ins.dst] = v[ValuePtr(ins.b)];
+			else if (v->type() == Value::RANGE && ins.c >= 0) regs[ins.dst] = v[ValuePtr(ins.c)];
+			else regs[ins.dst] = ValuePtr::undefined;
+			break;
+		}
+		case OP_RANGE:
+			if (ins.c < 0) {
+				regs[ins.dst] = ValuePtr(Value::RangeType(regs[ins.a]->toDouble(), regs[ins.b]->toDouble()));
+			}
+			else {
+				regs[ins.dst] = ValuePtr(Value::RangeType(regs[ins.a]->toDouble(), regs[ins.b]->toDouble(), regs[ins.c]->toDouble()));
+			}
+			break;
+		case OP_JUMP:
+			pc = ins.a;
+			break;
+		case OP_JUMPF:
+			if (!regs[ins.a]->toBool()) pc = ins.b;
+			break;
+		case OP_JUMPNN:
+			if (regs[ins.a]->type() != Value::NUMBER) pc = ins.b;
+			break;
+		case OP_VECBEGIN:
+			vectors.push_back(Value::VectorType());
+			break;
+		case OP_VECPUSH:
+			vectors.back().push_back(*regs[ins.a]);
+			break;
+		case OP_VECEND:
+			regs[ins.dst] = ValuePtr(vectors.back());
+			vectors.pop_back();
+			break;
+		case OP_ITERBEGIN: {
+			const ValuePtr &v = regs[ins.a];
+			iterators.push_back(Iterator());
+			Iterator &it = iterators.back();
+			if (v->type() == Value::RANGE) {
+				Value::RangeType range = v->toRange();
+				boost::uint32_t steps = range.nbsteps();
+				if (steps >= 1000000) {
+					PRINTB("WARNING: Bad range parameter in for statement: too many elements (%lu).", steps);
+				}
+				else {
+					it.isrange = true;
+					it.value = range.begin_value();
+					it.step = range.step_value();
+					it.end = range.end_value();
+				}
+			}
+			else if (v->type() == Value::VECTOR) {
+				it.values = v;
+				it.count = v->toVector().size();
+			}
+			else if (v->type() != Value::UNDEFINED) {
+				it.values = v;
+				it.count = 1;
+			}
+			break;
+		}
+		case OP_ITERNEXT: {
+			Iterator &it = iterators.back();
+			if (it.isrange) {
+				if (it.step != 0 && (it.step < 0 ? it.value >= it.end : it.value <= it.end)) {
+					regs[ins.dst] = ValuePtr(it.value);
+					it.value += it.step;
+					break;
+				}
+			}
+			else if (it.index < it.count) {
+				if (it.values->type() == Value::VECTOR) regs[ins.dst] = ValuePtr(it.values->toVector()[it.index]);
+				else regs[ins.dst] = it.values;
+				it.index++;
+				break;
+			}
+			iterators.pop_back();
+			pc = ins.a;
+			break;
+		}
+		case OP_CALL: {
+			const CallSite &site = this->calls[ins.a];
+			if (StackCheck::inst()->check()) {
+				throw RecursionException::create("function", site.call->funcname);
+			}
+			std::vector<ValuePtr> args;
+			args.reserve(site.args.size());
+			BOOST_FOREACH(int reg, site.args) args.push_back(regs[reg]);
+			EvalContext c(ctx, site.call->call_arguments, args);
+			regs[ins.dst] = ctx->evaluate_function(site.call->funcname, &c);
+			break;
+		}
+		case OP_CALLSELF: {
+			if (StackCheck::inst()->check()) {
+				throw RecursionException::create("function", this->function->name);
+			}
+			std::vector<ValuePtr> callregs(this->numregs, ValuePtr::undefined);
+			bindDefaults(ctx, callregs);
+			bind(this->calls[ins.a], regs, callregs);
+			regs[ins.dst] = execute(ctx, callregs);
+			break;
+		}
+		case OP_TAILCALL:
+			if (tailcalls++ == 1000000) throw RecursionException::create("function", this->function->name);
+			params.resize(this->numparams);
+			bindDefaults(ctx, params);
+			bind(this->calls[ins.a], regs, params);
+			std::copy(params.begin(), params.end(), regs.begin());
+			pc = 0;
+			break;
+		case OP_RETURN:
+			return regs[ins.a];
+		}
+	}
+}
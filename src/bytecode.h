@@ -0,0 +1,111 @@
+#pragma once
+
+#include "value.h"
+#include <string>
+#include <vector>
+
+class Expression;
+class ExpressionFunctionCall;
+class Function;
+class Context;
+class EvalContext;
+
+/*!
+	Expressions and functions compiled to a register based bytecode.
+
+	Variables bound inside the compiled code (function parameters, let()
+	assignments and list comprehension iterators) are resolved to
+	registers at compile time, so evaluating the code doesn't create any
+	Context objects. Other variables are looked up in the Context passed
+	to evaluate() or call(), and other functions are called through
+	Context::evaluate_function() with already evaluated arguments.
+	Recursive calls of the compiled function are bound directly, unless
+	function results are cached, and recursive calls in tail position are
+	turned into jumps.
+
+	Code which binds $ variables or assigns the same variable twice in one
+	let() isn't compiled; compile() returns NULL and the caller should
+	keep using the expression tree.
+
+	Enabled by the "bytecode" experimental feature.
+*/
+class Bytecode
+{
+public:
+	~Bytecode();
+
+	static Bytecode *compile(const Expression &expr);
+	static Bytecode *compile(const Function &func);
+
+	ValuePtr evaluate(const Context *ctx) const;
+
+	bool accepts(const EvalContext *evalctx) const;
+	ValuePtr call(const Context *ctx, const EvalContext *evalctx) const;
+
+	size_t size() const { return this->code.size(); }
+
+private:
+	friend class BytecodeCompiler;
+
+	enum Opcode {
+		OP_LOADK,      // dst = constants[a]
+		OP_MOVE,       // dst = a
+		OP_LOOKUP,     // dst = ctx->lookup_variable(names[a])
+		OP_NOT,        // dst = !a
+		OP_NEG,        // dst = -a
+		OP_BOOL,       // dst = bool(a)
+		OP_MUL,        // dst = a * b
+		OP_DIV,
+		OP_MOD,
+		OP_ADD,
+		OP_SUB,
+		OP_LT,
+		OP_LE,
+		OP_EQ,
+		OP_NE,
+		OP_GE,
+		OP_GT,
+		OP_INDEX,      // dst = a[b]
+		OP_MEMBER,     // dst = a.x/y/z (index b) or a.begin/step/end (index c)
+		OP_RANGE,      // dst = [a : b] or [a : b : c]
+		OP_JUMP,       // pc = a
+		OP_JUMPF,      // if !a: pc = b
+		OP_JUMPNN,     // if a isn't a number: pc = b
+		OP_VECBEGIN,   // start a new vector
+		OP_VECPUSH,    // append a to the current vector
+		OP_VECEND,     // dst = current vector
+		OP_ITERBEGIN,  // start iterating over a
+		OP_ITERNEXT,   // dst = next value, or pc = a when done
+		OP_CALL,       // dst = calls[a] through Context::evaluate_function()
+		OP_CALLSELF,   // dst = recursive call calls[a]
+		OP_TAILCALL,   // rebind parameters from calls[a], pc = 0
+		OP_RETURN      // return a
+	};
+
+	struct Instruction {
+		Instruction(Opcode op, int dst, int a, int b, int c) : op(op), dst(dst), a(a), b(b), c(c) {}
+		Opcode op;
+		int dst, a, b, c;
+	};
+
+	struct CallSite {
+		const ExpressionFunctionCall *call;
+		std::vector<int> args;   // argument registers
+		std::vector<int> params; // parameter index for each argument of recursive calls, -1 if unused
+	};
+
+	Bytecode(const Function *function);
+
+	static ValuePtr applyBinary(Opcode op, const ValuePtr &a, const ValuePtr &b);
+	void bindDefaults(const Context *ctx, std::vector<ValuePtr> &regs) const;
+	void bind(const CallSite &site, const std::vector<ValuePtr> &regs, std::vector<ValuePtr> &params) const;
+	ValuePtr execute(const Context *ctx, std::vector<ValuePtr> &regs) const;
+
+	const Function *function;
+	size_t numparams;
+	size_t numregs;
+	std::vector<Instruction> code;
+	std::vector<ValuePtr> constants;
+	std::vector<std::string> names;
+	std::vector<CallSite> calls;
+};
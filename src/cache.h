@@ -46,16 +46,35 @@
 
 #include <boost/unordered_map.hpp>
 #include <boost/format.hpp>
+#include <boost/cstdint.hpp>
 #include "printutils.h"
 
+/*!
+	Statistics of a cache. Sizes are in bytes for byte-budgeted caches,
+	which are 64 bit even on 32 bit builds.
+*/
+struct CacheStatistics
+{
+	CacheStatistics()
+		: entries(0), size(0), maxsize(0), hits(0), misses(0), insertions(0), evictions(0), rejections(0) {}
+	size_t entries;
+	boost::uint64_t size, maxsize;
+	size_t hits, misses;
+	size_t insertions;
+	// Entries removed to make room for new ones
+	size_t evictions;
+	// Insertions refused since the entry alone exceeds the limit
+	size_t rejections;
+};
+
 template <class Key, class T>
 class Cache
 {
 	struct Node {
 		inline Node() : keyPtr(0) {}
-		inline Node(T *data, int cost)
+		inline Node(T *data, boost::uint64_t cost)
 			: keyPtr(0), t(data), c(cost), p(0), n(0) {}
-		const Key *keyPtr; T *t; int c; Node *p,*n;
+		const Key *keyPtr; T *t; boost::uint64_t c; Node *p,*n;
 	};
 	typedef typename boost::unordered_map<Key, Node> map_type;
 	typedef typename map_type::iterator iterator_type;
@@ -64,7 +83,8 @@ class Cache
 	boost::unordered_map<Key, Node> hash;
 	Node *f, *l;
 	void *unused;
-	int mx, total;
+	boost::uint64_t mx, total;
+	mutable CacheStatistics stats;
 
 	inline void unlink(Node &n) {
 		if (n.p) n.p->n = n.n;
@@ -94,15 +114,15 @@ class Cache
 	}
 
 public:
-	inline explicit Cache(int maxCost = 100)
+	inline explicit Cache(boost::uint64_t maxCost = 100)
 		: f(0), l(0), unused(0), mx(maxCost), total(0) { }
 	inline ~Cache() { clear(); }
 
-	inline int maxCost() const { return mx; }
-	void setMaxCost(int m) { mx = m; trim(mx); }
-	inline int totalCost() const { return total; }
+	inline boost::uint64_t maxCost() const { return mx; }
+	void setMaxCost(boost::uint64_t m) { mx = m; trim(mx); }
+	inline boost::uint64_t totalCost() const { return total; }
 
-	inline int size() const { return hash.size(); }
+	inline size_t size() const { return hash.size(); }
 	inline bool empty() const { return hash.empty(); }
 
 	void clear() {
@@ -110,16 +130,35 @@ public:
 		hash.clear(); l = 0; total = 0;
 	}
 
-	bool insert(const Key &key, T *object, int cost = 1);
-	T *object(const Key &key) const { return const_cast<Cache<Key,T>*>(this)->relink(key); }
+	bool insert(const Key &key, T *object, boost::uint64_t cost = 1);
+	T *object(const Key &key) const {
+		T *t = find(key);
+		if (t) recordHit();
+		else recordMiss();
+		return t;
+	}
+	// Like object(), but leaves counting to the caller, for lookups which
+	// span several caches
+	T *find(const Key &key) const { return const_cast<Cache<Key,T>*>(this)->relink(key); }
+	void recordHit() const { stats.hits++; }
+	void recordMiss() const { stats.misses++; }
 	inline bool contains(const Key &key) const { return hash.find(key) != hash.end(); }
 	T *operator[](const Key &key) const { return object(key); }
 
 	bool remove(const Key &key);
 	T *take(const Key &key);
 
+	CacheStatistics statistics() const {
+		CacheStatistics s = stats;
+		s.entries = size();
+		s.size = total;
+		s.maxsize = mx;
+		return s;
+	}
+	void resetStatistics() { stats = CacheStatistics(); }
+
 private:
-	void trim(int m);
+	void trim(boost::uint64_t m);
 };
 
 template <class Key, class T>
@@ -140,7 +179,7 @@ inline T *Cache<Key,T>::take(const Key &key)
 	iterator_type i = hash.find(key);
 	if (i == hash.end()) return 0;
 
-	Node &n = *i;
+	Node &n = i->second;
 	T *t = n.t;
 	n.t = 0;
 	unlink(n);
@@ -148,10 +187,11 @@ inline T *Cache<Key,T>::take(const Key &key)
 }
 
 template <class Key, class T>
-bool Cache<Key,T>::insert(const Key &akey, T *aobject, int acost)
+bool Cache<Key,T>::insert(const Key &akey, T *aobject, boost::uint64_t acost)
 {
 	remove(akey);
 	if (acost > mx) {
+		stats.rejections++;
 		delete aobject;
 		return false;
 	}
@@ -160,6 +200,7 @@ bool Cache<Key,T>::insert(const Key &akey, T *aobject, int acost)
 	hash[akey] = node;
 	iterator_type i = hash.find(akey);
 	total += acost;
+	stats.insertions++;
 	Node *n = &i->second;
 	n->keyPtr = &i->first;
 	if (f) f->p = n;
@@ -170,7 +211,7 @@ bool Cache<Key,T>::insert(const Key &akey, T *aobject, int acost)
 }
 
 template <class Key, class T>
-void Cache<Key,T>::trim(int m)
+void Cache<Key,T>::trim(boost::uint64_t m)
 {
 	Node *n = l;
 	while (n && total > m) {
@@ -180,5 +221,6 @@ void Cache<Key,T>::trim(int m)
 		PRINTB("Trimming cache: %1% (%2% bytes)", u->keyPtr->substr(0, 40) % u->c);
 #endif
 		unlink(*u);
+		stats.evictions++;
 	}
 }
@@ -27,6 +27,11 @@
 #include "calc.h"
 #include "grid.h"
 
+#include <sstream>
+#include <locale>
+#include <cstdio>
+#include <boost/cstdint.hpp>
+
 /*!
 	Returns the number of subdivision of a whole circle, given radius and
 	the three special variables $fn, $fs and $fa
@@ -38,3 +43,68 @@ int Calc::get_fragments_from_r(double r, double fn, double fs, double fa)
 	return (int)ceil(fmax(fmin(360.0 / fa, r*2*M_PI / fs), 5));
 }
 
+/*!
+	Parses the decimal floating point number in [begin, end) independently
+	of the locale. Numbers with few significant digits, which is what
+	exporters write, are converted exactly without a stream. Returns false
+	if the token isn't a number.
+*/
+bool Calc::parse_double(const char *begin, const char *end, double &result)
+{
+	static const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	const char *p = begin;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+	boost::uint64_t mantissa = 0;
+	int digits = 0, exponent = 0;
+	bool anydigits = false;
+	for (; p < end && *p >= '0' && *p <= '9'; p++) {
+		anydigits = true;
+		if (digits < 19) {
+			mantissa = mantissa * 10 + (*p - '0');
+			if (mantissa) digits++;
+		}
+		else exponent++;
+	}
+	if (p < end && *p == '.') {
+		for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+			anydigits = true;
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa) digits++;
+				exponent--;
+			}
+		}
+	}
+	if (anydigits && p < end && (*p == 'e' || *p == 'E')) {
+		const char *q = p + 1;
+		bool negexp = false;
+		if (q < end && (*q == '-' || *q == '+')) negexp = (*q++ == '-');
+		if (q < end && *q >= '0' && *q <= '9') {
+			int e = 0;
+			for (; q < end && *q >= '0' && *q <= '9'; q++) {
+				if (e < 100000) e = e * 10 + (*q - '0');
+			}
+			exponent += negexp ? -e : e;
+			p = q;
+		}
+	}
+
+	if (anydigits && p == end && digits <= 15 && exponent >= -22 && exponent <= 22) {
+		// Both mantissa and power of ten are exact, so this rounds correctly
+		double d = double(mantissa);
+		d = exponent < 0 ? d / pow10[-exponent] : d * pow10[exponent];
+		result = negative ? -d : d;
+		return true;
+	}
+
+	// Long mantissas, large exponents and special values like "inf"
+	std::istringstream stream(std::string(begin, end));
+	stream.imbue(std::locale::classic());
+	stream >> result;
+	return !stream.fail() && stream.peek() == EOF;
+}
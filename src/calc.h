@@ -2,4 +2,5 @@
 
 namespace Calc {
 	int get_fragments_from_r(double r, double fn, double fs, double fa);
+	bool parse_double(const char *begin, const char *end, double &result);
 }
@@ -52,26 +52,32 @@ namespace /* anonymous */ {
 			std::vector<CGALPoint> vertices;
 			std::vector<std::vector<size_t> > indices;
 
-			// Align all vertices to grid and build vertex array in vertices
-			BOOST_FOREACH(const Polygon &p, ps.polygons) {
-				indices.push_back(std::vector<size_t>());
-                            indices.back().reserve(p.size());
-				BOOST_REVERSE_FOREACH(Vector3d v, p) {
-					// align v to the grid; the CGALPoint will receive the aligned vertex
-					size_t idx = grid.align(v);
-					if (idx == vertices.size()) {
-						CGALPoint p(v[0], v[1], v[2]);
-						vertices.push_back(p);
-					}
-					indices.back().push_back(idx);
+			// Align all vertices to grid and build vertex array in vertices.
+			// Vertices are shared in the PolySet, so each is only aligned once.
+			std::vector<size_t> gridindices;
+			gridindices.reserve(ps.getVertices().size());
+			BOOST_FOREACH(Vector3d v, ps.getVertices()) {
+				// align v to the grid; the CGALPoint will receive the aligned vertex
+				size_t idx = grid.align(v);
+				if (idx == vertices.size()) {
+					CGALPoint p(v[0], v[1], v[2]);
+					vertices.push_back(p);
 				}
+				gridindices.push_back(idx);
+			}
+			indices.reserve(ps.numPolygons());
+			for (size_t i = 0; i < ps.numPolygons(); i++) {
+				const PolySet::Face p = ps.getFace(i);
+				indices.push_back(std::vector<size_t>());
+				indices.back().reserve(p.size());
+				for (size_t j = p.size(); j-- > 0;) indices.back().push_back(gridindices[p.index(j)]);
 			}
 
 #ifdef GEN_SURFACE_DEBUG
 			printf("polyhedron(faces=[");
 			int pidx = 0;
 #endif
-			B.begin_surface(vertices.size(), ps.polygons.size());
+			B.begin_surface(vertices.size(), ps.numPolygons());
 			BOOST_FOREACH(const CGALPoint &p, vertices) {
 				B.add_vertex(p);
 			}
@@ -121,12 +127,12 @@ namespace /* anonymous */ {
 				std::vector<size_t> indices(3);
 
 				// Estimating same # of vertices as polygons (very rough)
-				B.begin_surface(ps.polygons.size(), ps.polygons.size());
+				B.begin_surface(ps.numPolygons(), ps.numPolygons());
 				int pidx = 0;
 #ifdef GEN_SURFACE_DEBUG
 				printf("polyhedron(faces=[");
 #endif
-				BOOST_FOREACH(const Polygon &p, ps.polygons) {
+				BOOST_FOREACH(const Polygon &p, ps.getPolygons()) {
 #ifdef GEN_SURFACE_DEBUG
 					if (pidx++ > 0) printf(",");
 #endif
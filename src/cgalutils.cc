@@ -12,6 +12,7 @@
 #include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
 #include <CGAL/normal_vector_newell_3.h>
 #include <CGAL/Handle_hash_function.h>
+#include <CGAL/Real_timer.h>
 
 #include <CGAL/config.h> 
 #include <CGAL/version.h> 
@@ -26,10 +27,13 @@
 #include "svg.h"
 #include "Reindexer.h"
 #include "GeometryUtils.h"
+#include "quickhull.h"
+#include "TaskScheduler.h"
 
 #include <map>
 #include <queue>
 #include <boost/foreach.hpp>
+#include <boost/bind.hpp>
 #include <boost/unordered_set.hpp>
 
 namespace /* anonymous */ {
@@ -57,10 +61,8 @@ static CGAL_Nef_polyhedron *createNefPolyhedronFromPolySet(const PolySet &ps)
 		// NB! CGAL's convex_hull_3() doesn't like std::set iterators, so we use a list
 		// instead.
 		std::list<K::Point_3> points;
-		BOOST_FOREACH(const Polygon &poly, ps.polygons) {
-			BOOST_FOREACH(const Vector3d &p, poly) {
-				points.push_back(vector_convert<K::Point_3>(p));
-			}
+		BOOST_FOREACH(const Vector3d &p, ps.getVertices()) {
+			points.push_back(vector_convert<K::Point_3>(p));
 		}
 
 		if (points.size() <= 3) return new CGAL_Nef_polyhedron();;
@@ -123,9 +125,7 @@ namespace CGALUtils {
 	{
 		typedef CGAL::Epick K;
 		// Collect point cloud
-		// NB! CGAL's convex_hull_3() doesn't like std::set iterators, so we use a list
-		// instead.
-		std::list<K::Point_3> points;
+		std::vector<Vector3d> points;
 
 		BOOST_FOREACH(const Geometry::ChildItem &item, children) {
 			const shared_ptr<const Geometry> &chgeom = item.second;
@@ -133,30 +133,34 @@ namespace CGALUtils {
 			if (N) {
 				if (!N->isEmpty()) {
 					for (CGAL_Nef_polyhedron3::Vertex_const_iterator i = N->p3->vertices_begin(); i != N->p3->vertices_end(); ++i) {
-						points.push_back(vector_convert<K::Point_3>(i->point()));
+						points.push_back(vector_convert<Vector3d>(i->point()));
 					}
 				}
 			} else {
 				const PolySet *ps = dynamic_cast<const PolySet *>(chgeom.get());
 				if (ps) {
-					BOOST_FOREACH(const Polygon &p, ps->polygons) {
-						BOOST_FOREACH(const Vector3d &v, p) {
-							points.push_back(K::Point_3(v[0], v[1], v[2]));
-						}
-					}
+					points.insert(points.end(), ps->getVertices().begin(), ps->getVertices().end());
 				}
 			}
 		}
 
 		if (points.size() <= 3) return false;
 
+		// Non-degenerate point clouds don't need CGAL
+		if (QuickHull::hull(points, result)) return true;
+
 		// Apply hull
 		bool success = false;
 		if (points.size() >= 4) {
 			CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
 			try {
+				std::vector<K::Point_3> kpoints;
+				kpoints.reserve(points.size());
+				BOOST_FOREACH(const Vector3d &v, points) {
+					kpoints.push_back(K::Point_3(v[0], v[1], v[2]));
+				}
 				CGAL::Polyhedron_3<K> r;
-				CGAL::convex_hull_3(points.begin(), points.end(), r);
+				CGAL::convex_hull_3(kpoints.begin(), kpoints.end(), r);
                             PRINTDB("After hull vertices: %d", r.size_of_vertices());
                             PRINTDB("After hull facets: %d", r.size_of_facets());
                             PRINTDB("After hull closed: %d", r.is_closed());
@@ -207,25 +211,187 @@ namespace CGALUtils {
 		return visited.size() == p.size_of_facets();
 	}
 
+	typedef CGAL::Epick Hull_kernel;
+	typedef std::vector<Hull_kernel::Point_3> Hull_points;
+	typedef CGAL::Polyhedron_3<Hull_kernel> Hull_polyhedron;
+
+	/*!
+		Task body of applyMinkowski(): Computes the Minkowski sum of two convex
+		parts as the convex hull of all pairwise point sums. \a result is left
+		empty if the points don't span a volume. Errors are reported through
+		\a failed, since tasks must not throw.
+	*/
+	static void minkowskiHull(const Hull_points &a, const Hull_points &b, Hull_polyhedron *result, char *failed)
+	{
+		try {
+			CGAL::Real_timer t;
+			t.start();
+			Hull_points minkowski_points;
+			minkowski_points.reserve(a.size() * b.size());
+			for (size_t i = 0; i < a.size(); i++) {
+				for (size_t j = 0; j < b.size(); j++) {
+					minkowski_points.push_back(a[i]+(b[j]-CGAL::ORIGIN));
+				}
+			}
+
+			if (minkowski_points.size() <= 3) return;
+
+			t.stop();
+			PRINTDB("Minkowski: Point cloud creation (%d ⨉ %d -> %d) took %f ms", a.size() % b.size() % minkowski_points.size() % (t.time()*1000));
+			t.reset();
+
+			t.start();
+
+			CGAL::convex_hull_3(minkowski_points.begin(), minkowski_points.end(), *result);
+
+			Hull_points strict_points;
+			strict_points.reserve(minkowski_points.size());
+
+			for (Hull_polyhedron::Vertex_iterator i = result->vertices_begin(); i != result->vertices_end(); ++i) {
+				Hull_kernel::Point_3 const& p = i->point();
+
+				Hull_polyhedron::Vertex::Halfedge_handle h,e;
+				h = i->halfedge();
+				e = h;
+				bool collinear = false;
+				bool coplanar = true;
+
+				do {
+					Hull_kernel::Point_3 const& q = h->opposite()->vertex()->point();
+					if (coplanar && !CGAL::coplanar(p,q,
+													h->next_on_vertex()->opposite()->vertex()->point(),
+													h->next_on_vertex()->next_on_vertex()->opposite()->vertex()->point())) {
+						coplanar = false;
+					}
+
+
+					for (Hull_polyhedron::Vertex::Halfedge_handle j = h->next_on_vertex();
+						 j != h && !collinear && ! coplanar;
+						 j = j->next_on_vertex()) {
+
+						Hull_kernel::Point_3 const& r = j->opposite()->vertex()->point();
+						if (CGAL::collinear(p,q,r)) {
+							collinear = true;
+						}
+					}
+
+					h = h->next_on_vertex();
+				} while (h != e && !collinear);
+
+				if (!collinear && !coplanar)
+					strict_points.push_back(p);
+			}
+
+			result->clear();
+			CGAL::convex_hull_3(strict_points.begin(), strict_points.end(), *result);
+
+			t.stop();
+			PRINTDB("Minkowski: Computing convex hull took %f s", t.time());
+		}
+		catch (...) {
+			result->clear();
+			*failed = true;
+		}
+	}
+
+	static void createMinkowskiNef(const Hull_polyhedron *part, CGAL_Nef_polyhedron **result, char *failed)
+	{
+		try {
+			PolySet ps(3,true);
+			createPolySetFromPolyhedron(*part, ps);
+			*result = createNefPolyhedronFromGeometry(ps);
+		}
+		catch (...) {
+			*failed = true;
+		}
+	}
+
+	static void unionMinkowskiNefs(CGAL_Nef_polyhedron **a, CGAL_Nef_polyhedron **b, char *failed)
+	{
+		try {
+			if ((*a)->isEmpty()) std::swap(*a, *b);
+			if (!(*b)->isEmpty()) **a += **b;
+		}
+		catch (...) {
+			*failed = true;
+		}
+	}
+
+	/*!
+		Unions the parts of a Minkowski sum. The parts are converted to Nef
+		polyhedra in parallel and then unioned pairwise as a balanced tree, so
+		each level of the tree runs in parallel.
+		Returns NULL if any CGAL operation failed.
+	*/
+	static CGAL_Nef_polyhedron *unionMinkowskiParts(const std::vector<const Hull_polyhedron *> &parts, TaskScheduler &scheduler)
+	{
+		std::vector<CGAL_Nef_polyhedron *> nefs(parts.size(), (CGAL_Nef_polyhedron *)NULL);
+		std::vector<char> failed(parts.size(), false);
+		TaskScheduler::TaskGroup group;
+
+		for (size_t i = 0; i < parts.size(); i++) {
+			scheduler.spawn(group, boost::bind(&createMinkowskiNef, parts[i], &nefs[i], &failed[i]));
+		}
+		scheduler.wait(group);
+		bool ok = std::find(failed.begin(), failed.end(), true) == failed.end();
+		for (size_t i = 0; ok && i < nefs.size(); i++) if (!nefs[i]) ok = false;
+
+		for (size_t step = 1; ok && step < nefs.size(); step *= 2) {
+			for (size_t i = 0; i + step < nefs.size(); i += 2*step) {
+				scheduler.spawn(group, boost::bind(&unionMinkowskiNefs, &nefs[i], &nefs[i + step], &failed[i]));
+			}
+			scheduler.wait(group);
+			ok = std::find(failed.begin(), failed.end(), true) == failed.end();
+		}
+
+		for (size_t i = ok ? 1 : 0; i < nefs.size(); i++) delete nefs[i];
+		return ok ? nefs[0] : NULL;
+	}
+
 	/*!
 		children cannot contain NULL objects
+
+		For each pair of children, the sum of two convex PolySets is computed
+		directly as a PolySet. Otherwise both operands are decomposed into convex
+		parts. The Minkowski sums of all pairs of parts are computed as convex
+		hulls in the inexact kernel and unioned in exact arithmetic. Both steps
+		run in parallel when called from a task of a TaskScheduler.
 	*/
 	Geometry const * applyMinkowski(const Geometry::ChildList &children)
 	{
-		CGAL::Timer t,t_tot;
+		CGAL::Real_timer t,t_tot;
 		assert(children.size() >= 2);
 		Geometry::ChildList::const_iterator it = children.begin();
 		t_tot.start();
 		Geometry const* operands[2] = {it->second.get(), NULL};
+		// Without a scheduler, the calling thread runs all tasks while waiting
+		TaskScheduler serial(0);
+		TaskScheduler &scheduler = TaskScheduler::current() ? *TaskScheduler::current() : serial;
 		try {
 			while (++it != children.end()) {
 				operands[1] = it->second.get();
 
-				typedef CGAL::Epick Hull_kernel;
+				// The sum of two convex PolySets is the hull of their vertex sums
+				const PolySet *ps0 = dynamic_cast<const PolySet *>(operands[0]);
+				const PolySet *ps1 = dynamic_cast<const PolySet *>(operands[1]);
+				if (ps0 && ps1 && ps0->is_convex() && ps1->is_convex()) {
+					t.start();
+					PolySet *ps = new PolySet(3, true);
+					bool ok = QuickHull::minkowski(*ps0, *ps1, *ps);
+					t.stop();
+					if (ok) {
+						PRINTDB("Minkowski: Both operands are convex, hull took %f s", t.time());
+						t.reset();
+						if (it != boost::next(children.begin()))
+							delete operands[0];
+						operands[0] = ps;
+						continue;
+					}
+					t.reset();
+					delete ps;
+				}
 
 				std::list<CGAL_Polyhedron> P[2];
-				std::list<CGAL::Polyhedron_3<Hull_kernel> > result_parts;
-
 				for (int i = 0; i < 2; i++) {
 					CGAL_Polyhedron poly;
 
@@ -274,119 +440,54 @@ namespace CGALUtils {
 					}
 				}
 
-				std::vector<Hull_kernel::Point_3> points[2];
-				std::vector<Hull_kernel::Point_3> minkowski_points;
-
-				for (size_t i = 0; i < P[0].size(); i++) {
-					for (size_t j = 0; j < P[1].size(); j++) {
-						t.start();
-						points[0].clear();
-						points[1].clear();
-
-						for (int k = 0; k < 2; k++) {
-							std::list<CGAL_Polyhedron>::iterator it = P[k].begin();
-							std::advance(it, k==0?i:j);
-
-							CGAL_Polyhedron const& poly = *it;
-							points[k].reserve(poly.size_of_vertices());
-
-							for (CGAL_Polyhedron::Vertex_const_iterator pi = poly.vertices_begin(); pi != poly.vertices_end(); ++pi) {
-								CGAL_Polyhedron::Point_3 const& p = pi->point();
-								points[k].push_back(Hull_kernel::Point_3(to_double(p[0]),to_double(p[1]),to_double(p[2])));
-							}
+				// Convert the parts to the inexact kernel up front, so the tasks
+				// don't touch any exact number types
+				std::vector<Hull_points> points[2];
+				for (int k = 0; k < 2; k++) {
+					BOOST_FOREACH(const CGAL_Polyhedron &poly, P[k]) {
+						points[k].push_back(Hull_points());
+						Hull_points &pts = points[k].back();
+						pts.reserve(poly.size_of_vertices());
+						for (CGAL_Polyhedron::Vertex_const_iterator pi = poly.vertices_begin(); pi != poly.vertices_end(); ++pi) {
+							CGAL_Polyhedron::Point_3 const& p = pi->point();
+							pts.push_back(Hull_kernel::Point_3(to_double(p[0]),to_double(p[1]),to_double(p[2])));
 						}
+					}
+				}
 
-						minkowski_points.clear();
-						minkowski_points.reserve(points[0].size() * points[1].size());
-						for (int i = 0; i < points[0].size(); i++) {
-							for (int j = 0; j < points[1].size(); j++) {
-								minkowski_points.push_back(points[0][i]+(points[1][j]-CGAL::ORIGIN));
-							}
-						}
-
-						if (minkowski_points.size() <= 3) {
-							t.stop();
-							continue;
-						}
-
-
-						CGAL::Polyhedron_3<Hull_kernel> result;
-						t.stop();
-						PRINTDB("Minkowski: Point cloud creation (%d ⨉ %d -> %d) took %f ms", points[0].size() % points[1].size() % minkowski_points.size() % (t.time()*1000));
-						t.reset();
-
-						t.start();
-
-						CGAL::convex_hull_3(minkowski_points.begin(), minkowski_points.end(), result);
-
-						std::vector<Hull_kernel::Point_3> strict_points;
-						strict_points.reserve(minkowski_points.size());
-
-						for (CGAL::Polyhedron_3<Hull_kernel>::Vertex_iterator i = result.vertices_begin(); i != result.vertices_end(); ++i) {
-							Hull_kernel::Point_3 const& p = i->point();
-
-							CGAL::Polyhedron_3<Hull_kernel>::Vertex::Halfedge_handle h,e;
-							h = i->halfedge();
-							e = h;
-							bool collinear = false;
-							bool coplanar = true;
-
-							do {
-								Hull_kernel::Point_3 const& q = h->opposite()->vertex()->point();
-								if (coplanar && !CGAL::coplanar(p,q,
-																h->next_on_vertex()->opposite()->vertex()->point(),
-																h->next_on_vertex()->next_on_vertex()->opposite()->vertex()->point())) {
-									coplanar = false;
-								}
-
-
-								for (CGAL::Polyhedron_3<Hull_kernel>::Vertex::Halfedge_handle j = h->next_on_vertex();
-									 j != h && !collinear && ! coplanar;
-									 j = j->next_on_vertex()) {
-
-									Hull_kernel::Point_3 const& r = j->opposite()->vertex()->point();
-									if (CGAL::collinear(p,q,r)) {
-										collinear = true;
-									}
-								}
-
-								h = h->next_on_vertex();
-							} while (h != e && !collinear);
-
-							if (!collinear && !coplanar)
-								strict_points.push_back(p);
-						}
-
-						result.clear();
-						CGAL::convex_hull_3(strict_points.begin(), strict_points.end(), result);
-
-
-						t.stop();
-						PRINTDB("Minkowski: Computing convex hull took %f s", t.time());
-						t.reset();
-
-						result_parts.push_back(result);
+				size_t numpairs = points[0].size() * points[1].size();
+				std::vector<Hull_polyhedron> hulls(numpairs);
+				std::vector<char> failed(numpairs, false);
+				t.start();
+				TaskScheduler::TaskGroup group;
+				for (size_t i = 0; i < points[0].size(); i++) {
+					for (size_t j = 0; j < points[1].size(); j++) {
+						size_t idx = i * points[1].size() + j;
+						scheduler.spawn(group, boost::bind(&minkowskiHull, boost::cref(points[0][i]), boost::cref(points[1][j]), &hulls[idx], &failed[idx]));
 					}
 				}
+				scheduler.wait(group);
+				t.stop();
+				PRINTDB("Minkowski: Computing %d convex hulls using %d threads took %f s", numpairs % (scheduler.numThreads() + 1) % t.time());
+				t.reset();
+				if (std::find(failed.begin(), failed.end(), true) != failed.end()) throw 0;
+
+				std::vector<const Hull_polyhedron *> result_parts;
+				BOOST_FOREACH(const Hull_polyhedron &hull, hulls) {
+					if (!hull.empty()) result_parts.push_back(&hull);
+				}
 
 				if (it != boost::next(children.begin()))
 					delete operands[0];
 
 				if (result_parts.size() == 1) {
 					PolySet *ps = new PolySet(3,true);
-					createPolySetFromPolyhedron(*result_parts.begin(), *ps);
+					createPolySetFromPolyhedron(*result_parts[0], *ps);
 					operands[0] = ps;
 				} else if (!result_parts.empty()) {
 					t.start();
 					PRINTDB("Minkowski: Computing union of %d parts",result_parts.size());
-					Geometry::ChildList fake_children;
-					for (std::list<CGAL::Polyhedron_3<Hull_kernel> >::iterator i = result_parts.begin(); i != result_parts.end(); ++i) {
-						PolySet ps(3,true);
-						createPolySetFromPolyhedron(*i, ps);
-						fake_children.push_back(std::make_pair((const AbstractNode*)NULL,
-															   shared_ptr<const Geometry>(createNefPolyhedronFromGeometry(ps))));
-					}
-					CGAL_Nef_polyhedron *N = CGALUtils::applyOperator(fake_children, OPENSCAD_UNION);
+					CGAL_Nef_polyhedron *N = unionMinkowskiParts(result_parts, scheduler);
 					// FIXME: This hould really never throw.
 					// Assert once we figured out what went wrong with issue #1069?
 					if (!N) throw 0;
@@ -720,16 +821,17 @@ namespace CGALUtils {
 		typedef std::pair<Vector3d,Vector3d> Edge;
 		typedef std::map<Edge, int, VecPairCompare> Edge_to_facet_map;
 		Edge_to_facet_map edge_to_facet_map;
-		std::vector<Plane> facet_planes; facet_planes.reserve(ps.polygons.size());
+		std::vector<Plane> facet_planes; facet_planes.reserve(ps.numPolygons());
 
-		for (int i = 0; i < ps.polygons.size(); i++) {
+		for (int i = 0; i < ps.numPolygons(); i++) {
 			Plane plane;
-			size_t N = ps.polygons[i].size();
+			const PolySet::Face face = ps.getFace(i);
+			size_t N = face.size();
 			if (N >= 3) {
 				std::vector<Point> v(N);
 				for (int j = 0; j < N; j++) {
-					v[j] = vector_convert<Point>(ps.polygons[i][j]);
-					Edge edge(ps.polygons[i][j],ps.polygons[i][(j+1)%N]);
+					v[j] = vector_convert<Point>(face[j]);
+					Edge edge(face[j],face[(j+1)%N]);
 					if (edge_to_facet_map.count(edge)) return false; // edge already exists: nonmanifold
 					edge_to_facet_map[edge] = i;
 				}
@@ -740,18 +842,19 @@ namespace CGALUtils {
 			facet_planes.push_back(plane);
 		}
 
-		for (int i = 0; i < ps.polygons.size(); i++) {
-			size_t N = ps.polygons[i].size();
+		for (int i = 0; i < ps.numPolygons(); i++) {
+			const PolySet::Face face = ps.getFace(i);
+			size_t N = face.size();
 			if (N < 3) continue;
 			for (int j = 0; j < N; j++) {
-				Edge other_edge(ps.polygons[i][(j+1)%N], ps.polygons[i][j]);
+				Edge other_edge(face[(j+1)%N], face[j]);
 				if (edge_to_facet_map.count(other_edge) == 0) return false;//
 				//Edge_to_facet_map::const_iterator it = edge_to_facet_map.find(other_edge);
 				//if (it == edge_to_facet_map.end()) return false; // not a closed manifold
 				//int other_facet = it->second;
 				int other_facet = edge_to_facet_map[other_edge];
 
-				Point p = vector_convert<Point>(ps.polygons[i][(j+2)%N]);
+				Point p = vector_convert<Point>(face[(j+2)%N]);
 
 				if (facet_planes[other_facet].has_on_positive_side(p)) {
 					// Check angle
@@ -774,9 +877,10 @@ namespace CGALUtils {
 		while(!facets_to_visit.empty()) {
 			int f = facets_to_visit.front(); facets_to_visit.pop();
 
-			for (int i = 0; i < ps.polygons[f].size(); i++) {
-				int j = (i+1) % ps.polygons[f].size();
-				Edge_to_facet_map::iterator it = edge_to_facet_map.find(Edge(ps.polygons[f][j], ps.polygons[f][i]));
+			const PolySet::Face face = ps.getFace(f);
+			for (int i = 0; i < face.size(); i++) {
+				int j = (i+1) % face.size();
+				Edge_to_facet_map::iterator it = edge_to_facet_map.find(Edge(face[j], face[i]));
 				if (it == edge_to_facet_map.end()) return false; // Nonmanifold
 				if (!explored_facets.count(it->second)) {
 					explored_facets.insert(it->second);
@@ -786,7 +890,7 @@ namespace CGALUtils {
 		}
 
 		// Make sure that we were able to reach all polygons during our visit
-		return explored_facets.size() == ps.polygons.size();
+		return explored_facets.size() == ps.numPolygons();
 	}
 
 
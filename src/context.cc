@@ -31,6 +31,7 @@
 #include "module.h"
 #include "builtin.h"
 #include "printutils.h"
+#include "FunctionCache.h"
 #include <boost/foreach.hpp>
 #include <boost/filesystem.hpp>
 namespace fs = boost::filesystem;
@@ -135,6 +136,7 @@ ValuePtr Context::lookup_variable(const std::string &name, bool silent) const
 		return ValuePtr::undefined;
 	}
 	if (is_config_variable(name)) {
+		FunctionCache::markUncacheable();
 		for (int i = this->ctx_stack->size()-1; i >= 0; i--) {
 			const ValueMap &confvars = ctx_stack->at(i)->config_variables;
 			if (confvars.find(name) != confvars.end())
@@ -32,6 +32,7 @@
 #include "printutils.h"
 #include "fileutils.h"
 #include "evalcontext.h"
+#include "FunctionCache.h"
 
 #include "mathc99.h"
 #include <sstream>
@@ -45,6 +46,8 @@ namespace fs = boost::filesystem;
 
 ValuePtr builtin_dxf_dim(const Context *ctx, const EvalContext *evalctx)
 {
+	// The result depends on the contents of the file
+	FunctionCache::markUncacheable();
 	std::string filename;
 	std::string layername;
 	std::string name;
@@ -140,6 +143,8 @@ ValuePtr builtin_dxf_dim(const Context *ctx, const EvalContext *evalctx)
 
 ValuePtr builtin_dxf_cross(const Context *ctx, const EvalContext *evalctx)
 {
+	// The result depends on the contents of the file
+	FunctionCache::markUncacheable();
 	std::string filename;
 	std::string layername;
 	double xorigin = 0;
@@ -11,10 +11,21 @@
 
 EvalContext::EvalContext(const Context *parent, 
 												 const AssignmentList &args, const class LocalScope *const scope)
-	: Context(parent), eval_arguments(args), scope(scope)
+	: Context(parent), eval_arguments(args), eval_values(NULL), scope(scope)
 {
 }
 
+/*!
+	Initializes the context with already evaluated argument values, one
+	for each of the arguments in args.
+*/
+EvalContext::EvalContext(const Context *parent,
+												 const AssignmentList &args, const std::vector<ValuePtr> &values)
+	: Context(parent), eval_arguments(args), eval_values(&values), scope(NULL)
+{
+	assert(values.size() == args.size());
+}
+
 const std::string &EvalContext::getArgName(size_t i) const
 {
 	assert(i < this->eval_arguments.size());
@@ -24,6 +35,7 @@ const std::string &EvalContext::getArgName(size_t i) const
 ValuePtr EvalContext::getArgValue(size_t i, const Context *ctx) const
 {
 	assert(i < this->eval_arguments.size());
+	if (this->eval_values) return (*this->eval_values)[i];
 	const Assignment &arg = this->eval_arguments[i];
 	ValuePtr v;
 	if (arg.second) {
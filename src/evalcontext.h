@@ -13,9 +13,12 @@ public:
 
 	EvalContext(const Context *parent, 
 							const AssignmentList &args, const class LocalScope *const scope = NULL);
+	EvalContext(const Context *parent,
+							const AssignmentList &args, const std::vector<ValuePtr> &values);
 	virtual ~EvalContext() {}
 
 	size_t numArgs() const { return this->eval_arguments.size(); }
+	const AssignmentList &getArgs() const { return this->eval_arguments; }
 	const std::string &getArgName(size_t i) const;
 	ValuePtr getArgValue(size_t i, const Context *ctx = NULL) const;
 
@@ -28,5 +31,6 @@ public:
 
 private:
 	const AssignmentList &eval_arguments;
+	const std::vector<ValuePtr> *eval_values;
 	const LocalScope *const scope;
 };
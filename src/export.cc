@@ -29,6 +29,7 @@
 #include "polyset.h"
 #include "polyset-utils.h"
 #include "dxfdata.h"
+#include "BufferedWriter.h"
 
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string.hpp>
@@ -41,12 +42,6 @@
 #include "cgal.h"
 #include "cgalutils.h"
 
-struct triangle {
-    std::string vs1;
-    std::string vs2;
-    std::string vs3;
-};
-
 void exportFile(const class Geometry *root_geom, std::ostream &output, FileFormat format)
 {
 	if (const CGAL_Nef_polyhedron *N = dynamic_cast<const CGAL_Nef_polyhedron *>(root_geom)) {
@@ -55,6 +50,9 @@ void exportFile(const class Geometry *root_geom, std::ostream &output, FileForma
 		case OPENSCAD_STL:
 			export_stl(N, output);
 			break;
+		case OPENSCAD_STL_BINARY:
+			export_stl_binary(N, output);
+			break;
 		case OPENSCAD_OFF:
 			export_off(N, output);
 			break;
@@ -74,6 +72,9 @@ void exportFile(const class Geometry *root_geom, std::ostream &output, FileForma
 			case OPENSCAD_STL:
 				export_stl(*ps, output);
 				break;
+			case OPENSCAD_STL_BINARY:
+				export_stl_binary(*ps, output);
+				break;
 			case OPENSCAD_OFF:
 				export_off(*ps, output);
 				break;
@@ -104,7 +105,9 @@ void exportFile(const class Geometry *root_geom, std::ostream &output, FileForma
 void exportFileByName(const class Geometry *root_geom, FileFormat format,
 	const char *name2open, const char *name2display)
 {
-	std::ofstream fstream(name2open);
+	std::ios::openmode mode = std::ios::out;
+	if (format == OPENSCAD_STL_BINARY) mode |= std::ios::binary;
+	std::ofstream fstream(name2open, mode);
 	if (!fstream.is_open()) {
 		PRINTB("Can't open file \"%s\" for export", name2display);
 	} else {
@@ -126,25 +129,55 @@ void exportFileByName(const class Geometry *root_geom, FileFormat format,
 	}
 }
 
+/*!
+	The vertices of a PolySet formatted as "x y z", each formatted only once.
+	Vertices which format to the same text are considered identical by the
+	exporters, like when each triangle was formatted separately.
+ */
+class FormattedVertices
+{
+public:
+	FormattedVertices(const PolySet &ps) {
+		const std::vector<Vector3d> &vertices = ps.getVertices();
+		this->offsets.reserve(vertices.size() + 1);
+		this->text.reserve(vertices.size() * 3 * 10);
+		char buf[BufferedWriter::MAX_DOUBLE_LENGTH];
+		this->offsets.push_back(0);
+		BOOST_FOREACH(const Vector3d &v, vertices) {
+			for (int j = 0; j < 3; j++) {
+				if (j > 0) this->text.push_back(' ');
+				size_t len = BufferedWriter::formatDouble(v[j], buf);
+				this->text.insert(this->text.end(), buf, buf + len);
+			}
+			this->offsets.push_back(this->text.size());
+		}
+	}
+
+	const char *data(int i) const { return &this->text[this->offsets[i]]; }
+	size_t length(int i) const { return this->offsets[i+1] - this->offsets[i]; }
+	bool equal(int a, int b) const {
+		return a == b || (length(a) == length(b) && !memcmp(data(a), data(b), length(a)));
+	}
+	void write(BufferedWriter &writer, int i) const { writer.write(data(i), length(i)); }
+
+private:
+	std::vector<char> text;
+	std::vector<size_t> offsets;
+};
+
 void export_stl(const PolySet &ps, std::ostream &output)
 {
 	PolySet triangulated(3);
 	PolysetUtils::tessellate_faces(ps, triangulated);
+	FormattedVertices vs(triangulated);
 
-	setlocale(LC_NUMERIC, "C"); // Ensure radix is . (not ,) in output
-	output << "solid OpenSCAD_Model\n";
-	BOOST_FOREACH(const Polygon &p, triangulated.polygons) {
+	BufferedWriter writer(output);
+	writer.write("solid OpenSCAD_Model\n");
+	for (size_t i = 0; i < triangulated.numPolygons(); i++) {
+		const PolySet::Face p = triangulated.getFace(i);
 		assert(p.size() == 3); // STL only allows triangles
-		std::stringstream stream;
-		stream << p[0][0] << " " << p[0][1] << " " << p[0][2];
-		std::string vs1 = stream.str();
-		stream.str("");
-		stream << p[1][0] << " " << p[1][1] << " " << p[1][2];
-		std::string vs2 = stream.str();
-		stream.str("");
-		stream << p[2][0] << " " << p[2][1] << " " << p[2][2];
-		std::string vs3 = stream.str();
-		if (vs1 != vs2 && vs1 != vs3 && vs2 != vs3) {
+		int i0 = p.index(0), i1 = p.index(1), i2 = p.index(2);
+		if (!vs.equal(i0, i1) && !vs.equal(i0, i2) && !vs.equal(i1, i2)) {
 			// The above condition ensures that there are 3 distinct vertices, but
 			// they may be collinear. If they are, the unit normal is meaningless
 			// so the default value of "1 0 0" can be used. If the vertices are not
@@ -152,18 +185,71 @@ void export_stl(const PolySet &ps, std::ostream &output)
 			// components.
 			Vector3d normal = (p[1] - p[0]).cross(p[2] - p[0]);
 			normal.normalize();
-			output << "  facet normal " << normal[0] << " " << normal[1] << " " << normal[2] << "\n";
-			output << "    outer loop\n";
-		
-			BOOST_FOREACH(const Vector3d &v, p) {
-				output << "      vertex " << v[0] << " " << v[1] << " " << v[2] << "\n";
+			writer.write("  facet normal ");
+			writer.write(normal[0]);
+			writer.write(' ');
+			writer.write(normal[1]);
+			writer.write(' ');
+			writer.write(normal[2]);
+			writer.write("\n    outer loop\n");
+			for (size_t j = 0; j < 3; j++) {
+				writer.write("      vertex ");
+				vs.write(writer, p.index(j));
+				writer.write('\n');
 			}
-			output << "    endloop\n";
-			output << "  endfacet\n";
+			writer.write("    endloop\n  endfacet\n");
 		}
 	}
-	output << "endsolid OpenSCAD_Model\n";
-	setlocale(LC_NUMERIC, "");      // Set default locale
+	writer.write("endsolid OpenSCAD_Model\n");
+	writer.flush();
+}
+
+/*!
+	Saves the PolySet as binary STL. Coordinates are stored as single
+	precision floats; triangles which degenerate when converted to floats
+	are left out.
+ */
+void export_stl_binary(const PolySet &ps, std::ostream &output)
+{
+	PolySet triangulated(3);
+	PolysetUtils::tessellate_faces(ps, triangulated);
+
+	const std::vector<Vector3d> &vertices = triangulated.getVertices();
+	std::vector<Eigen::Vector3f> fvertices;
+	fvertices.reserve(vertices.size());
+	BOOST_FOREACH(const Vector3d &v, vertices) fvertices.push_back(v.cast<float>());
+
+	std::vector<size_t> faces;
+	faces.reserve(triangulated.numPolygons());
+	for (size_t i = 0; i < triangulated.numPolygons(); i++) {
+		const PolySet::Face p = triangulated.getFace(i);
+		assert(p.size() == 3); // STL only allows triangles
+		const Eigen::Vector3f &v0 = fvertices[p.index(0)];
+		const Eigen::Vector3f &v1 = fvertices[p.index(1)];
+		const Eigen::Vector3f &v2 = fvertices[p.index(2)];
+		if (v0 != v1 && v0 != v2 && v1 != v2) faces.push_back(i);
+	}
+
+	BufferedWriter writer(output);
+	// The header must not start with "solid", or readers take it for ASCII
+	char header[80];
+	memset(header, ' ', sizeof(header));
+	const char *title = "OpenSCAD Model";
+	memcpy(header, title, strlen(title));
+	writer.write(header, sizeof(header));
+	writer.writeLittleEndian(boost::uint32_t(faces.size()));
+	BOOST_FOREACH(size_t i, faces) {
+		const PolySet::Face p = triangulated.getFace(i);
+		Vector3d normal = (p[1] - p[0]).cross(p[2] - p[0]);
+		if (normal.squaredNorm() > 0) normal.normalize();
+		for (int j = 0; j < 3; j++) writer.writeLittleEndian(float(normal[j]));
+		for (size_t k = 0; k < 3; k++) {
+			const Eigen::Vector3f &v = fvertices[p.index(k)];
+			for (int j = 0; j < 3; j++) writer.writeLittleEndian(v[j]);
+		}
+		writer.writeLittleEndian(boost::uint16_t(0)); // attribute byte count
+	}
+	writer.flush();
 }
 
 /*!
@@ -280,12 +366,51 @@ void export_stl(const CGAL_Nef_polyhedron *root_N, std::ostream &output)
 	}
 }
 
+/*!
+	Saves the current 3D CGAL Nef polyhedron as binary STL to the given file.
+	The file must be open in binary mode.
+ */
+void export_stl_binary(const CGAL_Nef_polyhedron *root_N, std::ostream &output)
+{
+	if (!root_N->p3->is_simple()) {
+		PRINT("WARNING: Exported object may not be a valid 2-manifold and may need repair");
+	}
+
+	PolySet ps(3);
+	bool err = CGALUtils::createPolySetFromNefPolyhedron3(*(root_N->p3), ps);
+	if (err) { PRINT("ERROR: Nef->PolySet failed"); }
+	else {
+		export_stl_binary(ps, output);
+	}
+}
+
 void export_off(const class PolySet &ps, std::ostream &output)
 {
-	// FIXME: Implement this without creating a Nef polyhedron
-	CGAL_Nef_polyhedron *N = CGALUtils::createNefPolyhedronFromGeometry(ps);
-	export_off(N, output);
-	delete N;
+	const std::vector<Vector3d> &vertices = ps.getVertices();
+	BufferedWriter writer(output);
+	writer.write("OFF\n");
+	writer.write((unsigned long)vertices.size());
+	writer.write(' ');
+	writer.write((unsigned long)ps.numPolygons());
+	writer.write(" 0\n");
+	BOOST_FOREACH(const Vector3d &v, vertices) {
+		writer.write(v[0]);
+		writer.write(' ');
+		writer.write(v[1]);
+		writer.write(' ');
+		writer.write(v[2]);
+		writer.write('\n');
+	}
+	for (size_t i = 0; i < ps.numPolygons(); i++) {
+		const PolySet::Face face = ps.getFace(i);
+		writer.write((unsigned long)face.size());
+		for (size_t j = 0; j < face.size(); j++) {
+			writer.write(' ');
+			writer.write((unsigned long)face.index(j));
+		}
+		writer.write('\n');
+	}
+	writer.flush();
 }
 
 void export_off(const CGAL_Nef_polyhedron *root_N, std::ostream &output)
@@ -308,10 +433,57 @@ void export_off(const CGAL_Nef_polyhedron *root_N, std::ostream &output)
 
 void export_amf(const class PolySet &ps, std::ostream &output)
 {
-	// FIXME: Implement this without creating a Nef polyhedron
-	CGAL_Nef_polyhedron *N = CGALUtils::createNefPolyhedronFromGeometry(ps);
-	export_amf(N, output);
-	delete N;
+	PolySet triangulated(3);
+	PolysetUtils::tessellate_faces(ps, triangulated);
+	FormattedVertices vs(triangulated);
+	const std::vector<Vector3d> &vertices = triangulated.getVertices();
+
+	BufferedWriter writer(output);
+	writer.write("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\r\n"
+							 "<amf unit=\"millimeter\">\r\n"
+							 " <metadata type=\"producer\">OpenSCAD " QUOTED(OPENSCAD_VERSION)
+#ifdef OPENSCAD_COMMIT
+							 " (git " QUOTED(OPENSCAD_COMMIT) ")"
+#endif
+							 "</metadata>\r\n"
+							 " <object id=\"0\">\r\n"
+							 "  <mesh>\r\n"
+							 "   <vertices>\r\n");
+	for (size_t i = 0; i < vertices.size(); i++) {
+		const Vector3d &v = vertices[i];
+		writer.write("    <vertex><coordinates>\r\n");
+		for (int j = 0; j < 3; j++) {
+			static const char *axes[3][2] = {
+				{"     <x>", "</x>\r\n"}, {"     <y>", "</y>\r\n"}, {"     <z>", "</z>\r\n"}
+			};
+			writer.write(axes[j][0]);
+			writer.write(v[j]);
+			writer.write(axes[j][1]);
+		}
+		writer.write("    </coordinates></vertex>\r\n");
+	}
+	writer.write("   </vertices>\r\n"
+							 "   <volume>\r\n");
+	for (size_t i = 0; i < triangulated.numPolygons(); i++) {
+		const PolySet::Face p = triangulated.getFace(i);
+		int i0 = p.index(0), i1 = p.index(1), i2 = p.index(2);
+		if (vs.equal(i0, i1) || vs.equal(i0, i2) || vs.equal(i1, i2)) continue;
+		writer.write("    <triangle>\r\n");
+		for (int j = 0; j < 3; j++) {
+			static const char *tags[3][2] = {
+				{"     <v1>", "</v1>\r\n"}, {"     <v2>", "</v2>\r\n"}, {"     <v3>", "</v3>\r\n"}
+			};
+			writer.write(tags[j][0]);
+			writer.write((unsigned long)p.index(j));
+			writer.write(tags[j][1]);
+		}
+		writer.write("    </triangle>\r\n");
+	}
+	writer.write("   </volume>\r\n"
+							 "  </mesh>\r\n"
+							 " </object>\r\n"
+							 "</amf>\r\n");
+	writer.flush();
 }
 
 /*!
@@ -324,113 +496,12 @@ void export_amf(const CGAL_Nef_polyhedron *root_N, std::ostream &output)
 		PRINT("WARNING: Export failed, the object isn't a valid 2-manifold.");
 		return;
 	}
-	CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
-	try {
-		CGAL_Polyhedron P;
-		root_N->p3->convert_to_Polyhedron(P);
-
-		typedef CGAL_Polyhedron::Vertex Vertex;
-		typedef CGAL_Polyhedron::Vertex_const_iterator VCI;
-		typedef CGAL_Polyhedron::Facet_const_iterator FCI;
-		typedef CGAL_Polyhedron::Halfedge_around_facet_const_circulator HFCC;
-
-		setlocale(LC_NUMERIC, "C"); // Ensure radix is . (not ,) in output
-
-		std::vector<std::string> vertices;
-		std::vector<triangle> triangles;
-
-		for (FCI fi = P.facets_begin(); fi != P.facets_end(); ++fi) {
-			HFCC hc = fi->facet_begin();
-			HFCC hc_end = hc;
-			Vertex v1, v2, v3;
-			v1 = *VCI((hc++)->vertex());
-			v3 = *VCI((hc++)->vertex());
-			do {
-				v2 = v3;
-				v3 = *VCI((hc++)->vertex());
-				double x1 = CGAL::to_double(v1.point().x());
-				double y1 = CGAL::to_double(v1.point().y());
-				double z1 = CGAL::to_double(v1.point().z());
-				double x2 = CGAL::to_double(v2.point().x());
-				double y2 = CGAL::to_double(v2.point().y());
-				double z2 = CGAL::to_double(v2.point().z());
-				double x3 = CGAL::to_double(v3.point().x());
-				double y3 = CGAL::to_double(v3.point().y());
-				double z3 = CGAL::to_double(v3.point().z());
-				std::stringstream stream;
-				stream << x1 << " " << y1 << " " << z1;
-				std::string vs1 = stream.str();
-				stream.str("");
-				stream << x2 << " " << y2 << " " << z2;
-				std::string vs2 = stream.str();
-				stream.str("");
-				stream << x3 << " " << y3 << " " << z3;
-				std::string vs3 = stream.str();
-				if (std::find(vertices.begin(), vertices.end(), vs1) == vertices.end())
-					vertices.push_back(vs1);
-				if (std::find(vertices.begin(), vertices.end(), vs2) == vertices.end())
-					vertices.push_back(vs2);
-				if (std::find(vertices.begin(), vertices.end(), vs3) == vertices.end())
-					vertices.push_back(vs3);
-
-				if (vs1 != vs2 && vs1 != vs3 && vs2 != vs3) {
-					// The above condition ensures that there are 3 distinct vertices, but
-					// they may be collinear. If they are, the unit normal is meaningless
-					// so the default value of "1 0 0" can be used. If the vertices are not
-					// collinear then the unit normal must be calculated from the
-					// components.
-					triangle tri = {vs1, vs2, vs3};
-					triangles.push_back(tri);
-				}
-			} while (hc != hc_end);
-		}
-
-		output << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\r\n"
-			<< "<amf unit=\"millimeter\">\r\n"
-			<< " <metadata type=\"producer\">OpenSCAD " << QUOTED(OPENSCAD_VERSION)
-#ifdef OPENSCAD_COMMIT
-			<< " (git " << QUOTED(OPENSCAD_COMMIT) << ")"
-#endif
-			<< "</metadata>\r\n"
-			<< " <object id=\"0\">\r\n"
-			<< "  <mesh>\r\n";
-		output << "   <vertices>\r\n";
-		for (size_t i = 0; i < vertices.size(); i++) {
-			std::string s = vertices[i];
-			output << "    <vertex><coordinates>\r\n";
-			char* chrs = new char[s.length() + 1];
-			strcpy(chrs, s.c_str());
-			std::string coords = strtok(chrs, " ");
-			output << "     <x>" << coords << "</x>\r\n";
-			coords = strtok(NULL, " ");
-			output << "     <y>" << coords << "</y>\r\n";
-			coords = strtok(NULL, " ");
-			output << "     <z>" << coords << "</z>\r\n";
-			output << "    </coordinates></vertex>\r\n";
-		}
-		output << "   </vertices>\r\n";
-		output << "   <volume>\r\n";
-		for (size_t i = 0; i < triangles.size(); i++) {
-			triangle t = triangles[i];
-			output << "    <triangle>\r\n";
-			size_t index;
-			index = std::distance(vertices.begin(), std::find(vertices.begin(), vertices.end(), t.vs1));
-			output << "     <v1>" << index << "</v1>\r\n";
-			index = std::distance(vertices.begin(), std::find(vertices.begin(), vertices.end(), t.vs2));
-			output << "     <v2>" << index << "</v2>\r\n";
-			index = std::distance(vertices.begin(), std::find(vertices.begin(), vertices.end(), t.vs3));
-			output << "     <v3>" << index << "</v3>\r\n";
-			output << "    </triangle>\r\n";
-		}
-		output << "   </volume>\r\n";
-		output << "  </mesh>\r\n"
-			<< " </object>\r\n"
-			<< "</amf>\r\n";
-	} catch (CGAL::Assertion_exception e) {
-		PRINTB("ERROR: CGAL error in CGAL_Nef_polyhedron3::convert_to_Polyhedron(): %s", e.what());
+	PolySet ps(3);
+	bool err = CGALUtils::createPolySetFromNefPolyhedron3(*(root_N->p3), ps);
+	if (err) { PRINT("ERROR: Nef->PolySet failed"); }
+	else {
+		export_amf(ps, output);
 	}
-	CGAL::set_error_behaviour(old_behaviour);
-	setlocale(LC_NUMERIC, ""); // Set default locale
 }
 
 #endif // ENABLE_CGAL
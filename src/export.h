@@ -9,6 +9,7 @@
 
 enum FileFormat {
 	OPENSCAD_STL,
+	OPENSCAD_STL_BINARY,
 	OPENSCAD_OFF,
 	OPENSCAD_AMF,
 	OPENSCAD_DXF,
@@ -22,6 +23,8 @@ void export_png(shared_ptr<const class Geometry> root_geom, Camera &c, std::ostr
 
 void export_stl(const class CGAL_Nef_polyhedron *root_N, std::ostream &output);
 void export_stl(const class PolySet &ps, std::ostream &output);
+void export_stl_binary(const class CGAL_Nef_polyhedron *root_N, std::ostream &output);
+void export_stl_binary(const class PolySet &ps, std::ostream &output);
 void export_off(const CGAL_Nef_polyhedron *root_N, std::ostream &output);
 void export_off(const class PolySet &ps, std::ostream &output);
 void export_amf(const class CGAL_Nef_polyhedron *root_N, std::ostream &output);
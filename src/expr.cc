@@ -26,6 +26,8 @@
 #include "expression.h"
 #include "value.h"
 #include "evalcontext.h"
+#include "bytecode.h"
+#include "feature.h"
 #include <assert.h>
 #include <sstream>
 #include <algorithm>
@@ -44,6 +46,8 @@ namespace {
 			assert(vec[i].type() == Value::VECTOR);
 			n += vec[i].toVector().size();
 		}
+		// A single vector is returned as is, sharing its elements
+		if (vec.size() == 1) return vec[0].toVector();
 		Value::VectorType ret; ret.reserve(n);
 		for (unsigned int i = 0; i < vec.size(); i++) {
 			std::copy(vec[i].toVector().begin(),vec[i].toVector().end(),std::back_inserter(ret));
@@ -505,12 +509,25 @@ void ExpressionLet::print(std::ostream &stream) const
 	stream << "let(" << this->call_arguments << ") " << *first;
 }
 
-ExpressionLcExpression::ExpressionLcExpression(Expression *expr) : Expression(expr)
+ExpressionLcExpression::ExpressionLcExpression(Expression *expr)
+	: Expression(expr), bytecode(NULL), compiled(false)
 {
 }
 
+ExpressionLcExpression::~ExpressionLcExpression()
+{
+	delete this->bytecode;
+}
+
 ValuePtr ExpressionLcExpression::evaluate(const Context *context) const
 {
+	if (Feature::ExperimentalBytecode.is_enabled()) {
+		if (!this->compiled) {
+			this->bytecode = Bytecode::compile(*this);
+			this->compiled = true;
+		}
+		if (this->bytecode) return this->bytecode->evaluate(context);
+	}
 	return this->first->evaluate(context);
 }
 
@@ -197,6 +197,8 @@ public:
 	ValuePtr evaluate(const class Context *context) const;
 	virtual void print(std::ostream &stream) const;
 private:
+	friend class BytecodeCompiler;
+	friend class Function;
 	std::string var_name;
 };
 
@@ -207,6 +209,7 @@ public:
 	ValuePtr evaluate(const class Context *context) const;
 	virtual void print(std::ostream &stream) const;
 private:
+	friend class BytecodeCompiler;
 	std::string member;
 };
 
@@ -228,6 +231,8 @@ public:
 	ValuePtr evaluate(const class Context *context) const;
 	virtual void print(std::ostream &stream) const;
 private:
+	friend class BytecodeCompiler;
+	friend class Function;
 	AssignmentList call_arguments;
 };
 
@@ -235,8 +240,12 @@ class ExpressionLcExpression : public Expression
 {
 public:
 	ExpressionLcExpression(Expression *expr);
+	virtual ~ExpressionLcExpression();
 	ValuePtr evaluate(const class Context *context) const;
 	virtual void print(std::ostream &stream) const;
+private:
+	mutable class Bytecode *bytecode;
+	mutable bool compiled;
 };
 
 class ExpressionLc : public Expression
@@ -250,6 +259,8 @@ public:
 	ValuePtr evaluate(const class Context *context) const;
 	virtual void print(std::ostream &stream) const;
 private:
+	friend class BytecodeCompiler;
+	friend class Function;
 	std::string name;
 	AssignmentList call_arguments;
 };
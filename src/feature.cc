@@ -19,6 +19,9 @@ Feature::list_t Feature::feature_list;
  * context.
  */
 
+const Feature Feature::ExperimentalBytecode("bytecode", "Compile functions and list comprehensions to bytecode.");
+const Feature Feature::ExperimentalMemoize("memoize", "Cache the results of functions which only depend on their arguments.");
+
 Feature::Feature(const std::string &name, const std::string &description)
 	: enabled(false), name(name), description(description)
 {
@@ -12,6 +12,9 @@ public:
 	typedef std::vector<Feature *> list_t;
 	typedef list_t::iterator iterator;
 
+	static const Feature ExperimentalBytecode;
+	static const Feature ExperimentalMemoize;
+
 	const std::string& get_name() const;
 	const std::string& get_description() const;
     
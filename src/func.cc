@@ -27,6 +27,9 @@
 #include "function.h"
 #include "expression.h"
 #include "evalcontext.h"
+#include "bytecode.h"
+#include "modcontext.h"
+#include "FunctionCache.h"
 #include "builtin.h"
 #include <sstream>
 #include <ctime>
@@ -38,6 +41,9 @@
 #include "stackcheck.h"
 #include "exceptions.h"
 #include <boost/foreach.hpp>
+#include <boost/unordered_map.hpp>
+#include <list>
+#include <map>
 
 #include <boost/math/special_functions/fpclassify.hpp>
 using boost::math::isnan;
@@ -85,19 +91,52 @@ std::string AbstractFunction::dump(const std::string &indent, const std::string
 	return dump.str();
 }
 
+static unsigned long function_counter = 0;
+
 Function::Function(const char *name, AssignmentList &definition_arguments, Expression *expr)
-	: name(name), definition_arguments(definition_arguments), expr(expr)
+	: name(name), definition_arguments(definition_arguments), expr(expr), bytecode(NULL), compiled(false),
+		id(function_counter++), cacheable(true), analyzed(false)
 {
 }
 
 Function::~Function()
 {
+	delete bytecode;
 	delete expr;
 }
 
+/*!
+	Returns the function compiled to bytecode, or NULL if the bytecode
+	feature is disabled or the function can't be compiled. The function
+	is compiled the first time it's called.
+*/
+const Bytecode *Function::getBytecode() const
+{
+	if (!Feature::ExperimentalBytecode.is_enabled()) return NULL;
+	if (!this->compiled) {
+		this->bytecode = Bytecode::compile(*this);
+		this->compiled = true;
+	}
+	return this->bytecode;
+}
+
 ValuePtr Function::evaluate(const Context *ctx, const EvalContext *evalctx) const
 {
 	if (!expr) return ValuePtr::undefined;
+	if (this->cacheable && evalctx && Feature::ExperimentalMemoize.is_enabled()) {
+		// Only functions defined at file level are cached, their free
+		// variables and called functions don't change between calls.
+		const FileContext *filectx = dynamic_cast<const FileContext *>(ctx);
+		if (filectx) return evaluateCached(filectx, evalctx);
+	}
+	return evaluateBody(ctx, evalctx);
+}
+
+ValuePtr Function::evaluateBody(const Context *ctx, const EvalContext *evalctx) const
+{
+	const Bytecode *code = getBytecode();
+	if (code && code->accepts(evalctx)) return code->call(ctx, evalctx);
+
 	Context c(ctx);
 	c.setVariables(definition_arguments, evalctx);
 	ValuePtr result = expr->evaluate(&c);
@@ -105,6 +144,120 @@ ValuePtr Function::evaluate(const Context *ctx, const EvalContext *evalctx) cons
 	return result;
 }
 
+/*!
+	Evaluates the function through the FunctionCache. The key consists of
+	the evaluated arguments and the values of the variables found by
+	findVariables(). Results are only cached if the evaluation didn't print
+	anything, and the function isn't cached any more once an evaluation
+	depended on $ variables or random numbers.
+*/
+ValuePtr Function::evaluateCached(const FileContext *ctx, const EvalContext *evalctx) const
+{
+	if (!this->analyzed) findVariables(ctx);
+
+	std::vector<ValuePtr> values;
+	values.reserve(evalctx->numArgs() + this->variables.size());
+	std::string key;
+	key.append(reinterpret_cast<const char *>(&this->id), sizeof(this->id));
+	for (size_t i = 0; i < evalctx->numArgs(); i++) {
+		values.push_back(evalctx->getArgValue(i));
+		FunctionCache::appendKey(key, evalctx->getArgName(i));
+		FunctionCache::appendKey(key, values.back());
+	}
+	BOOST_FOREACH(const std::string &name, this->variables) {
+		values.push_back(ctx->lookup_variable(name, true));
+		FunctionCache::appendKey(key, values.back());
+	}
+
+	ValuePtr result;
+	if (FunctionCache::instance()->lookup(key, result)) return result;
+
+	// The arguments are already evaluated
+	std::vector<ValuePtr> args(values.begin(), values.begin() + evalctx->numArgs());
+	EvalContext c(evalctx->getParent(), evalctx->getArgs(), args);
+	unsigned long uncacheable = FunctionCache::uncacheableCount();
+	print_messages_push();
+	try {
+		result = evaluateBody(ctx, &c);
+	}
+	catch (...) {
+		print_messages_pop();
+		throw;
+	}
+	bool printed = !print_messages_stack.back().empty();
+	print_messages_pop();
+
+	if (FunctionCache::uncacheableCount() != uncacheable) this->cacheable = false;
+	else if (!printed) FunctionCache::instance()->insert(key, result, values);
+	return result;
+}
+
+/*!
+	Finds the variables the function may read besides its parameters:
+	variables used in its body and default values, and in those of the
+	functions it calls which are defined in the same file. Functions from
+	other files only see variables of their own file, which are the same
+	for every call. Variables bound by let() or list comprehensions may be
+	included, that only makes the cache key larger.
+*/
+void Function::findVariables(const FileContext *ctx) const
+{
+	std::set<std::string> variables;
+	std::set<const Function *> visited;
+	std::vector<const Function *> pending;
+	pending.push_back(this);
+	visited.insert(this);
+	while (!pending.empty()) {
+		const Function *f = pending.back();
+		pending.pop_back();
+
+		std::set<std::string> names, functions;
+		collectNames(f->expr, names, functions);
+		BOOST_FOREACH(const Assignment &arg, f->definition_arguments) {
+			collectNames(arg.second.get(), names, functions);
+		}
+		BOOST_FOREACH(const Assignment &arg, f->definition_arguments) {
+			names.erase(arg.first);
+		}
+		BOOST_FOREACH(const std::string &name, names) {
+			// $ variables make the function uncacheable when looked up
+			if (name[0] != '$') variables.insert(name);
+		}
+		BOOST_FOREACH(const std::string &name, functions) {
+			const Function *callee = dynamic_cast<const Function *>(ctx->findLocalFunction(name));
+			if (callee && visited.insert(callee).second) pending.push_back(callee);
+		}
+	}
+	this->variables.assign(variables.begin(), variables.end());
+	this->analyzed = true;
+}
+
+void Function::collectNames(const Expression *expr, std::set<std::string> &variables, std::set<std::string> &functions)
+{
+	if (!expr) return;
+	const AssignmentList *args = NULL;
+	if (const ExpressionLookup *lookup = dynamic_cast<const ExpressionLookup *>(expr)) {
+		variables.insert(lookup->var_name);
+	}
+	else if (const ExpressionFunctionCall *call = dynamic_cast<const ExpressionFunctionCall *>(expr)) {
+		functions.insert(call->funcname);
+		args = &call->call_arguments;
+	}
+	else if (const ExpressionLet *let = dynamic_cast<const ExpressionLet *>(expr)) {
+		args = &let->call_arguments;
+	}
+	else if (const ExpressionLc *lc = dynamic_cast<const ExpressionLc *>(expr)) {
+		args = &lc->call_arguments;
+	}
+	if (args) {
+		BOOST_FOREACH(const Assignment &arg, *args) collectNames(arg.second.get(), variables, functions);
+	}
+	BOOST_FOREACH(const Expression *child, expr->children) collectNames(child, variables, functions);
+	collectNames(expr->first, variables, functions);
+	collectNames(expr->second, variables, functions);
+	collectNames(expr->third, variables, functions);
+}
+
 std::string Function::dump(const std::string &indent, const std::string &name) const
 {
 	std::stringstream dump;
@@ -130,7 +283,8 @@ public:
 	FunctionTailRecursion(const char *name, AssignmentList &definition_arguments, Expression *expr, ExpressionFunctionCall *call, Expression *endexpr, bool invert);
 	virtual ~FunctionTailRecursion();
 
-	virtual ValuePtr evaluate(const Context *ctx, const EvalContext *evalctx) const;
+protected:
+	virtual ValuePtr evaluateBody(const Context *ctx, const EvalContext *evalctx) const;
 };
 
 FunctionTailRecursion::FunctionTailRecursion(const char *name, AssignmentList &definition_arguments, Expression *expr, ExpressionFunctionCall *call, Expression *endexpr, bool invert)
@@ -142,9 +296,10 @@ FunctionTailRecursion::~FunctionTailRecursion()
 {
 }
 
-ValuePtr FunctionTailRecursion::evaluate(const Context *ctx, const EvalContext *evalctx) const
+ValuePtr FunctionTailRecursion::evaluateBody(const Context *ctx, const EvalContext *evalctx) const
 {
-	if (!expr) return ValuePtr::undefined;
+	const Bytecode *code = getBytecode();
+	if (code && code->accepts(evalctx)) return code->call(ctx, evalctx);
 
 	Context c(ctx);
 	c.setVariables(definition_arguments, evalctx);
@@ -232,6 +387,7 @@ ValuePtr builtin_sign(const Context *, const EvalContext *evalctx)
 
 ValuePtr builtin_rands(const Context *, const EvalContext *evalctx)
 {
+	FunctionCache::markUncacheable();
 	size_t n = evalctx->numArgs();
 	if (n == 3 || n == 4) {
 		ValuePtr v0 = evalctx->getArgValue(0);
@@ -616,10 +772,7 @@ ValuePtr builtin_concat(const Context *, const EvalContext *evalctx)
 	for (size_t i = 0; i < evalctx->numArgs(); i++) {
 		ValuePtr v = evalctx->getArgValue(i);
 		if (v->type() == Value::VECTOR) {
-			Value::VectorType vec = v->toVector();
-			for (Value::VectorType::const_iterator it = vec.begin(); it != vec.end(); it++) {
-				result.push_back(*it);
-			}
+			result.append(v->toVector());
 		} else {
 			result.push_back(*v);
 		}
@@ -627,6 +780,148 @@ ValuePtr builtin_concat(const Context *, const EvalContext *evalctx)
 	return ValuePtr(result);
 }
 
+/*!
+	Index of a table passed to search() or lookup(), so repeated calls with
+	the same table don't have to scan all of its rows.
+
+	Tables are identified by their shared elements (see Value::VectorType),
+	so the index is found again as long as the same vector is passed, e.g.
+	from a variable. The index keeps the table alive, which makes sure the
+	elements aren't replaced by another table at the same address.
+*/
+class TableIndex
+{
+public:
+	typedef std::vector<size_t> Rows;
+
+	static TableIndex &get(const Value::VectorType &table);
+
+	const Rows *findValue(const Value &value, unsigned int column);
+	const Rows *findGlyph(gunichar glyph, unsigned int column);
+	size_t invalidRow(unsigned int column);
+	bool getSamples(const std::vector<double> *&keys, const std::vector<double> *&values);
+
+private:
+	TableIndex(const Value::VectorType &table) : table(table), samples_state(UNKNOWN) {}
+
+	static void add(Rows &rows, size_t row) { if (rows.empty() || rows.back() != row) rows.push_back(row); }
+
+	// Rows by hash_value() of their values, the caller compares the values
+	typedef boost::unordered_map<size_t, Rows> ValueMap;
+	typedef boost::unordered_map<gunichar, Rows> GlyphMap;
+
+	Value::VectorType table;
+	std::map<unsigned int, ValueMap> values;
+	std::map<unsigned int, GlyphMap> glyphs;
+	std::map<unsigned int, size_t> invalid;
+
+	enum { UNKNOWN, SORTED, UNSORTED } samples_state;
+	std::vector<double> keys, samples;
+};
+
+// Smaller tables are scanned, indexing them doesn't pay off
+static const size_t min_indexed_rows = 16;
+// Number of tables to keep indexes for
+static const size_t max_table_indexes = 8;
+
+TableIndex &TableIndex::get(const Value::VectorType &table)
+{
+	static std::list<shared_ptr<TableIndex> > indexes;
+
+	for (std::list<shared_ptr<TableIndex> >::iterator it = indexes.begin(); it != indexes.end(); it++) {
+		const Value::VectorType &indexed = (*it)->table;
+		if (indexed.size() == table.size() && &indexed[0] == &table[0]) {
+			indexes.splice(indexes.begin(), indexes, it);
+			return *indexes.front();
+		}
+	}
+	indexes.push_front(shared_ptr<TableIndex>(new TableIndex(table)));
+	if (indexes.size() > max_table_indexes) indexes.pop_back();
+	return *indexes.front();
+}
+
+/*!
+	Returns the rows which may match value in search(): the row itself if
+	column is 0, and the value in column. The rows are in order.
+*/
+const TableIndex::Rows *TableIndex::findValue(const Value &value, unsigned int column)
+{
+	std::map<unsigned int, ValueMap>::iterator found = this->values.find(column);
+	if (found == this->values.end()) {
+		ValueMap &map = this->values[column];
+		for (size_t j = 0; j < this->table.size(); j++) {
+			const Value &element = this->table[j];
+			if (column == 0) add(map[hash_value(element)], j);
+			if (column < element.toVector().size()) add(map[hash_value(element.toVector()[column])], j);
+		}
+		found = this->values.find(column);
+	}
+	ValueMap::const_iterator rows = found->second.find(hash_value(value));
+	return rows == found->second.end() ? NULL : &rows->second;
+}
+
+/*!
+	Returns the rows whose value in column starts with glyph when converted
+	to a string. Only rows which have the column are indexed.
+*/
+const TableIndex::Rows *TableIndex::findGlyph(gunichar glyph, unsigned int column)
+{
+	std::map<unsigned int, GlyphMap>::iterator found = this->glyphs.find(column);
+	if (found == this->glyphs.end()) {
+		GlyphMap &map = this->glyphs[column];
+		for (size_t j = 0; j < this->table.size(); j++) {
+			const Value::VectorType &entry = this->table[j].toVector();
+			if (entry.size() <= column) continue;
+			std::string str = entry[column].toString();
+			add(map[g_utf8_get_char(str.c_str())], j);
+		}
+		found = this->glyphs.find(column);
+	}
+	GlyphMap::const_iterator rows = found->second.find(glyph);
+	return rows == found->second.end() ? NULL : &rows->second;
+}
+
+/*!
+	Returns the first row which doesn't have the column, or the number of
+	rows if all have it.
+*/
+size_t TableIndex::invalidRow(unsigned int column)
+{
+	std::map<unsigned int, size_t>::iterator found = this->invalid.find(column);
+	if (found != this->invalid.end()) return found->second;
+	size_t j = 0;
+	while (j < this->table.size() && this->table[j].toVector().size() > column) j++;
+	this->invalid[column] = j;
+	return j;
+}
+
+/*!
+	Returns the keys and values of a lookup() table if all rows are valid
+	and the keys are in ascending order.
+*/
+bool TableIndex::getSamples(const std::vector<double> *&keys, const std::vector<double> *&values)
+{
+	if (this->samples_state == UNKNOWN) {
+		this->samples_state = SORTED;
+		this->keys.resize(this->table.size());
+		this->samples.resize(this->table.size());
+		for (size_t i = 0; i < this->table.size(); i++) {
+			if (!this->table[i].getVec2(this->keys[i], this->samples[i]) ||
+					(i > 0 && !(this->keys[i - 1] <= this->keys[i]))) {
+				this->samples_state = UNSORTED;
+				break;
+			}
+		}
+		if (this->samples_state == UNSORTED) {
+			this->keys.clear();
+			this->samples.clear();
+		}
+	}
+	keys = &this->keys;
+	values = &this->samples;
+	return this->samples_state == SORTED;
+}
+
 ValuePtr builtin_lookup(const Context *, const EvalContext *evalctx)
 {
 	double p, low_p, low_v, high_p, high_v;
@@ -636,20 +931,37 @@ ValuePtr builtin_lookup(const Context *, const EvalContext *evalctx)
 
 	ValuePtr v1 = evalctx->getArgValue(1);
 	const Value::VectorType &vec = v1->toVector();
-	if (vec[0].toVector().size() < 2) // Second must be a vector of vectors
+	if (vec.empty() || vec[0].toVector().size() < 2) // Second must be a vector of vectors
 		return ValuePtr::undefined;
 	if (!vec[0].getVec2(low_p, low_v) || !vec[0].getVec2(high_p, high_v))
 		return ValuePtr::undefined;
-	for (size_t i = 1; i < vec.size(); i++) {
-		double this_p, this_v;
-		if (vec[i].getVec2(this_p, this_v)) {
-			if (this_p <= p && (this_p > low_p || low_p > p)) {
-				low_p = this_p;
-				low_v = this_v;
-			}
-			if (this_p >= p && (this_p < high_p || high_p < p)) {
-				high_p = this_p;
-				high_v = this_v;
+
+	const std::vector<double> *keys, *values;
+	if (vec.size() >= min_indexed_rows && !isnan(p) && TableIndex::get(vec).getSamples(keys, values)) {
+		// Same rows as found by the scan below: the first of the largest
+		// keys <= p and the first of the smallest keys >= p, else row 0
+		size_t high = std::lower_bound(keys->begin(), keys->end(), p) - keys->begin();
+		size_t upper = std::upper_bound(keys->begin(), keys->end(), p) - keys->begin();
+		size_t low = 0;
+		if (upper > 0) low = std::lower_bound(keys->begin(), keys->begin() + upper, (*keys)[upper - 1]) - keys->begin();
+		if (high == keys->size()) high = 0;
+		low_p = (*keys)[low];
+		low_v = (*values)[low];
+		high_p = (*keys)[high];
+		high_v = (*values)[high];
+	}
+	else {
+		for (size_t i = 1; i < vec.size(); i++) {
+			double this_p, this_v;
+			if (vec[i].getVec2(this_p, this_v)) {
+				if (this_p <= p && (this_p > low_p || low_p > p)) {
+					low_p = this_p;
+					low_v = this_v;
+				}
+				if (this_p >= p && (this_p < high_p || high_p < p)) {
+					high_p = this_p;
+					high_v = this_v;
+				}
 			}
 		}
 	}
@@ -749,43 +1061,100 @@ static Value::VectorType search(const std::string &find, const std::string &tabl
 	return returnvec;
 }
 
+/*!
+	Appends the rows of table whose value in column (or the whole row, for
+	column 0) equals find to rows, up to limit rows unless limit is 0.
+*/
+static void search_value(const Value &find, const Value::VectorType &table,
+												 unsigned int column, unsigned int limit, Value::VectorType &rows)
+{
+	if (table.size() < min_indexed_rows) {
+		for (size_t j = 0; j < table.size(); j++) {
+			const Value &element = table[j];
+			if ((column == 0 && find == element) ||
+					(column < element.toVector().size() && find == element.toVector()[column])) {
+				rows.push_back(Value(double(j)));
+				if (limit != 0 && rows.size() >= limit) break;
+			}
+		}
+		return;
+	}
+
+	const TableIndex::Rows *candidates = TableIndex::get(table).findValue(find, column);
+	if (!candidates) return;
+	BOOST_FOREACH(size_t j, *candidates) {
+		const Value &element = table[j];
+		if ((column == 0 && find == element) ||
+				(column < element.toVector().size() && find == element.toVector()[column])) {
+			rows.push_back(Value(double(j)));
+			if (limit != 0 && rows.size() >= limit) break;
+		}
+	}
+}
+
+/*!
+	Appends the rows of table whose value in column starts with glyph to
+	rows, up to limit rows unless limit is 0. Returns false if a row without
+	the column is reached before.
+*/
+static bool search_glyph(gunichar glyph, const Value::VectorType &table,
+												 unsigned int column, unsigned int limit, Value::VectorType &rows)
+{
+	size_t invalid = table.size();
+	if (table.size() < min_indexed_rows) {
+		for (size_t j = 0; j < table.size(); j++) {
+			const Value::VectorType &entry = table[j].toVector();
+			if (entry.size() <= column) {
+				invalid = j;
+				break;
+			}
+			std::string str = entry[column].toString();
+			if (g_utf8_get_char(str.c_str()) == glyph) {
+				rows.push_back(Value(double(j)));
+				if (limit != 0 && rows.size() >= limit) return true;
+			}
+		}
+	}
+	else {
+		TableIndex &index = TableIndex::get(table);
+		invalid = index.invalidRow(column);
+		const TableIndex::Rows *matches = index.findGlyph(glyph, column);
+		if (matches) {
+			BOOST_FOREACH(size_t j, *matches) {
+				if (j > invalid) break;
+				rows.push_back(Value(double(j)));
+				if (limit != 0 && rows.size() >= limit) return true;
+			}
+		}
+	}
+	if (invalid < table.size()) {
+		PRINTB("WARNING: Invalid entry in search vector at index %d, required number of values in the entry: %d. Invalid entry: %s", invalid % (column + 1) % table[invalid]);
+		return false;
+	}
+	return true;
+}
+
 static Value::VectorType search(const std::string &find, const Value::VectorType &table,
 																unsigned int num_returns_per_match, unsigned int index_col_num)
 {
 	Value::VectorType returnvec;
 	//Unicode glyph count for the length
 	unsigned int findThisSize =  g_utf8_strlen(find.c_str(), find.size());
-	unsigned int searchTableSize = table.size();
 	for (size_t i = 0; i < findThisSize; i++) {
-		unsigned int matchCount = 0;
 		Value::VectorType resultvec;
 		const gchar *ptr_ft = g_utf8_offset_to_pointer(find.c_str(), i);
-		for (size_t j = 0; j < searchTableSize; j++) {
-			Value::VectorType entryVec = table[j].toVector();
-			if (entryVec.size() <= index_col_num) {
-				PRINTB("WARNING: Invalid entry in search vector at index %d, required number of values in the entry: %d. Invalid entry: %s", j % (index_col_num + 1) % table[j]);
-				return Value::VectorType();
-			}
-			const gchar *ptr_st = g_utf8_offset_to_pointer(entryVec[index_col_num].toString().c_str(), 0);
-			if (ptr_ft && ptr_st && (g_utf8_get_char(ptr_ft) == g_utf8_get_char(ptr_st)) ) {
-				matchCount++;
-				if (num_returns_per_match == 1) {
-					returnvec.push_back(Value(double(j)));
-					break;
-				} else {
-					resultvec.push_back(Value(double(j)));
-				}
-				if (num_returns_per_match > 1 && matchCount >= num_returns_per_match) {
-					break;
-				}
-			}
+		if (!search_glyph(g_utf8_get_char(ptr_ft), table, index_col_num, num_returns_per_match, resultvec)) {
+			return Value::VectorType();
 		}
-		if (matchCount == 0) {
+		if (resultvec.empty()) {
 			gchar utf8_of_cp[6] = ""; //A buffer for a single unicode character to be copied into
 			if (ptr_ft) g_utf8_strncpy(utf8_of_cp, ptr_ft, 1);
 			PRINTB("  WARNING: search term not found: \"%s\"", utf8_of_cp);
 		}
-		if (num_returns_per_match == 0 || num_returns_per_match > 1) {
+		if (num_returns_per_match == 1) {
+			if (!resultvec.empty()) returnvec.push_back(resultvec[0]);
+		}
+		else {
 			returnvec.push_back(Value(resultvec));
 		}
 	}
@@ -804,19 +1173,7 @@ ValuePtr builtin_search(const Context *, const EvalContext *evalctx)
 	Value::VectorType returnvec;
 
 	if (findThis->type() == Value::NUMBER) {
-		unsigned int matchCount = 0;
-
-		for (size_t j = 0; j < searchTable->toVector().size(); j++) {
-			const Value &search_element = searchTable->toVector()[j];
-
-			if ((index_col_num == 0 && *findThis == search_element) ||
-					(index_col_num < search_element.toVector().size() &&
-					*findThis      == search_element.toVector()[index_col_num])) {
-				returnvec.push_back(Value(double(j)));
-				matchCount++;
-				if (num_returns_per_match != 0 && matchCount >= num_returns_per_match) break;
-			}
-		}
+		search_value(*findThis, searchTable->toVector(), index_col_num, num_returns_per_match, returnvec);
 	} else if (findThis->type() == Value::STRING) {
 		if (searchTable->type() == Value::STRING) {
 			returnvec = search(findThis->toString(), searchTable->toString(), num_returns_per_match);
@@ -826,39 +1183,24 @@ ValuePtr builtin_search(const Context *, const EvalContext *evalctx)
 		}
 	} else if (findThis->type() == Value::VECTOR) {
 		for (size_t i = 0; i < findThis->toVector().size(); i++) {
-		  unsigned int matchCount = 0;
 			Value::VectorType resultvec;
 
 			Value const& find_value = findThis->toVector()[i];
+			search_value(find_value, searchTable->toVector(), index_col_num, num_returns_per_match, resultvec);
 
-			for (size_t j = 0; j < searchTable->toVector().size(); j++) {
-
-				Value const& search_element = searchTable->toVector()[j];
-
-				if ((index_col_num == 0 && find_value == search_element) ||
-					(index_col_num < search_element.toVector().size() &&
-					find_value    == search_element.toVector()[index_col_num])) {
-					Value resultValue((double(j)));
-		      matchCount++;
-		      if (num_returns_per_match == 1) {
-						returnvec.push_back(resultValue);
-						break;
-		      } else {
-						resultvec.push_back(resultValue);
-		      }
-		      if (num_returns_per_match > 1 && matchCount >= num_returns_per_match) break;
-		    }
-		  }
-		  if (num_returns_per_match == 1 && matchCount == 0) {
-		    if (findThis->toVector()[i].type() == Value::NUMBER) {
-					PRINTB("  WARNING: search term not found: %s",findThis->toVector()[i].toDouble());
+			if (num_returns_per_match == 1 && !resultvec.empty()) {
+				returnvec.push_back(resultvec[0]);
+			}
+			else if (num_returns_per_match == 1) {
+				if (find_value.type() == Value::NUMBER) {
+					PRINTB("  WARNING: search term not found: %s",find_value.toDouble());
 				}
-		    else if (findThis->toVector()[i].type() == Value::STRING) {
-					PRINTB("  WARNING: search term not found: \"%s\"",findThis->toVector()[i].toString());
+				else if (find_value.type() == Value::STRING) {
+					PRINTB("  WARNING: search term not found: \"%s\"",find_value.toString());
 				}
-		    returnvec.push_back(resultvec);
-		  }
-		  if (num_returns_per_match == 0 || num_returns_per_match > 1) {
+				returnvec.push_back(resultvec);
+			}
+			if (num_returns_per_match == 0 || num_returns_per_match > 1) {
 				returnvec.push_back(resultvec);
 			}
 		}
@@ -898,6 +1240,7 @@ ValuePtr builtin_version_num(const Context *ctx, const EvalContext *evalctx)
 
 ValuePtr builtin_parent_module(const Context *, const EvalContext *evalctx)
 {
+	FunctionCache::markUncacheable();
 	int n;
 	double d;
 	int s = Module::stack_size();
@@ -6,6 +6,7 @@
 
 #include <string>
 #include <vector>
+#include <set>
 
 class AbstractFunction
 {
@@ -50,4 +51,25 @@ public:
 	virtual std::string dump(const std::string &indent, const std::string &name) const;
         
         static Function * create(const char *name, AssignmentList &definition_arguments, Expression *expr);
+
+protected:
+	virtual ValuePtr evaluateBody(const Context *ctx, const EvalContext *evalctx) const;
+	const class Bytecode *getBytecode() const;
+
+private:
+	ValuePtr evaluateCached(const class FileContext *ctx, const EvalContext *evalctx) const;
+	void findVariables(const class FileContext *ctx) const;
+	static void collectNames(const Expression *expr, std::set<std::string> &variables, std::set<std::string> &functions);
+
+	mutable class Bytecode *bytecode;
+	mutable bool compiled;
+
+	// Identifies the function in FunctionCache keys
+	const unsigned long id;
+	// Cleared when an evaluation depended on state not in the cache key
+	mutable bool cacheable;
+	// Variables the result depends on other than the arguments, including
+	// those of functions called from this one
+	mutable bool analyzed;
+	mutable std::vector<std::string> variables;
 };
@@ -6,14 +6,18 @@
 #include <boost/foreach.hpp>
 #include <boost/regex.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
 namespace fs = boost::filesystem;
 #include "boosty.h"
 
 boost::unordered_set<std::string> dependencies;
 const char *make_command = NULL;
+static boost::mutex dependencies_mutex;
 
 void handle_dep(const std::string &filename)
 {
+	// Leaf nodes may register dependencies from parallel geometry evaluation
+	boost::mutex::scoped_lock lock(dependencies_mutex);
 	fs::path filepath(filename);
 	std::string dep;
 	if (boosty::is_absolute(filepath)) dep = filename;
@@ -0,0 +1,103 @@
+#include "hash-utils.h"
+
+#include <cstring>
+#include <sstream>
+#include <iomanip>
+
+namespace HashUtils {
+
+	static inline boost::uint64_t rotl64(boost::uint64_t x, int r)
+	{
+		return (x << r) | (x >> (64 - r));
+	}
+
+	static inline boost::uint64_t fmix64(boost::uint64_t k)
+	{
+		k ^= k >> 33;
+		k *= 0xff51afd7ed558ccdULL;
+		k ^= k >> 33;
+		k *= 0xc4ceb9fe1a85ec53ULL;
+		k ^= k >> 33;
+		return k;
+	}
+
+	// Little-endian block read, independent of host byte order and alignment
+	static inline boost::uint64_t getblock64(const unsigned char *p)
+	{
+		boost::uint64_t k = 0;
+		for (int i=7;i>=0;i--) k = (k << 8) | p[i];
+		return k;
+	}
+
+	/*!
+		MurmurHash3_x64_128 by Austin Appleby (public domain).
+	*/
+	Hash128 hash128(const void *key, size_t len, boost::uint64_t seed)
+	{
+		const unsigned char *data = static_cast<const unsigned char *>(key);
+		const size_t nblocks = len / 16;
+
+		boost::uint64_t h1 = seed;
+		boost::uint64_t h2 = seed;
+		const boost::uint64_t c1 = 0x87c37b91114253d5ULL;
+		const boost::uint64_t c2 = 0x4cf5ad432745937fULL;
+
+		for (size_t i=0;i<nblocks;i++) {
+			boost::uint64_t k1 = getblock64(data + i*16);
+			boost::uint64_t k2 = getblock64(data + i*16 + 8);
+
+			k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+			h1 = rotl64(h1, 27); h1 += h2; h1 = h1*5 + 0x52dce729;
+			k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+			h2 = rotl64(h2, 31); h2 += h1; h2 = h2*5 + 0x38495ab5;
+		}
+
+		const unsigned char *tail = data + nblocks*16;
+		boost::uint64_t k1 = 0;
+		boost::uint64_t k2 = 0;
+		switch (len & 15) {
+		case 15: k2 ^= boost::uint64_t(tail[14]) << 48;
+		case 14: k2 ^= boost::uint64_t(tail[13]) << 40;
+		case 13: k2 ^= boost::uint64_t(tail[12]) << 32;
+		case 12: k2 ^= boost::uint64_t(tail[11]) << 24;
+		case 11: k2 ^= boost::uint64_t(tail[10]) << 16;
+		case 10: k2 ^= boost::uint64_t(tail[ 9]) << 8;
+		case  9: k2 ^= boost::uint64_t(tail[ 8]) << 0;
+			k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+		case  8: k1 ^= boost::uint64_t(tail[ 7]) << 56;
+		case  7: k1 ^= boost::uint64_t(tail[ 6]) << 48;
+		case  6: k1 ^= boost::uint64_t(tail[ 5]) << 40;
+		case  5: k1 ^= boost::uint64_t(tail[ 4]) << 32;
+		case  4: k1 ^= boost::uint64_t(tail[ 3]) << 24;
+		case  3: k1 ^= boost::uint64_t(tail[ 2]) << 16;
+		case  2: k1 ^= boost::uint64_t(tail[ 1]) << 8;
+		case  1: k1 ^= boost::uint64_t(tail[ 0]) << 0;
+			k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+		};
+
+		h1 ^= len; h2 ^= len;
+		h1 += h2; h2 += h1;
+		h1 = fmix64(h1); h2 = fmix64(h2);
+		h1 += h2; h2 += h1;
+
+		Hash128 result;
+		result.h1 = h1;
+		result.h2 = h2;
+		return result;
+	}
+
+	Hash128 hash128(const std::string &data, boost::uint64_t seed)
+	{
+		return hash128(data.data(), data.size(), seed);
+	}
+
+	/*!
+		Returns the hash as 32 hex digits.
+	*/
+	std::string Hash128::toString() const
+	{
+		std::ostringstream out;
+		out << std::hex << std::setfill('0') << std::setw(16) << h1 << std::setw(16) << h2;
+		return out.str();
+	}
+};
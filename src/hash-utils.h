@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+#include <boost/cstdint.hpp>
+
+namespace HashUtils {
+	/*!
+		A 128-bit hash value. Stable across runs and platforms, so it can be
+		used for persistent keys.
+	*/
+	struct Hash128 {
+		Hash128() : h1(0), h2(0) {}
+		boost::uint64_t h1, h2;
+		bool operator==(const Hash128 &other) const { return h1 == other.h1 && h2 == other.h2; }
+		bool operator!=(const Hash128 &other) const { return !(*this == other); }
+		std::string toString() const;
+	};
+
+	Hash128 hash128(const void *data, size_t len, boost::uint64_t seed = 0);
+	Hash128 hash128(const std::string &data, boost::uint64_t seed = 0);
+};
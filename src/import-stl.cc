@@ -0,0 +1,263 @@
+#include "import-stl.h"
+#include "polyset.h"
+#include "printutils.h"
+#include "TaskScheduler.h"
+#include "calc.h"
+
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+namespace fs = boost::filesystem;
+namespace ipc = boost::interprocess;
+
+// ASCII files larger than this are split between threads
+#define STL_PARALLEL_CHUNK_SIZE (4*1024*1024)
+#define STL_FACET_NUMBYTES 50
+
+namespace {
+
+	/*!
+		The content of a file, memory mapped if possible.
+	*/
+	class FileContent
+	{
+	public:
+		bool open(const std::string &filename) {
+			boost::system::error_code ec;
+			boost::uintmax_t size = fs::file_size(filename, ec);
+			if (ec) return false;
+			if (size == 0) {
+				this->begin = this->end = NULL;
+				return true;
+			}
+			try {
+				this->mapping = ipc::file_mapping(filename.c_str(), ipc::read_only);
+				this->region = ipc::mapped_region(this->mapping, ipc::read_only);
+				this->begin = static_cast<const char *>(this->region.get_address());
+				this->end = this->begin + this->region.get_size();
+				return true;
+			}
+			catch (const ipc::interprocess_exception &) {
+			}
+			// Fall back to reading the file, e.g. if mapping isn't supported
+			std::ifstream f(filename.c_str(), std::ios::in | std::ios::binary);
+			if (!f.good()) return false;
+			this->buffer.resize(size);
+			f.read(&this->buffer[0], size);
+			this->buffer.resize(f.gcount());
+			this->begin = this->buffer.empty() ? NULL : &this->buffer[0];
+			this->end = this->begin + this->buffer.size();
+			return true;
+		}
+
+		const char *begin;
+		const char *end;
+
+	private:
+		ipc::file_mapping mapping;
+		ipc::mapped_region region;
+		std::vector<char> buffer;
+	};
+
+	boost::uint32_t read_uint32(const char *p)
+	{
+		const unsigned char *b = reinterpret_cast<const unsigned char *>(p);
+		return boost::uint32_t(b[0]) | (boost::uint32_t(b[1]) << 8) |
+			(boost::uint32_t(b[2]) << 16) | (boost::uint32_t(b[3]) << 24);
+	}
+
+	// As there is no 'float32_t' standard, we assume the system's 'float'
+	// is a 'binary32' aka 'single' standard IEEE 32-bit floating point type
+	float read_float(const char *p)
+	{
+		boost::uint32_t n = read_uint32(p);
+		float f;
+		memcpy(&f, &n, sizeof(f));
+		return f;
+	}
+
+	bool is_space(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+	}
+
+	bool starts_with(const char *p, const char *end, const char *word)
+	{
+		size_t len = strlen(word);
+		return size_t(end - p) >= len && !memcmp(p, word, len);
+	}
+
+	/*!
+		Result of parsing a part of an ASCII STL file: the coordinates of
+		three vertices per facet, and the lines which couldn't be parsed.
+	*/
+	struct AsciiChunk {
+		AsciiChunk(const char *begin, const char *end) : begin(begin), end(end) {}
+		const char *begin;
+		const char *end;
+		std::vector<double> coords;
+		std::vector<std::string> badlines;
+	};
+
+	/*!
+		Parses all lines starting in [chunk.begin, chunk.end). Lines are
+		recognized by their first word; "outer loop" starts a facet and the
+		following three "vertex" lines complete it.
+	*/
+	void parse_ascii_chunk(AsciiChunk *chunk, const char *fileend)
+	{
+		chunk->coords.reserve((chunk->end - chunk->begin) / 80 * 3);
+		int i = 0;
+		double vdata[9];
+		const char *line = chunk->begin;
+		while (line < chunk->end) {
+			const char *eol = static_cast<const char *>(memchr(line, '\n', fileend - line));
+			if (!eol) eol = fileend;
+			const char *p = line;
+			const char *linebegin = line;
+			line = eol + 1;
+
+			while (p < eol && is_space(*p)) p++;
+			if (starts_with(p, eol, "outer")) {
+				i = 0;
+				continue;
+			}
+			if (!starts_with(p, eol, "vertex") || p + 6 == eol || !is_space(p[6])) continue;
+			p += 6;
+			if (i >= 3) continue;
+
+			int v;
+			for (v = 0; v < 3; v++) {
+				while (p < eol && is_space(*p)) p++;
+				const char *token = p;
+				while (p < eol && !is_space(*p)) p++;
+				if (token == p || !Calc::parse_double(token, p, vdata[3*i + v])) break;
+			}
+			if (v < 3) {
+				const char *lineend = eol;
+				while (lineend > linebegin && is_space(lineend[-1])) lineend--;
+				while (linebegin < lineend && is_space(*linebegin)) linebegin++;
+				chunk->badlines.push_back(std::string(linebegin, lineend));
+				i = 10;
+				continue;
+			}
+			if (++i == 3) chunk->coords.insert(chunk->coords.end(), vdata, vdata + 9);
+		}
+	}
+
+	/*!
+		Returns the start of the first line at or after pos which starts a
+		facet's vertex loop, or end if there is none.
+	*/
+	const char *next_facet_boundary(const char *pos, const char *begin, const char *end)
+	{
+		// Move to the start of a line
+		while (pos > begin && pos < end && pos[-1] != '\n') pos++;
+		while (pos < end) {
+			const char *p = pos;
+			while (p < end && (*p == ' ' || *p == '\t')) p++;
+			if (starts_with(p, end, "outer")) return pos;
+			const char *eol = static_cast<const char *>(memchr(pos, '\n', end - pos));
+			if (!eol) break;
+			pos = eol + 1;
+		}
+		return end;
+	}
+
+	void import_ascii(const char *begin, const char *end, PolySet &ps)
+	{
+		size_t numchunks = 1;
+		if (size_t(end - begin) > 2 * STL_PARALLEL_CHUNK_SIZE) {
+			numchunks = std::min(size_t(TaskScheduler::hardwareConcurrency()),
+													 size_t(end - begin) / STL_PARALLEL_CHUNK_SIZE);
+			if (numchunks < 1) numchunks = 1;
+		}
+
+		std::vector<AsciiChunk> chunks;
+		const char *chunkbegin = begin;
+		for (size_t i = 1; i <= numchunks; i++) {
+			const char *chunkend = (i == numchunks) ? end :
+				next_facet_boundary(begin + (end - begin) * i / numchunks, begin, end);
+			if (chunkend < chunkbegin) chunkend = chunkbegin;
+			chunks.push_back(AsciiChunk(chunkbegin, chunkend));
+			chunkbegin = chunkend;
+		}
+
+		if (chunks.size() > 1) {
+			// Share the threads of a parallel evaluation, if there is one. The
+			// calling thread parses chunks while waiting.
+			boost::scoped_ptr<TaskScheduler> ownscheduler;
+			if (!TaskScheduler::current()) ownscheduler.reset(new TaskScheduler(chunks.size() - 1));
+			TaskScheduler &scheduler = ownscheduler ? *ownscheduler : *TaskScheduler::current();
+			TaskScheduler::TaskGroup group;
+			for (size_t i = 0; i < chunks.size(); i++) {
+				scheduler.spawn(group, boost::bind(parse_ascii_chunk, &chunks[i], end));
+			}
+			scheduler.wait(group);
+		}
+		else {
+			parse_ascii_chunk(&chunks[0], end);
+		}
+
+		size_t numcoords = 0;
+		BOOST_FOREACH(const AsciiChunk &chunk, chunks) numcoords += chunk.coords.size();
+		ps.reserve(numcoords / 9, numcoords / 3);
+		BOOST_FOREACH(const AsciiChunk &chunk, chunks) {
+			BOOST_FOREACH(const std::string &line, chunk.badlines) {
+				PRINTB("WARNING: Can't parse vertex line '%s'.", line);
+			}
+			const std::vector<double> &coords = chunk.coords;
+			for (size_t i = 0; i + 9 <= coords.size(); i += 9) {
+				ps.append_poly();
+				ps.append_vertex(coords[i], coords[i+1], coords[i+2]);
+				ps.append_vertex(coords[i+3], coords[i+4], coords[i+5]);
+				ps.append_vertex(coords[i+6], coords[i+7], coords[i+8]);
+			}
+		}
+	}
+
+	/*!
+		Adds the facets of a binary STL file directly from the file content.
+	*/
+	void import_binary(const char *begin, size_t numfacets, PolySet &ps)
+	{
+		ps.reserve(numfacets, numfacets * 3);
+		const char *facet = begin + 84;
+		for (size_t i = 0; i < numfacets; i++, facet += STL_FACET_NUMBYTES) {
+			// The first 12 bytes are the normal, the attribute byte count is ignored
+			ps.append_poly();
+			for (int v = 0; v < 3; v++) {
+				const char *p = facet + 12 + 12 * v;
+				ps.append_vertex(read_float(p), read_float(p + 4), read_float(p + 8));
+			}
+		}
+	}
+}
+
+bool import_stl(const std::string &filename, PolySet &ps)
+{
+	FileContent content;
+	if (!content.open(filename)) return false;
+
+	size_t size = content.end - content.begin;
+	if (size >= 84) {
+		boost::uint32_t numfacets = read_uint32(content.begin + 80);
+		if (size == 84 + boost::uint64_t(STL_FACET_NUMBYTES) * numfacets) {
+			import_binary(content.begin, numfacets, ps);
+			return true;
+		}
+	}
+	if (starts_with(content.begin, content.end, "solid")) {
+		import_ascii(content.begin, content.end, ps);
+	}
+	return true;
+}
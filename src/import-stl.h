@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+
+class PolySet;
+
+/*!
+	Reads an ASCII or binary STL file into the given PolySet.
+
+	The file is memory mapped. ASCII files are parsed with a hand-written
+	tokenizer and large files are split at facet boundaries and parsed in
+	parallel. Vertices are shared between facets as they are added.
+
+	Returns false if the file couldn't be read.
+*/
+bool import_stl(const std::string &filename, PolySet &ps);
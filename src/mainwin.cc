@@ -638,10 +638,10 @@ void MainWindow::loadDesignSettings()
 	if (settings.value("design/autoReload", true).toBool()) {
 		designActionAutoReload->setChecked(true);
 	}
-	uint polySetCacheSize = Preferences::inst()->getValue("advanced/polysetCacheSize").toUInt();
+	qulonglong polySetCacheSize = Preferences::inst()->getValue("advanced/polysetCacheSize").toULongLong();
 	GeometryCache::instance()->setMaxSize(polySetCacheSize);
 #ifdef ENABLE_CGAL
-	uint cgalCacheSize = Preferences::inst()->getValue("advanced/cgalCacheSize").toUInt();
+	qulonglong cgalCacheSize = Preferences::inst()->getValue("advanced/cgalCacheSize").toULongLong();
 	CGALCache::instance()->setMaxSize(cgalCacheSize);
 #endif
 }
@@ -1027,6 +1027,9 @@ void MainWindow::instantiateRoot()
 	delete this->thrownTogetherRenderer;
 	this->thrownTogetherRenderer = NULL;
 
+	// Let the tree remember the IDs of the previous CSG tree before removing it
+	this->tree.setRoot(NULL);
+
 	// Remove previous CSG tree
 	delete this->absolute_root_node;
 	this->absolute_root_node = NULL;
@@ -1046,7 +1049,6 @@ void MainWindow::instantiateRoot()
 	this->background_chain = NULL;
 
 	this->root_node = NULL;
-	this->tree.setRoot(NULL);
 
 	if (this->root_module) {
 		// Evaluate CSG tree
@@ -1068,9 +1070,9 @@ void MainWindow::instantiateRoot()
 			}
 			// FIXME: Consider giving away ownership of root_node to the Tree, or use reference counted pointers
 			this->tree.setRoot(this->root_node);
-			// Dump the tree (to initialize caches).
-			// FIXME: We shouldn't really need to do this explicitly..
-			this->tree.getString(*this->root_node);
+			// The tree reuses the IDs of unchanged subtrees from the previous
+			// root, and their geometry is found in the caches by ID. The text
+			// dump is only created when needed.
 		}
 	}
 
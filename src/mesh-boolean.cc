@@ -0,0 +1,534 @@
+#include "mesh-boolean.h"
+#include "polyset.h"
+#include "polyset-utils.h"
+#include "GeometryUtils.h"
+#include "printutils.h"
+#include "grid.h"
+
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <boost/foreach.hpp>
+#include <boost/unordered_map.hpp>
+
+namespace /* anonymous */ {
+
+	/*!
+		The BSP CSG algorithm follows csg.js by Evan Wallace (MIT license).
+	*/
+	enum { COPLANAR = 0, FRONT = 1, BACK = 2, SPANNING = 3 };
+
+	// Points closer than this to a plane are considered to lie on the plane.
+	// Must be larger than the vertex quantization error.
+	const double PLANE_EPSILON = 10 * GRID_FINE;
+
+	struct Plane {
+		Vector3d normal;
+		double w;
+		void flip() {
+			this->normal = -this->normal;
+			this->w = -this->w;
+		}
+	};
+
+	struct BspPolygon {
+		std::vector<Vector3d> vertices;
+		Plane plane;
+		void flip() {
+			std::reverse(this->vertices.begin(), this->vertices.end());
+			this->plane.flip();
+		}
+	};
+
+	// Polygons are owned by a PolygonPool and passed around by pointer, since
+	// they move between BSP nodes a lot. std::deque keeps pointers valid.
+	typedef std::deque<BspPolygon> PolygonPool;
+	typedef std::vector<BspPolygon *> BspPolygons;
+
+	bool lexicographic_less(const Vector3d &a, const Vector3d &b)
+	{
+		if (a[0] != b[0]) return a[0] < b[0];
+		if (a[1] != b[1]) return a[1] < b[1];
+		return a[2] < b[2];
+	}
+
+	/*!
+		Splits polygon by plane. Coplanar polygons go into either coplanarFront
+		or coplanarBack depending on their orientation. Spanning polygons are
+		split into two new polygons allocated from pool.
+	*/
+	void splitPolygon(const Plane &plane, BspPolygon *polygon, PolygonPool &pool,
+										BspPolygons &coplanarFront, BspPolygons &coplanarBack,
+										BspPolygons &front, BspPolygons &back)
+	{
+		const std::vector<Vector3d> &vertices = polygon->vertices;
+		const size_t n = vertices.size();
+		int polygontype = COPLANAR;
+		for (size_t i=0;i<n && polygontype != SPANNING;i++) {
+			double t = plane.normal.dot(vertices[i]) - plane.w;
+			polygontype |= (t < -PLANE_EPSILON) ? BACK : (t > PLANE_EPSILON) ? FRONT : COPLANAR;
+		}
+
+		switch (polygontype) {
+		case COPLANAR:
+			if (plane.normal.dot(polygon->plane.normal) > 0) coplanarFront.push_back(polygon);
+			else coplanarBack.push_back(polygon);
+			return;
+		case FRONT:
+			front.push_back(polygon);
+			return;
+		case BACK:
+			back.push_back(polygon);
+			return;
+		}
+
+		// Spanning polygon
+		BspPolygon f, b;
+		f.plane = b.plane = polygon->plane;
+		double di = plane.normal.dot(vertices[0]) - plane.w;
+		for (size_t i=0;i<n;i++) {
+			const Vector3d &vi = vertices[i];
+			const Vector3d &vj = vertices[(i+1) % n];
+			double dj = plane.normal.dot(vj) - plane.w;
+			int ti = (di < -PLANE_EPSILON) ? BACK : (di > PLANE_EPSILON) ? FRONT : COPLANAR;
+			int tj = (dj < -PLANE_EPSILON) ? BACK : (dj > PLANE_EPSILON) ? FRONT : COPLANAR;
+			if (ti != BACK) f.vertices.push_back(vi);
+			if (ti != FRONT) b.vertices.push_back(vi);
+			if ((ti | tj) == SPANNING) {
+				// Interpolate in a canonical direction, so the edge shared
+				// with a neighbour polygon is split at the exact same point
+				Vector3d v;
+				if (lexicographic_less(vi, vj)) v = vi + (vj - vi) * (di / (di - dj));
+				else v = vj + (vi - vj) * (dj / (dj - di));
+				f.vertices.push_back(v);
+				b.vertices.push_back(v);
+			}
+			di = dj;
+		}
+		if (f.vertices.size() >= 3) {
+			pool.push_back(BspPolygon());
+			pool.back().plane = f.plane;
+			pool.back().vertices.swap(f.vertices);
+			front.push_back(&pool.back());
+		}
+		if (b.vertices.size() >= 3) {
+			pool.push_back(BspPolygon());
+			pool.back().plane = b.plane;
+			pool.back().vertices.swap(b.vertices);
+			back.push_back(&pool.back());
+		}
+	}
+
+	void append(BspPolygons &target, BspPolygons &source)
+	{
+		if (target.empty()) target.swap(source);
+		else target.insert(target.end(), source.begin(), source.end());
+	}
+
+	/*!
+		A BSP tree representing a solid. All operations are iterative to
+		avoid stack overflows on deep trees.
+	*/
+	class BspTree
+	{
+	public:
+		BspTree(PolygonPool &pool) : pool(pool), inverted(false) { this->root = newNode(); }
+
+		void build(BspPolygons &polygons);
+		void invert();
+		void clipTo(const BspTree &other);
+		void clipPolygons(BspPolygons &polygons) const;
+		void allPolygons(BspPolygons &polygons) const;
+
+	private:
+		BspTree(const BspTree &);
+		BspTree &operator=(const BspTree &);
+
+		struct Node {
+			Node() : hasplane(false), front(NULL), back(NULL) {}
+			Plane plane;
+			bool hasplane;
+			Node *front;
+			Node *back;
+			BspPolygons polygons;
+		};
+
+		Node *newNode() {
+			this->nodes.push_back(Node());
+			return &this->nodes.back();
+		}
+
+		PolygonPool &pool;
+		// std::deque keeps node pointers valid as nodes are added
+		std::deque<Node> nodes;
+		Node *root;
+		// Conservative bounds of the solid. Everything outside is empty space,
+		// or solid space if the tree is inverted.
+		BoundingBox bbox;
+		bool inverted;
+	};
+
+	/*!
+		Adds polygons to the tree. The polygons vector is consumed.
+	*/
+	void BspTree::build(BspPolygons &polygons)
+	{
+		BOOST_FOREACH(const BspPolygon *p, polygons) {
+			BOOST_FOREACH(const Vector3d &v, p->vertices) this->bbox.extend(v);
+		}
+
+		std::vector<std::pair<Node *, BspPolygons> > stack;
+		stack.push_back(std::make_pair(this->root, BspPolygons()));
+		stack.back().second.swap(polygons);
+		while (!stack.empty()) {
+			Node *node = stack.back().first;
+			BspPolygons polys;
+			polys.swap(stack.back().second);
+			stack.pop_back();
+			if (polys.empty()) continue;
+
+			if (!node->hasplane) {
+				node->plane = polys[polys.size()/2]->plane;
+				node->hasplane = true;
+			}
+			BspPolygons front, back;
+			BOOST_FOREACH(BspPolygon *p, polys) {
+				splitPolygon(node->plane, p, this->pool, node->polygons, node->polygons, front, back);
+			}
+			if (!front.empty()) {
+				if (!node->front) node->front = newNode();
+				stack.push_back(std::make_pair(node->front, BspPolygons()));
+				stack.back().second.swap(front);
+			}
+			if (!back.empty()) {
+				if (!node->back) node->back = newNode();
+				stack.push_back(std::make_pair(node->back, BspPolygons()));
+				stack.back().second.swap(back);
+			}
+		}
+	}
+
+	/*!
+		Converts solid space to empty space and vice versa.
+	*/
+	void BspTree::invert()
+	{
+		BOOST_FOREACH(Node &node, this->nodes) {
+			BOOST_FOREACH(BspPolygon *p, node.polygons) p->flip();
+			node.plane.flip();
+			std::swap(node.front, node.back);
+		}
+		this->inverted = !this->inverted;
+	}
+
+	/*!
+		Removes all parts of polygons inside this tree.
+	*/
+	void BspTree::clipPolygons(BspPolygons &polygons) const
+	{
+		if (!this->root->hasplane) return;
+
+		// Polygons outside our bounds are trivially classified
+		BspPolygons result, candidates;
+		BoundingBox bounds = this->bbox;
+		bounds.extend(this->bbox.min() - Vector3d::Constant(PLANE_EPSILON));
+		bounds.extend(this->bbox.max() + Vector3d::Constant(PLANE_EPSILON));
+		BOOST_FOREACH(BspPolygon *p, polygons) {
+			BoundingBox pbox;
+			BOOST_FOREACH(const Vector3d &v, p->vertices) pbox.extend(v);
+			if (bounds.intersects(pbox)) candidates.push_back(p);
+			else if (!this->inverted) result.push_back(p);
+		}
+
+		std::vector<std::pair<const Node *, BspPolygons> > stack;
+		stack.push_back(std::make_pair(this->root, BspPolygons()));
+		stack.back().second.swap(candidates);
+		while (!stack.empty()) {
+			const Node *node = stack.back().first;
+			BspPolygons polys;
+			polys.swap(stack.back().second);
+			stack.pop_back();
+
+			BspPolygons front, back;
+			BOOST_FOREACH(BspPolygon *p, polys) {
+				splitPolygon(node->plane, p, this->pool, front, back, front, back);
+			}
+			if (node->front) {
+				stack.push_back(std::make_pair(node->front, BspPolygons()));
+				stack.back().second.swap(front);
+			}
+			else {
+				append(result, front);
+			}
+			if (node->back) {
+				stack.push_back(std::make_pair(node->back, BspPolygons()));
+				stack.back().second.swap(back);
+			}
+		}
+		polygons.swap(result);
+	}
+
+	/*!
+		Removes all parts of polygons in this tree which are inside the other tree.
+	*/
+	void BspTree::clipTo(const BspTree &other)
+	{
+		BOOST_FOREACH(Node &node, this->nodes) {
+			other.clipPolygons(node.polygons);
+		}
+	}
+
+	void BspTree::allPolygons(BspPolygons &polygons) const
+	{
+		BOOST_FOREACH(const Node &node, this->nodes) {
+			polygons.insert(polygons.end(), node.polygons.begin(), node.polygons.end());
+		}
+	}
+
+	bool make_plane(const std::vector<Vector3d> &vertices, Plane &plane)
+	{
+		// Newell's method
+		Vector3d normal(0, 0, 0);
+		Vector3d center(0, 0, 0);
+		for (size_t i=0;i<vertices.size();i++) {
+			const Vector3d &a = vertices[i];
+			const Vector3d &b = vertices[(i+1) % vertices.size()];
+			normal[0] += (a[1] - b[1]) * (a[2] + b[2]);
+			normal[1] += (a[2] - b[2]) * (a[0] + b[0]);
+			normal[2] += (a[0] - b[0]) * (a[1] + b[1]);
+			center += a;
+		}
+		double len = normal.norm();
+		if (len == 0) return false;
+		plane.normal = normal / len;
+		plane.w = plane.normal.dot(center / vertices.size());
+		return true;
+	}
+
+	double signed_volume(const Polygons &polygons)
+	{
+		double volume = 0;
+		BOOST_FOREACH(const Polygon &p, polygons) {
+			for (size_t i=1;i+1<p.size();i++) volume += p[0].dot(p[i].cross(p[i+1]));
+		}
+		return volume / 6;
+	}
+
+	/*!
+		Converts a 3D PolySet to outward facing BSP polygons.
+		Returns false if the PolySet isn't a closed mesh.
+	*/
+	bool create_operand(const PolySet &ps, PolygonPool &pool, BspPolygons &result)
+	{
+		PolySet tess(3);
+		PolysetUtils::tessellate_faces(ps, tess);
+		Polygons polygons = tess.getPolygons();
+		if (!MeshBoolean::repairMesh(polygons)) return false;
+
+		bool reversed = signed_volume(polygons) < 0;
+		BOOST_FOREACH(Polygon &p, polygons) {
+			if (reversed) std::reverse(p.begin(), p.end());
+			Plane plane;
+			if (!make_plane(p, plane)) continue;
+			pool.push_back(BspPolygon());
+			pool.back().plane = plane;
+			pool.back().vertices.swap(p);
+			result.push_back(&pool.back());
+		}
+		return true;
+	}
+
+	struct AxisCompare {
+		AxisCompare(const std::vector<Vector3d> &vertices, int axis) : vertices(vertices), axis(axis) {}
+		bool operator()(int a, int b) const { return vertices[a][axis] < vertices[b][axis]; }
+		bool operator()(int a, double b) const { return vertices[a][axis] < b; }
+		bool operator()(double a, int b) const { return a < vertices[b][axis]; }
+		const std::vector<Vector3d> &vertices;
+		int axis;
+	};
+
+	typedef std::pair<double, int> EdgeVertex;
+}
+
+namespace MeshBoolean {
+
+	/*!
+		Snaps the vertices to the grid, removes degenerate polygons, inserts
+		vertices lying on edges of other polygons (T-junctions) and checks that
+		the result is a closed mesh. Returns false if it isn't closed.
+	*/
+	bool repairMesh(Polygons &polygons)
+	{
+		Grid3d<int> grid(GRID_FINE);
+		std::vector<Vector3d> vertices;
+		std::vector<IndexedFace> faces;
+		BOOST_FOREACH(const Polygon &p, polygons) {
+			IndexedFace face;
+			BOOST_FOREACH(Vector3d v, p) {
+				int idx = grid.align(v);
+				if (idx == int(vertices.size())) vertices.push_back(v);
+				if (face.empty() || face.back() != idx) face.push_back(idx);
+			}
+			while (face.size() > 1 && face.back() == face.front()) face.pop_back();
+			if (face.size() >= 3) faces.push_back(face);
+		}
+
+		// Vertex indices sorted along each axis, for finding vertices close to an edge
+		std::vector<int> sorted[3];
+		for (int axis=0;axis<3;axis++) {
+			sorted[axis].resize(vertices.size());
+			for (size_t i=0;i<vertices.size();i++) sorted[axis][i] = i;
+			std::sort(sorted[axis].begin(), sorted[axis].end(), AxisCompare(vertices, axis));
+		}
+
+		const double tolerance = 4 * GRID_FINE;
+		BOOST_FOREACH(IndexedFace &face, faces) {
+			IndexedFace newface;
+			for (size_t i=0;i<face.size();i++) {
+				int a = face[i], b = face[(i+1) % face.size()];
+				newface.push_back(a);
+				const Vector3d &va = vertices[a], &vb = vertices[b];
+				Vector3d d = vb - va;
+				double len2 = d.squaredNorm();
+				if (len2 == 0) continue;
+
+				// Search along the axis in which the edge is shortest
+				int axis = 0;
+				for (int k=1;k<3;k++) if (fabs(d[k]) < fabs(d[axis])) axis = k;
+				double lo = std::min(va[axis], vb[axis]) - tolerance;
+				double hi = std::max(va[axis], vb[axis]) + tolerance;
+				AxisCompare cmp(vertices, axis);
+				std::vector<int>::const_iterator begin = std::lower_bound(sorted[axis].begin(), sorted[axis].end(), lo, cmp);
+				std::vector<int>::const_iterator end = std::upper_bound(begin, std::vector<int>::const_iterator(sorted[axis].end()), hi, cmp);
+
+				std::vector<EdgeVertex> onedge;
+				for (std::vector<int>::const_iterator it = begin; it != end; it++) {
+					int k = *it;
+					if (k == a || k == b) continue;
+					double t = (vertices[k] - va).dot(d) / len2;
+					if (t <= 0 || t >= 1) continue;
+					if ((va + d * t - vertices[k]).squaredNorm() < tolerance * tolerance) {
+						onedge.push_back(EdgeVertex(t, k));
+					}
+				}
+				std::sort(onedge.begin(), onedge.end());
+				BOOST_FOREACH(const EdgeVertex &ev, onedge) newface.push_back(ev.second);
+			}
+			face.swap(newface);
+		}
+
+		// Closed meshes have a matching opposite halfedge for every halfedge
+		typedef std::pair<int, int> Edge;
+		boost::unordered_map<Edge, int> edges;
+		BOOST_FOREACH(const IndexedFace &face, faces) {
+			for (size_t i=0;i<face.size();i++) {
+				edges[Edge(face[i], face[(i+1) % face.size()])]++;
+			}
+		}
+		for (boost::unordered_map<Edge, int>::const_iterator it = edges.begin(); it != edges.end(); it++) {
+			boost::unordered_map<Edge, int>::const_iterator opposite = edges.find(Edge(it->first.second, it->first.first));
+			if (opposite == edges.end() || opposite->second != it->second) return false;
+		}
+
+		polygons.clear();
+		polygons.reserve(faces.size());
+		BOOST_FOREACH(const IndexedFace &face, faces) {
+			polygons.push_back(Polygon());
+			BOOST_FOREACH(int idx, face) polygons.back().push_back(vertices[idx]);
+		}
+		return true;
+	}
+
+	/*!
+		Applies op to all children and returns the result, or NULL if the
+		operation couldn't be performed using floating point meshes.
+		The child list should contain non-NULL 3D or empty Geometry objects.
+	*/
+	PolySet *applyOperator(const Geometry::ChildList &children, OpenSCADOperator op)
+	{
+		if (op != OPENSCAD_UNION && op != OPENSCAD_INTERSECTION && op != OPENSCAD_DIFFERENCE) return NULL;
+
+		PolygonPool pool;
+		std::vector<BspPolygons> operands;
+		bool first = true;
+		BOOST_FOREACH(const Geometry::ChildItem &item, children) {
+			const shared_ptr<const Geometry> &chgeom = item.second;
+			if (!chgeom || chgeom->isEmpty()) {
+				// Intersecting something with nothing results in nothing
+				if (op == OPENSCAD_INTERSECTION) return new PolySet(3);
+				// empty op <something> => empty
+				if (op == OPENSCAD_DIFFERENCE && first) return new PolySet(3);
+				first = false;
+				continue;
+			}
+			first = false;
+			const PolySet *ps = dynamic_cast<const PolySet *>(chgeom.get());
+			if (!ps || ps->getDimension() != 3) return NULL;
+
+			operands.push_back(BspPolygons());
+			if (!create_operand(*ps, pool, operands.back())) {
+				PRINTD("MeshBoolean: Operand is not a closed mesh");
+				return NULL;
+			}
+		}
+
+		BspTree a(pool);
+		if (!operands.empty()) a.build(operands[0]);
+		for (size_t i=1;i<operands.size();i++) {
+			BspTree b(pool);
+			b.build(operands[i]);
+			BspPolygons polygons;
+			switch (op) {
+			case OPENSCAD_UNION:
+				a.clipTo(b);
+				b.clipTo(a);
+				b.invert();
+				b.clipTo(a);
+				b.invert();
+				b.allPolygons(polygons);
+				a.build(polygons);
+				break;
+			case OPENSCAD_DIFFERENCE:
+				a.invert();
+				a.clipTo(b);
+				b.clipTo(a);
+				b.invert();
+				b.clipTo(a);
+				b.invert();
+				b.allPolygons(polygons);
+				a.build(polygons);
+				a.invert();
+				break;
+			case OPENSCAD_INTERSECTION:
+				a.invert();
+				b.clipTo(a);
+				b.invert();
+				a.clipTo(b);
+				b.clipTo(a);
+				b.allPolygons(polygons);
+				a.build(polygons);
+				a.invert();
+				break;
+			default:
+				break;
+			}
+		}
+
+		BspPolygons result;
+		a.allPolygons(result);
+		Polygons polygons;
+		polygons.reserve(result.size());
+		BOOST_FOREACH(BspPolygon *p, result) {
+			polygons.push_back(Polygon());
+			polygons.back().swap(p->vertices);
+		}
+		if (!repairMesh(polygons)) {
+			PRINTD("MeshBoolean: Result is not a closed mesh");
+			return NULL;
+		}
+		PolySet *ps = new PolySet(3);
+		ps->reserve(polygons.size(), 3 * polygons.size());
+		BOOST_FOREACH(const Polygon &p, polygons) ps->append_polygon(p);
+		return ps;
+	}
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Geometry.h"
+#include "GeometryUtils.h"
+#include "enums.h"
+
+class PolySet;
+
+/*!
+	Floating point CSG on polygon meshes, used as a fast alternative to
+	Nef polyhedra for union, intersection and difference.
+
+	This is a BSP tree based algorithm. The result is snapped to a fine
+	grid, T-junctions are resolved and the result is verified to be a
+	closed mesh. If any input isn't a closed PolySet or the result can't be
+	verified, NULL is returned and the caller should fall back to Nef
+	polyhedra.
+*/
+namespace MeshBoolean {
+	PolySet *applyOperator(const Geometry::ChildList &children, OpenSCADOperator op);
+	bool repairMesh(Polygons &polygons);
+};
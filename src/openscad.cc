@@ -42,6 +42,9 @@
 #include "stackcheck.h"
 #include "CocoaUtils.h"
 #include "FontCache.h"
+#include "GeometryCache.h"
+#include "FunctionCache.h"
+#include "RenderServer.h"
 
 #include <string>
 #include <vector>
@@ -50,6 +53,8 @@
 #ifdef ENABLE_CGAL
 #include "CGAL_Nef_polyhedron.h"
 #include "cgalutils.h"
+#include "CGALCache.h"
+#include "DiskCache.h"
 #endif
 
 #include "csgterm.h"
@@ -63,6 +68,9 @@
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/property_tree/json_parser.hpp>
 #include "boosty.h"
 
 #ifdef __APPLE__
@@ -88,7 +96,14 @@ using boost::is_any_of;
 std::string commandline_commands;
 std::string currentdir;
 static bool arg_info = false;
+static unsigned int arg_jobs = 1;
+static bool arg_meshbackend = false;
+static std::string arg_cachestats;
+static bool arg_stlbinary = false;
+static bool arg_preview = false;
 static std::string arg_colorscheme;
+static std::string arg_timing;
+static unsigned int arg_serverconnections = 4;
 
 #define QUOTE(x__) # x__
 #define QUOTED(x__) QUOTE(x__)
@@ -106,7 +121,8 @@ std::string openscad_version = "OpenSCAD " + openscad_versionnumber;
 class Echostream : public std::ofstream
 {
 public:
-	Echostream( const char * filename ) : std::ofstream( filename ) {
+	Echostream( const char * filename ) : std::ofstream( filename ),
+		prevhandler( outputhandler ), prevdata( outputhandler_data ) {
 		set_output_handler( &Echostream::output, this );
 	}
 	static void output( const std::string &msg, void *userdata ) {
@@ -115,7 +131,11 @@ public:
 	}
 	~Echostream() {
 		this->close();
+		set_output_handler( prevhandler, prevdata );
 	}
+private:
+	OutputHandlerFunc *prevhandler;
+	void *prevdata;
 };
 
 static void help(const char *progname, bool failure = false)
@@ -125,7 +145,7 @@ static void help(const char *progname, bool failure = false)
   for (int i=0;i<tablen;i++) tabstr[i] = ' ';
   tabstr[tablen] = '\0';
 
-	PRINTB("Usage: %1% [ -o output_file [ -d deps_file ] ]\\\n"
+	PRINTB("Usage: %1% [ -o output_file [..] [ -d deps_file ] ]\\\n"
          "%2%[ -m make_command ] [ -D var=val [..] ] \\\n"
 	 "%2%[ --help ] print this help message and exit \\\n"
          "%2%[ --version ] [ --info ] \\\n"
@@ -136,7 +156,12 @@ static void help(const char *progname, bool failure = false)
          "%2%[ --imgsize=width,height ] [ --projection=(o)rtho|(p)ersp] \\\n"
          "%2%[ --render | --preview[=throwntogether] ] \\\n"
          "%2%[ --colorscheme=[Cornfield|Sunset|Metallic|Starnight|BeforeDawn|Nature|DeepOcean] ] \\\n"
-         "%2%[ --csglimit=num ]"
+         "%2%[ --csglimit=num ] [ --jobs=num ] [ --backend=cgal|mesh ] \\\n"
+         "%2%[ --cache-dir=dir [ --cache-size=MB ] ] \\\n"
+         "%2%[ --geometry-cache-size=MB ] [ --cgal-cache-size=MB ] [ --cache-stats[=text|json] ] \\\n"
+         "%2%[ --stl-binary ] [ --timing[=text|json] ] [ --batch=jobfile ] \\\n"
+         "%2%[ --server[=socket] [ --server-connections=num ] ] jobs are rendered one at a time \\\n"
+         "%2%"
 #ifdef ENABLE_EXPERIMENTAL
          " [ --enable=<feature> ]"
 #endif
@@ -174,6 +199,107 @@ static void info()
 	exit(0);
 }
 
+static void print_cache_statistics(std::ostream &stream, const char *name, const CacheStatistics &stats, bool last)
+{
+	stream << "  \"" << name << "\": {"
+				 << "\"entries\": " << stats.entries << ", "
+				 << "\"size\": " << stats.size << ", "
+				 << "\"maxsize\": " << stats.maxsize << ", "
+				 << "\"hits\": " << stats.hits << ", "
+				 << "\"misses\": " << stats.misses << ", "
+				 << "\"insertions\": " << stats.insertions << ", "
+				 << "\"evictions\": " << stats.evictions << ", "
+				 << "\"rejections\": " << stats.rejections << "}"
+				 << (last ? "\n" : ",\n");
+}
+
+/*!
+	Prints statistics of the function and geometry caches, either human readable to the
+	console or as JSON to stdout.
+*/
+static void print_cache_statistics(bool json)
+{
+	if (!json) {
+		FunctionCache::instance()->print();
+		GeometryCache::instance()->print();
+#ifdef ENABLE_CGAL
+		CGALCache::instance()->print();
+		if (DiskCache::instance()->isEnabled()) DiskCache::instance()->print();
+#endif
+		return;
+	}
+
+	std::cout << "{\n";
+	print_cache_statistics(std::cout, "function", FunctionCache::instance()->statistics(), false);
+#ifdef ENABLE_CGAL
+	print_cache_statistics(std::cout, "geometry", GeometryCache::instance()->statistics(), false);
+	print_cache_statistics(std::cout, "cgal", CGALCache::instance()->statistics(), !DiskCache::instance()->isEnabled());
+	if (DiskCache::instance()->isEnabled()) {
+		print_cache_statistics(std::cout, "disk", DiskCache::instance()->statistics(), true);
+	}
+#else
+	print_cache_statistics(std::cout, "geometry", GeometryCache::instance()->statistics(), true);
+#endif
+	std::cout << "}\n";
+}
+
+/*!
+	Wall clock time spent in the phases of command line processing, see --timing.
+	Phases are reported in the order they were first stopped; a phase which
+	is stopped more than once accumulates.
+*/
+class PhaseTimer
+{
+public:
+	void start() { this->last = now(); }
+	void stop(const std::string &phase) {
+		boost::posix_time::ptime t = now();
+		double seconds = (t - this->last).total_microseconds() / 1e6;
+		this->last = t;
+		BOOST_FOREACH(Phase &p, this->phases) {
+			if (p.first == phase) {
+				p.second += seconds;
+				return;
+			}
+		}
+		this->phases.push_back(Phase(phase, seconds));
+	}
+	void print(bool json) const;
+
+private:
+	typedef std::pair<std::string, double> Phase;
+	static boost::posix_time::ptime now() { return boost::posix_time::microsec_clock::universal_time(); }
+
+	boost::posix_time::ptime last;
+	std::vector<Phase> phases;
+};
+
+static PhaseTimer phase_timer;
+
+/*!
+	Prints the time of each phase and their total, either human readable to the
+	console or as JSON to stdout.
+*/
+void PhaseTimer::print(bool json) const
+{
+	double total = 0;
+	BOOST_FOREACH(const Phase &p, this->phases) total += p.second;
+
+	if (!json) {
+		BOOST_FOREACH(const Phase &p, this->phases) {
+			PRINTB("Timing: %s: %.3f s", p.first % p.second);
+		}
+		PRINTB("Timing: total: %.3f s", total);
+		return;
+	}
+
+	std::cout << "{\n";
+	BOOST_FOREACH(const Phase &p, this->phases) {
+		std::cout << "  \"" << p.first << "\": " << p.second << ",\n";
+	}
+	std::cout << "  \"total\": " << total << "\n}\n";
+}
+
 /**
  * Initialize gettext. This must be called after the appliation path was
  * determined so we can lookup the resource path for the language translation
@@ -308,26 +434,20 @@ void set_render_color_scheme(const std::string color_scheme, const bool exit_if_
 	}
 }
 
-int cmdline(const char *deps_output_file, const std::string &filename, Camera &camera, const char *output_file, const fs::path &original_path, Render::type renderer, int argc, char ** argv )
+/*!
+	Evaluates filename, or source instead of its contents if given, and
+	exports the result to output_files, at most one per format. The model is
+	parsed, instantiated and evaluated once for all of them.
+*/
+static int cmdline_render(const char *deps_output_file, const std::string &filename, Camera &camera, const std::vector<std::string> &output_files, const fs::path &original_path, Render::type renderer, const std::string *source = NULL)
 {
-#ifdef OPENSCAD_QTGUI
-	QCoreApplication app(argc, argv);
-	const std::string application_path = QApplication::instance()->applicationDirPath().toLocal8Bit().constData();
-#else
-	const std::string application_path = boosty::stringy(boosty::absolute(boost::filesystem::path(argv[0]).parent_path()));
-#endif	
-	PlatformUtils::registerApplicationPath(application_path);
-	parser_init();
-	localization_init();
-
 	Tree tree;
 #ifdef ENABLE_CGAL
 	GeometryEvaluator geomevaluator(tree);
+	geomevaluator.setNumJobs(arg_jobs);
+	if (arg_meshbackend) geomevaluator.setBackend(GeometryEvaluator::BACKEND_MESH);
 #endif
-	if (arg_info) {
-	    info();
-	}
-	
+
 	const char *stl_output_file = NULL;
 	const char *off_output_file = NULL;
 	const char *amf_output_file = NULL;
@@ -339,26 +459,38 @@ int cmdline(const char *deps_output_file, const std::string &filename, Camera &c
 	const char *term_output_file = NULL;
 	const char *echo_output_file = NULL;
 
-	std::string suffix = boosty::extension_str( output_file );
-	boost::algorithm::to_lower( suffix );
-
-	if (suffix == ".stl") stl_output_file = output_file;
-	else if (suffix == ".off") off_output_file = output_file;
-	else if (suffix == ".amf") amf_output_file = output_file;
-	else if (suffix == ".dxf") dxf_output_file = output_file;
-	else if (suffix == ".svg") svg_output_file = output_file;
-	else if (suffix == ".csg") csg_output_file = output_file;
-	else if (suffix == ".png") png_output_file = output_file;
-	else if (suffix == ".ast") ast_output_file = output_file;
-	else if (suffix == ".term") term_output_file = output_file;
-	else if (suffix == ".echo") echo_output_file = output_file;
-	else {
-		PRINTB("Unknown suffix for output file %s\n", output_file);
-		return 1;
+	BOOST_FOREACH(const std::string &file, output_files) {
+		const char *output_file = file.c_str();
+		std::string suffix = boosty::extension_str( output_file );
+		boost::algorithm::to_lower( suffix );
+
+		const char **format_output_file;
+		if (suffix == ".stl") format_output_file = &stl_output_file;
+		else if (suffix == ".off") format_output_file = &off_output_file;
+		else if (suffix == ".amf") format_output_file = &amf_output_file;
+		else if (suffix == ".dxf") format_output_file = &dxf_output_file;
+		else if (suffix == ".svg") format_output_file = &svg_output_file;
+		else if (suffix == ".csg") format_output_file = &csg_output_file;
+		else if (suffix == ".png") format_output_file = &png_output_file;
+		else if (suffix == ".ast") format_output_file = &ast_output_file;
+		else if (suffix == ".term") format_output_file = &term_output_file;
+		else if (suffix == ".echo") format_output_file = &echo_output_file;
+		else {
+			PRINTB("Unknown suffix for output file %s\n", output_file);
+			return 1;
+		}
+		if (*format_output_file) {
+			PRINTB("Only one %s output file can be given\n", suffix);
+			return 1;
+		}
+		*format_output_file = output_file;
+	}
+	bool geometry_output = stl_output_file || off_output_file || amf_output_file || dxf_output_file || svg_output_file;
+	// Render images of geometry which is evaluated anyway, unless a preview is asked for
+	if (png_output_file && geometry_output && renderer == Render::OPENCSG && !arg_preview) {
+		renderer = Render::GEOMETRY;
 	}
 
-	set_render_color_scheme(arg_colorscheme, true);
-	
 	// Top context - this context only holds builtins
 	ModuleContext top_ctx;
 	top_ctx.registerBuiltin();
@@ -369,29 +501,39 @@ int cmdline(const char *deps_output_file, const std::string &filename, Camera &c
 	if (echo_output_file)
 		echostream.reset( new Echostream( echo_output_file ) );
 
-	FileModule *root_module;
+	boost::scoped_ptr<FileModule> root_module;
 	ModuleInstantiation root_inst("group");
 	AbstractNode *root_node;
-	AbstractNode *absolute_root_node;
+	// Owns the whole node tree; root_node may point into it (! modifier)
+	boost::scoped_ptr<AbstractNode> absolute_root_node;
 	shared_ptr<const Geometry> root_geom;
 
 	handle_dep(filename.c_str());
 
-	std::ifstream ifs(filename.c_str());
-	if (!ifs.is_open()) {
-		PRINTB("Can't open input file '%s'!\n", filename.c_str());
-		return 1;
+	std::string text;
+	if (source) {
+		phase_timer.start();
+		text = *source;
+	}
+	else {
+		std::ifstream ifs(filename.c_str());
+		if (!ifs.is_open()) {
+			PRINTB("Can't open input file '%s'!\n", filename.c_str());
+			return 1;
+		}
+		phase_timer.start();
+		text.assign((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
 	}
-	std::string text((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
 	text += "\n" + commandline_commands;
 	fs::path abspath = boosty::absolute(filename);
 	std::string parentpath = boosty::stringy(abspath.parent_path());
-	root_module = parse(text.c_str(), parentpath.c_str(), false);
+	root_module.reset(parse(text.c_str(), parentpath.c_str(), false));
 	if (!root_module) {
 		PRINTB("Can't parse file '%s'!\n", filename.c_str());
 		return 1;
 	}
 	root_module->handleDependencies();
+	phase_timer.stop("parse");
 
 	fs::path fpath = boosty::absolute(fs::path(filename));
 	fs::path fparent = fpath.parent_path();
@@ -399,14 +541,16 @@ int cmdline(const char *deps_output_file, const std::string &filename, Camera &c
 	top_ctx.setDocumentPath(fparent.string());
 
 	AbstractNode::resetIndexCounter();
-	absolute_root_node = root_module->instantiate(&top_ctx, &root_inst, NULL);
+	absolute_root_node.reset(root_module->instantiate(&top_ctx, &root_inst, NULL));
 
 	// Do we have an explicit root node (! modifier)?
-	if (!(root_node = find_root_tag(absolute_root_node)))
-		root_node = absolute_root_node;
+	if (!(root_node = find_root_tag(absolute_root_node.get())))
+		root_node = absolute_root_node.get();
 
 	tree.setRoot(root_node);
+	phase_timer.stop("instantiate");
 
+	int rc = 0;
 	if (csg_output_file) {
 		fs::current_path(original_path);
 		std::ofstream fstream(csg_output_file);
@@ -418,8 +562,9 @@ int cmdline(const char *deps_output_file, const std::string &filename, Camera &c
 			fstream << tree.getString(*root_node) << "\n";
 			fstream.close();
 		}
+		phase_timer.stop("export");
 	}
-	else if (ast_output_file) {
+	if (ast_output_file) {
 		fs::current_path(original_path);
 		std::ofstream fstream(ast_output_file);
 		if (!fstream.is_open()) {
@@ -430,13 +575,15 @@ int cmdline(const char *deps_output_file, const std::string &filename, Camera &c
 			fstream << root_module->dump("", "") << "\n";
 			fstream.close();
 		}
+		phase_timer.stop("export");
 	}
-	else if (term_output_file) {
+	if (term_output_file) {
 		std::vector<shared_ptr<CSGTerm> > highlight_terms;
 		std::vector<shared_ptr<CSGTerm> > background_terms;
 
 		CSGTermEvaluator csgRenderer(tree);
 		shared_ptr<CSGTerm> root_raw_term = csgRenderer.evaluateCSGTerm(*root_node, highlight_terms, background_terms);
+		phase_timer.stop("csg");
 
 		fs::current_path(original_path);
 		std::ofstream fstream(term_output_file);
@@ -451,15 +598,18 @@ int cmdline(const char *deps_output_file, const std::string &filename, Camera &c
 			}
 			fstream.close();
 		}
+		phase_timer.stop("export");
 	}
-	else {
+	if (geometry_output || png_output_file ||
+			(echo_output_file && !csg_output_file && !ast_output_file && !term_output_file)) {
 #ifdef ENABLE_CGAL
-		if ((echo_output_file || png_output_file) &&
-				(renderer==Render::OPENCSG || renderer==Render::THROWNTOGETHER)) {
+		if (!geometry_output && (renderer==Render::OPENCSG || renderer==Render::THROWNTOGETHER)) {
 			// echo or OpenCSG png -> don't necessarily need geometry evaluation
 		} else {
+			fs::current_path(fparent);
 			root_geom = geomevaluator.evaluateGeometry(*tree.root(), true);
 			if (!root_geom) root_geom.reset(new CGAL_Nef_polyhedron());
+			phase_timer.stop("geometry");
 			if (renderer == Render::CGAL && root_geom->getDimension() == 3) {
 				const CGAL_Nef_polyhedron *N = dynamic_cast<const CGAL_Nef_polyhedron*>(root_geom.get());
 				if (!N) {
@@ -467,6 +617,7 @@ int cmdline(const char *deps_output_file, const std::string &filename, Camera &c
 					root_geom.reset(N);
 					PRINT("Converted to Nef polyhedron");
 				}
+				phase_timer.stop("nef");
 			}
 		}
 
@@ -482,7 +633,7 @@ int cmdline(const char *deps_output_file, const std::string &filename, Camera &c
 			else if ( svg_output_file ) geom_out = std::string(svg_output_file);
 			else if ( png_output_file ) geom_out = std::string(png_output_file);
 			else {
-				PRINTB("Output file:%s\n",output_file);
+				PRINTB("Output file:%s\n",output_files[0]);
 				PRINT("Sorry, don't know how to write deps for that file type. Exiting\n");
 				return 1;
 			}
@@ -494,34 +645,35 @@ int cmdline(const char *deps_output_file, const std::string &filename, Camera &c
 		}
 
 		if (stl_output_file) {
-			if (!checkAndExport(root_geom, 3, OPENSCAD_STL, stl_output_file))
-				return 1;
+			if (!checkAndExport(root_geom, 3, arg_stlbinary ? OPENSCAD_STL_BINARY : OPENSCAD_STL, stl_output_file))
+				rc = 1;
 		}
 
 		if (off_output_file) {
 			if (!checkAndExport(root_geom, 3, OPENSCAD_OFF, off_output_file))
-				return 1;
+				rc = 1;
 		}
 
 		if (amf_output_file) {
 			if (!checkAndExport(root_geom, 3, OPENSCAD_AMF, amf_output_file))
-				return 1;
+				rc = 1;
 		}
 
 		if (dxf_output_file) {
 			if (!checkAndExport(root_geom, 2, OPENSCAD_DXF, dxf_output_file))
-				return 1;
+				rc = 1;
 		}
 		
 		if (svg_output_file) {
 			if (!checkAndExport(root_geom, 2, OPENSCAD_SVG, svg_output_file))
-				return 1;
+				rc = 1;
 		}
 
 		if (png_output_file) {
 			std::ofstream fstream(png_output_file,std::ios::out|std::ios::binary);
 			if (!fstream.is_open()) {
 				PRINTB("Can't open file \"%s\" for export", png_output_file);
+				rc = 1;
 			}
 			else {
 				if (renderer==Render::CGAL || renderer==Render::GEOMETRY) {
@@ -534,13 +686,164 @@ int cmdline(const char *deps_output_file, const std::string &filename, Camera &c
 				fstream.close();
 			}
 		}
+		phase_timer.stop("export");
 #else
 		PRINT("OpenSCAD has been compiled without CGAL support!\n");
 		return 1;
 #endif
 	}
-	delete root_node;
-	return 0;
+	return rc;
+}
+
+/*!
+	A variant of the input rendered by --batch: Its output file, and the
+	-D assignments applied in addition to those on the command line.
+*/
+struct BatchJob
+{
+	std::string filename;
+	std::string output_file;
+	std::string commands;
+};
+
+/*!
+	Reads a batch job file of the form
+
+	{ "jobs": [ { "output": "box-10.stl", "D": ["width=10", "label=\"A\""] },
+	            { "output": "box-20.stl", "D": ["width=20"], "file": "other.scad" } ] }
+
+	"file" defaults to the input file given on the command line. The
+	assignments are OpenSCAD expressions like those passed with -D.
+*/
+static bool read_batch_jobs(const std::string &jobfile, const std::string &filename, std::vector<BatchJob> &jobs)
+{
+	try {
+		boost::property_tree::ptree pt;
+		boost::property_tree::read_json(jobfile, pt);
+		BOOST_FOREACH(const boost::property_tree::ptree::value_type &v, pt.get_child("jobs")) {
+			BatchJob job;
+			job.filename = v.second.get<std::string>("file", filename);
+			job.output_file = v.second.get<std::string>("output");
+			boost::optional<const boost::property_tree::ptree &> defines = v.second.get_child_optional("D");
+			if (defines) {
+				BOOST_FOREACH(const boost::property_tree::ptree::value_type &d, *defines) {
+					job.commands += d.second.data() + ";\n";
+				}
+			}
+			if (job.filename.empty()) {
+				PRINTB("Batch job %d in '%s' has no input file", (jobs.size() + 1) % jobfile);
+				return false;
+			}
+			jobs.push_back(job);
+		}
+	}
+	catch (const boost::property_tree::ptree_error &e) {
+		PRINTB("Can't read batch job file '%s': %s", jobfile % e.what());
+		return false;
+	}
+	return true;
+}
+
+static std::string format_hits(const CacheStatistics &before, const CacheStatistics &after)
+{
+	size_t hits = after.hits - before.hits;
+	size_t lookups = hits + after.misses - before.misses;
+	return str(boost::format("%d/%d hits") % hits % lookups);
+}
+
+/*!
+	Renders all variants listed in jobfile in this process, so they share the
+	module, function, geometry, CGAL and font caches. Subtrees which don't
+	depend on the varied parameters are only evaluated by the first job.
+*/
+static int cmdline_batch(const std::string &jobfile, const std::string &filename, const Camera &camera, const fs::path &original_path, Render::type renderer)
+{
+	std::vector<BatchJob> jobs;
+	if (!read_batch_jobs(jobfile, filename, jobs)) return 1;
+
+	const std::string commands = commandline_commands;
+	int failures = 0;
+	for (size_t i = 0; i < jobs.size(); i++) {
+		const BatchJob &job = jobs[i];
+		fs::current_path(original_path);
+		commandline_commands = commands + job.commands;
+
+		CacheStatistics geometry = GeometryCache::instance()->statistics();
+#ifdef ENABLE_CGAL
+		CacheStatistics cgal = CGALCache::instance()->statistics();
+#endif
+		// PNG export adjusts the camera to the model, e.g. for --viewall
+		Camera jobcamera = camera;
+		boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+		int rc = cmdline_render(NULL, job.filename, jobcamera, std::vector<std::string>(1, job.output_file), original_path, renderer);
+		double seconds = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+		if (rc != 0) failures++;
+
+		std::string report = str(boost::format("Batch job %d/%d: %s %s in %.3f s, geometry cache %s")
+														 % (i + 1) % jobs.size() % job.output_file % (rc == 0 ? "done" : "failed") % seconds
+														 % format_hits(geometry, GeometryCache::instance()->statistics()));
+#ifdef ENABLE_CGAL
+		report += ", CGAL cache " + format_hits(cgal, CGALCache::instance()->statistics());
+#endif
+		PRINT(report);
+	}
+	commandline_commands = commands;
+	fs::current_path(original_path);
+
+	if (failures) PRINTB("%d of %d batch jobs failed", failures % jobs.size());
+	return failures ? 1 : 0;
+}
+
+/*!
+	Renders a job received by --server.
+*/
+static int server_render(const RenderJob &job, const std::string &output_file, const Camera &camera, const fs::path &original_path)
+{
+	Render::type renderer;
+	if (job.mode == "geometry") renderer = Render::GEOMETRY;
+	else if (job.mode == "cgal") renderer = Render::CGAL;
+	else if (job.mode == "opencsg") renderer = Render::OPENCSG;
+	else if (job.mode == "throwntogether") renderer = Render::THROWNTOGETHER;
+	else {
+		PRINTB("ERROR: Unknown mode '%s'", job.mode);
+		return 1;
+	}
+
+	const std::string commands = commandline_commands;
+	commandline_commands = commands + job.commands;
+	// PNG export adjusts the camera to the model, e.g. for --viewall
+	Camera jobcamera = camera;
+	int rc = cmdline_render(NULL, job.filename, jobcamera, std::vector<std::string>(1, output_file), original_path, renderer,
+													job.source ? &*job.source : NULL);
+	commandline_commands = commands;
+	fs::current_path(original_path);
+	return rc;
+}
+
+int cmdline(const char *deps_output_file, const std::string &filename, Camera &camera, const std::vector<std::string> &output_files, const std::string &jobfile, const std::string &socketpath, const fs::path &original_path, Render::type renderer, int argc, char ** argv )
+{
+#ifdef OPENSCAD_QTGUI
+	QCoreApplication app(argc, argv);
+	const std::string application_path = QApplication::instance()->applicationDirPath().toLocal8Bit().constData();
+#else
+	const std::string application_path = boosty::stringy(boosty::absolute(boost::filesystem::path(argv[0]).parent_path()));
+#endif	
+	PlatformUtils::registerApplicationPath(application_path);
+	parser_init();
+	localization_init();
+
+	if (arg_info) {
+	    info();
+	}
+
+	set_render_color_scheme(arg_colorscheme, true);
+
+	if (!socketpath.empty()) {
+		RenderServer server(socketpath, arg_serverconnections, boost::bind(server_render, _1, _2, camera, original_path));
+		return server.run();
+	}
+	if (!jobfile.empty()) return cmdline_batch(jobfile, filename, camera, original_path, renderer);
+	return cmdline_render(deps_output_file, filename, camera, output_files, original_path, renderer);
 }
 
 #ifdef OPENSCAD_QTGUI
@@ -762,7 +1065,7 @@ int main(int argc, char **argv)
 
 	fs::path original_path = fs::current_path();
 
-	const char *output_file = NULL;
+	vector<string> output_files;
 	const char *deps_output_file = NULL;
 
 	po::options_description desc("Allowed options");
@@ -773,6 +1076,18 @@ int main(int argc, char **argv)
 		("render", po::value<string>()->implicit_value(""), "if exporting a png image, do a full geometry evaluation")
 		("preview", po::value<string>()->implicit_value(""), "if exporting a png image, do an OpenCSG(default) or ThrownTogether preview")
 		("csglimit", po::value<unsigned int>(), "if exporting a png image, stop rendering at the given number of CSG elements")
+		("jobs", po::value<unsigned int>(), "number of threads used for geometry evaluation, 0 = one per core")
+		("backend", po::value<string>(), "3D boolean operations using cgal (default) or mesh, which falls back to cgal on failure")
+		("cache-dir", po::value<string>(), "directory for persistent geometry caching")
+		("cache-size", po::value<unsigned int>(), "size limit of the persistent geometry cache in MB")
+		("geometry-cache-size", po::value<unsigned int>(), "size limit of the in-memory PolySet cache in MB")
+		("cgal-cache-size", po::value<unsigned int>(), "size limit of the in-memory CGAL cache in MB")
+		("cache-stats", po::value<string>()->implicit_value("text"), "print cache statistics after processing, as text or json")
+		("stl-binary", "export STL files in binary format")
+		("timing", po::value<string>()->implicit_value("text"), "print the time spent parsing, instantiating, evaluating and exporting, as text or json")
+		("batch", po::value<string>(), "render each variant listed in the given JSON job file, sharing caches between them")
+		("server", po::value<string>()->implicit_value(""), "serve render jobs on a UNIX domain socket, see scripts/openscad-client.py")
+		("server-connections", po::value<unsigned int>(), "number of client connections accepted at once by --server, the jobs are still rendered one at a time")
 		("camera", po::value<string>(), "parameters for camera when exporting png")
 		("autocenter", "adjust camera to look at object center")
 		("viewall", "adjust camera to fit object")
@@ -780,7 +1095,7 @@ int main(int argc, char **argv)
 		("projection", po::value<string>(), "(o)rtho or (p)erspective when exporting png")
 		("colorscheme", po::value<string>(), "colorscheme")
 		("debug", po::value<string>(), "special debug info")
-		("o,o", po::value<string>(), "out-file")
+		("o,o", po::value<vector<string> >(), "out-file")
 		("s,s", po::value<string>(), "stl-file")
 		("x,x", po::value<string>(), "dxf-file")
 		("d,d", po::value<string>(), "deps-file")
@@ -821,6 +1136,7 @@ int main(int argc, char **argv)
 
 	Render::type renderer = Render::OPENCSG;
 	if (vm.count("preview")) {
+		arg_preview = true;
 		if (vm["preview"].as<string>() == "throwntogether")
 			renderer = Render::THROWNTOGETHER;
 	}
@@ -833,20 +1149,49 @@ int main(int argc, char **argv)
 		RenderSettings::inst()->openCSGTermLimit = vm["csglimit"].as<unsigned int>();
 	}
 
+	if (vm.count("jobs")) {
+		arg_jobs = vm["jobs"].as<unsigned int>();
+	}
+	if (vm.count("backend")) {
+		std::string backend = vm["backend"].as<string>();
+		if (backend == "mesh") arg_meshbackend = true;
+		else if (backend != "cgal") help(argv[0], true);
+	}
+
+#ifdef ENABLE_CGAL
+	if (vm.count("cache-size")) {
+		DiskCache::instance()->setMaxSize(boost::uint64_t(vm["cache-size"].as<unsigned int>()) * 1024 * 1024);
+	}
+	if (vm.count("cache-dir")) {
+		DiskCache::instance()->setPath(vm["cache-dir"].as<string>());
+	}
+	if (vm.count("cgal-cache-size")) {
+		CGALCache::instance()->setMaxSize(boost::uint64_t(vm["cgal-cache-size"].as<unsigned int>()) * 1024 * 1024);
+	}
+#endif
+	if (vm.count("geometry-cache-size")) {
+		GeometryCache::instance()->setMaxSize(boost::uint64_t(vm["geometry-cache-size"].as<unsigned int>()) * 1024 * 1024);
+	}
+	if (vm.count("cache-stats")) {
+		arg_cachestats = vm["cache-stats"].as<string>();
+		if (arg_cachestats != "text" && arg_cachestats != "json") help(argv[0], true);
+	}
+	if (vm.count("stl-binary")) arg_stlbinary = true;
+	if (vm.count("timing")) {
+		arg_timing = vm["timing"].as<string>();
+		if (arg_timing != "text" && arg_timing != "json") help(argv[0], true);
+	}
+
 	if (vm.count("o")) {
-		// FIXME: Allow for multiple output files?
-		if (output_file) help(argv[0], true);
-		output_file = vm["o"].as<string>().c_str();
+		output_files = vm["o"].as<vector<string> >();
 	}
 	if (vm.count("s")) {
 		printDeprecation("The -s option is deprecated. Use -o instead.\n");
-		if (output_file) help(argv[0], true);
-		output_file = vm["s"].as<string>().c_str();
+		output_files.push_back(vm["s"].as<string>());
 	}
 	if (vm.count("x")) { 
 		printDeprecation("The -x option is deprecated. Use -o instead.\n");
-		if (output_file) help(argv[0], true);
-		output_file = vm["x"].as<string>().c_str();
+		output_files.push_back(vm["x"].as<string>());
 	}
 	if (vm.count("d")) {
 		if (deps_output_file) help(argv[0], true);
@@ -887,15 +1232,37 @@ int main(int argc, char **argv)
 	NodeCache nodecache;
 	NodeDumper dumper(nodecache);
 
+	std::string jobfile;
+	if (vm.count("batch")) {
+		jobfile = vm["batch"].as<string>();
+		if (!output_files.empty() || deps_output_file) help(argv[0], true);
+	}
+
+	std::string socketpath;
+	if (vm.count("server")) {
+		socketpath = vm["server"].as<string>();
+		if (socketpath.empty()) {
+			socketpath = RenderServer::defaultSocketPath();
+			if (socketpath.empty()) exit(1);
+		}
+		if (!output_files.empty() || deps_output_file || !jobfile.empty() || !inputFiles.empty()) help(argv[0], true);
+	}
+	if (vm.count("server-connections")) {
+		arg_serverconnections = vm["server-connections"].as<unsigned int>();
+	}
+
 	bool cmdlinemode = false;
-	if (output_file) { // cmd-line mode
+	if (!output_files.empty() || !jobfile.empty() || !socketpath.empty()) { // cmd-line mode
 		cmdlinemode = true;
-		if (!inputFiles.size()) help(argv[0], true);
+		if (!inputFiles.size() && jobfile.empty() && socketpath.empty()) help(argv[0], true);
 	}
 
 	if (arg_info || cmdlinemode) {
 		if (inputFiles.size() > 1) help(argv[0], true);
-		rc = cmdline(deps_output_file, inputFiles[0], camera, output_file, original_path, renderer, argc, argv);
+		const std::string filename = inputFiles.empty() ? std::string() : inputFiles[0];
+		rc = cmdline(deps_output_file, filename, camera, output_files, jobfile, socketpath, original_path, renderer, argc, argv);
+		if (!arg_cachestats.empty()) print_cache_statistics(arg_cachestats == "json");
+		if (!arg_timing.empty()) phase_timer.print(arg_timing == "json");
 	}
 	else if (QtUseGUI()) {
 		rc = gui(inputFiles, original_path, argc, argv);
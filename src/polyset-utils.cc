@@ -3,11 +3,16 @@
 #include "Polygon2d.h"
 #include "printutils.h"
 #include "GeometryUtils.h"
+#include "clipper-utils.h"
+#include "TaskScheduler.h"
 #ifdef ENABLE_CGAL
 #include "cgalutils.h"
 #endif
 
 #include <boost/foreach.hpp>
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/unordered_map.hpp>
 
 namespace PolysetUtils {
 
@@ -17,16 +22,160 @@ namespace PolysetUtils {
 	Polygon2d *project(const PolySet &ps) {
 		Polygon2d *poly = new Polygon2d;
 
-		BOOST_FOREACH(const Polygon &p, ps.polygons) {
+		for (size_t i = 0; i < ps.numPolygons(); i++) {
+			const PolySet::Face p = ps.getFace(i);
 			Outline2d outline;
-			BOOST_FOREACH(const Vector3d &v, p) {
-				outline.vertices.push_back(Vector2d(v[0], v[1]));
+			outline.vertices.reserve(p.size());
+			for (size_t j = 0; j < p.size(); j++) {
+				outline.vertices.push_back(Vector2d(p[j][0], p[j][1]));
 			}
 			poly->addOutline(outline);
 		}
 		return poly;
 	}
 
+	// Number of faces unioned by each leaf task in projectUnion()
+	static const size_t projection_leaf_size = 1000;
+
+	/*!
+		Returns true if every edge of ps is used as often in one direction as
+		in the other, i.e. the faces form a closed, consistently oriented surface.
+	*/
+	static bool is_closed(const PolySet &ps)
+	{
+		boost::unordered_map<boost::uint64_t, int> edges;
+		for (size_t i = 0; i < ps.numPolygons(); i++) {
+			const PolySet::Face face = ps.getFace(i);
+			for (size_t j = 0; j < face.size(); j++) {
+				boost::uint32_t a = face.index(j), b = face.index((j+1) % face.size());
+				if (a < b) edges[(boost::uint64_t(a) << 32) | b]++;
+				else edges[(boost::uint64_t(b) << 32) | a]--;
+			}
+		}
+		for (boost::unordered_map<boost::uint64_t, int>::const_iterator it = edges.begin(); it != edges.end(); ++it) {
+			if (it->second != 0) return false;
+		}
+		return true;
+	}
+
+	/*!
+		Adds the projections of the faces of ps to paths.
+
+		The projection of a closed surface covers every point of its shadow
+		with as many front-facing as back-facing faces, as long as no face
+		turns both ways when projected. In that case only the front-facing
+		faces are added, which is about half of them; side-facing faces have
+		no area anyway. Otherwise all faces are added, made to point up.
+		Orientation is decided on the integer coordinates seen by Clipper.
+	*/
+	static void project_faces(const PolySet &ps, ClipperLib::Paths &paths)
+	{
+		bool closed = is_closed(ps);
+		size_t first = paths.size();
+		std::vector<int> orientations;
+		orientations.reserve(ps.numPolygons());
+		for (size_t i = 0; i < ps.numPolygons(); i++) {
+			const PolySet::Face face = ps.getFace(i);
+			ClipperLib::Path path;
+			path.reserve(face.size());
+			for (size_t j = 0; j < face.size(); j++) {
+				path.push_back(ClipperLib::IntPoint(face[j][0]*ClipperUtils::CLIPPER_SCALE, face[j][1]*ClipperUtils::CLIPPER_SCALE));
+			}
+			bool left = false, right = false;
+			for (size_t j = 0; j < path.size(); j++) {
+				const ClipperLib::IntPoint &p0 = path[j];
+				const ClipperLib::IntPoint &p1 = path[(j+1) % path.size()];
+				const ClipperLib::IntPoint &p2 = path[(j+2) % path.size()];
+				double turn = double(p1.X - p0.X) * double(p2.Y - p1.Y) - double(p1.Y - p0.Y) * double(p2.X - p1.X);
+				if (turn > 0) left = true;
+				else if (turn < 0) right = true;
+			}
+			if (left && right) closed = false;
+			orientations.push_back(left ? 1 : right ? -1 : 0);
+			paths.push_back(path);
+		}
+
+		size_t j = first;
+		for (size_t i = 0; i < orientations.size(); i++) {
+			ClipperLib::Path &path = paths[first + i];
+			if (closed) {
+				if (orientations[i] <= 0) continue;
+			}
+			else if (!ClipperLib::Orientation(path)) {
+				std::reverse(path.begin(), path.end());
+			}
+			if (j != first + i) paths[j].swap(path);
+			j++;
+		}
+		paths.resize(j);
+	}
+
+	static void union_paths(ClipperLib::Paths *paths)
+	{
+		// Using NonZero ensures that we don't create holes from polygons sharing
+		// edges since we're unioning a mesh
+		*paths = ClipperUtils::process(*paths, ClipperLib::ctUnion, ClipperLib::pftNonZero);
+	}
+
+	static void merge_paths(ClipperLib::Paths *a, ClipperLib::Paths *b)
+	{
+		a->insert(a->end(), b->begin(), b->end());
+		ClipperLib::Paths().swap(*b);
+		union_paths(a);
+	}
+
+	/*!
+		Projects the given PolySets onto the XY plane and returns the union of
+		their shadows, or NULL if it's empty.
+
+		Faces are unioned in chunks, and the chunks are merged pairwise as a
+		balanced tree. The chunks of each level of the tree are unioned in
+		parallel when called from a task of a TaskScheduler. A single Clipper
+		union over all faces would scale badly with the number of faces.
+	*/
+	Polygon2d *projectUnion(const std::vector<const PolySet *> &polysets)
+	{
+		ClipperLib::Paths faces;
+		BOOST_FOREACH(const PolySet *ps, polysets) project_faces(*ps, faces);
+		PRINTDB("Projecting %d faces", faces.size());
+
+		std::vector<ClipperLib::Paths> parts((faces.size() + projection_leaf_size - 1) / projection_leaf_size);
+		for (size_t i = 0; i < parts.size(); i++) {
+			ClipperLib::Paths::iterator begin = faces.begin() + i * projection_leaf_size;
+			ClipperLib::Paths::iterator end = faces.begin() + std::min(faces.size(), (i + 1) * projection_leaf_size);
+			parts[i].resize(end - begin);
+			for (size_t j = 0; begin != end; ++begin, ++j) parts[i][j].swap(*begin);
+		}
+		ClipperLib::Paths().swap(faces);
+
+		{
+			// Without a scheduler, the calling thread runs all tasks while waiting
+			TaskScheduler serial(0);
+			TaskScheduler &scheduler = TaskScheduler::current() ? *TaskScheduler::current() : serial;
+			TaskScheduler::TaskGroup group;
+			for (size_t i = 0; i < parts.size(); i++) {
+				scheduler.spawn(group, boost::bind(&union_paths, &parts[i]));
+			}
+			scheduler.wait(group);
+			for (size_t step = 1; step < parts.size(); step *= 2) {
+				for (size_t i = 0; i + step < parts.size(); i += 2*step) {
+					scheduler.spawn(group, boost::bind(&merge_paths, &parts[i], &parts[i + step]));
+				}
+				scheduler.wait(group);
+			}
+		}
+		if (parts.empty()) return NULL;
+
+		ClipperLib::Clipper sumclipper;
+		sumclipper.AddPaths(parts[0], ClipperLib::ptSubject, true);
+		ClipperLib::PolyTree sumresult;
+		// This is key - without StrictlySimple, we tend to get self-intersecting results
+		sumclipper.StrictlySimple(true);
+		sumclipper.Execute(ClipperLib::ctUnion, sumresult, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
+		if (sumresult.Total() == 0) return NULL;
+		return ClipperUtils::toPolygon2d(sumresult);
+	}
+
 /* Tessellation of 3d PolySet faces
 	 
 	 This code is for tessellating the faces of a 3d PolySet, assuming that
@@ -49,14 +198,15 @@ namespace PolysetUtils {
 */
 	void tessellate_faces(const PolySet &inps, PolySet &outps) {
 		int degeneratePolygons = 0;
-		for (size_t i = 0; i < inps.polygons.size(); i++) {
-			const Polygon &pgon = inps.polygons[i];
+		outps.reserve(inps.numPolygons(), 3 * inps.numPolygons());
+		for (size_t i = 0; i < inps.numPolygons(); i++) {
+			const PolySet::Face pgon = inps.getFace(i);
 			if (pgon.size() < 3) {
 				degeneratePolygons++;
 			}
 			else {
 				Polygons triangles;
-				bool err = GeometryUtils::tessellatePolygon(pgon, triangles);
+				bool err = GeometryUtils::tessellatePolygon(pgon.toPolygon(), triangles);
 				// Empty triangles tend to happen quite often,
 				// probably due to previous floating point conversion, so
 				// we don't issue any warnings.
@@ -1,11 +1,14 @@
 #pragma once
 
+#include <vector>
+
 class Polygon2d;
 class PolySet;
 
 namespace PolysetUtils {
 
 	Polygon2d *project(const PolySet &ps);
+	Polygon2d *projectUnion(const std::vector<const PolySet *> &polysets);
 	void tessellate_faces(const PolySet &inps, PolySet &outps);
 	bool is_approximately_convex(const PolySet &ps);
 
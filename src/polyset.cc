@@ -29,9 +29,12 @@
 #include "linalg.h"
 #include "printutils.h"
 #include "grid.h"
+#include "VBOCache.h"
 
+#include <map>
 #include <Eigen/LU>
 #include <boost/foreach.hpp>
+#include <boost/functional/hash.hpp>
 
 /*! /class PolySet
 
@@ -45,18 +48,53 @@
 
 	PolySet must only contain convex polygons
 
+	Vertices are shared: Each unique vertex is stored once, and polygons are
+	stored as a flat list of vertex indices. Use getFace() to access a
+	polygon without copying, or getPolygons() for the non-indexed layout.
+
  */
 
-PolySet::PolySet(unsigned int dim, boost::tribool convex) : dim(dim), convex(convex)
+PolySet::PolySet(unsigned int dim, boost::tribool convex) : dim(dim), convex(convex), rendered(false)
 {
+	this->faceoffsets.push_back(0);
 }
 
-PolySet::PolySet(const Polygon2d &origin) : polygon(origin), dim(2), convex(unknown)
+PolySet::PolySet(const Polygon2d &origin) : polygon(origin), dim(2), convex(unknown), rendered(false)
 {
+	this->faceoffsets.push_back(0);
 }
 
 PolySet::~PolySet()
 {
+#ifndef NULLGL
+	if (this->rendered) VBOCache::instance()->remove(this);
+#endif
+}
+
+Polygon PolySet::Face::toPolygon() const
+{
+	Polygon p(this->n);
+	for (size_t i=0;i<this->n;i++) p[i] = (*this)[i];
+	return p;
+}
+
+PolySet::Face PolySet::getFace(size_t i) const
+{
+	int offset = this->faceoffsets[i];
+	size_t size = this->faceoffsets[i+1] - offset;
+	return Face(this->vertices.empty() ? NULL : &this->vertices[0],
+							size == 0 ? NULL : &this->indices[offset], size);
+}
+
+/*!
+	Returns the polygons in the non-indexed layout, for code which hasn't
+	been converted to work on shared vertices.
+*/
+Polygons PolySet::getPolygons() const
+{
+	Polygons polygons(numPolygons());
+	for (size_t i = 0; i < numPolygons(); i++) polygons[i] = getFace(i).toPolygon();
+	return polygons;
 }
 
 std::string PolySet::dump() const
@@ -65,14 +103,14 @@ std::string PolySet::dump() const
 	out << "PolySet:"
 	  << "\n dimensions:" << this->dim
 	  << "\n convexity:" << this->convexity
-	  << "\n num polygons: " << polygons.size()
+	  << "\n num polygons: " << numPolygons()
 			<< "\n num outlines: " << polygon.outlines().size()
 	  << "\n polygons data:";
-	for (size_t i = 0; i < polygons.size(); i++) {
+	for (size_t i = 0; i < numPolygons(); i++) {
 		out << "\n  polygon begin:";
-		const Polygon *poly = &polygons[i];
-		for (size_t j = 0; j < poly->size(); j++) {
-			Vector3d v = poly->at(j);
+		const Face poly = getFace(i);
+		for (size_t j = 0; j < poly.size(); j++) {
+			Vector3d v = poly[j];
 			out << "\n   vertex:" << v.transpose();
 		}
 	}
@@ -82,9 +120,84 @@ std::string PolySet::dump() const
 	return out.str();
 }
 
+static size_t hash_vertex(const Vector3d &v)
+{
+	size_t seed = 0;
+	// Adding 0.0 turns -0.0 into 0.0, which compare equal
+	boost::hash_combine(seed, v[0] + 0.0);
+	boost::hash_combine(seed, v[1] + 0.0);
+	boost::hash_combine(seed, v[2] + 0.0);
+	return seed;
+}
+
+void PolySet::rehashVertices(size_t size)
+{
+	this->vertexhash.assign(size, -1);
+	size_t mask = size - 1;
+	for (size_t i = 0; i < this->vertices.size(); i++) {
+		size_t h = hash_vertex(this->vertices[i]) & mask;
+		while (this->vertexhash[h] >= 0) h = (h + 1) & mask;
+		this->vertexhash[h] = i;
+	}
+}
+
+/*!
+	Returns the index of the given vertex, adding it if it doesn't exist yet.
+*/
+int PolySet::vertexIndex(const Vector3d &v)
+{
+	// Keep the load factor below 1/2
+	if (this->vertexhash.size() < 2 * (this->vertices.size() + 1)) {
+		size_t size = 16;
+		while (size < 4 * (this->vertices.size() + 1)) size *= 2;
+		rehashVertices(size);
+	}
+	size_t mask = this->vertexhash.size() - 1;
+	for (size_t h = hash_vertex(v) & mask;; h = (h + 1) & mask) {
+		int idx = this->vertexhash[h];
+		if (idx < 0) {
+			this->vertexhash[h] = this->vertices.size();
+			this->vertices.push_back(v);
+			return this->vertices.size() - 1;
+		}
+		if (this->vertices[idx] == v) return idx;
+	}
+}
+
+void PolySet::reserve(size_t numpolygons, size_t numindices, size_t numvertices)
+{
+	this->faceoffsets.reserve(this->faceoffsets.size() + numpolygons);
+	this->indices.reserve(this->indices.size() + numindices);
+	if (numvertices) this->vertices.reserve(this->vertices.size() + numvertices);
+}
+
+/*!
+	Adds a vertex without looking for an existing equal one, and returns its
+	index for use with append_index(). For building meshes whose vertices
+	are known to be unique.
+*/
+int PolySet::add_vertex(const Vector3d &v)
+{
+	this->vertexhash.clear();
+	this->vertices.push_back(v);
+	return this->vertices.size() - 1;
+}
+
+void PolySet::append_index(int idx)
+{
+	this->indices.push_back(idx);
+	this->faceoffsets.back() = this->indices.size();
+}
+
+void PolySet::append_polygon(const Polygon &p)
+{
+	append_poly();
+	BOOST_FOREACH(const Vector3d &v, p) append_vertex(v);
+}
+
 void PolySet::append_poly()
 {
-	polygons.push_back(Polygon());
+	this->faceoffsets.push_back(this->indices.size());
 }
 
 void PolySet::append_vertex(double x, double y, double z)
@@ -94,12 +207,13 @@ void PolySet::append_vertex(double x, double y, double z)
 
 void PolySet::append_vertex(const Vector3d &v)
 {
-	polygons.back().push_back(v);
+	this->indices.push_back(vertexIndex(v));
+	this->faceoffsets.back() = this->indices.size();
 }
 
 void PolySet::append_vertex(const Vector3f &v)
 {
-	polygons.back().push_back(v.cast<double>());
+	append_vertex(Vector3d(v.cast<double>()));
 }
 
 void PolySet::insert_vertex(double x, double y, double z)
@@ -109,31 +223,30 @@ void PolySet::insert_vertex(double x, double y, double z)
 
 void PolySet::insert_vertex(const Vector3d &v)
 {
-	polygons.back().insert(polygons.back().begin(), v);
+	int idx = vertexIndex(v);
+	this->indices.insert(this->indices.begin() + this->faceoffsets[numPolygons() - 1], idx);
+	this->faceoffsets.back() = this->indices.size();
 }
 
 void PolySet::insert_vertex(const Vector3f &v)
 {
-	polygons.back().insert(polygons.back().begin(), v.cast<double>());
+	insert_vertex(Vector3d(v.cast<double>()));
 }
 
 BoundingBox PolySet::getBoundingBox() const
 {
 	BoundingBox bbox;
-	for (size_t i = 0; i < polygons.size(); i++) {
-		const Polygon &poly = polygons[i];
-		for (size_t j = 0; j < poly.size(); j++) {
-			const Vector3d &p = poly[j];
-			bbox.extend(p);
-		}
-	}
+	BOOST_FOREACH(const Vector3d &v, this->vertices) bbox.extend(v);
 	return bbox;
 }
 
 size_t PolySet::memsize() const
 {
 	size_t mem = 0;
-	BOOST_FOREACH(const Polygon &p, this->polygons) mem += p.size() * sizeof(Vector3d);
+	mem += this->vertices.capacity() * sizeof(Vector3d);
+	mem += this->indices.capacity() * sizeof(int);
+	mem += this->faceoffsets.capacity() * sizeof(int);
+	mem += this->vertexhash.capacity() * sizeof(int);
 	mem += this->polygon.memsize() - sizeof(this->polygon);
 	mem += sizeof(PolySet);
 	return mem;
@@ -141,19 +254,63 @@ size_t PolySet::memsize() const
 
 void PolySet::append(const PolySet &ps)
 {
-	this->polygons.insert(this->polygons.end(), ps.polygons.begin(), ps.polygons.end());
+	std::vector<int> remap(ps.vertices.size());
+	for (size_t i = 0; i < ps.vertices.size(); i++) remap[i] = vertexIndex(ps.vertices[i]);
+	reserve(ps.numPolygons(), ps.indices.size());
+	for (size_t i = 0; i < ps.numPolygons(); i++) {
+		append_poly();
+		for (int j = ps.faceoffsets[i]; j < ps.faceoffsets[i+1]; j++) {
+			this->indices.push_back(remap[ps.indices[j]]);
+		}
+		this->faceoffsets.back() = this->indices.size();
+	}
 }
 
-void PolySet::transform(const Transform3d &mat)
+/*!
+	Appends the polygons of \a ps transformed by \a mat, without copying
+	\a ps first.
+*/
+void PolySet::append(const PolySet &ps, const Transform3d &mat)
 {
 	// If mirroring transform, flip faces to avoid the object to end up being inside-out
 	bool mirrored = mat.matrix().determinant() < 0;
 
-	BOOST_FOREACH(Polygon &p, this->polygons) {
-		BOOST_FOREACH(Vector3d &v, p) {
-			v = mat * v;
+	std::vector<int> remap(ps.vertices.size());
+	for (size_t i = 0; i < ps.vertices.size(); i++) remap[i] = vertexIndex(mat * ps.vertices[i]);
+	reserve(ps.numPolygons(), ps.indices.size());
+	for (size_t i = 0; i < ps.numPolygons(); i++) {
+		append_poly();
+		if (mirrored) {
+			for (int j = ps.faceoffsets[i+1] - 1; j >= ps.faceoffsets[i]; j--) {
+				this->indices.push_back(remap[ps.indices[j]]);
+			}
+		}
+		else {
+			for (int j = ps.faceoffsets[i]; j < ps.faceoffsets[i+1]; j++) {
+				this->indices.push_back(remap[ps.indices[j]]);
+			}
 		}
-		if (mirrored) std::reverse(p.begin(), p.end());
+		this->faceoffsets.back() = this->indices.size();
+	}
+}
+
+void PolySet::transform(const Transform3d &mat)
+{
+	// If mirroring transform, flip faces to avoid the object to end up being inside-out
+	bool mirrored = mat.matrix().determinant() < 0;
+
+	BOOST_FOREACH(Vector3d &v, this->vertices) {
+		v = mat * v;
+	}
+	if (mirrored) reverseFaces();
+	// Vertices have moved, and may even have become identical
+	this->vertexhash.clear();
+}
+
+void PolySet::reverseFaces()
+{
+	for (size_t i = 0; i < numPolygons(); i++) {
+		std::reverse(this->indices.begin() + this->faceoffsets[i], this->indices.begin() + this->faceoffsets[i+1]);
 	}
 }
 
@@ -198,34 +355,69 @@ void PolySet::resize(Vector3d newsize, const Eigen::Matrix<bool,3,1> &autosize)
 void PolySet::quantizeVertices()
 {
 	Grid3d<int> grid(GRID_FINE);
-	int numverts = 0;
-	std::vector<int> indices; // Vertex indices in one polygon
-	for (std::vector<Polygon>::iterator iter = this->polygons.begin(); iter != this->polygons.end();) {
-		Polygon &p = *iter;
-		indices.resize(p.size());
-		// Quantize all vertices. Build index list
-		for (int i=0;i<p.size();i++) indices[i] = grid.align(p[i]);
+	// Vertices snapping to the same grid point are merged
+	std::vector<int> remap(this->vertices.size());
+	std::vector<int> gridindices(this->vertices.size());
+	for (size_t i = 0; i < this->vertices.size(); i++) {
+		gridindices[i] = grid.align(this->vertices[i]);
+	}
+	std::map<int, int> firstvertex;
+	for (size_t i = 0; i < this->vertices.size(); i++) {
+		remap[i] = firstvertex.insert(std::make_pair(gridindices[i], int(i))).first->second;
+	}
+
+	std::vector<int> newindices;
+	std::vector<int> newoffsets(1, 0);
+	newindices.reserve(this->indices.size());
+	newoffsets.reserve(this->faceoffsets.size());
+	for (size_t i = 0; i < numPolygons(); i++) {
+		int begin = this->faceoffsets[i], end = this->faceoffsets[i+1];
+		int n = end - begin;
 		// Remove consequtive duplicate vertices
-		Polygon::iterator currp = p.begin();
-		for (int i=0;i<indices.size();i++) {
-			if (indices[i] != indices[(i+1)%indices.size()]) {
-				(*currp++) = p[i];
-			}
+		for (int j = begin; j < end; j++) {
+			int idx = remap[this->indices[j]];
+			if (idx != remap[this->indices[begin + (j - begin + 1) % n]]) newindices.push_back(idx);
 		}
-		p.erase(currp, p.end());
-		if (p.size() < 3) {
+		if (int(newindices.size()) - newoffsets.back() < 3) {
 			PRINTD("Removing collapsed polygon due to quantizing");
-			this->polygons.erase(iter);
+			newindices.resize(newoffsets.back());
 		}
 		else {
-			iter++;
+			newoffsets.push_back(newindices.size());
+		}
+	}
+	this->faceoffsets.swap(newoffsets);
+
+	// Drop merged and unused vertices
+	std::vector<int> newvertexindex(this->vertices.size(), -1);
+	std::vector<Vector3d> newvertices;
+	BOOST_FOREACH(int &idx, newindices) {
+		if (newvertexindex[idx] < 0) {
+			newvertexindex[idx] = newvertices.size();
+			newvertices.push_back(this->vertices[idx]);
 		}
+		idx = newvertexindex[idx];
 	}
+	this->indices.swap(newindices);
+	this->vertices.swap(newvertices);
+	this->vertexhash.clear();
 }
 
-// all GL functions grouped together here
-#ifndef NULLGL
-static void gl_draw_triangle(GLint *shaderinfo, const Vector3d &p0, const Vector3d &p1, const Vector3d &p2, bool e0, bool e1, bool e2, double z, bool mirrored)
+static void append_vertex3f(std::vector<float> &data, double x, double y, double z)
+{
+	data.push_back(x);
+	data.push_back(y);
+	data.push_back(z);
+}
+
+/*!
+	Appends a triangle to the vertex data built by PolySet::buildSurface().
+	e0, e1 and e2 tell which of the edges p0-p1, p1-p2 and p2-p0 are
+	rendered by the edge shader.
+*/
+static void add_triangle(std::vector<float> &vertices, std::vector<float> *edgeattribs,
+												 const Vector3d &p0, const Vector3d &p1, const Vector3d &p2,
+												 bool e0, bool e1, bool e2, double z)
 {
 	double ax = p1[0] - p0[0], bx = p1[0] - p2[0];
 	double ay = p1[1] - p0[1], by = p1[1] - p2[1];
@@ -234,99 +426,74 @@ static void gl_draw_triangle(GLint *shaderinfo, const Vector3d &p0, const Vector
 	double ny = az*bx - ax*bz;
 	double nz = ax*by - ay*bx;
 	double nl = sqrt(nx*nx + ny*ny + nz*nz);
-	glNormal3d(nx / nl, ny / nl, nz / nl);
-#ifdef ENABLE_OPENCSG
-	if (shaderinfo) {
+	const Vector3d *p[3] = {&p0, &p1, &p2};
+	for (int i = 0; i < 3; i++) {
+		append_vertex3f(vertices, (*p[i])[0], (*p[i])[1], (*p[i])[2] + z);
+		append_vertex3f(vertices, nx / nl, ny / nl, nz / nl);
+	}
+	if (edgeattribs) {
 		double e0f = e0 ? 2.0 : -1.0;
 		double e1f = e1 ? 2.0 : -1.0;
 		double e2f = e2 ? 2.0 : -1.0;
-		glVertexAttrib3d(shaderinfo[3], e0f, e1f, e2f);
-		glVertexAttrib3d(shaderinfo[4], p1[0], p1[1], p1[2] + z);
-		glVertexAttrib3d(shaderinfo[5], p2[0], p2[1], p2[2] + z);
-		glVertexAttrib3d(shaderinfo[6], 0.0, 1.0, 0.0);
-		glVertex3d(p0[0], p0[1], p0[2] + z);
-		if (!mirrored) {
-			glVertexAttrib3d(shaderinfo[3], e0f, e1f, e2f);
-			glVertexAttrib3d(shaderinfo[4], p0[0], p0[1], p0[2] + z);
-			glVertexAttrib3d(shaderinfo[5], p2[0], p2[1], p2[2] + z);
-			glVertexAttrib3d(shaderinfo[6], 0.0, 0.0, 1.0);
-			glVertex3d(p1[0], p1[1], p1[2] + z);
-		}
-		glVertexAttrib3d(shaderinfo[3], e0f, e1f, e2f);
-		glVertexAttrib3d(shaderinfo[4], p0[0], p0[1], p0[2] + z);
-		glVertexAttrib3d(shaderinfo[5], p1[0], p1[1], p1[2] + z);
-		glVertexAttrib3d(shaderinfo[6], 1.0, 0.0, 0.0);
-		glVertex3d(p2[0], p2[1], p2[2] + z);
-		if (mirrored) {
-			glVertexAttrib3d(shaderinfo[3], e0f, e1f, e2f);
-			glVertexAttrib3d(shaderinfo[4], p0[0], p0[1], p0[2] + z);
-			glVertexAttrib3d(shaderinfo[5], p2[0], p2[1], p2[2] + z);
-			glVertexAttrib3d(shaderinfo[6], 0.0, 0.0, 1.0);
-			glVertex3d(p1[0], p1[1], p1[2] + z);
+		// trig, pos_b, pos_c and mask of each vertex
+		static const double mask[3][3] = {{0.0, 1.0, 0.0}, {0.0, 0.0, 1.0}, {1.0, 0.0, 0.0}};
+		for (int i = 0; i < 3; i++) {
+			const Vector3d &b = i == 0 ? p1 : p0;
+			const Vector3d &c = i == 2 ? p1 : p2;
+			append_vertex3f(*edgeattribs, e0f, e1f, e2f);
+			append_vertex3f(*edgeattribs, b[0], b[1], b[2] + z);
+			append_vertex3f(*edgeattribs, c[0], c[1], c[2] + z);
+			append_vertex3f(*edgeattribs, mask[i][0], mask[i][1], mask[i][2]);
 		}
 	}
-	else
-#endif
-	{
-		glVertex3d(p0[0], p0[1], p0[2] + z);
-		if (!mirrored)
-			glVertex3d(p1[0], p1[1], p1[2] + z);
-		glVertex3d(p2[0], p2[1], p2[2] + z);
-		if (mirrored)
-			glVertex3d(p1[0], p1[1], p1[2] + z);
-	}
 }
 
-void PolySet::render_surface(Renderer::csgmode_e csgmode, const Transform3d &m, GLint *shaderinfo) const
+/*!
+	Builds the triangles rendered by render_surface(). For each vertex,
+	vertices gets its position and normal, and edgeattribs, if given,
+	the trig, pos_b, pos_c and mask attributes of the edge shader.
+*/
+void PolySet::buildSurface(Renderer::csgmode_e csgmode, std::vector<float> &vertices, std::vector<float> *edgeattribs) const
 {
-	PRINTD("Polyset render");
-	bool mirrored = m.matrix().determinant() < 0;
-#ifdef ENABLE_OPENCSG
-	if (shaderinfo) {
-		glUniform1f(shaderinfo[7], shaderinfo[9]);
-		glUniform1f(shaderinfo[8], shaderinfo[10]);
-	}
-#endif /* ENABLE_OPENCSG */
 	if (this->dim == 2) {
 		// Render 2D objects 1mm thick, but differences slightly larger
 		double zbase = 1 + ((csgmode & CSGMODE_DIFFERENCE_FLAG) ? 0.1 : 0);
-		glBegin(GL_TRIANGLES);
 
 		// Render top+bottom
 		for (double z = -zbase/2; z < zbase; z += zbase) {
-			for (size_t i = 0; i < polygons.size(); i++) {
-				const Polygon *poly = &polygons[i];
-				if (poly->size() == 3) {
+			for (size_t i = 0; i < numPolygons(); i++) {
+				const Face poly = getFace(i);
+				if (poly.size() == 3) {
 					if (z < 0) {
-						gl_draw_triangle(shaderinfo, poly->at(0), poly->at(2), poly->at(1), true, true, true, z, mirrored);
+						add_triangle(vertices, edgeattribs, poly.at(0), poly.at(2), poly.at(1), true, true, true, z);
 					} else {
-						gl_draw_triangle(shaderinfo, poly->at(0), poly->at(1), poly->at(2), true, true, true, z, mirrored);
+						add_triangle(vertices, edgeattribs, poly.at(0), poly.at(1), poly.at(2), true, true, true, z);
 					}
 				}
-				else if (poly->size() == 4) {
+				else if (poly.size() == 4) {
 					if (z < 0) {
-						gl_draw_triangle(shaderinfo, poly->at(0), poly->at(3), poly->at(1), true, false, true, z, mirrored);
-						gl_draw_triangle(shaderinfo, poly->at(2), poly->at(1), poly->at(3), true, false, true, z, mirrored);
+						add_triangle(vertices, edgeattribs, poly.at(0), poly.at(3), poly.at(1), true, false, true, z);
+						add_triangle(vertices, edgeattribs, poly.at(2), poly.at(1), poly.at(3), true, false, true, z);
 					} else {
-						gl_draw_triangle(shaderinfo, poly->at(0), poly->at(1), poly->at(3), true, false, true, z, mirrored);
-						gl_draw_triangle(shaderinfo, poly->at(2), poly->at(3), poly->at(1), true, false, true, z, mirrored);
+						add_triangle(vertices, edgeattribs, poly.at(0), poly.at(1), poly.at(3), true, false, true, z);
+						add_triangle(vertices, edgeattribs, poly.at(2), poly.at(3), poly.at(1), true, false, true, z);
 					}
 				}
 				else {
 					Vector3d center = Vector3d::Zero();
-					for (size_t j = 0; j < poly->size(); j++) {
-						center[0] += poly->at(j)[0];
-						center[1] += poly->at(j)[1];
+					for (size_t j = 0; j < poly.size(); j++) {
+						center[0] += poly.at(j)[0];
+						center[1] += poly.at(j)[1];
 					}
-					center[0] /= poly->size();
-					center[1] /= poly->size();
-					for (size_t j = 1; j <= poly->size(); j++) {
+					center[0] /= poly.size();
+					center[1] /= poly.size();
+					for (size_t j = 1; j <= poly.size(); j++) {
 						if (z < 0) {
-							gl_draw_triangle(shaderinfo, center, poly->at(j % poly->size()), poly->at(j - 1),
-									false, true, false, z, mirrored);
+							add_triangle(vertices, edgeattribs, center, poly.at(j % poly.size()), poly.at(j - 1),
+													 false, true, false, z);
 						} else {
-							gl_draw_triangle(shaderinfo, center, poly->at(j - 1), poly->at(j % poly->size()),
-									false, true, false, z, mirrored);
+							add_triangle(vertices, edgeattribs, center, poly.at(j - 1), poly.at(j % poly.size()),
+													 false, true, false, z);
 						}
 					}
 				}
@@ -341,54 +508,50 @@ void PolySet::render_surface(Renderer::csgmode_e csgmode, const Transform3d &m,
 					Vector3d p2(o.vertices[j-1][0], o.vertices[j-1][1], zbase/2);
 					Vector3d p3(o.vertices[j % o.vertices.size()][0], o.vertices[j % o.vertices.size()][1], -zbase/2);
 					Vector3d p4(o.vertices[j % o.vertices.size()][0], o.vertices[j % o.vertices.size()][1], zbase/2);
-					gl_draw_triangle(shaderinfo, p2, p1, p3, true, true, false, 0, mirrored);
-					gl_draw_triangle(shaderinfo, p2, p3, p4, false, true, true, 0, mirrored);
+					add_triangle(vertices, edgeattribs, p2, p1, p3, true, true, false, 0);
+					add_triangle(vertices, edgeattribs, p2, p3, p4, false, true, true, 0);
 				}
 			}
 		}
 		else {
 			// If we don't have borders, use the polygons as borders.
 			// FIXME: When is this used?
-			const Polygons *borders_p = &polygons;
-			for (size_t i = 0; i < borders_p->size(); i++) {
-				const Polygon *poly = &borders_p->at(i);
-				for (size_t j = 1; j <= poly->size(); j++) {
-					Vector3d p1 = poly->at(j - 1), p2 = poly->at(j - 1);
-					Vector3d p3 = poly->at(j % poly->size()), p4 = poly->at(j % poly->size());
+			for (size_t i = 0; i < numPolygons(); i++) {
+				const Face poly = getFace(i);
+				for (size_t j = 1; j <= poly.size(); j++) {
+					Vector3d p1 = poly.at(j - 1), p2 = poly.at(j - 1);
+					Vector3d p3 = poly.at(j % poly.size()), p4 = poly.at(j % poly.size());
 					p1[2] -= zbase/2, p2[2] += zbase/2;
 					p3[2] -= zbase/2, p4[2] += zbase/2;
-					gl_draw_triangle(shaderinfo, p2, p1, p3, true, true, false, 0, mirrored);
-					gl_draw_triangle(shaderinfo, p2, p3, p4, false, true, true, 0, mirrored);
+					add_triangle(vertices, edgeattribs, p2, p1, p3, true, true, false, 0);
+					add_triangle(vertices, edgeattribs, p2, p3, p4, false, true, true, 0);
 				}
 			}
 		}
-		glEnd();
 	} else if (this->dim == 3) {
-		for (size_t i = 0; i < polygons.size(); i++) {
-			const Polygon *poly = &polygons[i];
-			glBegin(GL_TRIANGLES);
-			if (poly->size() == 3) {
-				gl_draw_triangle(shaderinfo, poly->at(0), poly->at(1), poly->at(2), true, true, true, 0, mirrored);
+		for (size_t i = 0; i < numPolygons(); i++) {
+			const Face poly = getFace(i);
+			if (poly.size() == 3) {
+				add_triangle(vertices, edgeattribs, poly.at(0), poly.at(1), poly.at(2), true, true, true, 0);
 			}
-			else if (poly->size() == 4) {
-				gl_draw_triangle(shaderinfo, poly->at(0), poly->at(1), poly->at(3), true, false, true, 0, mirrored);
-				gl_draw_triangle(shaderinfo, poly->at(2), poly->at(3), poly->at(1), true, false, true, 0, mirrored);
+			else if (poly.size() == 4) {
+				add_triangle(vertices, edgeattribs, poly.at(0), poly.at(1), poly.at(3), true, false, true, 0);
+				add_triangle(vertices, edgeattribs, poly.at(2), poly.at(3), poly.at(1), true, false, true, 0);
 			}
 			else {
 				Vector3d center = Vector3d::Zero();
-				for (size_t j = 0; j < poly->size(); j++) {
-					center[0] += poly->at(j)[0];
-					center[1] += poly->at(j)[1];
-					center[2] += poly->at(j)[2];
+				for (size_t j = 0; j < poly.size(); j++) {
+					center[0] += poly.at(j)[0];
+					center[1] += poly.at(j)[1];
+					center[2] += poly.at(j)[2];
 				}
-				center[0] /= poly->size();
-				center[1] /= poly->size();
-				center[2] /= poly->size();
-				for (size_t j = 1; j <= poly->size(); j++) {
-					gl_draw_triangle(shaderinfo, center, poly->at(j - 1), poly->at(j % poly->size()), false, true, false, 0, mirrored);
+				center[0] /= poly.size();
+				center[1] /= poly.size();
+				center[2] /= poly.size();
+				for (size_t j = 1; j <= poly.size(); j++) {
+					add_triangle(vertices, edgeattribs, center, poly.at(j - 1), poly.at(j % poly.size()), false, true, false, 0);
 				}
 			}
-			glEnd();
 		}
 	}
 	else {
@@ -396,24 +559,21 @@ void PolySet::render_surface(Renderer::csgmode_e csgmode, const Transform3d &m,
 	}
 }
 
-/*! This is used in throwntogether and CGAL mode
-
-	csgmode is set to CSGMODE_NONE in CGAL mode. In this mode a pure 2D rendering is performed.
-
-	For some reason, this is not used to render edges in Preview mode
+/*!
+	Builds the line segments rendered by render_edges(), as pairs of
+	vertex positions.
 */
-void PolySet::render_edges(Renderer::csgmode_e csgmode) const
+void PolySet::buildEdges(Renderer::csgmode_e csgmode, std::vector<float> &lines) const
 {
-	glDisable(GL_LIGHTING);
 	if (this->dim == 2) {
 		if (csgmode == Renderer::CSGMODE_NONE) {
 			// Render only outlines
 			BOOST_FOREACH(const Outline2d &o, polygon.outlines()) {
-				glBegin(GL_LINE_LOOP);
-				BOOST_FOREACH(const Vector2d &v, o.vertices) {
-					glVertex3d(v[0], v[1], -0.1);
+				for (size_t j = 0; j < o.vertices.size(); j++) {
+					const Vector2d &v1 = o.vertices[j], &v2 = o.vertices[(j+1) % o.vertices.size()];
+					append_vertex3f(lines, v1[0], v1[1], -0.1);
+					append_vertex3f(lines, v2[0], v2[1], -0.1);
 				}
-				glEnd();
 			}
 		}
 		else {
@@ -421,42 +581,65 @@ void PolySet::render_edges(Renderer::csgmode_e csgmode) const
 			double zbase = 1 + ((csgmode & CSGMODE_DIFFERENCE_FLAG) ? 0.1 : 0);
 
 			BOOST_FOREACH(const Outline2d &o, polygon.outlines()) {
-				// Render top+bottom outlines
-				for (double z = -zbase/2; z < zbase; z += zbase) {
-					glBegin(GL_LINE_LOOP);
-					BOOST_FOREACH(const Vector2d &v, o.vertices) {
-						glVertex3d(v[0], v[1], z);
+				for (size_t j = 0; j < o.vertices.size(); j++) {
+					const Vector2d &v1 = o.vertices[j], &v2 = o.vertices[(j+1) % o.vertices.size()];
+					// Render top+bottom outlines
+					for (double z = -zbase/2; z < zbase; z += zbase) {
+						append_vertex3f(lines, v1[0], v1[1], z);
+						append_vertex3f(lines, v2[0], v2[1], z);
 					}
-					glEnd();
+					// Render sides
+					append_vertex3f(lines, v1[0], v1[1], -zbase/2);
+					append_vertex3f(lines, v1[0], v1[1], +zbase/2);
 				}
-				// Render sides
-				glBegin(GL_LINES);
-				BOOST_FOREACH(const Vector2d &v, o.vertices) {
-					glVertex3d(v[0], v[1], -zbase/2);
-					glVertex3d(v[0], v[1], +zbase/2);
-				}
-				glEnd();
 			}
 		}
 	} else if (dim == 3) {
-		for (size_t i = 0; i < polygons.size(); i++) {
-			const Polygon *poly = &polygons[i];
-			glBegin(GL_LINE_LOOP);
-			for (size_t j = 0; j < poly->size(); j++) {
-				const Vector3d &p = poly->at(j);
-				glVertex3d(p[0], p[1], p[2]);
+		for (size_t i = 0; i < numPolygons(); i++) {
+			const Face poly = getFace(i);
+			for (size_t j = 0; j < poly.size(); j++) {
+				const Vector3d &p1 = poly.at(j), &p2 = poly.at((j+1) % poly.size());
+				append_vertex3f(lines, p1[0], p1[1], p1[2]);
+				append_vertex3f(lines, p2[0], p2[1], p2[2]);
 			}
-			glEnd();
 		}
 	}
 	else {
 		assert(false && "Cannot render object with no dimension");
 	}
+}
+
+// all GL functions grouped together here
+#ifndef NULLGL
+void PolySet::render_surface(Renderer::csgmode_e csgmode, const Transform3d &m, GLint *shaderinfo) const
+{
+	PRINTD("Polyset render");
+	bool mirrored = m.matrix().determinant() < 0;
+#ifdef ENABLE_OPENCSG
+	if (shaderinfo) {
+		glUniform1f(shaderinfo[7], shaderinfo[9]);
+		glUniform1f(shaderinfo[8], shaderinfo[10]);
+	}
+#endif /* ENABLE_OPENCSG */
+	this->rendered = true;
+	VBOCache::instance()->drawSurface(*this, csgmode, mirrored, shaderinfo);
+}
+
+/*! This is used in throwntogether and CGAL mode
+
+	csgmode is set to CSGMODE_NONE in CGAL mode. In this mode a pure 2D rendering is performed.
+
+	For some reason, this is not used to render edges in Preview mode
+*/
+void PolySet::render_edges(Renderer::csgmode_e csgmode) const
+{
+	glDisable(GL_LIGHTING);
+	this->rendered = true;
+	VBOCache::instance()->drawEdges(*this, csgmode);
 	glEnable(GL_LIGHTING);
 }
 
 #else //NULLGL
-static void gl_draw_triangle(GLint *shaderinfo, const Vector3d &p0, const Vector3d &p1, const Vector3d &p2, bool e0, bool e1, bool e2, double z, bool mirrored) {}
 void PolySet::render_surface(Renderer::csgmode_e csgmode, const Transform3d &m, GLint *shaderinfo) const {}
 void PolySet::render_edges(Renderer::csgmode_e csgmode) const {}
 #endif //NULLGL
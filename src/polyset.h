@@ -15,7 +15,21 @@ BOOST_TRIBOOL_THIRD_STATE(unknown)
 class PolySet : public Geometry
 {
 public:
-	Polygons polygons;
+	/*! Read-only view of one polygon. Invalidated when the PolySet changes. */
+	class Face {
+	public:
+		Face(const Vector3d *vertices, const int *indices, size_t size)
+			: vertices(vertices), indices(indices), n(size) {}
+		size_t size() const { return this->n; }
+		const Vector3d &operator[](size_t i) const { return this->vertices[this->indices[i]]; }
+		const Vector3d &at(size_t i) const { assert(i < this->n); return (*this)[i]; }
+		int index(size_t i) const { return this->indices[i]; }
+		Polygon toPolygon() const;
+	private:
+		const Vector3d *vertices;
+		const int *indices;
+		size_t n;
+	};
 
 	PolySet(unsigned int dim, boost::tribool convex = unknown);
 	PolySet(const Polygon2d &origin);
@@ -25,11 +39,18 @@ public:
 	virtual BoundingBox getBoundingBox() const;
 	virtual std::string dump() const;
 	virtual unsigned int getDimension() const { return this->dim; }
-	virtual bool isEmpty() const { return polygons.size() == 0; }
+	virtual bool isEmpty() const { return numPolygons() == 0; }
 	virtual Geometry *copy() const { return new PolySet(*this); }
 
 	void quantizeVertices();
-	size_t numPolygons() const { return polygons.size(); }
+	size_t numPolygons() const { return this->faceoffsets.size() - 1; }
+	Face getFace(size_t i) const;
+	const std::vector<Vector3d> &getVertices() const { return this->vertices; }
+	Polygons getPolygons() const;
+	void reserve(size_t numpolygons, size_t numindices, size_t numvertices = 0);
+	int add_vertex(const Vector3d &v);
+	void append_index(int idx);
+	void append_polygon(const Polygon &p);
 	void append_poly();
 	void append_vertex(double x, double y, double z = 0.0);
 	void append_vertex(const Vector3d &v);
@@ -38,18 +59,36 @@ public:
 	void insert_vertex(const Vector3d &v);
 	void insert_vertex(const Vector3f &v);
 	void append(const PolySet &ps);
+	void append(const PolySet &ps, const Transform3d &mat);
 
 	void render_surface(Renderer::csgmode_e csgmode, const Transform3d &m, GLint *shaderinfo = NULL) const;
 	void render_edges(Renderer::csgmode_e csgmode) const;
+	void buildSurface(Renderer::csgmode_e csgmode, std::vector<float> &vertices, std::vector<float> *edgeattribs) const;
+	void buildEdges(Renderer::csgmode_e csgmode, std::vector<float> &lines) const;
 
 	void transform(const Transform3d &mat);
+	void reverseFaces();
 	void resize(Vector3d newsize, const Eigen::Matrix<bool,3,1> &autosize);
 
 	bool is_convex() const;
 	boost::tribool convexValue() const { return this->convex; }
 
 private:
+	int vertexIndex(const Vector3d &v);
+	void rehashVertices(size_t size);
+
+	// Vertices are shared between polygons. Polygon i consists of
+	// indices[faceoffsets[i]] .. indices[faceoffsets[i+1]-1]
+	std::vector<Vector3d> vertices;
+	std::vector<int> indices;
+	std::vector<int> faceoffsets;
+	// Open addressing hash table of vertex indices, used to share vertices
+	// when building. Empty if it needs to be rebuilt.
+	std::vector<int> vertexhash;
+
 	Polygon2d polygon;
 	unsigned int dim;
 	mutable boost::tribool convex;
+	// Set when rendered, so the destructor knows to drop any vertex buffers
+	mutable bool rendered;
 };
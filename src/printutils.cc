@@ -5,6 +5,7 @@
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/circular_buffer.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/thread/recursive_mutex.hpp>
 namespace fs = boost::filesystem;
 #include "boosty.h"
 
@@ -14,6 +15,9 @@ void *outputhandler_data = NULL;
 std::string OpenSCAD::debug("");
 
 boost::circular_buffer<std::string> lastmessages(5);
+// Serializes output from worker threads, see GeometryEvaluator::evaluateParallel().
+// Recursive, since output handlers may print themselves.
+static boost::recursive_mutex output_mutex;
 
 void set_output_handler(OutputHandlerFunc *newhandler, void *userdata)
 {
@@ -23,11 +27,13 @@ void set_output_handler(OutputHandlerFunc *newhandler, void *userdata)
 
 void print_messages_push()
 {
+	boost::recursive_mutex::scoped_lock lock(output_mutex);
 	print_messages_stack.push_back(std::string());
 }
 
 void print_messages_pop()
 {
+	boost::recursive_mutex::scoped_lock lock(output_mutex);
 	std::string msg = print_messages_stack.back();
 	print_messages_stack.pop_back();
 	if (print_messages_stack.size() > 0 && !msg.empty()) {
@@ -41,6 +47,7 @@ void print_messages_pop()
 void PRINT(const std::string &msg)
 {
 	if (msg.empty()) return;
+	boost::recursive_mutex::scoped_lock lock(output_mutex);
 	if (print_messages_stack.size() > 0) {
 		if (!print_messages_stack.back().empty()) {
 			print_messages_stack.back() += "\n";
@@ -54,6 +61,8 @@ void PRINT_NOCACHE(const std::string &msg)
 {
 	if (msg.empty()) return;
 
+	boost::recursive_mutex::scoped_lock lock(output_mutex);
+
 	if (boost::starts_with(msg, "WARNING") || boost::starts_with(msg, "ERROR")) {
 		size_t i;
 		for (i=0;i<lastmessages.size();i++) {
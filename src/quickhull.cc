@@ -0,0 +1,322 @@
+#include "quickhull.h"
+#include "polyset.h"
+#include "printutils.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <boost/foreach.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/unordered_map.hpp>
+
+namespace /* anonymous */ {
+
+	bool lexicographic_less(const Vector3d &a, const Vector3d &b)
+	{
+		if (a[0] != b[0]) return a[0] < b[0];
+		if (a[1] != b[1]) return a[1] < b[1];
+		return a[2] < b[2];
+	}
+
+	void unique_points(std::vector<Vector3d> &points)
+	{
+		std::sort(points.begin(), points.end(), lexicographic_less);
+		points.erase(std::unique(points.begin(), points.end()), points.end());
+	}
+
+	/*!
+		Incremental Quickhull on a set of distinct points.
+
+		Faces are triangles oriented counter-clockwise seen from the outside.
+		Each face keeps the points which are outside of it and not yet
+		assigned to another face. Neighbors are found through a map of
+		directed edges; the face on the other side of edge (a,b) owns (b,a).
+
+		Points closer than eps to a face plane are considered to be on the
+		plane, so nearly coplanar faces are not merged but are never
+		created from points which don't extend the hull by more than eps.
+	*/
+	class Hull
+	{
+	public:
+		Hull(const std::vector<Vector3d> &points) : points(points), iteration(0) {
+			double max[3] = {0, 0, 0};
+			BOOST_FOREACH(const Vector3d &p, points) {
+				for (int i = 0; i < 3; i++) max[i] = std::max(max[i], std::fabs(p[i]));
+			}
+			this->eps = 3 * std::numeric_limits<double>::epsilon() * (max[0] + max[1] + max[2]);
+		}
+
+		bool build();
+		void output(PolySet &ps) const;
+
+	private:
+		struct Face {
+			int v[3];
+			Vector3d normal;
+			double offset;
+			std::vector<int> outside;
+			bool alive;
+			int visited;
+			double distance(const Vector3d &p) const { return this->normal.dot(p) - this->offset; }
+		};
+
+		static boost::uint64_t edgeKey(int a, int b) { return (boost::uint64_t(a) << 32) | boost::uint32_t(b); }
+
+		bool initialSimplex(int simplex[4]);
+		bool addFace(int a, int b, int c);
+		void removeFace(int f);
+		void assign(const std::vector<int> &candidates, size_t firstface);
+		bool addPoint(int f);
+
+		const std::vector<Vector3d> &points;
+		double eps;
+		std::vector<Face> faces;
+		boost::unordered_map<boost::uint64_t, int> edges;
+		std::vector<int> pending; // Faces which may have outside points
+		int iteration;
+	};
+
+	bool Hull::addFace(int a, int b, int c)
+	{
+		const Vector3d &pa = this->points[a], &pb = this->points[b], &pc = this->points[c];
+		Vector3d normal = (pb - pa).cross(pc - pa);
+		double len = normal.norm();
+		// Give up on sliver triangles, as their planes are unreliable
+		if (len <= this->eps * std::max((pb - pa).norm(), (pc - pa).norm())) return false;
+
+		Face face;
+		face.v[0] = a; face.v[1] = b; face.v[2] = c;
+		face.normal = normal / len;
+		face.offset = face.normal.dot((pa + pb + pc) / 3);
+		face.alive = true;
+		face.visited = 0;
+		int f = this->faces.size();
+		this->faces.push_back(face);
+		for (int i = 0; i < 3; i++) {
+			// Each directed edge must be used by exactly one face
+			if (!this->edges.insert(std::make_pair(edgeKey(face.v[i], face.v[(i+1)%3]), f)).second) return false;
+		}
+		return true;
+	}
+
+	void Hull::removeFace(int f)
+	{
+		Face &face = this->faces[f];
+		for (int i = 0; i < 3; i++) this->edges.erase(edgeKey(face.v[i], face.v[(i+1)%3]));
+		face.alive = false;
+		std::vector<int>().swap(face.outside);
+	}
+
+	/*!
+		Assigns each candidate point to the first face from firstface on which
+		it is outside of. Points which aren't outside any of these faces are
+		inside the hull and are dropped.
+	*/
+	void Hull::assign(const std::vector<int> &candidates, size_t firstface)
+	{
+		BOOST_FOREACH(int p, candidates) {
+			for (size_t f = firstface; f < this->faces.size(); f++) {
+				if (this->faces[f].distance(this->points[p]) > this->eps) {
+					if (this->faces[f].outside.empty()) this->pending.push_back(f);
+					this->faces[f].outside.push_back(p);
+					break;
+				}
+			}
+		}
+	}
+
+	bool Hull::initialSimplex(int simplex[4])
+	{
+		// The two extreme points along the axis with the largest extent
+		int extremes[3][2] = {{0, 0}, {0, 0}, {0, 0}};
+		for (size_t i = 0; i < this->points.size(); i++) {
+			for (int k = 0; k < 3; k++) {
+				if (this->points[i][k] < this->points[extremes[k][0]][k]) extremes[k][0] = i;
+				if (this->points[i][k] > this->points[extremes[k][1]][k]) extremes[k][1] = i;
+			}
+		}
+		double maxextent = -1;
+		for (int k = 0; k < 3; k++) {
+			double extent = this->points[extremes[k][1]][k] - this->points[extremes[k][0]][k];
+			if (extent > maxextent) {
+				maxextent = extent;
+				simplex[0] = extremes[k][0];
+				simplex[1] = extremes[k][1];
+			}
+		}
+		if (maxextent <= this->eps) return false;
+
+		// The point farthest from that line
+		const Vector3d &p0 = this->points[simplex[0]];
+		Vector3d dir = (this->points[simplex[1]] - p0).normalized();
+		double maxdist = -1;
+		for (size_t i = 0; i < this->points.size(); i++) {
+			double dist = (this->points[i] - p0).cross(dir).norm();
+			if (dist > maxdist) {
+				maxdist = dist;
+				simplex[2] = i;
+			}
+		}
+		if (maxdist <= this->eps) return false;
+
+		// The point farthest from that plane
+		Vector3d normal = (this->points[simplex[1]] - p0).cross(this->points[simplex[2]] - p0).normalized();
+		maxdist = -1;
+		for (size_t i = 0; i < this->points.size(); i++) {
+			double dist = std::fabs(normal.dot(this->points[i] - p0));
+			if (dist > maxdist) {
+				maxdist = dist;
+				simplex[3] = i;
+			}
+		}
+		return maxdist > this->eps;
+	}
+
+	bool Hull::build()
+	{
+		if (this->points.size() < 4) return false;
+
+		int s[4];
+		if (!initialSimplex(s)) return false;
+
+		// Orient the faces of the tetrahedron away from the opposite vertex
+		static const int tetra[4][4] = {{0,1,2,3}, {0,1,3,2}, {0,2,3,1}, {1,2,3,0}};
+		for (int i = 0; i < 4; i++) {
+			int a = s[tetra[i][0]], b = s[tetra[i][1]], c = s[tetra[i][2]];
+			const Vector3d &pa = this->points[a];
+			Vector3d normal = (this->points[b] - pa).cross(this->points[c] - pa);
+			if (normal.dot(this->points[s[tetra[i][3]]] - pa) > 0) std::swap(b, c);
+			if (!addFace(a, b, c)) return false;
+		}
+
+		std::vector<int> candidates;
+		candidates.reserve(this->points.size());
+		for (size_t i = 0; i < this->points.size(); i++) {
+			int p = i;
+			if (p != s[0] && p != s[1] && p != s[2] && p != s[3]) candidates.push_back(p);
+		}
+		assign(candidates, 0);
+
+		while (!this->pending.empty()) {
+			int f = this->pending.back();
+			this->pending.pop_back();
+			if (!this->faces[f].alive || this->faces[f].outside.empty()) continue;
+			if (!addPoint(f)) return false;
+		}
+
+		// Sanity check: Every edge must have a twin
+		for (boost::unordered_map<boost::uint64_t, int>::const_iterator it = this->edges.begin(); it != this->edges.end(); ++it) {
+			int a = int(it->first >> 32), b = int(it->first & 0xffffffff);
+			if (!this->edges.count(edgeKey(b, a))) return false;
+		}
+		return true;
+	}
+
+	/*!
+		Extends the hull by the point of face f's outside set which is
+		farthest from f.
+	*/
+	bool Hull::addPoint(int f)
+	{
+		int eye = -1;
+		double maxdist = -1;
+		BOOST_FOREACH(int p, this->faces[f].outside) {
+			double dist = this->faces[f].distance(this->points[p]);
+			if (dist > maxdist) {
+				maxdist = dist;
+				eye = p;
+			}
+		}
+		const Vector3d &eyepoint = this->points[eye];
+
+		// Find the faces visible from the eye point, and the horizon edges
+		// between visible and invisible faces.
+		this->iteration++;
+		std::vector<int> visible(1, f);
+		this->faces[f].visited = this->iteration;
+		std::vector<std::pair<int, int> > horizon;
+		for (size_t i = 0; i < visible.size(); i++) {
+			const Face &face = this->faces[visible[i]];
+			for (int k = 0; k < 3; k++) {
+				int a = face.v[k], b = face.v[(k+1)%3];
+				boost::unordered_map<boost::uint64_t, int>::const_iterator it = this->edges.find(edgeKey(b, a));
+				if (it == this->edges.end()) return false;
+				Face &neighbor = this->faces[it->second];
+				if (neighbor.visited == this->iteration) continue;
+				if (neighbor.distance(eyepoint) > this->eps) {
+					neighbor.visited = this->iteration;
+					visible.push_back(it->second);
+				}
+				else {
+					horizon.push_back(std::make_pair(a, b));
+				}
+			}
+		}
+
+		std::vector<int> orphans;
+		BOOST_FOREACH(int v, visible) {
+			BOOST_FOREACH(int p, this->faces[v].outside) {
+				if (p != eye) orphans.push_back(p);
+			}
+			removeFace(v);
+		}
+
+		size_t firstface = this->faces.size();
+		for (size_t i = 0; i < horizon.size(); i++) {
+			if (!addFace(horizon[i].first, horizon[i].second, eye)) return false;
+		}
+		assign(orphans, firstface);
+		return true;
+	}
+
+	void Hull::output(PolySet &ps) const
+	{
+		BOOST_FOREACH(const Face &face, this->faces) {
+			if (!face.alive) continue;
+			ps.append_poly();
+			for (int i = 0; i < 3; i++) ps.append_vertex(this->points[face.v[i]]);
+		}
+	}
+
+} // namespace
+
+namespace QuickHull {
+
+	/*!
+		Computes the convex hull of the given points.
+		Duplicate points are allowed.
+	*/
+	bool hull(const std::vector<Vector3d> &points, PolySet &result)
+	{
+		std::vector<Vector3d> unique(points);
+		unique_points(unique);
+
+		Hull h(unique);
+		if (!h.build()) {
+			PRINTDB("Degenerate hull of %d points, falling back to CGAL", unique.size());
+			return false;
+		}
+		h.output(result);
+		return true;
+	}
+
+	/*!
+		Computes the Minkowski sum of two convex PolySets, which is the convex
+		hull of the sums of all pairs of their vertices.
+	*/
+	bool minkowski(const PolySet &a, const PolySet &b, PolySet &result)
+	{
+		const std::vector<Vector3d> &va = a.getVertices();
+		const std::vector<Vector3d> &vb = b.getVertices();
+		std::vector<Vector3d> points;
+		points.reserve(va.size() * vb.size());
+		BOOST_FOREACH(const Vector3d &p, va) {
+			BOOST_FOREACH(const Vector3d &q, vb) {
+				points.push_back(p + q);
+			}
+		}
+		return hull(points, result);
+	}
+
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "linalg.h"
+#include <vector>
+
+class PolySet;
+
+/*!
+	Convex hulls in double precision, using the Quickhull algorithm.
+
+	These are fast paths for convex geometry which don't need exact
+	arithmetic. They give up and return false if the input is degenerate
+	(e.g. all points are coplanar) or if numerical problems are detected,
+	in which case the caller should fall back to CGAL.
+*/
+namespace QuickHull {
+	bool hull(const std::vector<Vector3d> &points, PolySet &result);
+	bool minkowski(const PolySet &a, const PolySet &b, PolySet &result);
+}
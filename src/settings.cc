@@ -1,9 +1,6 @@
 #include "settings.h"
 #include "printutils.h"
 
-#include <boost/assign/std/vector.hpp>
-using namespace boost::assign; // bring 'operator+=()' into scope
-
 namespace Settings {
 
 static std::list<SettingsEntry *> entries;
@@ -45,25 +42,32 @@ bool SettingsEntry::is_default() const
 
 static Value value(std::string s1, std::string s2) {
 	Value::VectorType v;
-	v += Value(s1), Value(s2);
+	v.push_back(Value(s1));
+	v.push_back(Value(s2));
 	return v;
 }
 
 static Value values(std::string s1, std::string s1disp, std::string s2, std::string s2disp) {
 	Value::VectorType v;
-	v += value(s1, s1disp), value(s2, s2disp);
+	v.push_back(value(s1, s1disp));
+	v.push_back(value(s2, s2disp));
 	return v;
 }
 
 static Value values(std::string s1, std::string s1disp, std::string s2, std::string s2disp, std::string s3, std::string s3disp) {
 	Value::VectorType v;
-	v += value(s1, s1disp), value(s2, s2disp), value(s3, s3disp);
+	v.push_back(value(s1, s1disp));
+	v.push_back(value(s2, s2disp));
+	v.push_back(value(s3, s3disp));
 	return v;
 }
 
 static Value values(std::string s1, std::string s1disp, std::string s2, std::string s2disp, std::string s3, std::string s3disp, std::string s4, std::string s4disp) {
 	Value::VectorType v;
-	v += value(s1, s1disp), value(s2, s2disp), value(s3, s3disp), value(s4, s4disp);
+	v.push_back(value(s1, s1disp));
+	v.push_back(value(s2, s2disp));
+	v.push_back(value(s3, s3disp));
+	v.push_back(value(s4, s4disp));
 	return v;
 }
 
@@ -34,13 +34,14 @@
 #include "handle_dep.h" // handle_dep()
 #include "visitor.h"
 #include "lodepng.h"
+#include "calc.h"
 
 #include <sstream>
 #include <fstream>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
 #include <boost/foreach.hpp>
-#include <boost/unordered_map.hpp>
-#include <boost/tokenizer.hpp>
-#include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/assign/std/vector.hpp>
 using namespace boost::assign; // bring 'operator+=()' into scope
@@ -55,7 +56,22 @@ public:
 	virtual AbstractNode *instantiate(const Context *ctx, const ModuleInstantiation *inst, EvalContext *evalctx) const;
 };
 
-typedef boost::unordered_map<std::pair<int,int>,double> img_data_t;
+/*!
+	Height samples of a surface, stored densely in row-major order. Samples
+	missing from ragged .dat files are 0.
+*/
+class img_data_t
+{
+public:
+	img_data_t() : rows(0), columns(0), min_val(std::numeric_limits<double>::max()) { }
+	double operator()(int row, int column) const { return this->data[size_t(row) * this->columns + column]; }
+
+	int rows;
+	int columns;
+	std::vector<double> data;
+	// One below the lowest sample read, the level of the bottom face
+	double min_val;
+};
 
 class SurfaceNode : public LeafNode
 {
@@ -131,7 +147,12 @@ void SurfaceNode::convert_image(img_data_t &data, std::vector<unsigned char> &im
 
 	double h = 100;
 	double scale = h / (z_max - z_min);
+	// The image fills rows 1 to height, bottom up. Row 0 is left at 0.
+	data.rows = height + 1;
+	data.columns = width;
+	data.data.assign(size_t(data.rows) * width, 0.0);
 	for (unsigned int y = 0;y < height;y++) {
+		double *row = &data.data[size_t(height - y) * width];
 		for (unsigned int x = 0;x < width;x++) {
 			long idx = 4 * (y * width + x);
 			double pixel = 0.2126 * img[idx] + 0.7152 * img[idx + 1] + 0.0722 * img[idx + 2];
@@ -139,8 +160,8 @@ void SurfaceNode::convert_image(img_data_t &data, std::vector<unsigned char> &im
 			if (invert) {
 				z = h - z;
 			}
-			data[std::make_pair(height - y, x)] = z;
-			
+			row[x] = z;
+			data.min_val = std::min(z - 1, data.min_val);
 		}
 	}
 }
@@ -175,7 +196,6 @@ img_data_t SurfaceNode::read_png_or_dat(std::string filename) const
 	unsigned error = lodepng::decode(img, width, height, png);
 	if (error) {
 		PRINTB("ERROR: Can't read PNG image '%s'", filename);
-		data.clear();
 		return data;
 	}
 	
@@ -184,6 +204,11 @@ img_data_t SurfaceNode::read_png_or_dat(std::string filename) const
 	return data;
 }
 
+/*!
+	Reads a .dat file of whitespace separated samples, one line per row.
+	Empty lines and lines starting with # are skipped. Reading stops at the
+	first value which isn't a number.
+*/
 img_data_t SurfaceNode::read_dat(std::string filename) const
 {
 	img_data_t data;
@@ -194,42 +219,65 @@ img_data_t SurfaceNode::read_dat(std::string filename) const
 		return data;
 	}
 
-	int lines = 0, columns = 0;
-	double min_val = 0;
-
-	typedef boost::tokenizer<boost::char_separator<char> > tokenizer;
-	boost::char_separator<char> sep(" \t");
+	// Samples in the order read, and the number of samples on each line
+	std::vector<double> values;
+	std::vector<int> linesizes;
+	int columns = 0;
 
-	while (!stream.eof()) {
-		std::string line;
-		while (!stream.eof() && (line.size() == 0 || line[0] == '#')) {
-			std::getline(stream, line);
-			boost::trim(line);
-		}
-		if (line.size() == 0 && stream.eof()) break;
-
-		int col = 0;
-		tokenizer tokens(line, sep);
-		try {
-			BOOST_FOREACH(const std::string &token, tokens) {
-				double v = boost::lexical_cast<double>(token);
-				data[std::make_pair(lines, col++)] = v;
-				if (col > columns) columns = col;
-				min_val = std::min(v-1, min_val);
+	std::string line;
+	while (std::getline(stream, line)) {
+		boost::trim(line);
+		if (line.size() == 0 || line[0] == '#') continue;
+
+		size_t start = values.size();
+		bool valid = true;
+		const char *p = line.c_str();
+		while (true) {
+			while (*p == ' ' || *p == '\t') p++;
+			if (!*p) break;
+			const char *end = p + strcspn(p, " \t");
+			double v;
+			if (!Calc::parse_double(p, end, v)) {
+				if (!stream.eof()) {
+					PRINTB("WARNING: Illegal value in '%s': %s", filename % std::string(p, end));
+				}
+				valid = false;
+				break;
 			}
+			values.push_back(v);
+			data.min_val = std::min(v - 1, data.min_val);
+			p = end;
+		}
+		if (values.size() > start) {
+			linesizes.push_back(values.size() - start);
+			columns = std::max(columns, linesizes.back());
+		}
+		if (!valid) break;
+	}
+
+	data.rows = linesizes.size();
+	data.columns = columns;
+	if (values.size() == size_t(data.rows) * columns) {
+		data.data.swap(values);
+	}
+	else {
+		// Ragged lines, pad them with 0
+		data.data.assign(size_t(data.rows) * columns, 0.0);
+		size_t idx = 0;
+		for (int i = 0; i < data.rows; i++) {
+			std::copy(values.begin() + idx, values.begin() + idx + linesizes[i], data.data.begin() + size_t(i) * columns);
+			idx += linesizes[i];
 		}
-		catch (const boost::bad_lexical_cast &blc) {
-			if (!stream.eof()) {
-				PRINTB("WARNING: Illegal value in '%s': %s", filename % blc.what());
-			}
-			break;
-  	}
-		lines++;
 	}
-	
 	return data;
 }
 
+/*!
+	Builds the mesh directly as an indexed PolySet: the samples are the
+	vertices of a grid, and each cell is split into four triangles meeting
+	at an added center vertex. Only the vertices of the walls and the bottom
+	are looked up to be shared.
+*/
 Geometry *SurfaceNode::createGeometry() const
 {
 	img_data_t data = read_png_or_dat(filename);
@@ -237,87 +285,94 @@ Geometry *SurfaceNode::createGeometry() const
 	PolySet *p = new PolySet(3);
 	p->setConvexity(convexity);
 	
-	int lines = 0;
-	int columns = 0;
-	double min_val = std::numeric_limits<double>::max();
-	for (img_data_t::iterator it = data.begin();it != data.end();it++) {
-		lines = std::max(lines, (*it).first.first + 1);
-		columns = std::max(columns, (*it).first.second + 1);
-		min_val = std::min((*it).second - 1, min_val);
-	}
+	int lines = data.rows;
+	int columns = data.columns;
+	double min_val = data.min_val;
 
 	double ox = center ? -(columns-1)/2.0 : 0;
 	double oy = center ? -(lines-1)/2.0 : 0;
 
+	size_t cells = lines > 0 && columns > 0 ? size_t(lines-1) * (columns-1) : 0;
+	p->reserve(4 * cells + 2 * (lines + columns) + 1, 12 * cells + 12 * (lines + columns),
+						 size_t(lines) * columns + cells + 2 * (lines + columns));
+
+	// Vertex i * columns + j is sample (i, j)
+	for (int i = 0; i < lines; i++)
+	for (int j = 0; j < columns; j++)
+	{
+		p->add_vertex(Vector3d(ox + j, oy + i, data(i, j)));
+	}
+
 	for (int i = 1; i < lines; i++)
 	for (int j = 1; j < columns; j++)
 	{
-		double v1 = data[std::make_pair(i-1, j-1)];
-		double v2 = data[std::make_pair(i-1, j)];
-		double v3 = data[std::make_pair(i, j-1)];
-		double v4 = data[std::make_pair(i, j)];
-		double vx = (v1 + v2 + v3 + v4) / 4;
+		int i1 = (i-1) * columns + j-1;
+		int i2 = (i-1) * columns + j;
+		int i3 = i * columns + j-1;
+		int i4 = i * columns + j;
+		double vx = (data(i-1, j-1) + data(i-1, j) + data(i, j-1) + data(i, j)) / 4;
+		int ix = p->add_vertex(Vector3d(ox + j-0.5, oy + i-0.5, vx));
 
 		p->append_poly();
-		p->append_vertex(ox + j-1, oy + i-1, v1);
-		p->append_vertex(ox + j, oy + i-1, v2);
-		p->append_vertex(ox + j-0.5, oy + i-0.5, vx);
+		p->append_index(i1);
+		p->append_index(i2);
+		p->append_index(ix);
 
 		p->append_poly();
-		p->append_vertex(ox + j, oy + i-1, v2);
-		p->append_vertex(ox + j, oy + i, v4);
-		p->append_vertex(ox + j-0.5, oy + i-0.5, vx);
+		p->append_index(i2);
+		p->append_index(i4);
+		p->append_index(ix);
 
 		p->append_poly();
-		p->append_vertex(ox + j, oy + i, v4);
-		p->append_vertex(ox + j-1, oy + i, v3);
-		p->append_vertex(ox + j-0.5, oy + i-0.5, vx);
+		p->append_index(i4);
+		p->append_index(i3);
+		p->append_index(ix);
 
 		p->append_poly();
-		p->append_vertex(ox + j-1, oy + i, v3);
-		p->append_vertex(ox + j-1, oy + i-1, v1);
-		p->append_vertex(ox + j-0.5, oy + i-0.5, vx);
+		p->append_index(i3);
+		p->append_index(i1);
+		p->append_index(ix);
 	}
 
 	for (int i = 1; i < lines; i++)
 	{
 		p->append_poly();
 		p->append_vertex(ox + 0, oy + i-1, min_val);
-		p->append_vertex(ox + 0, oy + i-1, data[std::make_pair(i-1, 0)]);
-		p->append_vertex(ox + 0, oy + i, data[std::make_pair(i, 0)]);
+		p->append_index((i-1) * columns);
+		p->append_index(i * columns);
 		p->append_vertex(ox + 0, oy + i, min_val);
 
 		p->append_poly();
-		p->insert_vertex(ox + columns-1, oy + i-1, min_val);
-		p->insert_vertex(ox + columns-1, oy + i-1, data[std::make_pair(i-1, columns-1)]);
-		p->insert_vertex(ox + columns-1, oy + i, data[std::make_pair(i, columns-1)]);
-		p->insert_vertex(ox + columns-1, oy + i, min_val);
+		p->append_vertex(ox + columns-1, oy + i, min_val);
+		p->append_index(i * columns + columns-1);
+		p->append_index((i-1) * columns + columns-1);
+		p->append_vertex(ox + columns-1, oy + i-1, min_val);
 	}
 
 	for (int i = 1; i < columns; i++)
 	{
 		p->append_poly();
-		p->insert_vertex(ox + i-1, oy + 0, min_val);
-		p->insert_vertex(ox + i-1, oy + 0, data[std::make_pair(0, i-1)]);
-		p->insert_vertex(ox + i, oy + 0, data[std::make_pair(0, i)]);
-		p->insert_vertex(ox + i, oy + 0, min_val);
+		p->append_vertex(ox + i, oy + 0, min_val);
+		p->append_index(i);
+		p->append_index(i-1);
+		p->append_vertex(ox + i-1, oy + 0, min_val);
 
 		p->append_poly();
 		p->append_vertex(ox + i-1, oy + lines-1, min_val);
-		p->append_vertex(ox + i-1, oy + lines-1, data[std::make_pair(lines-1, i-1)]);
-		p->append_vertex(ox + i, oy + lines-1, data[std::make_pair(lines-1, i)]);
+		p->append_index((lines-1) * columns + i-1);
+		p->append_index((lines-1) * columns + i);
 		p->append_vertex(ox + i, oy + lines-1, min_val);
 	}
 
 	p->append_poly();
-	for (int i = 0; i < columns-1; i++)
-		p->insert_vertex(ox + i, oy + 0, min_val);
-	for (int i = 0; i < lines-1; i++)
-		p->insert_vertex(ox + columns-1, oy + i, min_val);
-	for (int i = columns-1; i > 0; i--)
-		p->insert_vertex(ox + i, oy + lines-1, min_val);
+	for (int i = 1; i < lines; i++)
+		p->append_vertex(ox + 0, oy + i, min_val);
+	for (int i = 1; i < columns; i++)
+		p->append_vertex(ox + i, oy + lines-1, min_val);
 	for (int i = lines-1; i > 0; i--)
-		p->insert_vertex(ox + 0, oy + i, min_val);
+		p->append_vertex(ox + columns-1, oy + i-1, min_val);
+	for (int i = columns-1; i > 0; i--)
+		p->append_vertex(ox + i-1, oy + 0, min_val);
 
 	return p;
 }
@@ -34,6 +34,7 @@
 #include <boost/variant/apply_visitor.hpp>
 #include <boost/variant/static_visitor.hpp>
 #include <boost/format.hpp>
+#include <boost/functional/hash.hpp>
 #include "boost-utils.h"
 #include "boosty.h"
 /*Unicode support for string lengths and array accesses*/
@@ -115,6 +116,28 @@ Value::Value(char v) : value(std::string(1, v))
   //  std::cout << "creating string from char\n";
 }
 
+const Value::VectorType::StorageType &Value::VectorType::storage() const
+{
+  static StorageType empty;
+  return this->vec ? *this->vec : empty;
+}
+
+/*!
+  Make sure this vector is the only owner of its elements, copying them
+  if they're shared with another vector.
+*/
+void Value::VectorType::detach()
+{
+  if (!this->vec) this->vec.reset(new StorageType);
+  else if (!this->vec.unique()) this->vec.reset(new StorageType(*this->vec));
+}
+
+bool Value::VectorType::operator==(const VectorType &other) const
+{
+  // No shortcut for shared storage: NaN elements make a vector unequal to itself
+  return storage() == other.storage();
+}
+
 Value::Value(const VectorType &v) : value(v)
 {
   //  std::cout << "creating vector\n";
@@ -387,6 +410,49 @@ bool Value::operator!=(const Value &v) const
   return !(*this == v);
 }
 
+class hash_visitor : public boost::static_visitor<std::size_t>
+{
+public:
+  std::size_t operator()(const boost::blank &) const {
+    return 0;
+  }
+
+  std::size_t operator()(const bool &v) const {
+    return boost::hash<bool>()(v);
+  }
+
+  std::size_t operator()(const double &v) const {
+    return boost::hash<double>()(v == 0 ? 0 : v); // -0 == 0
+  }
+
+  std::size_t operator()(const std::string &v) const {
+    return boost::hash<std::string>()(v);
+  }
+
+  std::size_t operator()(const Value::VectorType &v) const {
+    std::size_t seed = v.size();
+    BOOST_FOREACH(const Value &val, v) boost::hash_combine(seed, val);
+    return seed;
+  }
+
+  std::size_t operator()(const Value::RangeType &v) const {
+    Value::RangeType range = v;
+    std::size_t seed = 0;
+    boost::hash_combine(seed, range.begin_value());
+    boost::hash_combine(seed, range.step_value());
+    boost::hash_combine(seed, range.end_value());
+    return seed;
+  }
+};
+
+/*!
+  Hash consistent with operator==, for use with boost::hash.
+*/
+std::size_t hash_value(const Value &value)
+{
+  return boost::apply_visitor(hash_visitor(), value.value);
+}
+
 #define DEFINE_VISITOR(name,op)\
 class name : public boost::static_visitor<bool> \
 { \
@@ -97,7 +97,54 @@ public:
     friend class bracket_visitor;
   };
 
-  typedef std::vector<Value> VectorType;
+  /*!
+    Vector of Values sharing its elements between copies.
+
+    Copying a VectorType (and hence a Value holding a vector) only copies
+    a reference counted pointer, so nested vectors can be indexed, passed
+    to functions and stored in other vectors without copying their
+    elements. The elements are only copied when a shared vector is
+    modified; vectors which aren't shared are appended to in place.
+  */
+  class VectorType {
+  public:
+    typedef std::vector<Value> StorageType;
+    typedef Value value_type;
+    typedef StorageType::size_type size_type;
+    typedef StorageType::difference_type difference_type;
+    typedef const Value &reference;
+    typedef const Value &const_reference;
+    typedef StorageType::const_iterator iterator;
+    typedef StorageType::const_iterator const_iterator;
+
+    VectorType() {}
+    template <class InputIterator> VectorType(InputIterator first, InputIterator last)
+      : vec(new StorageType(first, last)) {}
+
+    size_type size() const { return this->vec ? this->vec->size() : 0; }
+    bool empty() const { return size() == 0; }
+    const_iterator begin() const { return storage().begin(); }
+    const_iterator end() const { return storage().end(); }
+    const Value &operator[](size_type i) const { return (*this->vec)[i]; }
+    const Value &front() const { return this->vec->front(); }
+    const Value &back() const { return this->vec->back(); }
+
+    void reserve(size_type n) { detach(); this->vec->reserve(n); }
+    void push_back(const Value &v) { detach(); this->vec->push_back(v); }
+    void append(const VectorType &v) {
+      if (empty()) *this = v;
+      else if (!v.empty()) { detach(); this->vec->insert(this->vec->end(), v.begin(), v.end()); }
+    }
+
+    bool operator==(const VectorType &other) const;
+    bool operator!=(const VectorType &other) const { return !(*this == other); }
+
+  private:
+    const StorageType &storage() const;
+    void detach();
+
+    shared_ptr<StorageType> vec;
+  };
 
   enum ValueType {
     UNDEFINED,
@@ -160,6 +207,8 @@ public:
 
   typedef boost::variant< boost::blank, bool, double, std::string, VectorType, RangeType > Variant;
 
+  friend std::size_t hash_value(const Value &value);
+
 private:
   static Value multvecnum(const Value &vecval, const Value &numval);
   static Value multmatvec(const Value &matrixval, const Value &vectorval);
@@ -0,0 +1,83 @@
+#!/usr/bin/env python
+
+# Batch test
+#
+#
+# Usage: <script> <inputfile> --openscad=<executable-path> [<openscad args>] <outputfile>
+#
+#
+# step 1. Run OpenSCAD with --batch on the job file next to the input file, which has the
+#         same name with a .json suffix, in a private temporary directory
+# step 2. Check the report of each job, and write the outputs of all jobs followed by
+#         the reports without timing and cache statistics to the given output file
+# step 3. (done in CTest) - compare the output file to the expected output
+#
+# The openscad args are passed on to OpenSCAD.
+#
+# This script should return 0 on success, not-0 on error.
+#
+
+from __future__ import print_function
+
+import sys, os, re, shutil, tempfile, subprocess, argparse, json
+
+def failquit(*args):
+	if len(args)!=0: print(*args)
+	print('batchtest args:',str(sys.argv))
+	print('exiting batchtest.py with failure')
+	sys.exit(1)
+
+#
+# Parse arguments
+#
+parser = argparse.ArgumentParser()
+parser.add_argument('--openscad', required=True, help='Specify OpenSCAD executable')
+args,remaining_args = parser.parse_known_args()
+
+inputfile = os.path.abspath(remaining_args[0])
+outputfile = os.path.abspath(remaining_args[-1])
+remaining_args = remaining_args[1:-1] # Passed on to OpenSCAD
+jobfile = os.path.splitext(inputfile)[0] + '.json'
+
+if not os.path.exists(inputfile):
+	failquit('cant find input file named: ' + inputfile)
+if not os.path.exists(jobfile):
+	failquit('cant find job file named: ' + jobfile)
+if not os.path.exists(args.openscad):
+	failquit('cant find openscad executable named: ' + args.openscad)
+
+with open(jobfile) as fp:
+	jobs = json.load(fp)['jobs']
+
+tmpdir = tempfile.mkdtemp(prefix='openscad-batchtest-')
+try:
+	cmd = [args.openscad, '--batch=' + jobfile] + remaining_args + [inputfile]
+	print('Running OpenSCAD:', ' '.join(cmd), file=sys.stderr)
+	proc = subprocess.Popen(cmd, cwd=tmpdir, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+	console = proc.communicate()[0].decode('utf-8', 'replace')
+	print(console, file=sys.stderr)
+	if proc.returncode != 0:
+		failquit('OpenSCAD failed with return code ' + str(proc.returncode))
+
+	result = ''
+	for job in jobs:
+		path = os.path.join(tmpdir, job['output'])
+		if not os.path.exists(path):
+			failquit('Missing output of batch job: ' + job['output'])
+		with open(path) as fp:
+			result += fp.read()
+
+	# e.g. "Batch job 1/2: a.echo done in 0.012 s, geometry cache 0/0 hits, CGAL cache 0/0 hits"
+	report = re.compile(r'^(Batch job (\d+)/\d+: \S+ (done|failed)) in \d+\.\d+ s, geometry cache \d+/\d+ hits(, CGAL cache \d+/\d+ hits)?$')
+	reports = []
+	for line in console.splitlines():
+		m = report.match(line.strip())
+		if m: reports.append(m.group(1))
+	if len(reports) != len(jobs):
+		failquit('Expected a report for each of the ' + str(len(jobs)) + ' jobs, got ' + str(len(reports)))
+	result += ''.join(r + '\n' for r in reports)
+
+	with open(outputfile, 'w') as fp:
+		fp.write(result)
+finally:
+	shutil.rmtree(tmpdir, ignore_errors=True)
@@ -0,0 +1,184 @@
+#!/usr/bin/env python
+#
+# Benchmark driver: Runs .scad models through openscad and records the time
+# spent in each phase (parse, instantiate, geometry, nef, export), as
+# reported by openscad --timing=json.
+#
+# Usage: benchmark.py [<options>] --openscad=<exe> <file.scad>...
+#        benchmark.py [<options>] --merge=<dir>
+#        benchmark.py [<options>] --compare <baseline.json> <results.json>
+#
+# Results are written as JSON:
+#   {"models": {"<name>": {"parse": <s>, ..., "total": <s>}, ...}}
+# Each time is the minimum over all repetitions, which is the most stable
+# measure on a busy machine.
+#
+# If a baseline is given, each phase which is slower than in the baseline by
+# more than the threshold (in percent) and by more than the noise floor
+# (in seconds) is reported as a regression, and the exit code is 1.
+#
+# Returns 0 on success
+#         1 on failure or regression
+#         2 on invalid cmd-line options
+#
+
+from __future__ import print_function
+
+import sys
+import os
+import glob
+import json
+import getopt
+import shutil
+import tempfile
+import subprocess
+
+phases = ["parse", "instantiate", "geometry", "nef", "export", "total"]
+
+class Options:
+    def __init__(self):
+        self.openscad = None
+        self.output = None
+        self.baseline = None
+        self.merge = None
+        self.compare = False
+        self.repeat = 3
+        self.threshold = 10.0
+        self.noise = 0.05
+        self.args = ["--render=cgal"]
+
+def run_model(scadfile, tmpdir):
+    """Runs openscad on scadfile options.repeat times and returns the
+    minimum time of each phase, or None on failure."""
+    name = os.path.splitext(os.path.basename(scadfile))[0]
+    outfile = os.path.join(tmpdir, name + ".stl")
+    cmdline = [options.openscad, scadfile, "-o", outfile, "--timing=json"] + options.args
+
+    env = os.environ.copy()
+    env["OPENSCAD_FONT_PATH"] = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "testdata")
+
+    best = {}
+    for i in range(options.repeat):
+        print("run_model() cmdline:", cmdline)
+        sys.stdout.flush()
+        proc = subprocess.Popen(cmdline, env=env, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        stdouttext, errtext = proc.communicate()
+        if proc.returncode != 0:
+            print("Error: %s failed with return code %d" % (options.openscad, proc.returncode), file=sys.stderr)
+            print(errtext.decode("utf-8", "replace"), file=sys.stderr)
+            return None
+        try:
+            times = json.loads(stdouttext.decode("utf-8"))
+        except ValueError:
+            print("Error: Can't parse timing output of %s: %s" % (scadfile, stdouttext), file=sys.stderr)
+            return None
+        for phase, seconds in times.items():
+            if phase not in best or seconds < best[phase]: best[phase] = seconds
+    return best
+
+def load(filename):
+    with open(filename) as f:
+        return json.load(f)["models"]
+
+def save(models, filename):
+    with open(filename, "w") as f:
+        json.dump({"models": models}, f, indent=2, sort_keys=True)
+        f.write("\n")
+
+def compare(baseline, results):
+    """Prints a report of results relative to baseline and returns the number
+    of regressions."""
+    regressions = 0
+    for name in sorted(results):
+        if name not in baseline:
+            print("%s: not in baseline" % name)
+            continue
+        print("%s:" % name)
+        old, new = baseline[name], results[name]
+        for phase in phases + sorted(set(new) - set(phases)):
+            if phase not in old or phase not in new: continue
+            diff = new[phase] - old[phase]
+            percent = 100.0 * diff / old[phase] if old[phase] > 0 else 0.0
+            regressed = diff > options.noise and percent > options.threshold
+            if regressed: regressions += 1
+            print("  %-12s %9.3f s -> %9.3f s  %+7.1f%%%s" % (phase, old[phase], new[phase], percent,
+                                                               "  REGRESSION" if regressed else ""))
+    if regressions:
+        print("%d regression(s) above %.1f%%" % (regressions, options.threshold))
+    return regressions
+
+def usage():
+    print("Usage: " + sys.argv[0] + " [<options>] --openscad=<exe> <file.scad>...", file=sys.stderr)
+    print("       " + sys.argv[0] + " [<options>] --merge=<dir>", file=sys.stderr)
+    print("       " + sys.argv[0] + " [<options>] --compare <baseline.json> <results.json>", file=sys.stderr)
+    print("Options:", file=sys.stderr)
+    print("  -o, --output=<file>      Write results to the given JSON file", file=sys.stderr)
+    print("  -b, --baseline=<file>    Compare results against the given JSON file", file=sys.stderr)
+    print("  -m, --merge=<dir>        Combine all JSON results in the given directory", file=sys.stderr)
+    print("  -c, --compare            Compare two JSON result files", file=sys.stderr)
+    print("  -r, --repeat=<n>         Run each model n times (default 3)", file=sys.stderr)
+    print("  -t, --threshold=<pct>    Report phases slower by more than pct percent (default 10)", file=sys.stderr)
+    print("  -n, --noise=<s>          Ignore differences below s seconds (default 0.05)", file=sys.stderr)
+
+if __name__ == '__main__':
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], "o:b:m:cr:t:n:",
+                                   ["openscad=", "output=", "baseline=", "merge=", "compare",
+                                    "repeat=", "threshold=", "noise="])
+    except getopt.GetoptError as err:
+        usage()
+        sys.exit(2)
+
+    global options
+    options = Options()
+    try:
+        for o, a in opts:
+            if o == "--openscad": options.openscad = a
+            elif o in ("-o", "--output"): options.output = a
+            elif o in ("-b", "--baseline"): options.baseline = a
+            elif o in ("-m", "--merge"): options.merge = a
+            elif o in ("-c", "--compare"): options.compare = True
+            elif o in ("-r", "--repeat"): options.repeat = max(1, int(a))
+            elif o in ("-t", "--threshold"): options.threshold = float(a)
+            elif o in ("-n", "--noise"): options.noise = float(a)
+    except ValueError:
+        usage()
+        sys.exit(2)
+
+    if options.compare:
+        if len(args) != 2:
+            usage()
+            sys.exit(2)
+        sys.exit(1 if compare(load(args[0]), load(args[1])) else 0)
+
+    results = {}
+    if options.merge:
+        for filename in sorted(glob.glob(os.path.join(options.merge, "*.json"))):
+            results.update(load(filename))
+    else:
+        if not options.openscad or not args:
+            usage()
+            sys.exit(2)
+        tmpdir = tempfile.mkdtemp()
+        try:
+            for scadfile in args:
+                times = run_model(scadfile, tmpdir)
+                if times is None: sys.exit(1)
+                results[os.path.splitext(os.path.basename(scadfile))[0]] = times
+        finally:
+            shutil.rmtree(tmpdir)
+
+    if options.output:
+        outdir = os.path.dirname(options.output)
+        if outdir and not os.path.exists(outdir):
+            try:
+                os.makedirs(outdir)
+            except OSError as e:
+                if e.errno != 17: raise e # catch File Exists to allow parallel runs
+        save(results, options.output)
+    else:
+        json.dump({"models": results}, sys.stdout, indent=2, sort_keys=True)
+        print()
+
+    if options.baseline and compare(load(options.baseline), results):
+        sys.exit(1)
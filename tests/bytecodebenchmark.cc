@@ -0,0 +1,131 @@
+/*
+	Benchmark for the bytecode compiler.
+
+	Evaluates recursive functions and list comprehensions from the
+	expression trees and from bytecode, checks that both produce the same
+	output, and prints the time of each.
+
+	Usage: bytecodebenchmark [ <file.scad> [ <repetitions> ] ]
+*/
+
+#include "openscad.h"
+#include "parsersettings.h"
+#include "node.h"
+#include "module.h"
+#include "modcontext.h"
+#include "builtin.h"
+#include "feature.h"
+#include "printutils.h"
+#include "stackcheck.h"
+#include "PlatformUtils.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem.hpp>
+namespace fs = boost::filesystem;
+#include "boosty.h"
+
+std::string commandline_commands;
+std::string currentdir;
+
+static const char *definitions =
+	"function fib(n) = n < 2 ? n : fib(n - 1) + fib(n - 2);\n"
+	"function sum(v, i = 0, acc = 0) = i >= len(v) ? acc : sum(v, i + 1, acc + v[i]);\n"
+	"function circle(r, n) = [for (i = [0 : n - 1]) let(a = 360 * i / n) [r * cos(a), r * sin(a)]];\n"
+	"function pairs(n) = [for (i = [0 : n - 1]) for (j = [0 : n - 1]) if ((i + j) % 3 == 0) [i, j]];\n"
+	"function flatten(l) = [for (a = l) for (b = a) b];\n";
+
+static const char *workloads[][2] = {
+	{ "recursive function", "echo(fib(20));" },
+	{ "tail recursion", "echo(sum([for (i = [0 : 20000]) i]));" },
+	{ "list comprehension with let", "echo(len(circle(10, 20000)));" },
+	{ "nested list comprehension", "echo(len(pairs(200)));" },
+	{ "top-level list comprehension", "echo(len(flatten([for (i = [0 : 20000]) [i, i * i % 7]])));" }
+};
+
+static std::stringstream output;
+
+static void captureOutput(const std::string &msg, void *)
+{
+	output << msg << "\n";
+}
+
+/*!
+	Instantiates the script repetitions times, returns the time in
+	milliseconds. The output of the first repetition is stored in result.
+*/
+static double run(FileModule *module, ModuleContext &top_ctx, int repetitions, std::string &result)
+{
+	ModuleInstantiation root_inst("group");
+	boost::posix_time::ptime start = boost::posix_time::microsec_clock::local_time();
+	for (int i = 0; i < repetitions; i++) {
+		output.str("");
+		AbstractNode::resetIndexCounter();
+		delete module->instantiate(&top_ctx, &root_inst);
+		if (i == 0) result = output.str();
+	}
+	boost::posix_time::time_duration elapsed = boost::posix_time::microsec_clock::local_time() - start;
+	return elapsed.total_microseconds() / 1000.0 / repetitions;
+}
+
+static bool benchmark(const std::string &name, const std::string &script, int repetitions)
+{
+	FileModule *module = parse(script.c_str(), currentdir.c_str(), false);
+	if (!module) {
+		std::cerr << "Error: Unable to parse " << name << std::endl;
+		return false;
+	}
+
+	ModuleContext top_ctx;
+	top_ctx.registerBuiltin();
+
+	std::string treeresult, bytecoderesult;
+	Feature::enable_feature("bytecode", false);
+	double treetime = run(module, top_ctx, repetitions, treeresult);
+	Feature::enable_feature("bytecode", true);
+	double bytecodetime = run(module, top_ctx, repetitions, bytecoderesult);
+	delete module;
+
+	std::cout << name << ": expression tree " << treetime << " ms, bytecode " << bytecodetime
+						<< " ms, speedup " << treetime / bytecodetime << "x" << std::endl;
+	if (treeresult != bytecoderesult) {
+		std::cout << "  Output differs:\n" << treeresult << "  bytecode:\n" << bytecoderesult;
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	int repetitions = argc > 2 ? atoi(argv[2]) : 5;
+
+	StackCheck::inst()->init();
+	Builtins::instance()->initialize();
+	currentdir = boosty::stringy(fs::current_path());
+	PlatformUtils::registerApplicationPath(boosty::stringy(fs::path(argv[0]).branch_path()));
+	parser_init();
+	set_output_handler(&captureOutput, NULL);
+
+	bool ok = true;
+	if (argc > 1) {
+		std::ifstream file(argv[1]);
+		if (!file) {
+			std::cerr << "Error: Unable to open " << argv[1] << std::endl;
+			return 1;
+		}
+		std::stringstream script;
+		script << file.rdbuf();
+		ok = benchmark(argv[1], script.str(), repetitions);
+	}
+	else {
+		for (size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++) {
+			ok &= benchmark(workloads[i][0], std::string(definitions) + workloads[i][1], repetitions);
+		}
+	}
+
+	Builtins::instance(true);
+	return ok ? 0 : 1;
+}
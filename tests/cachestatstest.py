@@ -0,0 +1,91 @@
+#!/usr/bin/env python
+
+# Cache statistics test
+#
+#
+# Usage: <script> <inputfile> --openscad=<executable-path> [<openscad args>] <outputfile>
+#
+#
+# step 1. Render the input file with --cache-stats=json and cache budgets above 4 GB, writing
+#         the given output file. Check that the JSON has all caches and fields, that the
+#         budgets weren't truncated and that geometry was inserted into the caches
+# step 2. Render it again with --cache-stats and check the human readable statistics
+# step 3. (done in CTest) - compare the output file to the expected output
+#         of a direct OpenSCAD run on the input file. they should be the same!
+#
+# The openscad args (e.g. --render) are passed on to all runs.
+#
+# This script should return 0 on success, not-0 on error.
+#
+
+from __future__ import print_function
+
+import sys, os, shutil, tempfile, subprocess, argparse, json, numbers
+
+def failquit(*args):
+	if len(args)!=0: print(*args)
+	print('cachestatstest args:',str(sys.argv))
+	print('exiting cachestatstest.py with failure')
+	sys.exit(1)
+
+def run_openscad(extra_args, outputfile):
+	cmd = [args.openscad] + extra_args + ['-o', outputfile] + remaining_args + [inputfile]
+	print('Running OpenSCAD:', ' '.join(cmd), file=sys.stderr)
+	proc = subprocess.Popen(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+	stdouttext, errtext = proc.communicate()
+	if proc.returncode != 0:
+		failquit('OpenSCAD failed with return code ' + str(proc.returncode))
+	return stdouttext.decode('utf-8', 'replace'), errtext.decode('utf-8', 'replace')
+
+#
+# Parse arguments
+#
+parser = argparse.ArgumentParser()
+parser.add_argument('--openscad', required=True, help='Specify OpenSCAD executable')
+args,remaining_args = parser.parse_known_args()
+
+inputfile = remaining_args[0]
+outputfile = remaining_args[-1]
+remaining_args = remaining_args[1:-1] # Passed on to OpenSCAD
+
+if not os.path.exists(inputfile):
+	failquit('cant find input file named: ' + inputfile)
+if not os.path.exists(args.openscad):
+	failquit('cant find openscad executable named: ' + args.openscad)
+
+# Budgets in MB, both above 4 GB
+budgets = { 'geometry': 5000, 'cgal': 6000 }
+budget_args = ['--geometry-cache-size=' + str(budgets['geometry']), '--cgal-cache-size=' + str(budgets['cgal'])]
+
+stdouttext, errtext = run_openscad(budget_args + ['--cache-stats=json'], outputfile)
+start = stdouttext.find('{')
+end = stdouttext.rfind('}')
+if start < 0 or end < start:
+	failquit('No cache statistics in output: ' + stdouttext)
+try:
+	stats = json.loads(stdouttext[start:end+1])
+except ValueError as e:
+	failquit('Invalid cache statistics: ' + str(e) + '\n' + stdouttext)
+print('Cache statistics:', json.dumps(stats), file=sys.stderr)
+
+fields = ['entries', 'size', 'maxsize', 'hits', 'misses', 'insertions', 'evictions', 'rejections']
+for cache in ['function', 'geometry', 'cgal']:
+	if cache not in stats:
+		failquit('Missing statistics of the ' + cache + ' cache')
+	for field in fields:
+		if not isinstance(stats[cache].get(field), numbers.Integral) or stats[cache][field] < 0:
+			failquit('Missing or invalid ' + cache + ' cache field ' + field)
+for cache, mb in budgets.items():
+	if stats[cache]['maxsize'] != mb * 1024 * 1024:
+		failquit('The ' + cache + ' cache budget was truncated to ' + str(stats[cache]['maxsize']))
+if stats['geometry']['insertions'] + stats['cgal']['insertions'] == 0:
+	failquit('No geometry was inserted into the caches')
+
+tmpdir = tempfile.mkdtemp(prefix='openscad-cachestatstest-')
+try:
+	stdouttext, errtext = run_openscad(['--cache-stats'], os.path.join(tmpdir, os.path.basename(outputfile)))
+	for line in ['Function cache hits:', 'Geometry cache hits:', 'CGAL cache hits:']:
+		if line not in stdouttext + errtext:
+			failquit('Missing "' + line + '" in human readable statistics:\n' + stdouttext + errtext)
+finally:
+	shutil.rmtree(tmpdir, ignore_errors=True)
@@ -0,0 +1,104 @@
+#!/usr/bin/env python
+
+# Disk cache test
+#
+#
+# Usage: <script> <inputfile> --openscad=<executable-path> [<openscad args>] <outputfile>
+#
+#
+# step 1. Render the input file with --cache-dir pointing to an empty private temporary directory
+# step 2. Render it again with --cache-stats=json and check that the geometry was
+#         served from the disk cache, i.e. there were disk hits and no insertions
+# step 3. Corrupt the cache files and render again, writing the given output file.
+#         One file gets a huge vertex count, the others are truncated. Corrupt files
+#         must be reported as misses and replaced, not abort the render
+# step 4. Render once more and check that the replaced files are served from the disk cache
+# step 5. (done in CTest) - compare the output file to the expected output
+#         of a direct OpenSCAD run on the input file. they should be the same!
+#
+# The openscad args (e.g. --render) are passed on to all runs.
+#
+# This script should return 0 on success, not-0 on error.
+#
+
+from __future__ import print_function
+
+import sys, os, shutil, tempfile, subprocess, argparse, json
+
+def failquit(*args):
+	if len(args)!=0: print(*args)
+	print('diskcachetest args:',str(sys.argv))
+	print('exiting diskcachetest.py with failure')
+	sys.exit(1)
+
+def run_openscad(extra_args, outputfile):
+	cmd = [args.openscad, '--cache-dir=' + cachedir, '--cache-stats=json', '-o', outputfile] + remaining_args + extra_args + [inputfile]
+	print('Running OpenSCAD:', ' '.join(cmd), file=sys.stderr)
+	proc = subprocess.Popen(cmd, stdout=subprocess.PIPE)
+	stdouttext = proc.communicate()[0].decode('utf-8', 'replace')
+	if proc.returncode != 0:
+		failquit('OpenSCAD failed with return code ' + str(proc.returncode))
+	start = stdouttext.find('{')
+	end = stdouttext.rfind('}')
+	if start < 0 or end < start:
+		failquit('No cache statistics in output: ' + stdouttext)
+	try:
+		stats = json.loads(stdouttext[start:end+1])
+	except ValueError as e:
+		failquit('Invalid cache statistics: ' + str(e) + '\n' + stdouttext)
+	if 'disk' not in stats:
+		failquit('Disk cache not enabled: ' + stdouttext)
+	print('Disk cache statistics:', json.dumps(stats['disk']), file=sys.stderr)
+	return stats['disk']
+
+def cache_files():
+	return [os.path.join(cachedir, f) for f in os.listdir(cachedir) if f.endswith('.geom')]
+
+#
+# Parse arguments
+#
+parser = argparse.ArgumentParser()
+parser.add_argument('--openscad', required=True, help='Specify OpenSCAD executable')
+args,remaining_args = parser.parse_known_args()
+
+inputfile = remaining_args[0]
+outputfile = remaining_args[-1]
+remaining_args = remaining_args[1:-1] # Passed on to OpenSCAD
+
+if not os.path.exists(inputfile):
+	failquit('cant find input file named: ' + inputfile)
+if not os.path.exists(args.openscad):
+	failquit('cant find openscad executable named: ' + args.openscad)
+
+tmpdir = tempfile.mkdtemp(prefix='openscad-diskcachetest-')
+cachedir = os.path.join(tmpdir, 'cache')
+firstoutput = os.path.join(tmpdir, 'first' + os.path.splitext(outputfile)[1])
+try:
+	stats = run_openscad([], firstoutput)
+	if stats['insertions'] == 0 or len(cache_files()) == 0:
+		failquit('First run did not write any cache files')
+
+	stats = run_openscad([], firstoutput)
+	if stats['hits'] == 0:
+		failquit('Second run was not served from the disk cache')
+	if stats['insertions'] != 0:
+		failquit('Second run evaluated geometry which should have been cached on disk')
+
+	files = cache_files()
+	with open(files[0], 'rb') as fp:
+		header = fp.readline()
+	with open(files[0], 'wb') as fp:
+		fp.write(header + b'polyset 1 100000000000000 1\n')
+	for f in files[1:]:
+		size = os.path.getsize(f)
+		with open(f, 'r+b') as fp:
+			fp.truncate(size // 2)
+	stats = run_openscad([], outputfile)
+	if stats['misses'] == 0:
+		failquit('Corrupt cache files were not reported as misses')
+
+	stats = run_openscad([], firstoutput)
+	if stats['hits'] == 0 or stats['insertions'] != 0:
+		failquit('Corrupt cache files were not replaced')
+finally:
+	shutil.rmtree(tmpdir, ignore_errors=True)
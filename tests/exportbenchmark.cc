@@ -0,0 +1,113 @@
+/*
+	Benchmark for the STL exporters.
+
+	Exports a generated torus through the previous stringstream based ASCII
+	STL writer, the buffered ASCII writer and the binary writer, and prints
+	the time and output size of each.
+
+	Usage: exportbenchmark [ <segments> [ <repetitions> ] ]
+*/
+
+#include "polyset.h"
+#include "polyset-utils.h"
+#include "export.h"
+#include "printutils.h"
+
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <clocale>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+std::string commandline_commands;
+std::string currentdir;
+
+static PolySet *createTorus(int segments)
+{
+	PolySet *ps = new PolySet(3);
+	const double r1 = 10, r2 = 3;
+	for (int i = 0; i < segments; i++) {
+		for (int j = 0; j < segments; j++) {
+			Vector3d p[4];
+			for (int k = 0; k < 4; k++) {
+				double a = 2 * M_PI * ((i + (k == 1 || k == 2)) % segments) / segments;
+				double b = 2 * M_PI * ((j + (k >= 2)) % segments) / segments;
+				p[k] = Vector3d((r1 + r2 * cos(b)) * cos(a), (r1 + r2 * cos(b)) * sin(a), r2 * sin(b));
+			}
+			ps->append_poly();
+			for (int k = 0; k < 4; k++) ps->append_vertex(p[k]);
+		}
+	}
+	return ps;
+}
+
+// The ASCII STL writer as it was before exporting through BufferedWriter
+static void export_stl_legacy(const PolySet &ps, std::ostream &output)
+{
+	PolySet triangulated(3);
+	PolysetUtils::tessellate_faces(ps, triangulated);
+
+	setlocale(LC_NUMERIC, "C");
+	output << "solid OpenSCAD_Model\n";
+	for (size_t i = 0; i < triangulated.numPolygons(); i++) {
+		const PolySet::Face p = triangulated.getFace(i);
+		std::stringstream stream;
+		stream << p[0][0] << " " << p[0][1] << " " << p[0][2];
+		std::string vs1 = stream.str();
+		stream.str("");
+		stream << p[1][0] << " " << p[1][1] << " " << p[1][2];
+		std::string vs2 = stream.str();
+		stream.str("");
+		stream << p[2][0] << " " << p[2][1] << " " << p[2][2];
+		std::string vs3 = stream.str();
+		if (vs1 != vs2 && vs1 != vs3 && vs2 != vs3) {
+			Vector3d normal = (p[1] - p[0]).cross(p[2] - p[0]);
+			normal.normalize();
+			output << "  facet normal " << normal[0] << " " << normal[1] << " " << normal[2] << "\n";
+			output << "    outer loop\n";
+			for (size_t j = 0; j < 3; j++) {
+				output << "      vertex " << p[j][0] << " " << p[j][1] << " " << p[j][2] << "\n";
+			}
+			output << "    endloop\n";
+			output << "  endfacet\n";
+		}
+	}
+	output << "endsolid OpenSCAD_Model\n";
+	setlocale(LC_NUMERIC, "");
+}
+
+typedef void (*export_function)(const PolySet &ps, std::ostream &output);
+
+static void benchmark(const char *name, export_function fn, const PolySet &ps, int repetitions)
+{
+	size_t size = 0;
+	boost::posix_time::ptime start = boost::posix_time::microsec_clock::local_time();
+	for (int i = 0; i < repetitions; i++) {
+		std::ostringstream output;
+		fn(ps, output);
+		size = output.str().size();
+	}
+	boost::posix_time::time_duration elapsed = boost::posix_time::microsec_clock::local_time() - start;
+	double ms = double(elapsed.total_microseconds()) / 1000 / repetitions;
+	std::cout << name << ": " << ms << " ms, " << size << " bytes\n";
+}
+
+int main(int argc, char **argv)
+{
+	int segments = argc > 1 ? atoi(argv[1]) : 300;
+	int repetitions = argc > 2 ? atoi(argv[2]) : 3;
+	if (segments < 3 || repetitions < 1) {
+		std::cerr << "Usage: " << argv[0] << " [ <segments> [ <repetitions> ] ]\n";
+		return 1;
+	}
+
+	PolySet *ps = createTorus(segments);
+	std::cout << "Torus with " << ps->numPolygons() << " quads\n";
+
+	benchmark("legacy ascii stl", export_stl_legacy, *ps, repetitions);
+	benchmark("ascii stl", export_stl, *ps, repetitions);
+	benchmark("binary stl", export_stl_binary, *ps, repetitions);
+
+	delete ps;
+	return 0;
+}
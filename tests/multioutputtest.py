@@ -0,0 +1,88 @@
+#!/usr/bin/env python
+
+# Multiple output test
+#
+#
+# Usage: <script> <inputfile> --openscad=<executable-path> [<openscad args>] <outputfile>
+#
+#
+# step 1. Run OpenSCAD once, writing an STL file, an echo file and the given output file,
+#         usually a PNG image. Since a geometry output is requested, the image is rendered
+#         from the evaluated geometry like with --render, not previewed with OpenCSG
+# step 2. Compare the echo file to the expected output of echotest, ignoring the
+#         statistics printed by the geometry evaluation, which echotest doesn't do
+# step 3. Compare the STL file to the output of a separate STL export of the input file
+# step 4. (done in CTest) - compare the output file to the expected output
+#         of a direct OpenSCAD run on the input file. they should be the same!
+#
+# The openscad args are passed on to all runs.
+#
+# This script should return 0 on success, not-0 on error.
+#
+
+from __future__ import print_function
+
+import sys, os, shutil, tempfile, subprocess, argparse, difflib
+
+def failquit(*args):
+	if len(args)!=0: print(*args)
+	print('multioutputtest args:',str(sys.argv))
+	print('exiting multioutputtest.py with failure')
+	sys.exit(1)
+
+def run_openscad(outputs):
+	cmd = [args.openscad]
+	for output in outputs: cmd += ['-o', output]
+	cmd += remaining_args + [inputfile]
+	print('Running OpenSCAD:', ' '.join(cmd), file=sys.stderr)
+	result = subprocess.call(cmd)
+	if result != 0:
+		failquit('OpenSCAD failed with return code ' + str(result))
+
+def read_lines(filename):
+	with open(filename) as fp:
+		return fp.read().splitlines()
+
+def compare(actual, expected, name):
+	if actual != expected:
+		failquit(name + ' differs from the expected output:\n' +
+						 '\n'.join(difflib.unified_diff(expected, actual, 'expected', 'actual', lineterm='')))
+
+# Printed by GeometryEvaluator::printStatistics()
+statistics = ('Mesh backend:', 'Union fast path:', 'Deferred transforms:')
+
+#
+# Parse arguments
+#
+parser = argparse.ArgumentParser()
+parser.add_argument('--openscad', required=True, help='Specify OpenSCAD executable')
+args,remaining_args = parser.parse_known_args()
+
+inputfile = remaining_args[0]
+outputfile = remaining_args[-1]
+remaining_args = remaining_args[1:-1] # Passed on to OpenSCAD
+
+basename = os.path.splitext(os.path.basename(inputfile))[0]
+expectedecho = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'regression', 'echotest', basename + '-expected.echo')
+
+if not os.path.exists(inputfile):
+	failquit('cant find input file named: ' + inputfile)
+if not os.path.exists(expectedecho):
+	failquit('cant find expected echo output named: ' + expectedecho)
+if not os.path.exists(args.openscad):
+	failquit('cant find openscad executable named: ' + args.openscad)
+
+tmpdir = tempfile.mkdtemp(prefix='openscad-multioutputtest-')
+try:
+	stlfile = os.path.join(tmpdir, basename + '.stl')
+	echofile = os.path.join(tmpdir, basename + '.echo')
+	run_openscad([stlfile, echofile, outputfile])
+
+	echo = [line for line in read_lines(echofile) if not line.startswith(statistics)]
+	compare(echo, read_lines(expectedecho), 'Echo output')
+
+	singlestlfile = os.path.join(tmpdir, basename + '-single.stl')
+	run_openscad([singlestlfile])
+	compare(read_lines(stlfile), read_lines(singlestlfile), 'STL output')
+finally:
+	shutil.rmtree(tmpdir, ignore_errors=True)
@@ -0,0 +1,102 @@
+/*
+	Benchmark for search() and lookup() on large tables.
+
+	Calls each builtin once per row of a table of growing size and prints
+	the time per call, which should stay about the same as the table
+	grows since tables are indexed on first use.
+
+	Usage: searchbenchmark [ <repetitions> ]
+*/
+
+#include "openscad.h"
+#include "parsersettings.h"
+#include "node.h"
+#include "module.h"
+#include "modcontext.h"
+#include "builtin.h"
+#include "printutils.h"
+#include "stackcheck.h"
+#include "PlatformUtils.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <boost/format.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem.hpp>
+namespace fs = boost::filesystem;
+#include "boosty.h"
+
+std::string commandline_commands;
+std::string currentdir;
+
+static const char *workloads[][2] = {
+	{ "search number", "echo(len([for (i = [0 : n - 1]) search([i], table, 1, 1)[0]]));" },
+	{ "search string", "echo(len([for (i = [0 : n - 1]) search([str(\"k\", i)], table)[0]]));" },
+	{ "lookup", "echo(len([for (i = [0 : n - 1]) lookup(i + 0.5, curve)]));" }
+};
+
+static const int sizes[] = { 100, 1000, 10000 };
+
+static std::string output;
+
+static void captureOutput(const std::string &msg, void *)
+{
+	output += msg + "\n";
+}
+
+static bool benchmark(const std::string &name, int n, const std::string &workload, int repetitions)
+{
+	std::string script = str(boost::format(
+		"n = %d;\n"
+		"table = [for (i = [0 : n - 1]) [str(\"k\", i), i]];\n"
+		"curve = [for (i = [0 : n - 1]) [i, sin(i)]];\n") % n) + workload;
+	FileModule *module = parse(script.c_str(), currentdir.c_str(), false);
+	if (!module) {
+		std::cerr << "Error: Unable to parse " << name << std::endl;
+		return false;
+	}
+
+	ModuleContext top_ctx;
+	top_ctx.registerBuiltin();
+	ModuleInstantiation root_inst("group");
+
+	boost::posix_time::ptime start = boost::posix_time::microsec_clock::local_time();
+	for (int i = 0; i < repetitions; i++) {
+		output.clear();
+		AbstractNode::resetIndexCounter();
+		delete module->instantiate(&top_ctx, &root_inst);
+	}
+	boost::posix_time::time_duration elapsed = boost::posix_time::microsec_clock::local_time() - start;
+	delete module;
+
+	double ms = elapsed.total_microseconds() / 1000.0 / repetitions;
+	std::cout << name << ", " << n << " rows: " << ms << " ms, "
+						<< ms * 1000 / n << " us per call" << std::endl;
+	if (output != str(boost::format("ECHO: %d\n") % n)) {
+		std::cout << "  Unexpected output:\n" << output;
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	int repetitions = argc > 1 ? atoi(argv[1]) : 3;
+
+	StackCheck::inst()->init();
+	Builtins::instance()->initialize();
+	currentdir = boosty::stringy(fs::current_path());
+	PlatformUtils::registerApplicationPath(boosty::stringy(fs::path(argv[0]).branch_path()));
+	parser_init();
+	set_output_handler(&captureOutput, NULL);
+
+	bool ok = true;
+	for (size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++) {
+		for (size_t j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++) {
+			ok &= benchmark(workloads[i][0], sizes[j], workloads[i][1], repetitions);
+		}
+	}
+
+	Builtins::instance(true);
+	return ok ? 0 : 1;
+}
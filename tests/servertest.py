@@ -0,0 +1,85 @@
+#!/usr/bin/env python
+
+# Server test
+#
+#
+# Usage: <script> <inputfile> --openscad=<executable-path> --client=<client-script> [<client args>] <outputfile>
+#
+#
+# step 1. Start OpenSCAD with --server on a socket in a private temporary directory
+# step 2. Submit the input file with scripts/openscad-client.py, writing the given output file
+# step 3. Shut the server down through the client and wait for it to exit
+# step 4. (done in CTest) - compare the output file to the expected output
+#         of a direct OpenSCAD run on the input file. they should be the same!
+#
+# The client args (-D, --render, --preview) are passed on to the client.
+#
+# This script should return 0 on success, not-0 on error.
+#
+
+from __future__ import print_function
+
+import sys, os, time, shutil, tempfile, subprocess, argparse
+
+def failquit(*args):
+	if len(args)!=0: print(*args)
+	print('servertest args:',str(sys.argv))
+	print('exiting servertest.py with failure')
+	sys.exit(1)
+
+#
+# Parse arguments
+#
+parser = argparse.ArgumentParser()
+parser.add_argument('--openscad', required=True, help='Specify OpenSCAD executable')
+parser.add_argument('--client', required=True, help='Specify openscad-client.py script')
+args,remaining_args = parser.parse_known_args()
+
+inputfile = remaining_args[0]
+outputfile = remaining_args[-1]
+remaining_args = remaining_args[1:-1] # Passed on to the client
+
+if not os.path.exists(inputfile):
+	failquit('cant find input file named: ' + inputfile)
+if not os.path.exists(args.openscad):
+	failquit('cant find openscad executable named: ' + args.openscad)
+if not os.path.exists(args.client):
+	failquit('cant find client script named: ' + args.client)
+
+socketdir = tempfile.mkdtemp(prefix='openscad-servertest-')
+socketpath = os.path.join(socketdir, 'server.sock')
+client_cmd = [sys.executable, args.client, '--socket=' + socketpath]
+
+#
+# Start the server and wait until it listens
+#
+server_cmd = [args.openscad, '--server=' + socketpath]
+print('Running OpenSCAD server:', ' '.join(server_cmd), file=sys.stderr)
+server = subprocess.Popen(server_cmd)
+try:
+	deadline = time.time() + 60
+	while not os.path.exists(socketpath):
+		if server.poll() is not None:
+			failquit('OpenSCAD server exited with return code ' + str(server.returncode))
+		if time.time() > deadline:
+			failquit('OpenSCAD server did not create ' + socketpath)
+		time.sleep(0.1)
+
+	render_cmd = client_cmd + ['-o', outputfile] + remaining_args + [inputfile]
+	print('Running client:', ' '.join(render_cmd), file=sys.stderr)
+	result = subprocess.call(render_cmd)
+	if result != 0:
+		failquit('Client failed with return code ' + str(result))
+
+	shutdown_cmd = client_cmd + ['--shutdown']
+	print('Running client:', ' '.join(shutdown_cmd), file=sys.stderr)
+	result = subprocess.call(shutdown_cmd)
+	if result != 0:
+		failquit('Client shutdown failed with return code ' + str(result))
+	if server.wait() != 0:
+		failquit('OpenSCAD server exited with return code ' + str(server.returncode))
+finally:
+	if server.poll() is None:
+		server.kill()
+		server.wait()
+	shutil.rmtree(socketdir, ignore_errors=True)